@@ -6,6 +6,7 @@
 #include "app_util_platform.h"
 #include "sdk_common.h"
 #include "ecs_defs.h"
+#include "debug_config.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -97,6 +98,23 @@ typedef union
     uint8_t w_remain_connectable_boolean;
 } ble_ecs_remain_conntbl_t;
 
+#ifdef ADV_TIMING_DEBUG
+/**@brief Struct for the ADV Timing characteristic (vendor specific, not part of the eddystone spec)
+ * @details Timing statistics of the active slot since the advertising schedule was last (re)built,
+ *          all values are little endian, see @ref eddystone_adv_timing_stats_get
+ */
+typedef PACKED(struct)
+{
+    uint32_t    num_of_samples;
+    int32_t     lateness_min_us;        /**< how late the slot went on air compared to its deadline, negative if early */
+    int32_t     lateness_max_us;
+    int32_t     lateness_mean_us;
+    uint32_t    interval_min_us;        /**< time between two consecutive advertisements of the slot */
+    uint32_t    interval_max_us;
+    uint32_t    interval_mean_us;
+} ble_ecs_adv_timing_t;
+#endif
+
 /**@brief eddystone configuration service event types (corresponds to each char.) */
 typedef enum
 {
@@ -113,7 +131,10 @@ typedef enum
     BLE_ECS_EVT_RW_ADV_SLOT_PREP, /*used for longs writes*/
     BLE_ECS_EVT_RW_ADV_SLOT_EXEC, /*used for longs writes*/
     BLE_ECS_EVT_FACTORY_RESET,
-    BLE_ECS_EVT_REMAIN_CNNTBL
+    BLE_ECS_EVT_REMAIN_CNNTBL,
+#ifdef ADV_TIMING_DEBUG
+    BLE_ECS_EVT_ADV_TIMING
+#endif
 } ble_ecs_evt_type_t;
 
 /**@brief eddystone configuration service init params (corresponds to required char.) */
@@ -173,6 +194,9 @@ struct ble_ecs_s
     ble_gatts_char_handles_t        rw_adv_slot_handles;          //...
     ble_gatts_char_handles_t        factory_reset_handles;        //...
     ble_gatts_char_handles_t        remain_cnntbl_handles;        //...
+#ifdef ADV_TIMING_DEBUG
+    ble_gatts_char_handles_t        adv_timing_handles;           //...
+#endif
     uint16_t                        conn_handle;                  /**< Handle of the current connection (as provided by the S132 SoftDevice). BLE_CONN_HANDLE_INVALID if not in a connection. */
     ble_ecs_write_evt_handler_t     write_evt_handler;            /**< Event handler to be called for handling write attempts. */
     ble_ecs_read_evt_handler_t      read_evt_handler;             /**< Event handler to be called for handling read attempts. */
@@ -2,6 +2,7 @@
 #define EDDYSTONE_ADV_SLOT_H
 
 #include <stdint.h>
+#include "ble_gap.h"
 #include "ble_ecs.h"
 #include "eddystone.h"
 
@@ -26,16 +27,29 @@ typedef union
     eddystone_etlm_frame_t  etlm;
 } eddystone_adv_frame_t;
 
+/**@brief Advertising payload of a slot, fully encoded and ready to be handed to the stack
+ * @details Rebuilt only when the slot's frame, TX power/ranging data, EID or TLM data changes.
+ *          A length of 0 means the slot has nothing to advertise (yet).
+ */
+typedef struct
+{
+    uint8_t                 data[BLE_GAP_ADV_MAX_SIZE];                             /** flags + complete 16-bit UUID list + service data AD structures */
+    uint8_t                 length;                                                 /** number of bytes in data that are in use */
+} eddystone_adv_slot_encoded_t;
+
 /**@brief Structure that directly interfaces with the R/W ADV slot operations*/
 typedef struct
 {
     uint8_t                 slot_no;                                                /** identifier for the slot, indexed at 0 */
     ble_ecs_adv_intrvl_t    adv_intrvl;                                             /** advertising interval in ms */
+    ble_ecs_adv_intrvl_t    achieved_adv_intrvl;                                    /** advertising interval in ms the advertising manager actually achieves, 0 if not scheduled */
     ble_ecs_radio_tx_pwr_t  radio_tx_pwr;                                           /** radio tx pwr in dB*/
     int8_t                  frame_write_buffer[ECS_ADV_SLOT_CHAR_LENGTH_MAX];       /** RW frame data for the slot that come from the Central*/
     uint16_t                frame_write_length;                                     /** Length of the frame_write_buffer that is occupied with data */
     ble_ecs_eid_id_key_t    encrypted_eid_id_key;                                   /** EID key for the slot*/
     eddystone_adv_frame_t   adv_frame;                                              /** Frame structure to be passed in for advertising data */
+    bool                    is_eid_ready;                                           /** adv_frame holds an EID of the current registration, see @ref eddystone_adv_slot_eid_ready */
+    eddystone_adv_slot_encoded_t encoded_adv_data;                                  /** adv_frame encoded as advertising data, see @ref eddystone_adv_slot_encoded_t */
 } eddystone_adv_slot_t;
 
 
@@ -47,12 +61,15 @@ typedef struct
     eddystone_frame_type_t      frame_type;
     eddystone_adv_frame_t       * p_adv_frame;
     uint8_t                     url_frame_length;     //Since the url length is variable, it must be provided as a parameter
+    eddystone_adv_slot_encoded_t const * p_encoded_adv_data; //Ready-to-send advertising data for the slot
 } eddystone_adv_slot_params_t;
 
 /**@brief Function to initialize the eddystone advertising slots with default values
  *
  * @details This function will synchronize ALL the slots with the initial values of the relevant characteristics:
- *          Advertising interval, TX power, R/W ADV Slot etc.
+ *          Advertising interval, TX power, R/W ADV Slot etc., or restore them from flash if configs are stored.
+ *          Stored configs are parsed where they are in flash, so the slots are set up when this function returns.
+ *          EID slots are restored through the security module, which has to be initialized by then.
  *
  * @param[in]   p_ble_ecs_init   Pointer to the ECS init struct
  */
@@ -78,6 +95,9 @@ void eddystone_adv_slots_init( ble_ecs_init_t * p_ble_ecs_init );
 void eddystone_adv_slot_adv_intrvl_set( uint8_t slot_no, ble_ecs_adv_intrvl_t * p_adv_intrvl, bool global);
 
 /**@brief Function for getting the advertising interval (is ms) of the slot_no'th slot
+ *
+ * @details If the advertising manager cannot meet the interval that was set, the interval it actually achieves
+ *          is returned instead, see @ref eddystone_adv_slot_adv_intrvl_achieved_set.
  *
  * @warning For compatibility with eddystone specifications, p_adv_intrvl will point to a converted 16-bit BIG ENDIAN value.
  *
@@ -87,6 +107,15 @@ void eddystone_adv_slot_adv_intrvl_set( uint8_t slot_no, ble_ecs_adv_intrvl_t *
  */
 void eddystone_adv_slot_adv_intrvl_get( uint8_t slot_no, ble_ecs_adv_intrvl_t * p_adv_intrvl );
 
+/**@brief Function for reporting the advertising interval (in ms) the advertising manager achieves for the slot_no'th slot
+ *
+ * @note Unlike @ref eddystone_adv_slot_adv_intrvl_set, adv_intrvl is a little endian value. It is not written to flash.
+ *
+ * @param[in]       slot_no         the slot index
+ * @param[in]       adv_intrvl      the achieved advertising interval, 0 if the slot is not being advertised
+ */
+void eddystone_adv_slot_adv_intrvl_achieved_set( uint8_t slot_no, ble_ecs_adv_intrvl_t adv_intrvl );
+
 /**@brief Function for setting the TX power of the slot_no'th slot
  *
  * @note if the slot_no is larger than maximum allowable value
@@ -136,7 +165,14 @@ void eddystone_adv_slot_rw_adv_data_get( uint8_t slot_no, ble_ecs_rw_adv_slot_t
 /**@brief Function for writing the slot's configuration to flash*/
 void eddystone_adv_slot_write_to_flash( uint8_t slot_no );
 
+/**@brief Function for writing the configurations that changed since they were last written to flash
+ * @details Only the slots changed through the setters are written, and the flash flags only if
+ *          which slots are configured has changed. A session that only read characteristics writes nothing.
+ */
+void eddystone_adv_slots_persist( void );
+
 /**@brief Function for setting the slot's encrypted EID Identity Key to be displayed in the EID Identity Key characteristic
+* @details A key that differs from the one the slot has marks its config to be written on disconnect.
 *
 * @param[in]       slot_no         the slot index
 * @param[in,out]   p_eid_id_key    pointer to a ble_ecs_eid_id_key_t where the key will be written from
@@ -153,6 +189,15 @@ ret_code_t eddystone_adv_slot_encrypted_eid_id_key_get( uint8_t slot_no, ble_ecs
 /**@brief Function to call when an EID has been generated so the adv frame can be populated with the EID*/
 void eddystone_adv_slot_eid_ready( uint8_t slot_no );
 
+/**@brief Function for refreshing the TLM data of a TLM slot and re-encoding its advertising data
+*
+* @param[in]       slot_no         the slot index
+* @param[in]       p_etlm          pointer to an eTLM frame to advertise, pass in NULL to fetch
+*                                  a plain TLM frame from the TLM manager instead
+* @note            Refreshes the published slot, which is what the advertising manager advertises
+*/
+void eddystone_adv_slot_tlm_refresh( uint8_t slot_no, eddystone_etlm_frame_t const * p_etlm );
+
 /**@brief Function for getting the id and total number of slots that are EIDs
 *
 * @param[out]       p_which_slots_are_eids   optional: (pass in NULL to not use this feature)
@@ -163,10 +208,14 @@ void eddystone_adv_slot_eid_ready( uint8_t slot_no );
 * @param[out]       p_etlm_required          Handy output variable to know if any eTLM is required (both TLM and EID exist)
                                              (pass in NULL to not use this feature)
 * @retval          the total number of slots that are currently configured as EIDs
+* @note            Answered from an index that is updated whenever a slot changes, no slots are scanned.
+*                  It reports the published configuration, see @ref eddystone_adv_slot_commit
 */
 uint8_t eddystone_adv_slot_num_of_current_eids(uint8_t * p_which_slots_are_eids, bool * p_etlm_required);
 
-/**@brief Similar to @ref eddystone_adv_slot_num_of_current_eids */
+/**@brief Similar to @ref eddystone_adv_slot_num_of_current_eids
+* @note Like @ref eddystone_adv_slot_num_of_current_eids, this reports the published configuration, see @ref eddystone_adv_slot_commit
+*/
 uint8_t eddystone_adv_slot_num_of_configured_slots(uint8_t * p_which_slots_are_configured);
 
 /**@brief Whether or not the slot if the slot has been configured
@@ -175,9 +224,25 @@ uint8_t eddystone_adv_slot_num_of_configured_slots(uint8_t * p_which_slots_are_c
 bool eddystone_adv_slot_is_configured (uint8_t slot_no);
 
 /**@brief Function for getting the parameters required by the advertising module to broadcast the slot
+* @note            The parameters come from the published configuration, see @ref eddystone_adv_slot_commit.
+*                  p_adv_frame and p_encoded_adv_data point into the published table and stay valid
+*                  until the next call to @ref eddystone_adv_slot_commit, they are never written from another context.
 * @param[in]       slot_no         the slot index
 * @param[in]       p_params        pointer to a eddystone_adv_slot_params_t where the data will be retrieved to
 */
 void eddystone_adv_slot_params_get( uint8_t slot_no, eddystone_adv_slot_params_t * p_params);
 
+/**@brief Function for publishing the staged slot configuration to the advertising manager
+* @details The setters of this module (ECS writes, flash restore, EID generation) only change the staged configuration.
+*          The staged configuration is copied into the back one of two published tables, which is then published by
+*          flipping a single byte, so readers never see a half-written slot and interrupts are never disabled.
+*          Must be called from main context, like all the readers of the published configuration.
+*          The advertising manager calls this at the boundaries of its schedule, and from then on
+*          @ref eddystone_adv_slot_params_get, @ref eddystone_adv_slot_num_of_configured_slots and
+*          @ref eddystone_adv_slot_num_of_current_eids return the committed configuration.
+*
+* @retval          true if the slot layout or an advertising interval changed, so the schedule must be rebuilt
+*/
+bool eddystone_adv_slot_commit(void);
+
 #endif /*EDDYSTONE_ADV_SLOT_H*/
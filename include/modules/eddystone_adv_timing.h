@@ -0,0 +1,47 @@
+#ifndef EDDYSTONE_ADV_TIMING_H
+#define EDDYSTONE_ADV_TIMING_H
+
+#include <stdint.h>
+#include "ble_ecs.h"
+#include "debug_config.h"
+
+/**@brief Advertising timing recorder
+ * @details Enabled with ADV_TIMING_DEBUG in debug_config.h. Every time a slot goes on air, the RTC counter
+ *          is compared to the deadline the advertising manager scheduled it for. Per slot, the lateness
+ *          (drift from the schedule) and the time since the slot's previous advertisement (jitter) are kept in a
+ *          ring buffer, summarized over RTT every time the ring buffer wraps, and accumulated into min/max/mean
+ *          statistics that can be read through the ADV Timing characteristic of the ECS.
+ *          Without ADV_TIMING_DEBUG, the functions compile to nothing.
+ */
+
+#define ADV_TIMING_LOG_SIZE     16      /**< Number of samples kept per slot in the ring buffer*/
+
+#ifdef ADV_TIMING_DEBUG
+
+/**@brief Function for clearing all the recorded samples and statistics
+ * @details Should be called whenever the schedule is rebuilt, since the deadlines and intervals change.
+ */
+void eddystone_adv_timing_reset(void);
+
+/**@brief Function for recording that a slot is about to go on air
+ * @note Can be called from interrupt context.
+ *
+ * @param[in] slot_no   the slot index
+ * @param[in] deadline  RTC counter value at which the slot was scheduled to go on air
+ */
+void eddystone_adv_timing_record(uint8_t slot_no, uint32_t deadline);
+
+/**@brief Function for getting the accumulated timing statistics of a slot
+ * @param[in]  slot_no  the slot index
+ * @param[out] p_stats  pointer to where the statistics will be retrieved, in microseconds and little endian
+ */
+void eddystone_adv_timing_stats_get(uint8_t slot_no, ble_ecs_adv_timing_t * p_stats);
+
+#else
+
+#define eddystone_adv_timing_reset()
+#define eddystone_adv_timing_record(...)
+
+#endif /*ADV_TIMING_DEBUG*/
+
+#endif /*EDDYSTONE_ADV_TIMING_H*/
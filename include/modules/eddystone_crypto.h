@@ -0,0 +1,402 @@
+#ifndef EDDYSTONE_CRYPTO_H
+#define EDDYSTONE_CRYPTO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "app_error.h"
+#include "nrf_soc.h"
+#include "eddystone_app_config.h"
+
+//Tiny AES
+#include "tiny-aes128-c/aes.h"
+
+//Cifra
+#include "aes.h"
+#include "modes.h"
+#include "hmac.h"
+#include "sha2.h"
+#include "curve25519.h"
+
+//RFC6234
+#include "sha.h"
+
+#include "eddystone_ecdh.h"
+
+/**@brief Crypto primitives used by the Eddystone modules
+ * @details Every primitive has one or more backends, selected at compile time with the APP_CRYPTO_*_BACKEND
+ *          defines in eddystone_app_config.h. The selected backend is called directly, there are no function pointers.
+ *          The backend specific functions stay visible, for the host tests and the host benchmark in tests/host,
+ *          which run all of them on the same inputs.
+ *
+ *          Primitive          | Backends
+ *          -------------------|-------------------------------------------------------------
+ *          AES-128 ECB enc    | SD, TINY_AES, CIFRA
+ *          AES-128 ECB dec    | BITSLICED, TINY_AES, CIFRA
+ *          AES-128 EAX enc    | CACHED, CIFRA
+ *          HMAC-SHA256        | RFC6234, CIFRA
+ *          X25519             | SLICED, CIFRA
+ */
+
+#define EDDYSTONE_CRYPTO_BACKEND_SD         1   /**< SoftDevice ECB peripheral, sd_ecb_block_encrypt*/
+#define EDDYSTONE_CRYPTO_BACKEND_TINY_AES   2   /**< tiny-AES128-C*/
+#define EDDYSTONE_CRYPTO_BACKEND_CIFRA      3   /**< cifra*/
+#define EDDYSTONE_CRYPTO_BACKEND_RFC6234    4   /**< RFC 6234 reference code*/
+#define EDDYSTONE_CRYPTO_BACKEND_CACHED     5   /**< EAX with the key schedule and key dependent values kept per key, on cifra AES*/
+#define EDDYSTONE_CRYPTO_BACKEND_SLICED     6   /**< resumable X25519 of eddystone_ecdh.h*/
+#define EDDYSTONE_CRYPTO_BACKEND_BITSLICED  7   /**< constant time AES decryption of eddystone_crypto.c*/
+
+#define EDDYSTONE_CRYPTO_AES_BLOCK_SIZE     16
+#define EDDYSTONE_CRYPTO_AES_KEY_SIZE       16
+#define EDDYSTONE_CRYPTO_AES_NUM_OF_ROUNDS  10
+#define EDDYSTONE_CRYPTO_HMAC_SHA256_SIZE   32
+#define EDDYSTONE_CRYPTO_X25519_KEY_SIZE    EDDYSTONE_ECDH_KEY_SIZE
+
+#if APP_CRYPTO_AES_ENC_BACKEND != EDDYSTONE_CRYPTO_BACKEND_SD \
+ && APP_CRYPTO_AES_ENC_BACKEND != EDDYSTONE_CRYPTO_BACKEND_TINY_AES \
+ && APP_CRYPTO_AES_ENC_BACKEND != EDDYSTONE_CRYPTO_BACKEND_CIFRA
+    #error "Unsupported APP_CRYPTO_AES_ENC_BACKEND"
+#endif
+
+#if APP_CRYPTO_AES_DEC_BACKEND != EDDYSTONE_CRYPTO_BACKEND_BITSLICED \
+ && APP_CRYPTO_AES_DEC_BACKEND != EDDYSTONE_CRYPTO_BACKEND_TINY_AES \
+ && APP_CRYPTO_AES_DEC_BACKEND != EDDYSTONE_CRYPTO_BACKEND_CIFRA
+    #error "Unsupported APP_CRYPTO_AES_DEC_BACKEND"
+#endif
+
+#if APP_CRYPTO_EAX_BACKEND != EDDYSTONE_CRYPTO_BACKEND_CACHED \
+ && APP_CRYPTO_EAX_BACKEND != EDDYSTONE_CRYPTO_BACKEND_CIFRA
+    #error "Unsupported APP_CRYPTO_EAX_BACKEND"
+#endif
+
+#if APP_CRYPTO_HMAC_BACKEND != EDDYSTONE_CRYPTO_BACKEND_RFC6234 \
+ && APP_CRYPTO_HMAC_BACKEND != EDDYSTONE_CRYPTO_BACKEND_CIFRA
+    #error "Unsupported APP_CRYPTO_HMAC_BACKEND"
+#endif
+
+#if APP_CRYPTO_X25519_BACKEND != EDDYSTONE_CRYPTO_BACKEND_SLICED \
+ && APP_CRYPTO_X25519_BACKEND != EDDYSTONE_CRYPTO_BACKEND_CIFRA
+    #error "Unsupported APP_CRYPTO_X25519_BACKEND"
+#endif
+
+/**@brief Key schedule and key dependent values of an EAX key
+ * @details With the CACHED backend and an empty header, an encryption of a nonce and a message of at most one
+ *          block each then only costs three AES blocks: the nonce OMAC, one CTR block and the ciphertext OMAC.
+ */
+typedef struct
+{
+    cf_aes_context  aes;                                            /**< expanded key schedule */
+    uint8_t         k1[EDDYSTONE_CRYPTO_AES_BLOCK_SIZE];            /**< OMAC subkey for a complete final block */
+    uint8_t         k2[EDDYSTONE_CRYPTO_AES_BLOCK_SIZE];            /**< OMAC subkey for a padded final block */
+    uint8_t         nonce_prefix[EDDYSTONE_CRYPTO_AES_BLOCK_SIZE];  /**< E(K, [0]), the first CBC-MAC block of the nonce OMAC */
+    uint8_t         cipher_prefix[EDDYSTONE_CRYPTO_AES_BLOCK_SIZE]; /**< E(K, [2]), the first CBC-MAC block of the ciphertext OMAC */
+    uint8_t         header_mac[EDDYSTONE_CRYPTO_AES_BLOCK_SIZE];    /**< OMAC of the empty header */
+    bool            is_valid;                                       /**< to be cleared by the owner whenever the key changes */
+} eddystone_crypto_eax_t;
+
+/**@brief State of an X25519 scalar multiplication that can be run in slices
+ * @details Only the SLICED backend really splits the work, the CIFRA backend does it all in the first slice.
+ */
+#if APP_CRYPTO_X25519_BACKEND == EDDYSTONE_CRYPTO_BACKEND_SLICED
+typedef eddystone_ecdh_job_t eddystone_crypto_x25519_job_t;
+#else
+typedef struct
+{
+    uint8_t scalar[EDDYSTONE_CRYPTO_X25519_KEY_SIZE];
+    uint8_t point[EDDYSTONE_CRYPTO_X25519_KEY_SIZE];
+    uint8_t result[EDDYSTONE_CRYPTO_X25519_KEY_SIZE];
+    bool    is_base_point;
+    bool    is_done;
+} eddystone_crypto_x25519_job_t;
+#endif
+
+/**@brief AES-128 decryption key, expanded once by @ref eddystone_crypto_aes_dec_key_set*/
+typedef struct
+{
+#if APP_CRYPTO_AES_DEC_BACKEND == EDDYSTONE_CRYPTO_BACKEND_BITSLICED
+    uint16_t        round_keys[EDDYSTONE_CRYPTO_AES_NUM_OF_ROUNDS + 1][8];  /**< round keys in the bitsliced layout */
+#elif APP_CRYPTO_AES_DEC_BACKEND == EDDYSTONE_CRYPTO_BACKEND_CIFRA
+    cf_aes_context  aes;
+#else
+    uint8_t         key[EDDYSTONE_CRYPTO_AES_KEY_SIZE];                     /**< tiny-AES expands the key on every call */
+#endif
+} eddystone_crypto_aes_dec_key_t;
+
+/* AES-128 ECB ---------------------------------------------------------------------------------------------------*/
+
+static __INLINE ret_code_t eddystone_crypto_sd_aes_ecb_encrypt(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out)
+{
+    nrf_ecb_hal_data_t ecb;
+    ret_code_t         err_code;
+
+    memcpy(ecb.key, p_key, EDDYSTONE_CRYPTO_AES_KEY_SIZE);
+    memcpy(ecb.cleartext, p_in, EDDYSTONE_CRYPTO_AES_BLOCK_SIZE);
+    err_code = sd_ecb_block_encrypt(&ecb);
+    memcpy(p_out, ecb.ciphertext, EDDYSTONE_CRYPTO_AES_BLOCK_SIZE);
+    memset(&ecb, 0, sizeof(ecb));
+
+    return err_code;
+}
+
+static __INLINE ret_code_t eddystone_crypto_tiny_aes_ecb_encrypt(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out)
+{
+    AES128_ECB_encrypt((uint8_t *)p_in, (uint8_t *)p_key, p_out);
+    return NRF_SUCCESS;
+}
+
+static __INLINE ret_code_t eddystone_crypto_cifra_aes_ecb_encrypt(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out)
+{
+    cf_aes_context ctx;
+
+    cf_aes_init(&ctx, p_key, EDDYSTONE_CRYPTO_AES_KEY_SIZE);
+    cf_aes_encrypt(&ctx, p_in, p_out);
+    cf_aes_finish(&ctx);
+    return NRF_SUCCESS;
+}
+
+static __INLINE ret_code_t eddystone_crypto_tiny_aes_ecb_decrypt(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out)
+{
+    AES128_ECB_decrypt((uint8_t *)p_in, (uint8_t *)p_key, p_out);
+    return NRF_SUCCESS;
+}
+
+static __INLINE ret_code_t eddystone_crypto_cifra_aes_ecb_decrypt(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out)
+{
+    cf_aes_context ctx;
+
+    cf_aes_init(&ctx, p_key, EDDYSTONE_CRYPTO_AES_KEY_SIZE);
+    cf_aes_decrypt(&ctx, p_in, p_out);
+    cf_aes_finish(&ctx);
+    return NRF_SUCCESS;
+}
+
+/**@brief Function for expanding an AES-128 key into bitsliced round keys
+ * @param[out] p_round_keys  the EDDYSTONE_CRYPTO_AES_NUM_OF_ROUNDS + 1 round keys
+ * @param[in]  p_key         16 byte key
+ */
+void eddystone_crypto_bitsliced_aes_key_expand(uint16_t p_round_keys[][8], const uint8_t * p_key);
+
+/**@brief Function for decrypting one AES-128 block in constant time
+ * @details The block is bitsliced, so that the S-box is computed with logic operations instead of table lookups.
+ *          Neither the time taken nor the memory accessed depends on the key or the data.
+ * @param[in]  p_round_keys  round keys from @ref eddystone_crypto_bitsliced_aes_key_expand
+ * @param[in]  p_in          16 byte ciphertext
+ * @param[out] p_out         16 byte plaintext, can be the same buffer as p_in
+ */
+void eddystone_crypto_bitsliced_aes_decrypt(const uint16_t p_round_keys[][8], const uint8_t * p_in, uint8_t * p_out);
+
+/**@brief Function for expanding the key and decrypting one block, see @ref eddystone_crypto_bitsliced_aes_decrypt*/
+ret_code_t eddystone_crypto_bitsliced_aes_ecb_decrypt(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out);
+
+/**@brief Function for encrypting one AES-128 block
+ * @param[in]  p_key    16 byte key
+ * @param[in]  p_in     16 byte plaintext
+ * @param[out] p_out    16 byte ciphertext, can be the same buffer as p_in
+ * @retval see @ref sd_ecb_block_encrypt for the SD backend, NRF_SUCCESS otherwise
+ */
+static __INLINE ret_code_t eddystone_crypto_aes_ecb_encrypt(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out)
+{
+#if APP_CRYPTO_AES_ENC_BACKEND == EDDYSTONE_CRYPTO_BACKEND_SD
+    return eddystone_crypto_sd_aes_ecb_encrypt(p_key, p_in, p_out);
+#elif APP_CRYPTO_AES_ENC_BACKEND == EDDYSTONE_CRYPTO_BACKEND_TINY_AES
+    return eddystone_crypto_tiny_aes_ecb_encrypt(p_key, p_in, p_out);
+#else
+    return eddystone_crypto_cifra_aes_ecb_encrypt(p_key, p_in, p_out);
+#endif
+}
+
+/**@brief Function for decrypting one AES-128 block
+ * @param[in]  p_key    16 byte key
+ * @param[in]  p_in     16 byte ciphertext
+ * @param[out] p_out    16 byte plaintext, can be the same buffer as p_in
+ * @retval NRF_SUCCESS
+ */
+static __INLINE ret_code_t eddystone_crypto_aes_ecb_decrypt(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out)
+{
+#if APP_CRYPTO_AES_DEC_BACKEND == EDDYSTONE_CRYPTO_BACKEND_BITSLICED
+    return eddystone_crypto_bitsliced_aes_ecb_decrypt(p_key, p_in, p_out);
+#elif APP_CRYPTO_AES_DEC_BACKEND == EDDYSTONE_CRYPTO_BACKEND_TINY_AES
+    return eddystone_crypto_tiny_aes_ecb_decrypt(p_key, p_in, p_out);
+#else
+    return eddystone_crypto_cifra_aes_ecb_decrypt(p_key, p_in, p_out);
+#endif
+}
+
+/**@brief Function for expanding an AES-128 decryption key, for keys that decrypt more than once
+ * @param[out] p_dec_key  the expanded key
+ * @param[in]  p_key      16 byte key
+ */
+static __INLINE void eddystone_crypto_aes_dec_key_set(eddystone_crypto_aes_dec_key_t * p_dec_key, const uint8_t * p_key)
+{
+#if APP_CRYPTO_AES_DEC_BACKEND == EDDYSTONE_CRYPTO_BACKEND_BITSLICED
+    eddystone_crypto_bitsliced_aes_key_expand(p_dec_key->round_keys, p_key);
+#elif APP_CRYPTO_AES_DEC_BACKEND == EDDYSTONE_CRYPTO_BACKEND_CIFRA
+    cf_aes_init(&p_dec_key->aes, p_key, EDDYSTONE_CRYPTO_AES_KEY_SIZE);
+#else
+    memcpy(p_dec_key->key, p_key, EDDYSTONE_CRYPTO_AES_KEY_SIZE);
+#endif
+}
+
+/**@brief Function for decrypting one AES-128 block with an expanded key
+ * @param[in]  p_dec_key  key from @ref eddystone_crypto_aes_dec_key_set
+ * @param[in]  p_in       16 byte ciphertext
+ * @param[out] p_out      16 byte plaintext, can be the same buffer as p_in
+ * @retval NRF_SUCCESS
+ */
+static __INLINE ret_code_t eddystone_crypto_aes_ecb_decrypt_with_key(const eddystone_crypto_aes_dec_key_t * p_dec_key,
+                                                                     const uint8_t * p_in, uint8_t * p_out)
+{
+#if APP_CRYPTO_AES_DEC_BACKEND == EDDYSTONE_CRYPTO_BACKEND_BITSLICED
+    eddystone_crypto_bitsliced_aes_decrypt(p_dec_key->round_keys, p_in, p_out);
+    return NRF_SUCCESS;
+#elif APP_CRYPTO_AES_DEC_BACKEND == EDDYSTONE_CRYPTO_BACKEND_CIFRA
+    cf_aes_decrypt(&p_dec_key->aes, p_in, p_out);
+    return NRF_SUCCESS;
+#else
+    return eddystone_crypto_tiny_aes_ecb_decrypt(p_dec_key->key, p_in, p_out);
+#endif
+}
+
+/* AES-128 EAX ---------------------------------------------------------------------------------------------------*/
+
+/**@brief Function for the CACHED backend of @ref eddystone_crypto_eax_init, the key dependent values included*/
+void eddystone_crypto_cached_eax_init(eddystone_crypto_eax_t * p_eax, const uint8_t * p_key);
+
+/**@brief Function for the CACHED backend of @ref eddystone_crypto_eax_encrypt, three AES blocks*/
+void eddystone_crypto_cached_eax_encrypt(const eddystone_crypto_eax_t * p_eax,
+                                         const uint8_t * p_nonce, uint8_t nonce_length,
+                                         const uint8_t * p_plain, uint8_t length,
+                                         uint8_t * p_cipher, uint8_t * p_tag, uint8_t tag_length);
+
+/**@brief Function for the CIFRA backend of @ref eddystone_crypto_eax_init, only the key schedule*/
+void eddystone_crypto_cifra_eax_init(eddystone_crypto_eax_t * p_eax, const uint8_t * p_key);
+
+/**@brief Function for the CIFRA backend of @ref eddystone_crypto_eax_encrypt, cf_eax_encrypt on the key schedule*/
+void eddystone_crypto_cifra_eax_encrypt(const eddystone_crypto_eax_t * p_eax,
+                                        const uint8_t * p_nonce, uint8_t nonce_length,
+                                        const uint8_t * p_plain, uint8_t length,
+                                        uint8_t * p_cipher, uint8_t * p_tag, uint8_t tag_length);
+
+/**@brief Function for expanding an EAX key and computing its key dependent values
+ * @param[out] p_eax    the key state, valid until the key changes
+ * @param[in]  p_key    16 byte key
+ */
+void eddystone_crypto_eax_init(eddystone_crypto_eax_t * p_eax, const uint8_t * p_key);
+
+/**@brief Function for EAX encryption with an empty header
+ * @param[in]  p_eax         key state from @ref eddystone_crypto_eax_init
+ * @param[in]  p_nonce       the nonce
+ * @param[in]  nonce_length  length of the nonce, 1 to 16 bytes
+ * @param[in]  p_plain       the message
+ * @param[in]  length        length of the message, 1 to 16 bytes
+ * @param[out] p_cipher      buffer of length bytes for the ciphertext
+ * @param[out] p_tag         buffer of tag_length bytes for the tag
+ * @param[in]  tag_length    length of the tag, at most 16 bytes
+ */
+void eddystone_crypto_eax_encrypt(const eddystone_crypto_eax_t * p_eax,
+                                  const uint8_t * p_nonce, uint8_t nonce_length,
+                                  const uint8_t * p_plain, uint8_t length,
+                                  uint8_t * p_cipher, uint8_t * p_tag, uint8_t tag_length);
+
+/* HMAC-SHA256 ---------------------------------------------------------------------------------------------------*/
+
+static __INLINE void eddystone_crypto_rfc6234_hmac_sha256(const uint8_t * p_key, uint8_t key_length,
+                                                          const uint8_t * p_msg, uint8_t msg_length, uint8_t * p_mac)
+{
+    //Only SHA256HashSize bytes of the digest are written for SHA256
+    UNUSED_VARIABLE(hmac(SHA256, p_msg, msg_length, p_key, key_length, p_mac));
+}
+
+static __INLINE void eddystone_crypto_cifra_hmac_sha256(const uint8_t * p_key, uint8_t key_length,
+                                                        const uint8_t * p_msg, uint8_t msg_length, uint8_t * p_mac)
+{
+    cf_hmac(p_key, key_length, p_msg, msg_length, p_mac, &cf_sha256);
+}
+
+/**@brief Function for computing an HMAC-SHA256
+ * @param[in]  p_key        the key
+ * @param[in]  key_length   length of the key
+ * @param[in]  p_msg        the message
+ * @param[in]  msg_length   length of the message
+ * @param[out] p_mac        buffer of EDDYSTONE_CRYPTO_HMAC_SHA256_SIZE bytes for the MAC
+ */
+static __INLINE void eddystone_crypto_hmac_sha256(const uint8_t * p_key, uint8_t key_length,
+                                                  const uint8_t * p_msg, uint8_t msg_length, uint8_t * p_mac)
+{
+#if APP_CRYPTO_HMAC_BACKEND == EDDYSTONE_CRYPTO_BACKEND_RFC6234
+    eddystone_crypto_rfc6234_hmac_sha256(p_key, key_length, p_msg, msg_length, p_mac);
+#else
+    eddystone_crypto_cifra_hmac_sha256(p_key, key_length, p_msg, msg_length, p_mac);
+#endif
+}
+
+/* X25519 --------------------------------------------------------------------------------------------------------*/
+
+/**@brief Function for starting an X25519 scalar multiplication
+ * @param[out] p_job     the job to start
+ * @param[in]  p_scalar  the 32 byte scalar (private key)
+ * @param[in]  p_point   the 32 byte u coordinate of the point (public key), or NULL for the base point
+ */
+static __INLINE void eddystone_crypto_x25519_start(eddystone_crypto_x25519_job_t * p_job, const uint8_t * p_scalar, const uint8_t * p_point)
+{
+#if APP_CRYPTO_X25519_BACKEND == EDDYSTONE_CRYPTO_BACKEND_SLICED
+    eddystone_ecdh_job_start(p_job, p_scalar, p_point);
+#else
+    memset(p_job, 0, sizeof(eddystone_crypto_x25519_job_t));
+    memcpy(p_job->scalar, p_scalar, EDDYSTONE_CRYPTO_X25519_KEY_SIZE);
+    p_job->is_base_point = (p_point == NULL);
+    if (p_point != NULL)
+    {
+        memcpy(p_job->point, p_point, EDDYSTONE_CRYPTO_X25519_KEY_SIZE);
+    }
+#endif
+}
+
+/**@brief Function for running the next steps of an X25519 scalar multiplication
+ * @param[in,out] p_job      the job
+ * @param[in]     max_steps  maximum number of steps to run, see eddystone_ecdh.h
+ * @retval true if the multiplication is done
+ */
+static __INLINE bool eddystone_crypto_x25519_run(eddystone_crypto_x25519_job_t * p_job, uint16_t max_steps)
+{
+#if APP_CRYPTO_X25519_BACKEND == EDDYSTONE_CRYPTO_BACKEND_SLICED
+    return eddystone_ecdh_job_run(p_job, max_steps);
+#else
+    if (!p_job->is_done)
+    {
+        if (p_job->is_base_point)
+        {
+            cf_curve25519_mul_base(p_job->result, p_job->scalar);
+        }
+        else
+        {
+            cf_curve25519_mul(p_job->result, p_job->scalar, p_job->point);
+        }
+        p_job->is_done = true;
+    }
+    return true;
+#endif
+}
+
+/**@brief Function for fetching the result of a finished X25519 scalar multiplication
+ * @param[in]  p_job     the job
+ * @param[out] p_result  buffer of EDDYSTONE_CRYPTO_X25519_KEY_SIZE bytes for the result
+ */
+static __INLINE void eddystone_crypto_x25519_result_get(const eddystone_crypto_x25519_job_t * p_job, uint8_t * p_result)
+{
+#if APP_CRYPTO_X25519_BACKEND == EDDYSTONE_CRYPTO_BACKEND_SLICED
+    eddystone_ecdh_job_result_get(p_job, p_result);
+#else
+    memcpy(p_result, p_job->result, EDDYSTONE_CRYPTO_X25519_KEY_SIZE);
+#endif
+}
+
+/**@brief Function for clearing the secret state of an X25519 job
+ * @param[in] p_job  the job
+ */
+static __INLINE void eddystone_crypto_x25519_clear(eddystone_crypto_x25519_job_t * p_job)
+{
+    memset(p_job, 0, sizeof(eddystone_crypto_x25519_job_t));
+}
+
+#endif /*EDDYSTONE_CRYPTO_H*/
@@ -0,0 +1,57 @@
+#ifndef EDDYSTONE_ECDH_H
+#define EDDYSTONE_ECDH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**@brief Resumable X25519 (RFC 7748) scalar multiplication
+ * @details The Montgomery ladder and the final field inversion are split into steps, so that a key agreement
+ *          can be run a few steps at a time from the scheduler instead of blocking it for the whole multiplication.
+ *          A step is one bit of the ladder or one squaring of the inversion. The arithmetic is constant time.
+ */
+
+#define EDDYSTONE_ECDH_KEY_SIZE     32      /**< Size of scalars and points in bytes*/
+#define EDDYSTONE_ECDH_NUM_OF_STEPS (255 + 254 + 1) /**< Ladder bits, inversion squarings and the final encoding*/
+
+typedef int64_t eddystone_ecdh_gf_t[16];    /**< Field element in radix 2^16*/
+
+/**@brief State of a scalar multiplication, to be kept between the steps*/
+typedef struct
+{
+    uint8_t             scalar[EDDYSTONE_ECDH_KEY_SIZE];    /**< clamped scalar*/
+    eddystone_ecdh_gf_t x1;                                 /**< u coordinate of the input point*/
+    eddystone_ecdh_gf_t x2;
+    eddystone_ecdh_gf_t z2;
+    eddystone_ecdh_gf_t x3;
+    eddystone_ecdh_gf_t z3;
+    eddystone_ecdh_gf_t inv;                                /**< z2 raised to the power of the steps done so far*/
+    uint8_t             result[EDDYSTONE_ECDH_KEY_SIZE];
+    uint16_t            step;                               /**< next step, EDDYSTONE_ECDH_NUM_OF_STEPS when done*/
+} eddystone_ecdh_job_t;
+
+/**@brief Function for starting a scalar multiplication
+ * @param[out] p_job     the job to start
+ * @param[in]  p_scalar  the 32 byte scalar (private key), clamped as per RFC 7748
+ * @param[in]  p_point   the 32 byte u coordinate of the point (public key), or NULL for the base point
+ */
+void eddystone_ecdh_job_start(eddystone_ecdh_job_t * p_job, const uint8_t * p_scalar, const uint8_t * p_point);
+
+/**@brief Function for running the next steps of a scalar multiplication
+ * @param[in,out] p_job      the job
+ * @param[in]     max_steps  maximum number of steps to run
+ * @retval true if the multiplication is done and the result can be fetched
+ */
+bool eddystone_ecdh_job_run(eddystone_ecdh_job_t * p_job, uint16_t max_steps);
+
+/**@brief Function for fetching the result of a finished scalar multiplication
+ * @param[in]  p_job     the job
+ * @param[out] p_result  buffer of EDDYSTONE_ECDH_KEY_SIZE bytes for the u coordinate of the result
+ */
+void eddystone_ecdh_job_result_get(const eddystone_ecdh_job_t * p_job, uint8_t * p_result);
+
+/**@brief Function for clearing the secret state of a job
+ * @param[in] p_job  the job
+ */
+void eddystone_ecdh_job_clear(eddystone_ecdh_job_t * p_job);
+
+#endif /*EDDYSTONE_ECDH_H*/
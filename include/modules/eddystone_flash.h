@@ -10,12 +10,6 @@
 #define FLASH_BLOCK_SIZE    32  //Minimum size 32, for ECDH key storage
 #define WORD_SIZE           4
 
-#define FLASH_OP_WAIT()       uint32_t pending_ops = eddystone_flash_num_pending_ops(); \
-                              while (pending_ops != 0)                                  \
-                              {                                                         \
-                                  pending_ops = eddystone_flash_num_pending_ops();      \
-                              }                                                         \
-
 /**@brief struct for writing and reading persistent slot config to/from flash
  * @note size is word aligned and also matches flash block size of 32 bytes
  * @details Data inside frame_data corresponds exactly to how the user would write to a slot's
@@ -48,55 +42,188 @@ typedef enum
     EDDYSTONE_FLASH_ACCESS_CLEAR
 } eddystone_flash_access_t;
 
+/**@brief Flash access requests
+ * @details Every access is queued and the queue runs one flash operation at a time. Writes and clears append a record
+ *          to a log spread over APP_FLASH_LOG_NUM_OF_PAGES pages, the latest record of a block is what a read returns,
+ *          and a cleared block reads as all 0xFF. Nothing waits for flash: a read buffer has to stay valid
+ *          until the done callback, write data is copied into a static buffer when the request is queued.
+ *          Without a done callback an error of the operation is handled by APP_ERROR_CHECK.
+ */
+
+/**@brief Callback for when a flash access is complete
+ * @details Called from the scheduler, in the order the accesses were requested except that a read may complete
+ *          ahead of queued writes to other blocks.
+ * @param[in] result     NRF_SUCCESS, or the error of the pstorage operation
+ * @param[in] p_context  the context given with the request
+ */
+typedef void (*eddystone_flash_done_cb_t)(ret_code_t result, void * p_context);
+
 /**@brief Function for accessing ECDH keys to/from flash
  *
  * @param[out,in]   p_priv_key     pointer to the private key r/w buffer
  * @param[out,in]   p_pub_key      pointer to the public key r/w buffer
  * @param[in]       access_type    see @eddystone_flash_access_t
- * @retval          see @ref pstorage_update, @ref pstorage_load, @ref pstorage_clear,
+ * @param[in]       done_cb        called once both keys are accessed, or NULL. A write or clear is a transaction
+ * @param[in]       p_context      passed to done_cb
+ * @retval          NRF_SUCCESS if the request is queued
+ * @retval          NRF_ERROR_NO_MEM if the request queue is full
+ */
+ret_code_t eddystone_flash_access_ecdh_key_pair(uint8_t * p_priv_key,
+                                                uint8_t * p_pub_key,
+                                                eddystone_flash_access_t access_type,
+                                                eddystone_flash_done_cb_t done_cb,
+                                                void * p_context);
+
+/**@brief Function for accessing slot cnfigurations to/from flash
+ *
+ * @param[in]       slot_no        Slot index
+ * @param[out,in]   p_config       pointer to the slot config r/w buffer
+ * @param[in]       access_type    see @eddystone_flash_access_t
+ * @param[in]       done_cb        called once the config is accessed, or NULL
+ * @param[in]       p_context      passed to done_cb
+ * @retval          NRF_SUCCESS if the request is queued
+ * @retval          NRF_ERROR_NO_MEM if the request queue is full
  */
- ret_code_t eddystone_flash_access_ecdh_key_pair(uint8_t * p_priv_key,
-                                                 uint8_t * p_pub_key,
-                                                 eddystone_flash_access_t access_type);
-
- /**@brief Function for accessing slot cnfigurations to/from flash
-  *
-  * @param[in]       slot_no        Slot index
-  * @param[out,in]   p_config       pointer to the slot config r/w buffer
-  * @param[in]       access_type    see @eddystone_flash_access_t
-  * @retval          see @ref pstorage_update, @ref pstorage_load, @ref pstorage_clear,
-  */
 ret_code_t eddystone_flash_access_slot_configs(uint8_t slot_no,
                                                eddystone_flash_slot_config_t * p_config,
-                                               eddystone_flash_access_t access_type);
+                                               eddystone_flash_access_t access_type,
+                                               eddystone_flash_done_cb_t done_cb,
+                                               void * p_context);
 /**@brief Function for accessing beacon lock key to/from flash
 *
 * @param[out,in]   p_lock_key     pointer to the lock key r/w buffer
 * @param[in]       access_type    see @eddystone_flash_access_t
-* @retval          see @ref pstorage_update, @ref pstorage_load, @ref pstorage_clear,
+* @param[in]       done_cb        called once the lock key is accessed, or NULL
+* @param[in]       p_context      passed to done_cb
+* @retval          NRF_SUCCESS if the request is queued
+* @retval          NRF_ERROR_NO_MEM if the request queue is full
 */
-ret_code_t eddystone_flash_access_lock_key(uint8_t * p_lock_key, eddystone_flash_access_t access_type);
+ret_code_t eddystone_flash_access_lock_key(uint8_t * p_lock_key,
+                                           eddystone_flash_access_t access_type,
+                                           eddystone_flash_done_cb_t done_cb,
+                                           void * p_context);
 /**@brief Function for accessing flash config flag from flash
 *
-* @param[out,in]   p_flags         pointer to the flag r/w buffer
+* @param[out,in]   p_flags        pointer to the flag r/w buffer
 * @param[in]       access_type    see @eddystone_flash_access_t
-* @retval          see @ref pstorage_update, @ref pstorage_load, @ref pstorage_clear,
+* @param[in]       done_cb        called once the flags are accessed, or NULL
+* @param[in]       p_context      passed to done_cb
+* @retval          NRF_SUCCESS if the request is queued
+* @retval          NRF_ERROR_NO_MEM if the request queue is full
+*/
+ret_code_t eddystone_flash_access_flags(eddystone_flash_flags_t * p_flags,
+                                        eddystone_flash_access_t access_type,
+                                        eddystone_flash_done_cb_t done_cb,
+                                        void * p_context);
+/**@brief Reads in place
+ * @details Flash is memory-mapped, so a block can be read where its latest record is stored instead of through the
+ *          queue. The record is checked and a pointer to its data is returned at once. The data may be moved by the
+ *          next flash operation, so the pointer is only valid until the scheduler runs again.
+ */
+
+/**@brief Function for reading a slot config in place
+* @param[in]       slot_no        Slot index
+* @param[out]      pp_config      pointer to the config in flash, NULL if none is stored or it is cleared
+* @retval          NRF_SUCCESS
+* @retval          NRF_ERROR_BUSY if a write or clear of the slot is queued, it can be read through the queue
+* @retval          NRF_ERROR_INVALID_DATA if the stored record is corrupt
+*/
+ret_code_t eddystone_flash_slot_config_get(uint8_t slot_no, eddystone_flash_slot_config_t const ** pp_config);
+
+/**@brief Function for reading the flash config flag in place
+* @param[out]      pp_flags       pointer to the flags in flash, NULL if none are stored
+* @retval          see @ref eddystone_flash_slot_config_get
+*/
+ret_code_t eddystone_flash_flags_get(eddystone_flash_flags_t const ** pp_flags);
+
+/**@brief Flash transactions
+ * @details The writes and clears of a transaction are committed to flash with one commit marker after them. Until the
+ *          marker is stored none of them is read back, and a reset before that leaves all the blocks as they were.
+ *          The data is copied when the transaction is committed.
+ */
+#define EDDYSTONE_FLASH_TRANSACTION_MAX_RECORDS    (APP_MAX_ADV_SLOTS + 4)    /**< every block once */
+
+typedef struct
+{
+    uint8_t                     block_index;
+    eddystone_flash_access_t    access_type;
+    uint16_t                    size;
+    uint8_t const *             p_data;
+} eddystone_flash_transaction_record_t;
+
+typedef struct
+{
+    uint8_t                                 num_of_records;
+    eddystone_flash_transaction_record_t    records[EDDYSTONE_FLASH_TRANSACTION_MAX_RECORDS];
+} eddystone_flash_transaction_t;
+
+/**@brief Function for starting an empty transaction
+* @param[out]  p_transaction  the transaction
+*/
+void eddystone_flash_transaction_init(eddystone_flash_transaction_t * p_transaction);
+
+/**@brief Function for adding a write or clear of a slot config to a transaction
+* @details A slot already in the transaction is replaced.
+* @param[in,out]   p_transaction  the transaction
+* @param[in]       slot_no        Slot index
+* @param[in]       p_config       pointer to the slot config, valid until the commit. NULL for a clear
+* @param[in]       access_type    EDDYSTONE_FLASH_ACCESS_WRITE or EDDYSTONE_FLASH_ACCESS_CLEAR
+* @retval          NRF_ERROR_INVALID_PARAM for a read
+*/
+ret_code_t eddystone_flash_transaction_slot_config_add(eddystone_flash_transaction_t * p_transaction,
+                                                       uint8_t slot_no,
+                                                       eddystone_flash_slot_config_t const * p_config,
+                                                       eddystone_flash_access_t access_type);
+
+/**@brief Function for adding a write of the flash config flag to a transaction
+* @param[in,out]   p_transaction  the transaction
+* @param[in]       p_flags        pointer to the flags, valid until the commit
+*/
+ret_code_t eddystone_flash_transaction_flags_add(eddystone_flash_transaction_t * p_transaction,
+                                                 eddystone_flash_flags_t const * p_flags);
+
+/**@brief Function for committing a transaction
+* @param[in]       p_transaction  the transaction
+* @param[in]       done_cb        called once the commit marker is stored, or NULL
+* @param[in]       p_context      passed to done_cb
+* @retval          NRF_SUCCESS if the transaction is queued
+* @retval          NRF_ERROR_NO_MEM if the request queue has no room for all of it, nothing is queued
 */
-ret_code_t eddystone_flash_access_flags(eddystone_flash_flags_t * p_flags, eddystone_flash_access_t access_type);
+ret_code_t eddystone_flash_transaction_commit(eddystone_flash_transaction_t const * p_transaction,
+                                              eddystone_flash_done_cb_t done_cb,
+                                              void * p_context);
+
 /**@brief Helper function to check if an array read from flash contains all 0xFFs
 * @retval  true or false
 */
 bool eddystone_flash_read_is_empty(uint8_t * p_input_array, uint8_t length);
-/**@brief Function for retrieving the number of operations queued
-* @retval  the number of operations queued
+/**@brief Function for retrieving the number of requests queued or in progress
+* @retval  the number of requests not yet complete
 */
 uint32_t eddystone_flash_num_pending_ops(void);
 
+/**@brief Wear report of the record log*/
+typedef struct
+{
+    uint32_t    erase_counts[APP_FLASH_LOG_NUM_OF_PAGES];   /**< times each page has been erased */
+    uint8_t     head_page;                                  /**< page records are appended to */
+    uint16_t    free_records;                               /**< records left in the head page */
+    uint32_t    num_of_compactions;                         /**< compactions since init */
+    uint32_t    num_of_records;                             /**< records stored for requests since init, commit markers included */
+    uint32_t    num_of_copies;                              /**< records stored by compactions since init */
+} eddystone_flash_log_report_t;
+
+/**@brief Function for retrieving the wear report of the record log
+* @param[out]  p_report    the report
+*/
+void eddystone_flash_log_report_get(eddystone_flash_log_report_t * p_report);
+
 /**@brief Function for initializing the flash module
- * @param[in] ps_cb    Callback for when a pstorage operation is complete
- * @retval see @ref pstorage_register
+ * @details Scans the record log for the latest record of every block. The erases and compaction a reset
+ *          cut short are picked up from the scheduler.
+ * @retval see @ref pstorage_register and @ref pstorage_block_identifier_get
  */
-ret_code_t eddystone_flash_init(pstorage_ntf_cb_t ps_cb);
+ret_code_t eddystone_flash_init(void);
 
 
 #endif /*EDDYSTONE_FLASH_H*/
@@ -0,0 +1,60 @@
+#ifndef EDDYSTONE_HKDF_H
+#define EDDYSTONE_HKDF_H
+
+#include <stdint.h>
+#include "sha2.h"
+
+/**@brief HKDF-SHA256 (RFC 5869)
+ * @details HMAC keys are absorbed once into SHA-256 inner and outer midstates, which every HMAC under that key
+ *          then starts from. Expanding more than one block thus costs two compressions less per block, and the
+ *          output is written straight to the caller's buffer without staging the full digest chain.
+ */
+
+#define EDDYSTONE_HKDF_PRK_SIZE     CF_SHA256_HASHSZ        /**< Size of the pseudorandom key in bytes*/
+#define EDDYSTONE_HKDF_OKM_MAX_SIZE (255 * CF_SHA256_HASHSZ) /**< Largest output of the expand step in bytes*/
+
+/**@brief HMAC-SHA256 key, as the hash states after the padded key blocks*/
+typedef struct
+{
+    cf_sha256_context inner;
+    cf_sha256_context outer;
+} eddystone_hkdf_hmac_key_t;
+
+/**@brief Function for absorbing an HMAC-SHA256 key into inner and outer midstates
+ * @param[out] p_hmac_key   the midstates
+ * @param[in]  p_key        the key, hashed first if longer than a SHA-256 block
+ * @param[in]  key_length   length of the key in bytes
+ */
+void eddystone_hkdf_hmac_key_set(eddystone_hkdf_hmac_key_t * p_hmac_key, const uint8_t * p_key, uint16_t key_length);
+
+/**@brief Function for the HKDF extract step, PRK = HMAC-SHA256(salt, IKM)
+ * @param[in]  p_salt       the salt, may be NULL if salt_length is 0
+ * @param[in]  salt_length  length of the salt in bytes, 0 is the same as EDDYSTONE_HKDF_PRK_SIZE zeros
+ * @param[in]  p_ikm        the input keying material
+ * @param[in]  ikm_length   length of the input keying material in bytes
+ * @param[out] p_prk        EDDYSTONE_HKDF_PRK_SIZE bytes of pseudorandom key
+ */
+void eddystone_hkdf_extract(const uint8_t * p_salt, uint16_t salt_length,
+                            const uint8_t * p_ikm, uint16_t ikm_length,
+                            uint8_t * p_prk);
+
+/**@brief Function for the HKDF expand step, OKM = T(1) | T(2) | ... truncated to okm_length bytes
+ * @param[in]  p_prk        EDDYSTONE_HKDF_PRK_SIZE bytes of pseudorandom key
+ * @param[in]  p_info       the context information, may be NULL if info_length is 0
+ * @param[in]  info_length  length of the context information in bytes
+ * @param[out] p_okm        the output keying material
+ * @param[in]  okm_length   length of the output keying material in bytes, at most EDDYSTONE_HKDF_OKM_MAX_SIZE
+ */
+void eddystone_hkdf_expand(const uint8_t * p_prk,
+                           const uint8_t * p_info, uint16_t info_length,
+                           uint8_t * p_okm, uint16_t okm_length);
+
+/**@brief Function for deriving a key with HKDF-SHA256, the extract step followed by the expand step
+ * @details The pseudorandom key only lives on the stack and is cleared before returning.
+ */
+void eddystone_hkdf(const uint8_t * p_salt, uint16_t salt_length,
+                    const uint8_t * p_ikm, uint16_t ikm_length,
+                    const uint8_t * p_info, uint16_t info_length,
+                    uint8_t * p_okm, uint16_t okm_length);
+
+#endif /*EDDYSTONE_HKDF_H*/
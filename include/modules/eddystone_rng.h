@@ -0,0 +1,61 @@
+#ifndef EDDYSTONE_RNG_H
+#define EDDYSTONE_RNG_H
+
+#include <stdint.h>
+#include "app_error.h"
+
+/**@brief Entropy reservoir
+ * @details Keeps a reservoir of APP_RNG_RESERVOIR_SIZE random bytes, refilled from the SoftDevice RNG pool on every
+ *          SoftDevice system event and, while the reservoir is not full, from a single shot timer. Random bytes are
+ *          served from the reservoir without ever waiting for the RNG. A consumer that cannot proceed without them
+ *          can ask to be called back once enough bytes are available.
+ */
+
+/**@brief Callback for when the requested number of random bytes is available
+ * @note Called from the context the reservoir is refilled in, which can be an interrupt.
+ */
+typedef void (*eddystone_rng_ready_cb_t)(void);
+
+/**@brief Fill level statistics of the reservoir*/
+typedef struct
+{
+    uint8_t     level;              /**< number of bytes in the reservoir*/
+    uint8_t     level_min;          /**< lowest level seen after serving a request*/
+    uint32_t    num_of_requests;    /**< number of requests served*/
+    uint32_t    num_of_shortfalls;  /**< number of requests refused because the reservoir did not hold enough bytes*/
+} eddystone_rng_stats_t;
+
+/**@brief Function for initializing the reservoir
+ * @note The SoftDevice has to be enabled.
+ * @retval see @ref app_timer_create
+ */
+ret_code_t eddystone_rng_init(void);
+
+/**@brief Function for getting random bytes from the reservoir, without waiting
+ * @param[out] p_buff   buffer for the random bytes
+ * @param[in]  length   number of random bytes, at most APP_RNG_RESERVOIR_SIZE
+ * @retval NRF_SUCCESS
+ * @retval NRF_ERROR_SOC_RAND_NOT_ENOUGH_VALUES if the reservoir does not hold length bytes, nothing is copied then
+ */
+ret_code_t eddystone_rng_bytes_get(uint8_t * p_buff, uint8_t length);
+
+/**@brief Function for asking to be called back once the reservoir holds a number of bytes
+ * @details Only one consumer can wait at a time. The callback is called right away if the bytes are already there.
+ * @param[in] length    number of random bytes needed, at most APP_RNG_RESERVOIR_SIZE
+ * @param[in] ready_cb  the callback
+ * @retval NRF_SUCCESS
+ * @retval NRF_ERROR_BUSY if another consumer is waiting
+ */
+ret_code_t eddystone_rng_bytes_wait(uint8_t length, eddystone_rng_ready_cb_t ready_cb);
+
+/**@brief Function for refilling the reservoir on a SoftDevice system event
+ * @param[in] evt_id    the system event
+ */
+void eddystone_rng_on_sys_evt(uint32_t evt_id);
+
+/**@brief Function for getting the fill level statistics of the reservoir
+ * @param[out] p_stats  pointer to where the statistics will be retrieved
+ */
+void eddystone_rng_stats_get(eddystone_rng_stats_t * p_stats);
+
+#endif /*EDDYSTONE_RNG_H*/
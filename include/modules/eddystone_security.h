@@ -15,9 +15,13 @@ typedef enum
 
 typedef void (*eddystone_security_msg_cb_t)(uint8_t slot_no,
                                             eddystone_security_msg_t msg_type);
+/**@brief Callback for when the security module has restored its keys from flash*/
+typedef void (*eddystone_security_init_done_cb_t)(void);
+
 typedef struct
 {
-    eddystone_security_msg_cb_t    msg_cb;  /**< Callback function pointer used by the security module to pass out events*/
+    eddystone_security_msg_cb_t         msg_cb;         /**< Callback function pointer used by the security module to pass out events*/
+    eddystone_security_init_done_cb_t   init_done_cb;   /**< Called once the lock code and ECDH key pair are read from flash, or NULL*/
 } eddystone_security_init_t;
 
 /**@brief structure used to preserve/restore an EID slot*/
@@ -31,9 +35,21 @@ typedef PACKED(struct)
 
 typedef ble_ecs_lock_state_read_t eddystone_security_lock_state_t;
 
+/**@brief Accumulated statistics of the batched ECB service
+ * @details Throughput in blocks per ms is num_of_blocks * APP_TIMER_CLOCK_FREQ / (1000 * (APP_TIMER_PRESCALER + 1) * ticks).
+ */
+typedef struct
+{
+    uint32_t num_of_jobs;       /**< number of batches run*/
+    uint32_t num_of_blocks;     /**< number of blocks encrypted in all batches*/
+    uint32_t ticks;             /**< RTC ticks spent in all batches*/
+} eddystone_security_ecb_stats_t;
+
 /**@brief Initialize the security module
+ * @details The lock code and the ECDH key pair are read from flash without waiting, init_done_cb
+ *          is called from the scheduler once they are restored.
  * @param[in] p_cb_init       pointer to the security init struct
- * @retval see @ref app_timer_start
+ * @retval see @ref app_timer_create and @ref eddystone_flash_access_lock_key
  */
 ret_code_t eddystone_security_init (eddystone_security_init_t * p_cb_init);
 
@@ -58,7 +74,7 @@ void eddystone_security_unlock_verify( uint8_t * p_unlock_token );
 
 /**@brief Generates a random challenge for the unlock characteristic
  * param[out]   p_rand_chlg_buff    pointer to buffer where to random challenge will be copied to
- * @retval      see @ref sd_rand_application_vector_get
+ * @retval      see @ref eddystone_rng_bytes_get
  */
 ret_code_t eddystone_security_random_challenge_generate( uint8_t * p_rand_chlg_buff );
 
@@ -68,6 +84,9 @@ ret_code_t eddystone_security_random_challenge_generate( uint8_t * p_rand_chlg_b
 * @param[in] slot_no         the index of the slot whose public ECDH key will be retrieved
 * @param[in] p_pub_ecdh      pointer to the public ECDH
 * @param[in] scaler_k        K rotation scaler
+* @retval NRF_SUCCESS        the key agreement runs in the background (after the beacon key pair generation started at
+*                            init, if it is not finished yet) and is reported with EDDYSTONE_SECURITY_MSG_ECDH and EDDYSTONE_SECURITY_MSG_IK
+* @retval NRF_ERROR_BUSY     a registration of another slot is in progress, a new registration of the same slot replaces it
 */
 ret_code_t eddystone_security_client_pub_ecdh_receive( uint8_t slot_no, uint8_t * p_pub_ecdh, uint8_t scaler_k );
 /**@brief Stores the shared IK from the client in the beacon registration process.
@@ -91,6 +110,11 @@ void eddystone_security_pub_ecdh_get(uint8_t slot_no, uint8_t * p_edch_buffer );
  */
 uint32_t eddystone_security_clock_get( uint8_t slot_no );
 
+/**@brief Copies the accumulated statistics of the batched ECB service
+ * @param[out] p_stats  pointer to where the statistics will be retrieved
+ */
+void eddystone_security_ecb_stats_get( eddystone_security_ecb_stats_t * p_stats );
+
 /**@brief Returns the rotation exponent scaler value
  * @param[in] slot_no        the index of the slot
  * @retval    K rotation scaler
@@ -103,6 +127,16 @@ uint8_t eddystone_security_scaler_get( uint8_t slot_no );
 */
 void eddystone_security_eid_get( uint8_t slot_no, uint8_t * p_eid_buffer );
 
+/**@brief Computes the EID a slot advertises at any beacon time, past or future, for diagnostics
+* @details Costs two AES blocks, and does not change the state of the slot.
+* @param[in]  slot_no        the index of the slot
+* @param[in]  seconds        the beacon time in seconds, see @ref eddystone_security_clock_get
+* @param[out] p_eid_buffer   pointer to the buffer of EDDYSTONE_EID_ID_LENGTH bytes
+* @retval NRF_SUCCESS
+* @retval NRF_ERROR_INVALID_STATE if the slot is not an EID slot
+*/
+ret_code_t eddystone_security_eid_at_time_get( uint8_t slot_no, uint32_t seconds, uint8_t * p_eid_buffer );
+
 /**@brief Function to restore EID slot
 * @param[in] slot_no        the index of the slot to restore
 * @param[in] p_restore_data  pointer to the restore data structure
@@ -117,7 +151,7 @@ void eddystone_security_eid_slot_destroy( uint8_t slot_no );
 /**@brief Function for fetching the EID config */
 void eddystone_security_eid_config_get( uint8_t slot_no, eddystone_eid_config_t * p_config);
 
-/**@brief Preserve ECDH key pair by writing to flash
+/**@brief Preserve ECDH key pair by writing to flash, if it changed since it was last written
  * @retval see @ref eddystone_flash_access_ecdh_key_pair
  */
 ret_code_t eddystone_security_ecdh_pair_preserve( void );
@@ -19,6 +19,35 @@ void eddystone_tlm_manager_tlm_get(eddystone_tlm_frame_t * p_tlm_frame);
  */
 void eddystone_tlm_manager_etlm_get( uint8_t eik_pair_slot, eddystone_etlm_frame_t * p_etlm_frame);
 
+/**@brief Function for requesting an eTLM to be precomputed in the background
+ * @details The eTLM is encrypted in an app_scheduler job, outside of the advertising deadlines, into a double buffer
+ *          from which it can be taken with @ref eddystone_tlm_manager_etlm_ready_get. Any previously precomputed
+ *          eTLM for the EIK pairing is discarded, so this should also be called whenever the EIK changes.
+ *
+ * @param[in] eik_pair_slot  the slot index of the EID (containing an EIK) to which the eTLM will be paired
+ */
+void eddystone_tlm_manager_etlm_precompute( uint8_t eik_pair_slot );
+
+/**@brief Function for discarding the precomputed eTLM of an EIK pairing when its EID changes
+ * @details A new Identity Key or a new EID rotation period makes a precomputed eTLM stale. If the pairing is in use,
+ *          the eTLM is precomputed again as with @ref eddystone_tlm_manager_etlm_precompute, otherwise nothing is done.
+ *
+ * @param[in] eik_pair_slot  the slot index of the EID (containing an EIK) to which the eTLM is paired
+ */
+void eddystone_tlm_manager_etlm_invalidate( uint8_t eik_pair_slot );
+
+/**@brief Function for taking the precomputed eTLM of an EIK pairing
+ * @details The next eTLM for the pairing is precomputed right away into the other buffer,
+ *          so the returned frame stays valid until the next call for the same pairing.
+ *
+ * @param[in]  eik_pair_slot    the slot index of the EID (containing an EIK) to which the eTLM is paired
+ * @param[out] pp_etlm_frame    pointer to where a pointer to the precomputed eTLM frame will be retrieved
+ *
+ * @retval NRF_SUCCESS              if a precomputed eTLM was available
+ * @retval NRF_ERROR_INVALID_STATE  if no eTLM has been precomputed (yet), use @ref eddystone_tlm_manager_etlm_get instead
+ */
+ret_code_t eddystone_tlm_manager_etlm_ready_get( uint8_t eik_pair_slot, eddystone_etlm_frame_t const ** pp_etlm_frame );
+
 /**@brief Function for increase ADV_CNT field of the TLM frame
  * @details should be called everytime a frame is advertised
  *
@@ -9,6 +9,10 @@
 // #define SECURITY_DEBUG
 // #define TLM_DEBUG
 
+/* Uncomment to record how far advertising deviates from its schedule per slot,
+printed to SEGGER_RTT and readable from the ADV Timing characteristic (see eddystone_adv_timing.h) */
+// #define ADV_TIMING_DEBUG
+
 /* Uncomment to Erase All Flash when board is reset */
 // #define ERASE_FLASH_ON_REBOOT
 
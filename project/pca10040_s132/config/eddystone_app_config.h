@@ -8,6 +8,15 @@
 //HW CONFIGS
 #define REGISTRATION_BUTTON                             BUTTON_1                         /**< Button to push when putting the beacon in registration mode */
 #define USE_ECB_ENCRYPT_HW                              1                                /**< Configure between using the hardware peripheral or software library for ECB encyrption (decryption is always SW) */
+#define APP_RNG_RESERVOIR_SIZE                          64                               /**< Number of random bytes kept ready for the consumers, see eddystone_rng.h */
+#define APP_ECDH_STEPS_PER_SLICE                        8                                /**< Number of X25519 steps run per scheduler event during an ECDH EID registration, see eddystone_ecdh.h */
+
+//CRYPTO BACKENDS, see eddystone_crypto.h
+#define APP_CRYPTO_AES_ENC_BACKEND                      ((USE_ECB_ENCRYPT_HW) ? EDDYSTONE_CRYPTO_BACKEND_SD : EDDYSTONE_CRYPTO_BACKEND_TINY_AES)
+#define APP_CRYPTO_AES_DEC_BACKEND                      EDDYSTONE_CRYPTO_BACKEND_BITSLICED
+#define APP_CRYPTO_EAX_BACKEND                          EDDYSTONE_CRYPTO_BACKEND_CACHED
+#define APP_CRYPTO_HMAC_BACKEND                         EDDYSTONE_CRYPTO_BACKEND_RFC6234
+#define APP_CRYPTO_X25519_BACKEND                       EDDYSTONE_CRYPTO_BACKEND_SLICED
 
 //TIMER CONFIGS
 #define APP_TIMER_PRESCALER                             0                                 /**< Value of the RTC1 PRESCALER register. 4095 = 125 ms every tick */
@@ -28,6 +37,8 @@
 #define APP_CFG_NON_CONN_ADV_INTERVAL_MS                1000                            /**< The default advertising interval for non-connectable advertisement (1000 ms). This value can vary between 100 ms and 10.24 s). */
 #define APP_CFG_CONNECTABLE_ADV_TIMEOUT                 60                              /**< Time for which the device must be advertising in connectable mode (in seconds). 0 disables the time-out. */
 #define APP_CFG_CONNECTABLE_ADV_INTERVAL_MS             100                             /**< The advertising interval for connectable advertisement (1000 ms). This value can vary between 20 ms and 10.24 s). */
+#define APP_CONNECTABLE_ADV_INTERLEAVED                 0                               /**< 1: keep advertising the slots during registration, the connectable advertisement is scheduled as an extra slot.
+                                                                                             0: only the connectable advertisement is on air during registration. */
 
 #define APP_CFG_DEFAULT_RADIO_TX_POWER                  0x00                             /**< Default TX power of the radio */
 
@@ -42,11 +53,14 @@
 
 //EDDYSTONE CONFIGS
 #define APP_MAX_ADV_SLOTS                               5
+#define APP_ADV_USE_RADIO_NOTIFICATION                  0                                 /**< 1: keep one advertiser running and swap the slot data after every advertising event (radio notification),
+                                                                                             0: stop and restart advertising for every slot from a timer */
 #define APP_MAX_EID_SLOTS                               APP_MAX_ADV_SLOTS  /*MAX EID SLOT SHOULD NOT BE DIFFERENT THAN APP_MAX_ADV_SLOTS WITHOUT MODIFICATION
                                                                             to the eddystone_security module since the security slots' slot numbers map 1 to 1 to the advertising slots'*/
+#define APP_FLASH_LOG_NUM_OF_PAGES                      2                                 /**< Flash pages the configuration record log goes round, 2 up to PSTORAGE_NUM_OF_PAGES */
 
 //Broadcast Capabilities
-#define APP_IS_VARIABLE_ADV_SUPPORTED                   ECS_BRDCST_VAR_ADV_SUPPORTED_No
+#define APP_IS_VARIABLE_ADV_SUPPORTED                   ECS_BRDCST_VAR_ADV_SUPPORTED_Yes
 #define APP_IS_VARIABLE_TX_POWER_SUPPORTED              ECS_BRDCST_VAR_TX_POWER_SUPPORTED_Yes
 
 #define APP_IS_UID_SUPPORTED                            ECS_FRAME_TYPE_UID_SUPPORTED_Yes
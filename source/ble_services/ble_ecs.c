@@ -26,6 +26,7 @@
 #define BLE_UUID_ECS_RW_ADV_SLOT_CHAR           0x750A
 #define BLE_UUID_ECS_FACTORY_RESET_CHAR         0x750B
 #define BLE_UUID_ECS_REMAIN_CNNTBL_CHAR         0x750C
+#define BLE_UUID_ECS_ADV_TIMING_CHAR            0x75F0  //Vendor specific, only with ADV_TIMING_DEBUG
 
 #define ECS_BASE_UUID                       \
 {{0x95, 0xE2, 0xED, 0xEB, 0x1B, 0xA0, 0x39, 0x8A, 0xDF, 0x4B, 0xD3, 0x8E, 0x00, 0x00, 0xC8, 0xA3}}
@@ -170,6 +171,12 @@ static void on_read(ble_ecs_t * p_ecs, ble_evt_t * p_ble_evt)
     {
         p_ecs->read_evt_handler(p_ecs, BLE_ECS_EVT_RW_ADV_SLOT, p_evt_read->handle);
     }
+#ifdef ADV_TIMING_DEBUG
+    else if (p_evt_read->handle == p_ecs->adv_timing_handles.value_handle)
+    {
+        p_ecs->read_evt_handler(p_ecs, BLE_ECS_EVT_ADV_TIMING, p_evt_read->handle);
+    }
+#endif
     else
     {
         // Do Nothing. This event is not relevant for this service.
@@ -873,6 +880,60 @@ static uint32_t remain_cnntbl_char_add(ble_ecs_t * p_ecs, const ble_ecs_init_t *
                                            &p_ecs->remain_cnntbl_handles);
 }
 
+#ifdef ADV_TIMING_DEBUG
+/**@brief Function for adding the vendor specific ADV timing characteristic.
+ *
+ * @param[in] p_ecs       Eddystone Configuration Service structure.
+ * @param[in] p_ecs_init  Information needed to initialize the service.
+ *
+ * @return NRF_SUCCESS on success, otherwise an error code.
+ */
+static uint32_t adv_timing_char_add(ble_ecs_t * p_ecs, const ble_ecs_init_t * p_ecs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+
+    char_md.char_props.read          = 1;
+    char_md.p_char_user_desc         = NULL;
+    char_md.p_char_pf                = NULL;
+    char_md.p_user_desc_md           = NULL;
+    char_md.p_cccd_md                = NULL;
+    char_md.p_sccd_md                = NULL;
+
+    ble_uuid.type = p_ecs->uuid_type;
+    ble_uuid.uuid = BLE_UUID_ECS_ADV_TIMING_CHAR;
+
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+
+    attr_md.vloc    = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth = 1;
+    attr_md.wr_auth = 0;
+    attr_md.vlen    = 0;
+
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+    ble_ecs_adv_timing_t init_val;
+    memset(&init_val, 0, sizeof(init_val));
+    attr_char_value.p_uuid    = &ble_uuid;
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.init_len  = sizeof(ble_ecs_adv_timing_t);
+    attr_char_value.init_offs = 0;
+    attr_char_value.p_value   = (uint8_t *)&init_val;
+    attr_char_value.max_len   = sizeof(ble_ecs_adv_timing_t);
+
+    return sd_ble_gatts_characteristic_add(p_ecs->service_handle,
+                                           &char_md,
+                                           &attr_char_value,
+                                           &p_ecs->adv_timing_handles);
+}
+#endif
+
 uint32_t ble_ecs_init(ble_ecs_t * p_ecs, const ble_ecs_init_t * p_ecs_init)
 {
     uint32_t      err_code;
@@ -940,5 +1001,10 @@ uint32_t ble_ecs_init(ble_ecs_t * p_ecs, const ble_ecs_init_t * p_ecs_init)
     err_code = remain_cnntbl_char_add(p_ecs, p_ecs_init);
     VERIFY_SUCCESS(err_code);
 
+#ifdef ADV_TIMING_DEBUG
+    err_code = adv_timing_char_add(p_ecs, p_ecs_init);
+    VERIFY_SUCCESS(err_code);
+#endif
+
     return NRF_SUCCESS;
 }
@@ -9,6 +9,8 @@
 #include "eddystone_tlm_manager.h"
 #include "debug_config.h"
 #include "app_scheduler.h"
+#include "app_util_platform.h"
+#include "nrf.h"
 #include <stdint.h>
 #include <string.h>
 
@@ -25,175 +27,298 @@
 //Forward Declaration:
 static uint32_t eddystone_adv_slot_adv_frame_set(uint8_t slot_no);
 static void eddystone_adv_frame_set_scheduler_evt( void * p_event_data, uint16_t event_size );
-static void eddystone_adv_slot_load_from_flash( uint8_t slot_no );
+static void eddystone_adv_slot_encode( eddystone_adv_slot_t * p_slot );
+static bool eddystone_adv_slot_configured_check( eddystone_adv_slot_t const * p_slot );
+static void eddystone_adv_slot_index_update( uint8_t slot_no );
 
-static eddystone_adv_slot_t m_slots[APP_MAX_ADV_SLOTS];
+#if APP_MAX_ADV_SLOTS > 32
+    #error "The slot index bitmaps hold at most 32 slots"
+#endif
+
+/**@brief Which slots are configured, EIDs or TLMs
+ * @details Updated by @ref eddystone_adv_slot_index_update whenever a slot's frame type or configuration changes,
+ *          so the queries the advertising manager makes on every schedule (re)build do not need to scan the slots.
+ */
+typedef struct
+{
+    uint32_t    configured_bitmap;                          /**< bit n set if slot n is configured */
+    uint32_t    eid_bitmap;                                 /**< bit n set if slot n has the EID frame type */
+    uint32_t    tlm_bitmap;                                 /**< bit n set if slot n has the TLM frame type */
+    uint8_t     configured_positions[APP_MAX_ADV_SLOTS];    /**< configured slots in increasing order, 0xFF represent blanks */
+    uint8_t     eid_positions[APP_MAX_EID_SLOTS];           /**< EID slots in increasing order, 0xFF represent blanks */
+    uint8_t     num_of_configured;
+    uint8_t     num_of_eids;
+} eddystone_adv_slot_index_t;
+
+/**@brief A published copy of the slot configuration*/
+typedef struct
+{
+    eddystone_adv_slot_t        slots[APP_MAX_ADV_SLOTS];
+    eddystone_adv_slot_index_t  index;
+} eddystone_adv_slot_table_t;
+
+/**@note m_slots and m_index are the staged configuration, written (also from BLE event context) and read back
+ *       through the ECS characteristics. Every change to them increments m_staged_seq.
+ *       The advertising manager only sees the front one of the double buffered published tables, which
+ *       @ref eddystone_adv_slot_commit brings up to date at the boundaries of its schedule, so a configuration session
+ *       never interrupts advertising and the advertising path never disables interrupts.
+ */
+static eddystone_adv_slot_t         m_slots[APP_MAX_ADV_SLOTS];
+static eddystone_adv_slot_index_t   m_index;
+static volatile uint32_t            m_staged_seq = 0;               /**< incremented on every change to the staged configuration */
+static eddystone_adv_slot_table_t   m_published[2];
+static volatile uint8_t             m_published_front = 0;          /**< index of the table the advertising manager reads */
+static uint32_t                     m_published_seq = 0;            /**< m_staged_seq the front table was copied at */
+
+/**@brief The flash config flag as restored from flash, see @ref eddystone_adv_slots_init*/
+static eddystone_flash_flags_t              m_flash_flags;
+
+/**@brief Bit n set if the config of slot n has changed since it was last written to flash, see @ref eddystone_adv_slots_persist
+ * @note m_flash_flags keeps the flags as they are in flash, so they are only written again when they change.
+ */
+static uint32_t                             m_flash_dirty_bitmap;
+
+/**@brief Marks the config of a slot as changed, also from BLE event context*/
+static void eddystone_adv_slot_dirty_set( uint8_t slot_no )
+{
+    CRITICAL_REGION_ENTER();
+    m_flash_dirty_bitmap |= (1UL << slot_no);
+    CRITICAL_REGION_EXIT();
+}
+
+/**@brief Gives a slot without a stored config the default values, after slot 0 is set up*/
+static void eddystone_adv_slot_defaults_set( uint8_t slot_no )
+{
+    m_slots[slot_no].slot_no = slot_no;
+    m_slots[slot_no].adv_intrvl = m_slots[0].adv_intrvl;
+    m_slots[slot_no].radio_tx_pwr = m_slots[0].radio_tx_pwr;
+    memset((m_slots[slot_no]).frame_write_buffer, 0, 1);
+    m_slots[slot_no].frame_write_length = 0;
+    m_slots[slot_no].is_eid_ready = false;
+    memset(&(m_slots[slot_no].adv_frame), 0, sizeof(eddystone_adv_frame_t));
+    memset(&(m_slots[slot_no].encoded_adv_data), 0, sizeof(eddystone_adv_slot_encoded_t));
+}
+
+/**@brief Sets up a slot from its config, read in place from flash
+ * @param[in] p_config  the config in flash, NULL if none is stored
+ */
+static void eddystone_adv_slot_restore( uint8_t slot_no, eddystone_flash_slot_config_t const * p_config )
+{
+    if (p_config == NULL)
+    {
+        m_slots[slot_no].frame_write_length = 0;
+        //eddystone_adv_slot_is_configured() will treat a frame_write_length of 0 as not configured
+    }
+    else
+    {
+        m_slots[slot_no].adv_intrvl = p_config->adv_int;
+        m_slots[slot_no].radio_tx_pwr = p_config->radio_tx_pwr;
+        ble_ecs_rw_adv_slot_t slot_input;
+        slot_input.frame_type = (eddystone_frame_type_t)p_config->frame_data[0];
+        slot_input.p_data = (int8_t*)(&p_config->frame_data[1]);
+        slot_input.char_length = p_config->data_length;
+
+        if (slot_input.frame_type != EDDYSTONE_FRAME_TYPE_EID)
+        {
+            eddystone_adv_slot_rw_adv_data_set(slot_no, &slot_input);
+        }
+        else if (slot_input.frame_type == EDDYSTONE_FRAME_TYPE_EID)
+        {
+            m_slots[slot_no].is_eid_ready = false;
+            eddystone_security_eid_slots_restore(slot_no, (eddystone_eid_config_t*)p_config->frame_data);
+            //Since restoring an EID slot does not go through the @ref eddystone_adv_slot_rw_adv_data_set() interface"
+            //The frame_write_length must be set to > 1 so that @ref eddystone_adv_slot_is_configured() will treat it
+            //As a configured slot
+            m_slots[slot_no].frame_write_length = 2;
+            eddystone_adv_slot_index_update(slot_no);
+        }
+    }
+}
 
 void eddystone_adv_slots_init( ble_ecs_init_t * p_ble_ecs_init )
 {
-    ret_code_t err_code;
-    eddystone_flash_flags_t flash_flags;
-    memset(&flash_flags, 0, sizeof(eddystone_flash_flags_t));
+    eddystone_flash_flags_t const * p_flash_flags;
 
     //Read the flash flags to see if there are any previously stored slot configs
-    err_code = eddystone_flash_access_flags(&flash_flags, EDDYSTONE_FLASH_ACCESS_READ);
-    APP_ERROR_CHECK(err_code);
-
-    uint32_t pending_ops = eddystone_flash_num_pending_ops();
-    while (pending_ops != 0)
+    APP_ERROR_CHECK(eddystone_flash_flags_get(&p_flash_flags));
+    if (p_flash_flags == NULL)
+    {
+        memset(&m_flash_flags, 0xFF, sizeof(eddystone_flash_flags_t));
+    }
+    else
     {
-        pending_ops = eddystone_flash_num_pending_ops();
+        memcpy(&m_flash_flags, p_flash_flags, sizeof(eddystone_flash_flags_t));
     }
+
     DEBUG_PRINTF(0, "Flash Flags: \r\n",0);
-    PRINT_ARRAY((uint8_t *)&flash_flags, sizeof(eddystone_flash_flags_t));
+    PRINT_ARRAY((uint8_t *)&m_flash_flags, sizeof(eddystone_flash_flags_t));
     //No previous configs, set default configs
-    if (flash_flags.factory_state)
+    if (m_flash_flags.factory_state)
     {
-        if(flash_flags.factory_state != 1 && flash_flags.factory_state != 0xFF)
+        if(m_flash_flags.factory_state != 1 && m_flash_flags.factory_state != 0xFF)
         {
             APP_ERROR_CHECK(NRF_ERROR_INVALID_PARAM);
             //sanity check
         }
-        for (uint8_t i = 0; i < APP_MAX_ADV_SLOTS; i++)
+        m_slots[0].slot_no = 0;
+        m_slots[0].adv_intrvl = p_ble_ecs_init->p_init_vals->adv_intrvl;
+        m_slots[0].radio_tx_pwr = p_ble_ecs_init->p_init_vals->radio_tx_pwr;
+        m_slots[0].frame_write_buffer[0] = p_ble_ecs_init->p_init_vals->rw_adv_slot.frame_type;
+
+        //Copy length corresponds to the length of JUST the data in the frame, excluding frame type
+        uint16_t copy_length = p_ble_ecs_init->p_init_vals->rw_adv_slot.char_length - 1;
+        //If not a TLM frame
+        if (copy_length > 0) //copy_length would be 0 for a TLM frame
         {
-            if (i == 0)
-            {
-                m_slots[i].slot_no = i;
-                m_slots[i].adv_intrvl = p_ble_ecs_init->p_init_vals->adv_intrvl;
-                m_slots[i].radio_tx_pwr = p_ble_ecs_init->p_init_vals->radio_tx_pwr;
-                m_slots[i].frame_write_buffer[0] = p_ble_ecs_init->p_init_vals->rw_adv_slot.frame_type;
+            memcpy((m_slots[0]).frame_write_buffer + 1, p_ble_ecs_init->p_init_vals->rw_adv_slot.p_data, copy_length);
+        }
 
-                //Copy length corresponds to the length of JUST the data in the frame, excluding frame type
-                uint16_t copy_length = p_ble_ecs_init->p_init_vals->rw_adv_slot.char_length - 1;
-                ret_code_t err_code;
-                //If not a TLM frame
-                if (copy_length > 0) //copy_length would be 0 for a TLM frame
-                {
-                    memcpy((m_slots[i]).frame_write_buffer + 1, p_ble_ecs_init->p_init_vals->rw_adv_slot.p_data, copy_length);
-                }
+        m_slots[0].frame_write_length = p_ble_ecs_init->p_init_vals->rw_adv_slot.char_length;
+        if (eddystone_adv_slot_is_configured(0))
+        {
+            APP_ERROR_CHECK(eddystone_adv_slot_adv_frame_set(0));
+        }
 
-                m_slots[i].frame_write_length = p_ble_ecs_init->p_init_vals->rw_adv_slot.char_length;
-                if (eddystone_adv_slot_is_configured(i))
-                {
-                    err_code = eddystone_adv_slot_adv_frame_set(i);
-                    APP_ERROR_CHECK(err_code);
-                }
-            }
-            else
-            {
-                m_slots[i].slot_no = i;
-                m_slots[i].adv_intrvl = m_slots[0].adv_intrvl;
-                m_slots[i].radio_tx_pwr = m_slots[0].radio_tx_pwr;
-                memset((m_slots[i]).frame_write_buffer, 0, 1);
-                m_slots[i].frame_write_length = 0;
-                memset(&(m_slots[i].adv_frame), 0, sizeof(eddystone_adv_frame_t));
-            }
+        for (uint8_t i = 1; i < APP_MAX_ADV_SLOTS; i++)
+        {
+            eddystone_adv_slot_defaults_set(i);
         }
     }
-    //Stored configs are available, use these instead
+    //Stored configs are available, parse them where they are in flash
     else
     {
         for (uint8_t i = 0; i < APP_MAX_ADV_SLOTS; i++)
         {
-            if (!flash_flags.slot_is_empty[i])
+            if (!m_flash_flags.slot_is_empty[i])
             {
-                eddystone_adv_slot_load_from_flash(i);
+                eddystone_flash_slot_config_t const * p_config;
+
+                APP_ERROR_CHECK(eddystone_flash_slot_config_get(i, &p_config));
+                eddystone_adv_slot_restore(i, p_config);
             }
             else
             {
-                if(flash_flags.slot_is_empty[i] != 1 && flash_flags.slot_is_empty[i] != 0xFF)
+                if(m_flash_flags.slot_is_empty[i] != 1 && m_flash_flags.slot_is_empty[i] != 0xFF)
                 {
                     APP_ERROR_CHECK(NRF_ERROR_INVALID_PARAM);
                     //sanity check
                 }
-                m_slots[i].slot_no = i;
-                m_slots[i].adv_intrvl = m_slots[0].adv_intrvl;
-                m_slots[i].radio_tx_pwr = m_slots[0].radio_tx_pwr;
-                memset((m_slots[i]).frame_write_buffer, 0, 1);
-                m_slots[i].frame_write_length = 0;
-                memset(&(m_slots[i].adv_frame), 0, sizeof(eddystone_adv_frame_t));
+                eddystone_adv_slot_defaults_set(i);
             }
         }
     }
+
+    //What is set up now is what flash holds, restoring the slots does not make them dirty
+    m_flash_dirty_bitmap = 0;
+
+    for (uint8_t i = 0; i < APP_MAX_ADV_SLOTS; i++)
+    {
+        eddystone_adv_slot_index_update(i);
+    }
 }
 
-static void eddystone_adv_slot_load_from_flash( uint8_t slot_no )
+/**@brief Fills in the config of a slot the way it is stored in flash, the slot is no longer dirty after
+ * @retval true if the slot is configured, false if its stored config is to be cleared
+ */
+static bool eddystone_adv_slot_flash_config_get( uint8_t slot_no, eddystone_flash_slot_config_t * p_config )
 {
-    eddystone_flash_slot_config_t config;
-    memset(&config, 0, sizeof(config));
-    ret_code_t err_code;
+    memset(p_config, 0, sizeof(eddystone_flash_slot_config_t));
 
-    err_code = eddystone_flash_access_slot_configs( slot_no,
-                                                    &config,
-                                                    EDDYSTONE_FLASH_ACCESS_READ);
-    APP_ERROR_CHECK(err_code);
-    FLASH_OP_WAIT();
+    CRITICAL_REGION_ENTER();
+    m_flash_dirty_bitmap &= ~(1UL << slot_no);
+    CRITICAL_REGION_EXIT();
 
-    if (eddystone_flash_read_is_empty((uint8_t*)(&config), FLASH_BLOCK_SIZE))
+    if (!eddystone_adv_slot_is_configured(slot_no))
     {
-        m_slots[slot_no].frame_write_length = 0;
-        //eddystone_adv_slot_is_configured() will treat a frame_write_length of 0 as not configured
+        return false;
+    }
+
+    p_config->adv_int = m_slots[slot_no].adv_intrvl;
+    p_config->radio_tx_pwr = m_slots[slot_no].radio_tx_pwr;
+    if (m_slots[slot_no].frame_write_buffer[0] != EDDYSTONE_FRAME_TYPE_EID)
+    {
+        memcpy(p_config->frame_data, m_slots[slot_no].frame_write_buffer, m_slots[slot_no].frame_write_length);
+        p_config->data_length = m_slots[slot_no].frame_write_length;
     }
     else
     {
-        m_slots[slot_no].adv_intrvl = config.adv_int;
-        m_slots[slot_no].radio_tx_pwr = config.radio_tx_pwr;
-        ble_ecs_rw_adv_slot_t slot_input;
-        slot_input.frame_type = (eddystone_frame_type_t)config.frame_data[0];
-        slot_input.p_data = (int8_t*)(&config.frame_data[1]);
-        slot_input.char_length = config.data_length;
-
-        if (slot_input.frame_type != EDDYSTONE_FRAME_TYPE_EID)
-        {
-            eddystone_adv_slot_rw_adv_data_set(slot_no, &slot_input);
-        }
-        else if (slot_input.frame_type == EDDYSTONE_FRAME_TYPE_EID)
-        {
-            eddystone_security_eid_slots_restore(slot_no, (eddystone_eid_config_t*)config.frame_data);
-            //Since restoring an EID slot does not go through the @ref eddystone_adv_slot_rw_adv_data_set() interface"
-            //The frame_write_length must be set to > 1 so that @ref eddystone_adv_slot_is_configured() will treat it
-            //As a configured slot
-            m_slots[slot_no].frame_write_length = 2;
-        }
+        eddystone_eid_config_t eid_config;
+        eddystone_security_eid_config_get(slot_no, &eid_config);
+        memcpy(p_config->frame_data, &eid_config, sizeof(eddystone_eid_config_t));
+        p_config->data_length = sizeof(eddystone_eid_config_t);
     }
+
+    return true;
 }
 
 void eddystone_adv_slot_write_to_flash( uint8_t slot_no )
 {
     ret_code_t err_code;
     eddystone_flash_slot_config_t config;
-    memset(&config, 0, sizeof(config));
 
-    if (eddystone_adv_slot_is_configured(slot_no))
+    if (eddystone_adv_slot_flash_config_get(slot_no, &config))
     {
-        config.adv_int = m_slots[slot_no].adv_intrvl;
-        config.radio_tx_pwr = m_slots[slot_no].radio_tx_pwr;
-        if (m_slots[slot_no].frame_write_buffer[0] != EDDYSTONE_FRAME_TYPE_EID)
-        {
-            memcpy(config.frame_data, m_slots[slot_no].frame_write_buffer, m_slots[slot_no].frame_write_length);
-            config.data_length = m_slots[slot_no].frame_write_length;
-        }
-        else
-        {
-            eddystone_eid_config_t eid_config;
-            eddystone_security_eid_config_get(slot_no, &eid_config);
-            memcpy(config.frame_data, &eid_config, sizeof(eddystone_eid_config_t));
-            config.data_length = sizeof(eddystone_eid_config_t);
-        }
-
         err_code = eddystone_flash_access_slot_configs( slot_no,
                                                         &config,
-                                                        EDDYSTONE_FLASH_ACCESS_WRITE);
+                                                        EDDYSTONE_FLASH_ACCESS_WRITE,
+                                                        NULL,
+                                                        NULL);
     }
     else
     {
         err_code = eddystone_flash_access_slot_configs( slot_no,
                                                         NULL,
-                                                        EDDYSTONE_FLASH_ACCESS_CLEAR);
+                                                        EDDYSTONE_FLASH_ACCESS_CLEAR,
+                                                        NULL,
+                                                        NULL);
     }
     APP_ERROR_CHECK(err_code);
 }
 
+void eddystone_adv_slots_persist( void )
+{
+    eddystone_flash_transaction_t transaction;
+    eddystone_flash_slot_config_t configs[APP_MAX_ADV_SLOTS];
+    eddystone_flash_flags_t       flags;
+    memset(&flags, 0, sizeof(flags));
+
+    //The slot configs and the flags are committed together, so the flags never claim a config that is not there
+    eddystone_flash_transaction_init(&transaction);
+
+    for (uint8_t i = 0; i < APP_MAX_ADV_SLOTS; i++)
+    {
+        flags.slot_is_empty[i] = !eddystone_adv_slot_is_configured(i);
+
+        //A configured slot the flags in flash mark as empty has no stored config yet, e.g. the factory default slot
+        if ((m_flash_dirty_bitmap & (1UL << i)) || (!flags.slot_is_empty[i] && m_flash_flags.slot_is_empty[i]))
+        {
+            DEBUG_PRINTF(0,"Slot [%d] changed, writing to flash \r\n", i);
+            if (eddystone_adv_slot_flash_config_get(i, &configs[i]))
+            {
+                APP_ERROR_CHECK(eddystone_flash_transaction_slot_config_add(&transaction, i, &configs[i],
+                                                                            EDDYSTONE_FLASH_ACCESS_WRITE));
+            }
+            else
+            {
+                APP_ERROR_CHECK(eddystone_flash_transaction_slot_config_add(&transaction, i, NULL,
+                                                                            EDDYSTONE_FLASH_ACCESS_CLEAR));
+            }
+        }
+    }
+    flags.factory_state = false;
+
+    if (memcmp(&flags, &m_flash_flags, sizeof(flags)) != 0)
+    {
+        APP_ERROR_CHECK(eddystone_flash_transaction_flags_add(&transaction, &flags));
+        memcpy(&m_flash_flags, &flags, sizeof(flags));
+    }
+
+    if (transaction.num_of_records > 0)
+    {
+        APP_ERROR_CHECK(eddystone_flash_transaction_commit(&transaction, NULL, NULL));
+    }
+}
+
 void eddystone_adv_slot_adv_intrvl_set( uint8_t slot_no, ble_ecs_adv_intrvl_t * p_adv_intrvl, bool global )
 {
     //Boundary check: if out of bounds, set input value to boundary value
@@ -215,17 +340,20 @@ void eddystone_adv_slot_adv_intrvl_set( uint8_t slot_no, ble_ecs_adv_intrvl_t *
         *p_adv_intrvl = BYTES_SWAP_16BIT(*p_adv_intrvl); //make big endian
     }
 
-    if (!global)
-    {
-        m_slots[slot_no].adv_intrvl = BYTES_SWAP_16BIT(*p_adv_intrvl); //convert dereferenced value back to small endian
-    }
-    else
+    temp_var = BYTES_SWAP_16BIT(*p_adv_intrvl); //convert dereferenced value back to small endian
+    for (uint8_t i = 0; i < APP_MAX_ADV_SLOTS; i++)
     {
-        for (uint8_t i = 0; i < APP_MAX_ADV_SLOTS; i++)
+        if (global || i == slot_no)
         {
-            m_slots[i].adv_intrvl = BYTES_SWAP_16BIT(*p_adv_intrvl); //convert dereferenced value back to small endian
+            if (m_slots[i].adv_intrvl != temp_var)
+            {
+                eddystone_adv_slot_dirty_set(i);
+            }
+            m_slots[i].adv_intrvl = temp_var;
+            m_slots[i].achieved_adv_intrvl = 0; //until the advertising manager reschedules the slot
         }
     }
+    m_staged_seq++;
 }
 
 void eddystone_adv_slot_adv_intrvl_get( uint8_t slot_no, ble_ecs_adv_intrvl_t * p_adv_intrvl )
@@ -233,11 +361,24 @@ void eddystone_adv_slot_adv_intrvl_get( uint8_t slot_no, ble_ecs_adv_intrvl_t *
     SLOT_BOUNDARY_CHECK(slot_no);
     if (p_adv_intrvl != NULL)
     {
-        memcpy(p_adv_intrvl, &(m_slots[slot_no].adv_intrvl), sizeof(ble_ecs_adv_intrvl_t));
+        if (m_slots[slot_no].achieved_adv_intrvl != 0)
+        {
+            memcpy(p_adv_intrvl, &(m_slots[slot_no].achieved_adv_intrvl), sizeof(ble_ecs_adv_intrvl_t));
+        }
+        else
+        {
+            memcpy(p_adv_intrvl, &(m_slots[slot_no].adv_intrvl), sizeof(ble_ecs_adv_intrvl_t));
+        }
         *p_adv_intrvl = BYTES_SWAP_16BIT(*p_adv_intrvl); //convert dereferenced value to big endian
     }
 }
 
+void eddystone_adv_slot_adv_intrvl_achieved_set( uint8_t slot_no, ble_ecs_adv_intrvl_t adv_intrvl )
+{
+    SLOT_BOUNDARY_CHECK(slot_no);
+    m_slots[slot_no].achieved_adv_intrvl = adv_intrvl;
+}
+
 /**@brief Function for setting the ranging data field to be broadcast in the frame
 * @param[in]       slot_no         the slot index
 * @param[in]       tx_power        the radio tx power to be calibrated to ranging data
@@ -294,15 +435,26 @@ void eddystone_adv_slot_radio_tx_pwr_set( uint8_t slot_no, ble_ecs_radio_tx_pwr_
         {
             for (uint8_t i = 0; i < APP_MAX_ADV_SLOTS; i++)
             {
+                if (m_slots[i].radio_tx_pwr != *p_radio_tx_pwr)
+                {
+                    eddystone_adv_slot_dirty_set(i);
+                }
                 m_slots[i].radio_tx_pwr = *p_radio_tx_pwr;
                 eddystone_set_ranging_data(i, m_slots[i].radio_tx_pwr);
+                eddystone_adv_slot_encode(&m_slots[i]);
             }
         }
         else if (!global)
         {
+            if (m_slots[slot_no].radio_tx_pwr != *p_radio_tx_pwr)
+            {
+                eddystone_adv_slot_dirty_set(slot_no);
+            }
             m_slots[slot_no].radio_tx_pwr = *p_radio_tx_pwr;
             eddystone_set_ranging_data(slot_no, m_slots[slot_no].radio_tx_pwr);
+            eddystone_adv_slot_encode(&m_slots[slot_no]);
         }
+        m_staged_seq++;
     }
 
     else
@@ -328,6 +480,17 @@ void eddystone_adv_slot_rw_adv_data_set( uint8_t slot_no, ble_ecs_rw_adv_slot_t
     if (p_frame_data != NULL)
     {
         uint8_t copy_offset = 1;
+
+        //Writing the same frame again changes nothing in flash, except for an EID where it starts a new registration
+        if (p_frame_data->frame_type == EDDYSTONE_FRAME_TYPE_EID
+            || m_slots[slot_no].frame_write_buffer[0] != p_frame_data->frame_type
+            || m_slots[slot_no].frame_write_length != p_frame_data->char_length
+            || (p_frame_data->char_length > 1
+                && memcmp(m_slots[slot_no].frame_write_buffer + copy_offset, p_frame_data->p_data, (p_frame_data->char_length) - copy_offset) != 0))
+        {
+            eddystone_adv_slot_dirty_set(slot_no);
+        }
+
         m_slots[slot_no].frame_write_buffer[0] = p_frame_data->frame_type;
 
         //length > 1 means the client is NOT trying to clear a slot, or not setting an TLM
@@ -337,6 +500,8 @@ void eddystone_adv_slot_rw_adv_data_set( uint8_t slot_no, ble_ecs_rw_adv_slot_t
         }
 
         m_slots[slot_no].frame_write_length = p_frame_data->char_length;
+        m_slots[slot_no].is_eid_ready = false;
+        eddystone_adv_slot_index_update(slot_no);
 
         if (m_slots[slot_no].frame_write_buffer[0] != EDDYSTONE_FRAME_TYPE_EID)
         {
@@ -348,6 +513,10 @@ void eddystone_adv_slot_rw_adv_data_set( uint8_t slot_no, ble_ecs_rw_adv_slot_t
             err_code = app_sched_event_put(&slot_no, sizeof(slot_no), eddystone_adv_frame_set_scheduler_evt);
             APP_ERROR_CHECK(err_code);
         }
+        else
+        {
+            m_slots[slot_no].encoded_adv_data.length = 0;
+        }
     }
 }
 
@@ -386,7 +555,7 @@ void eddystone_adv_slot_rw_adv_data_get( uint8_t slot_no, ble_ecs_rw_adv_slot_t
                     //The data in adv_frame.tlm is set via a pointer memcpy everytime the advertising_manager
                     //advertises a TLM/eTLM so that upon a read of the slot the user will receive the last
                     //advertised packet, as required by the eddystone spec.
-                    if (eddystone_adv_slot_num_of_current_eids(NULL, NULL) == 0)
+                    if (m_index.num_of_eids == 0)
                     {
                         p_frame_data->p_data = (int8_t*)&(m_slots[slot_no].adv_frame.tlm.version);
                         p_frame_data->char_length = EDDYSTONE_TLM_LENGTH;
@@ -437,6 +606,12 @@ void eddystone_adv_slot_encrypted_eid_id_key_set( uint8_t slot_no, ble_ecs_eid_i
     SLOT_BOUNDARY_CHECK(slot_no);
     if (p_eid_id_key != NULL)
     {
+        //A new Identity Key, from a registration or a shared key. An EID rotation leaves the stored config as it is,
+        //the EID clock is stored every 24 hours on its own
+        if (memcmp(&(m_slots[slot_no].encrypted_eid_id_key), p_eid_id_key, sizeof(ble_ecs_eid_id_key_t)) != 0)
+        {
+            eddystone_adv_slot_dirty_set(slot_no);
+        }
         memcpy(&(m_slots[slot_no].encrypted_eid_id_key),p_eid_id_key, sizeof(ble_ecs_eid_id_key_t));
     }
 }
@@ -444,62 +619,162 @@ void eddystone_adv_slot_encrypted_eid_id_key_set( uint8_t slot_no, ble_ecs_eid_i
 void eddystone_adv_slot_eid_ready( uint8_t slot_no )
 {
     m_slots[slot_no].frame_write_buffer[0] = EDDYSTONE_FRAME_TYPE_EID;
+    eddystone_adv_slot_index_update(slot_no);
     m_slots[slot_no].adv_frame.eid.frame_type = EDDYSTONE_FRAME_TYPE_EID;
     m_slots[slot_no].frame_write_length = ECS_EID_WRITE_ECDH_LENGTH;
     eddystone_set_ranging_data(slot_no, m_slots[slot_no].radio_tx_pwr);
     eddystone_security_eid_get(slot_no, (uint8_t*)m_slots[slot_no].adv_frame.eid.eid);
+    m_slots[slot_no].is_eid_ready = true;
+    eddystone_adv_slot_encode(&m_slots[slot_no]);
+    //A new Identity Key or rotation period leaves the schedule as it is, but not the eTLMs paired with the slot
+    eddystone_tlm_manager_etlm_invalidate(slot_no);
+    m_staged_seq++;
 }
 
-uint8_t eddystone_adv_slot_num_of_configured_slots(uint8_t * p_which_slots_are_configured)
+void eddystone_adv_slot_tlm_refresh( uint8_t slot_no, eddystone_etlm_frame_t const * p_etlm )
+{
+    SLOT_BOUNDARY_CHECK(slot_no);
+    eddystone_adv_slot_t * p_slot = &m_published[m_published_front].slots[slot_no];
+
+    if (p_slot->frame_write_buffer[0] != EDDYSTONE_FRAME_TYPE_TLM)
+    {
+        return;
+    }
+
+    if (p_etlm == NULL)
+    {
+        eddystone_tlm_manager_tlm_get(&p_slot->adv_frame.tlm);
+    }
+    else
+    {
+        memcpy(&p_slot->adv_frame.etlm, p_etlm, sizeof(eddystone_etlm_frame_t));
+    }
+    eddystone_adv_slot_encode(p_slot);
+
+    //A read of the slot returns the last advertised TLM, as required by the eddystone spec.
+    //Not a configuration change, so m_staged_seq is left alone
+    if (m_slots[slot_no].frame_write_buffer[0] == EDDYSTONE_FRAME_TYPE_TLM)
+    {
+        memcpy(&m_slots[slot_no].adv_frame, &p_slot->adv_frame, sizeof(eddystone_adv_frame_t));
+    }
+}
+
+/**@brief Function for updating the slot index after the frame type or configuration of a slot has changed
+* @param[in]       slot_no         the slot index
+*/
+static void eddystone_adv_slot_index_update( uint8_t slot_no )
 {
-    uint8_t slots_count = 0;
-    memset(p_which_slots_are_configured, 0xFF, APP_MAX_ADV_SLOTS);
+    uint32_t slot_mask = (1UL << slot_no);
+
+    m_index.configured_bitmap &= ~slot_mask;
+    m_index.eid_bitmap        &= ~slot_mask;
+    m_index.tlm_bitmap        &= ~slot_mask;
+
+    if (eddystone_adv_slot_is_configured(slot_no))
+    {
+        m_index.configured_bitmap |= slot_mask;
+    }
+    //Like the frame type itself, these are kept regardless of the slot being configured
+    if (m_slots[slot_no].frame_write_buffer[0] == EDDYSTONE_FRAME_TYPE_EID && slot_no < APP_MAX_EID_SLOTS)
+    {
+        m_index.eid_bitmap |= slot_mask;
+    }
+    else if (m_slots[slot_no].frame_write_buffer[0] == EDDYSTONE_FRAME_TYPE_TLM)
+    {
+        m_index.tlm_bitmap |= slot_mask;
+    }
+
+    m_staged_seq++;
+
+    //Rebuild the position arrays, this only happens when a slot changes
+    memset(m_index.configured_positions, 0xFF, APP_MAX_ADV_SLOTS);
+    memset(m_index.eid_positions, 0xFF, APP_MAX_EID_SLOTS);
+    m_index.num_of_configured = 0;
+    m_index.num_of_eids       = 0;
     for (uint8_t i = 0; i < APP_MAX_ADV_SLOTS; i++)
     {
-        if (eddystone_adv_slot_is_configured(i))
+        if (m_index.configured_bitmap & (1UL << i))
+        {
+            m_index.configured_positions[m_index.num_of_configured++] = i;
+        }
+        if (m_index.eid_bitmap & (1UL << i))
         {
-            *(p_which_slots_are_configured+slots_count) = i;
-            slots_count++;
+            m_index.eid_positions[m_index.num_of_eids++] = i;
         }
     }
-    return slots_count;
 }
+
+uint8_t eddystone_adv_slot_num_of_configured_slots(uint8_t * p_which_slots_are_configured)
+{
+    eddystone_adv_slot_index_t const * p_index = &m_published[m_published_front].index;
+
+    if (p_which_slots_are_configured != NULL)
+    {
+        memcpy(p_which_slots_are_configured, p_index->configured_positions, APP_MAX_ADV_SLOTS);
+    }
+    return p_index->num_of_configured;
+}
+
 uint8_t eddystone_adv_slot_num_of_current_eids(uint8_t * p_which_slots_are_eids, bool * p_etlm_required)
 {
-    uint8_t eid_count = 0;
-    bool tlm_exists = false;
+    eddystone_adv_slot_index_t const * p_index = &m_published[m_published_front].index;
 
     if (p_which_slots_are_eids != NULL)
     {
-        memset(p_which_slots_are_eids, 0xFF, APP_MAX_EID_SLOTS);
+        memcpy(p_which_slots_are_eids, p_index->eid_positions, APP_MAX_EID_SLOTS);
     }
-    for (uint8_t i = 0; i < APP_MAX_EID_SLOTS; i++)
+
+    if (p_etlm_required != NULL)
     {
-        if (m_slots[i].frame_write_buffer[0] == EDDYSTONE_FRAME_TYPE_TLM)
-        {
-            tlm_exists = true;
-        }
+        *p_etlm_required = (p_index->eid_bitmap != 0 && p_index->tlm_bitmap != 0);
+    }
 
-        if (m_slots[i].frame_write_buffer[0] == EDDYSTONE_FRAME_TYPE_EID)
-        {
-            if (p_which_slots_are_eids != NULL)
-            {
-                *(p_which_slots_are_eids+eid_count) = i;
-            }
-            eid_count++;
-        }
+    return p_index->num_of_eids;
+}
+
+bool eddystone_adv_slot_commit(void)
+{
+    bool                                is_schedule_changed = false;
+    uint32_t                            seq;
+    uint8_t                             back = m_published_front ^ 1;
+    eddystone_adv_slot_table_t const  * p_front = &m_published[m_published_front];
+    eddystone_adv_slot_table_t        * p_back  = &m_published[back];
+
+    if (m_staged_seq == m_published_seq)
+    {
+        return false;
     }
 
-    if (p_etlm_required != NULL && eid_count > 0 && tlm_exists == true )
+    //Sequence counter read: a write from BLE event context always completes before this (main) context resumes,
+    //so if the counter did not move during the copy, no write overlapped it. Otherwise copy again.
+    do
+    {
+        seq = m_staged_seq;
+        __DMB();
+        memcpy(p_back->slots, m_slots, sizeof(m_slots));
+        memcpy(&p_back->index, &m_index, sizeof(eddystone_adv_slot_index_t));
+        __DMB();
+    } while (seq != m_staged_seq);
+
+    //Only the slot layout and the intervals shape the schedule, new frame data is simply advertised from now on
+    if (memcmp(&p_back->index, &p_front->index, sizeof(eddystone_adv_slot_index_t)) != 0)
     {
-        *p_etlm_required = true;
+        is_schedule_changed = true;
     }
-    else if (p_etlm_required != NULL)
+    for (uint8_t i = 0; i < APP_MAX_ADV_SLOTS; i++)
     {
-        *p_etlm_required = false;
+        if (p_back->slots[i].adv_intrvl != p_front->slots[i].adv_intrvl)
+        {
+            is_schedule_changed = true;
+        }
     }
 
-    return eid_count;
+    //Publish with a single byte write
+    m_published_seq   = seq;
+    m_published_front = back;
+
+    DEBUG_PRINTF(0, "Slot configuration committed, schedule changed: %d \r\n", is_schedule_changed);
+    return is_schedule_changed;
 }
 
 /**@brief scheduler event to execute in main context (key exchange for EIDs is quite comp. intensive)*/
@@ -508,16 +783,25 @@ static void eddystone_adv_frame_set_scheduler_evt(void * p_event_data, uint16_t
     uint8_t slot_no = *(uint8_t*)(p_event_data);
     ret_code_t err_code;
     err_code = eddystone_adv_slot_adv_frame_set(slot_no);
-    //If the user wrote something invalid, then change the rw buffer length to 0 so
-    //when the user reads it back, they'll know the slot was not succesfully configured
-    if (err_code == NRF_ERROR_INVALID_PARAM)
+    //If the user wrote something invalid, or registered an EID while another slot is being registered, then change
+    //the rw buffer length to 0 so when the user reads it back, they'll know the slot was not succesfully configured
+    if (err_code == NRF_ERROR_INVALID_PARAM || err_code == NRF_ERROR_BUSY)
     {
         m_slots[slot_no].frame_write_length = 0;
+        m_slots[slot_no].encoded_adv_data.length = 0;
+        eddystone_adv_slot_index_update(slot_no);
+        eddystone_adv_slot_dirty_set(slot_no);
     }
     else
     {
         APP_ERROR_CHECK(err_code);
+        //The registration has set the scaler, the Identity Key may follow later, see @ref eddystone_adv_slot_encrypted_eid_id_key_set
+        if (m_slots[slot_no].frame_write_buffer[0] == EDDYSTONE_FRAME_TYPE_EID)
+        {
+            eddystone_adv_slot_dirty_set(slot_no);
+        }
     }
+    m_staged_seq++;
 }
 
 
@@ -529,7 +813,6 @@ static uint32_t eddystone_adv_slot_adv_frame_set(uint8_t slot_no)
 {
     SLOT_BOUNDARY_CHECK(slot_no);
     eddystone_frame_type_t frame_type = (eddystone_frame_type_t)m_slots[slot_no].frame_write_buffer[0];
-    uint8_t                eid_slot_positions[APP_MAX_EID_SLOTS];
     switch (frame_type)
     {
         case EDDYSTONE_FRAME_TYPE_UID:
@@ -540,6 +823,7 @@ static uint32_t eddystone_adv_slot_adv_frame_set(uint8_t slot_no)
                 memcpy(m_slots[slot_no].adv_frame.uid.namespace, &(m_slots[slot_no].frame_write_buffer[1]), ECS_UID_WRITE_LENGTH);
                 uint8_t rfu[EDDYSTONE_UID_RFU_LENGTH] = {EDDYSTONE_UID_RFU};
                 memcpy(m_slots[slot_no].adv_frame.uid.rfu, rfu, EDDYSTONE_UID_RFU_LENGTH);
+                eddystone_adv_slot_encode(&m_slots[slot_no]);
             }
             else
             {
@@ -552,6 +836,7 @@ static uint32_t eddystone_adv_slot_adv_frame_set(uint8_t slot_no)
                 m_slots[slot_no].adv_frame.url.frame_type = frame_type;
                 eddystone_set_ranging_data(slot_no, m_slots[slot_no].radio_tx_pwr);
                 memcpy(&m_slots[slot_no].adv_frame.url.url_scheme, &(m_slots[slot_no].frame_write_buffer[1]), ECS_URL_WRITE_LENGTH - 1);
+                eddystone_adv_slot_encode(&m_slots[slot_no]);
             }
             else
             {
@@ -561,14 +846,15 @@ static uint32_t eddystone_adv_slot_adv_frame_set(uint8_t slot_no)
         case EDDYSTONE_FRAME_TYPE_TLM:
             if ((m_slots[slot_no].frame_write_length == ECS_TLM_WRITE_LENGTH)) //1 byte
             {
-                if (eddystone_adv_slot_num_of_current_eids(eid_slot_positions, NULL) == 0)
+                if (m_index.num_of_eids == 0)
                 {
                     eddystone_tlm_manager_tlm_get(&m_slots[slot_no].adv_frame.tlm);
                 }
                 else
                 {
-                    eddystone_tlm_manager_etlm_get(eid_slot_positions[0], &m_slots[slot_no].adv_frame.etlm);
+                    eddystone_tlm_manager_etlm_get(m_index.eid_positions[0], &m_slots[slot_no].adv_frame.etlm);
                 }
+                eddystone_adv_slot_encode(&m_slots[slot_no]);
             }
             else
             {
@@ -578,6 +864,8 @@ static uint32_t eddystone_adv_slot_adv_frame_set(uint8_t slot_no)
         case EDDYSTONE_FRAME_TYPE_EID:
 
             eddystone_set_ranging_data(slot_no, m_slots[slot_no].radio_tx_pwr);
+            //Nothing to advertise until the security module reports the first EID, see @ref eddystone_adv_slot_eid_ready
+            m_slots[slot_no].encoded_adv_data.length = 0;
 
             if (m_slots[slot_no].frame_write_length == ECS_EID_WRITE_ECDH_LENGTH) //34 bytes
             {
@@ -622,16 +910,18 @@ static uint32_t eddystone_adv_slot_adv_frame_set(uint8_t slot_no)
     return NRF_SUCCESS;
 }
 
-bool eddystone_adv_slot_is_configured (uint8_t slot_no)
+/**@brief Function for checking if a slot, staged or published, is configured
+* @param[in]       p_slot          pointer to the slot
+*/
+static bool eddystone_adv_slot_configured_check( eddystone_adv_slot_t const * p_slot )
 {
-    SLOT_BOUNDARY_CHECK(slot_no);
     //Client wrote an empty array
-    if ( m_slots[slot_no].frame_write_length == 0 )
+    if ( p_slot->frame_write_length == 0 )
     {
         return false;
     }
     //Client wrote a single byte of 0
-    else if ( m_slots[slot_no].frame_write_length == 1 && m_slots[slot_no].frame_write_buffer[0] == 0 )
+    else if ( p_slot->frame_write_length == 1 && p_slot->frame_write_buffer[0] == 0 )
     {
         return false;
     }
@@ -641,11 +931,86 @@ bool eddystone_adv_slot_is_configured (uint8_t slot_no)
     }
 }
 
+bool eddystone_adv_slot_is_configured (uint8_t slot_no)
+{
+    SLOT_BOUNDARY_CHECK(slot_no);
+    return eddystone_adv_slot_configured_check(&m_slots[slot_no]);
+}
+
 void eddystone_adv_slot_params_get( uint8_t slot_no, eddystone_adv_slot_params_t * p_params)
 {
-    p_params->adv_intrvl            = m_slots[slot_no].adv_intrvl;
-    p_params->radio_tx_pwr          = m_slots[slot_no].radio_tx_pwr;
-    p_params->frame_type            = (eddystone_frame_type_t)m_slots[slot_no].frame_write_buffer[0];
-    p_params->p_adv_frame           = &(m_slots[slot_no].adv_frame);
-    p_params->url_frame_length      = m_slots[slot_no].frame_write_length+1; // Add the RSSI byte length
+    SLOT_BOUNDARY_CHECK(slot_no);
+    eddystone_adv_slot_t const * p_slot = &m_published[m_published_front].slots[slot_no];
+
+    p_params->adv_intrvl            = p_slot->adv_intrvl;
+    p_params->radio_tx_pwr          = p_slot->radio_tx_pwr;
+    p_params->frame_type            = (eddystone_frame_type_t)p_slot->frame_write_buffer[0];
+    p_params->p_adv_frame           = (eddystone_adv_frame_t *)&(p_slot->adv_frame);
+    p_params->url_frame_length      = p_slot->frame_write_length+1; // Add the RSSI byte length
+    p_params->p_encoded_adv_data    = &(p_slot->encoded_adv_data);
+}
+
+/**@brief Function for getting the length of the frame currently held in the slot's adv_frame
+* @param[in]       p_slot          pointer to the slot
+* @retval          the frame length in bytes, 0 if the slot has no advertisable frame
+*/
+static uint8_t eddystone_adv_slot_frame_length_get( eddystone_adv_slot_t const * p_slot )
+{
+    switch ((eddystone_frame_type_t)p_slot->frame_write_buffer[0])
+    {
+        case EDDYSTONE_FRAME_TYPE_UID:
+            return EDDYSTONE_UID_LENGTH;
+        case EDDYSTONE_FRAME_TYPE_URL:
+            return p_slot->frame_write_length + 1; // Add the RSSI byte length
+        case EDDYSTONE_FRAME_TYPE_TLM:
+            if (p_slot->adv_frame.tlm.version == EDDYSTONE_TLM_VERSION_ETLM)
+            {
+                return EDDYSTONE_ETLM_LENGTH;
+            }
+            return EDDYSTONE_TLM_LENGTH;
+        case EDDYSTONE_FRAME_TYPE_EID:
+            //An EID slot being registered has no EID to advertise yet, whatever else is re-encoded
+            return p_slot->is_eid_ready ? EDDYSTONE_EID_LENGTH : 0;
+        default:
+            return 0;
+    }
+}
+
+/**@brief Function for encoding the slot's adv_frame into its ready-to-send advertising data
+* @details Produces the same bytes as ble_advdata_set() would for the flags, the complete
+*          16-bit UUID list (Eddystone UUID) and the Eddystone service data, without
+*          going through the generic encoder on every advertisement.
+* @param[in]       p_slot          pointer to the slot, staged or published
+*/
+static void eddystone_adv_slot_encode( eddystone_adv_slot_t * p_slot )
+{
+    eddystone_adv_slot_encoded_t * p_encoded = &(p_slot->encoded_adv_data);
+    uint8_t frame_length = eddystone_adv_slot_frame_length_get(p_slot);
+    uint8_t i = 0;
+
+    if (!eddystone_adv_slot_configured_check(p_slot) || frame_length == 0)
+    {
+        p_encoded->length = 0;
+        return;
+    }
+
+    //Flags
+    p_encoded->data[i++] = 2;
+    p_encoded->data[i++] = BLE_GAP_AD_TYPE_FLAGS;
+    p_encoded->data[i++] = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
+
+    //Complete list of 16-bit service UUIDs
+    p_encoded->data[i++] = 3;
+    p_encoded->data[i++] = BLE_GAP_AD_TYPE_16BIT_SERVICE_UUID_COMPLETE;
+    p_encoded->data[i++] = (uint8_t)(APP_EDDYSTONE_UUID & 0xFF);
+    p_encoded->data[i++] = (uint8_t)(APP_EDDYSTONE_UUID >> 8);
+
+    //Service data
+    p_encoded->data[i++] = 3 + frame_length;
+    p_encoded->data[i++] = BLE_GAP_AD_TYPE_SERVICE_DATA;
+    p_encoded->data[i++] = (uint8_t)(APP_EDDYSTONE_UUID & 0xFF);
+    p_encoded->data[i++] = (uint8_t)(APP_EDDYSTONE_UUID >> 8);
+    memcpy(&(p_encoded->data[i]), &(p_slot->adv_frame), frame_length);
+
+    p_encoded->length = i + frame_length;
 }
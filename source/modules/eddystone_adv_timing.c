@@ -0,0 +1,178 @@
+#include "eddystone_adv_timing.h"
+#include "eddystone_app_config.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include <string.h>
+#include "debug_config.h"
+
+#ifdef ADV_TIMING_DEBUG
+
+#include "SEGGER_RTT.h"
+#define DEBUG_PRINTF SEGGER_RTT_printf
+
+#define RTC_COUNTER_HALF_RANGE      0x00800000                              /**< Half the range of the 24 bit RTC counter */
+#define TICKS_TO_US(ticks)          ((int32_t)(((int64_t)(ticks) * 1000000 * (APP_TIMER_PRESCALER + 1)) / APP_TIMER_CLOCK_FREQ))
+
+/**@brief One sample of the ring buffer*/
+typedef struct
+{
+    int32_t     lateness_ticks;         /**< ticks between the deadline and going on air, negative if early */
+    uint32_t    interval_ticks;         /**< ticks since the slot's previous sample, 0 for the first sample */
+} eddystone_adv_timing_sample_t;
+
+/**@brief Samples and accumulated statistics of one slot*/
+typedef struct
+{
+    eddystone_adv_timing_sample_t   log[ADV_TIMING_LOG_SIZE];
+    uint8_t                         log_idx;            /**< where the next sample will be written */
+    uint32_t                        last_on_air;        /**< RTC counter value of the previous sample */
+    uint32_t                        num_of_samples;
+    int32_t                         lateness_min;
+    int32_t                         lateness_max;
+    int64_t                         lateness_sum;
+    uint32_t                        num_of_intervals;   /**< the first sample after a reset has no interval */
+    uint32_t                        interval_min;
+    uint32_t                        interval_max;
+    uint64_t                        interval_sum;
+} eddystone_adv_timing_slot_t;
+
+static eddystone_adv_timing_slot_t m_timing[APP_MAX_ADV_SLOTS];
+
+/**@brief Function for printing the summary of a slot's ring buffer over RTT*/
+static void log_print(uint8_t slot_no)
+{
+    eddystone_adv_timing_slot_t * p_slot = &m_timing[slot_no];
+    int32_t  lateness_min  = INT32_MAX;
+    int32_t  lateness_max  = INT32_MIN;
+    int32_t  lateness_sum  = 0;
+    uint32_t interval_min  = UINT32_MAX;
+    uint32_t interval_max  = 0;
+    uint32_t interval_sum  = 0;
+    uint8_t  num_of_intervals = 0;
+
+    for (uint8_t i = 0; i < ADV_TIMING_LOG_SIZE; i++)
+    {
+        eddystone_adv_timing_sample_t * p_sample = &p_slot->log[i];
+
+        lateness_min  = MIN(lateness_min, p_sample->lateness_ticks);
+        lateness_max  = MAX(lateness_max, p_sample->lateness_ticks);
+        lateness_sum += p_sample->lateness_ticks;
+
+        if (p_sample->interval_ticks != 0)
+        {
+            interval_min  = MIN(interval_min, p_sample->interval_ticks);
+            interval_max  = MAX(interval_max, p_sample->interval_ticks);
+            interval_sum += p_sample->interval_ticks;
+            num_of_intervals++;
+        }
+    }
+
+    DEBUG_PRINTF(0, "Slot [%d] - late min/max/mean: %d/%d/%d us \r\n", slot_no,
+                 TICKS_TO_US(lateness_min), TICKS_TO_US(lateness_max), TICKS_TO_US(lateness_sum / ADV_TIMING_LOG_SIZE));
+    if (num_of_intervals != 0)
+    {
+        DEBUG_PRINTF(0, "Slot [%d] - interval min/max/mean: %d/%d/%d us \r\n", slot_no,
+                     TICKS_TO_US(interval_min), TICKS_TO_US(interval_max), TICKS_TO_US(interval_sum / num_of_intervals));
+    }
+}
+
+void eddystone_adv_timing_reset(void)
+{
+    CRITICAL_REGION_ENTER();
+    memset(m_timing, 0, sizeof(m_timing));
+    CRITICAL_REGION_EXIT();
+}
+
+void eddystone_adv_timing_record(uint8_t slot_no, uint32_t deadline)
+{
+    eddystone_adv_timing_slot_t   * p_slot;
+    eddystone_adv_timing_sample_t   sample;
+    uint32_t                        now;
+    uint32_t                        diff;
+    bool                            log_full;
+
+    if (slot_no >= APP_MAX_ADV_SLOTS)
+    {
+        return;
+    }
+    p_slot = &m_timing[slot_no];
+
+    UNUSED_VARIABLE(app_timer_cnt_get(&now));
+
+    //Deadlines can be both in the past and the future, interpret the 24 bit difference as signed
+    UNUSED_VARIABLE(app_timer_cnt_diff_compute(now, deadline, &diff));
+    sample.lateness_ticks = (diff < RTC_COUNTER_HALF_RANGE) ? (int32_t)diff : (int32_t)diff - (int32_t)(2 * RTC_COUNTER_HALF_RANGE);
+
+    sample.interval_ticks = 0;
+    if (p_slot->num_of_samples != 0)
+    {
+        UNUSED_VARIABLE(app_timer_cnt_diff_compute(now, p_slot->last_on_air, &sample.interval_ticks));
+    }
+
+    CRITICAL_REGION_ENTER();
+    p_slot->log[p_slot->log_idx] = sample;
+    p_slot->log_idx              = (p_slot->log_idx + 1) % ADV_TIMING_LOG_SIZE;
+    p_slot->last_on_air          = now;
+
+    if (p_slot->num_of_samples == 0)
+    {
+        p_slot->lateness_min = sample.lateness_ticks;
+        p_slot->lateness_max = sample.lateness_ticks;
+    }
+    p_slot->lateness_min  = MIN(p_slot->lateness_min, sample.lateness_ticks);
+    p_slot->lateness_max  = MAX(p_slot->lateness_max, sample.lateness_ticks);
+    p_slot->lateness_sum += sample.lateness_ticks;
+    p_slot->num_of_samples++;
+
+    if (sample.interval_ticks != 0)
+    {
+        if (p_slot->num_of_intervals == 0)
+        {
+            p_slot->interval_min = sample.interval_ticks;
+            p_slot->interval_max = sample.interval_ticks;
+        }
+        p_slot->interval_min  = MIN(p_slot->interval_min, sample.interval_ticks);
+        p_slot->interval_max  = MAX(p_slot->interval_max, sample.interval_ticks);
+        p_slot->interval_sum += sample.interval_ticks;
+        p_slot->num_of_intervals++;
+    }
+
+    log_full = (p_slot->log_idx == 0);
+    CRITICAL_REGION_EXIT();
+
+    if (log_full)
+    {
+        log_print(slot_no);
+    }
+}
+
+void eddystone_adv_timing_stats_get(uint8_t slot_no, ble_ecs_adv_timing_t * p_stats)
+{
+    eddystone_adv_timing_slot_t slot;
+
+    memset(p_stats, 0, sizeof(ble_ecs_adv_timing_t));
+    if (slot_no >= APP_MAX_ADV_SLOTS)
+    {
+        return;
+    }
+
+    CRITICAL_REGION_ENTER();
+    slot = m_timing[slot_no];
+    CRITICAL_REGION_EXIT();
+
+    p_stats->num_of_samples = slot.num_of_samples;
+    if (slot.num_of_samples != 0)
+    {
+        p_stats->lateness_min_us  = TICKS_TO_US(slot.lateness_min);
+        p_stats->lateness_max_us  = TICKS_TO_US(slot.lateness_max);
+        p_stats->lateness_mean_us = TICKS_TO_US(slot.lateness_sum / (int32_t)slot.num_of_samples);
+    }
+    if (slot.num_of_intervals != 0)
+    {
+        p_stats->interval_min_us  = TICKS_TO_US(slot.interval_min);
+        p_stats->interval_max_us  = TICKS_TO_US(slot.interval_max);
+        p_stats->interval_mean_us = TICKS_TO_US(slot.interval_sum / slot.num_of_intervals);
+    }
+}
+
+#endif /*ADV_TIMING_DEBUG*/
@@ -10,9 +10,13 @@
 #include "eddystone_adv_slot.h"
 #include "app_timer.h"
 #include "app_error.h"
+#include "app_scheduler.h"
+#include "nrf_soc.h"
 #include "endian_convert.h"
+#include "macros_common.h"
 #include "bsp.h"
 #include "eddystone_tlm_manager.h"
+#include "eddystone_adv_timing.h"
 #include "debug_config.h"
 
 static ble_gap_adv_params_t m_non_conn_adv_params;               /**< Parameters to be passed to the stack when starting advertising in non-connectable mode. */
@@ -25,43 +29,81 @@ static ble_gap_adv_params_t m_conn_adv_params;                   /**< Parameters
     #define DEBUG_PRINTF(...)
 #endif
 
-APP_TIMER_DEF(m_eddystone_adv_interval_timer);
-APP_TIMER_DEF(m_eddystone_adv_slot_timer);
-APP_TIMER_DEF(m_eddystone_etlm_cycle_timer);
+APP_TIMER_DEF(m_eddystone_adv_schedule_timer);
+
+#define ADV_SCHEDULE_MAX_ENTRIES        (APP_MAX_ADV_SLOTS + APP_MAX_EID_SLOTS + APP_CONNECTABLE_ADV_INTERLEAVED) /**< Every slot once, plus one eTLM entry per EID for the TLM slot, plus the connectable pseudo-slot */
+#define ADV_SCHEDULE_NO_EIK_PAIR        (0xFF)                                    /**< eik_pair_slot value of entries that are not eTLMs */
+#define ADV_SCHEDULE_CONNECTABLE_SLOT   (0xFE)                                    /**< slot_no of the pseudo-slot carrying the connectable registration advertisement */
+#define ADV_SCHEDULE_IDLE_POLL_MS       (APP_CFG_NON_CONN_ADV_INTERVAL_MS)        /**< How often an empty schedule checks for a newly committed slot configuration */
+#if APP_CONNECTABLE_ADV_INTERLEAVED && APP_ADV_USE_RADIO_NOTIFICATION
+    #error "Connectable advertising cannot be interleaved by swapping the data of a non-connectable advertiser"
+#endif
+#if APP_ADV_USE_RADIO_NOTIFICATION
+#define ADV_SCHEDULE_MIN_SPACING_MS     (MIN_NON_CONN_ADV_INTERVAL)               /**< Every advertising event carries one scheduled advertisement, at most as fast as non-connectable advertising allows */
+#else
+#define ADV_SCHEDULE_MIN_SPACING_MS     (20)                                      /**< Minimum time between two scheduled advertisements, room for one advertising event */
+#endif
+#define RTC_COUNTER_RANGE               (0x01000000)                              /**< RTC1 is a 24-bit counter */
+#define RTC_COUNTER_HALF_RANGE          (0x00800000)                              /**< Tick differences above this are treated as negative (deadline already passed) */
 
 static bool m_is_connectable_adv = false;
 static bool m_is_connected       = false;
 static uint8_t m_ecs_uuid_type = 0;
 
-//Struct to keep track of the pairing between eTLM and EIDs
+#if APP_CONNECTABLE_ADV_INTERLEAVED
+static uint8_t  m_conn_adv_data[BLE_GAP_ADV_MAX_SIZE];           /**< Encoded advertising data of the connectable pseudo-slot */
+static uint8_t  m_conn_adv_data_len;
+static uint8_t  m_conn_scrsp_data[BLE_GAP_ADV_MAX_SIZE];         /**< Encoded scan response data of the connectable pseudo-slot */
+static uint8_t  m_conn_scrsp_data_len;
+static uint32_t m_conn_adv_end;                                  /**< RTC counter value at which connectable advertising ends */
+#endif
+
+/**@brief One periodic advertisement in the advertising schedule*/
 typedef struct
 {
-  uint8_t eid_slot_counter;                         /**<which element in the eid_positions array is the eTLM current paired with */
-  uint8_t eid_positions[APP_MAX_EID_SLOTS];         /**<see param[out] of @ ref eddystone_adv_slot_num_of_current_eids() */
-} eddystone_etlm_adv_counter_t;
-
-/**@brief Struct of all advertising timing related intervals that control timers for advertising*/
+    uint32_t next_deadline;             /**<RTC counter value at which the entry should next go on air */
+    uint32_t period_ticks;              /**<the achieved advertising interval of the entry in RTC ticks */
+    uint16_t period_ms;                 /**<the achieved advertising interval of the entry in ms */
+    uint8_t  slot_no;                   /**<the slot to advertise */
+    uint8_t  eik_pair_slot;             /**<for eTLM advertisements, the EID slot whose EIK the eTLM is paired with, else ADV_SCHEDULE_NO_EIK_PAIR */
+} eddystone_adv_schedule_entry_t;
+
+/**@brief Earliest-deadline-first schedule of all the advertisements, built whenever the slot configuration changes*/
 typedef struct
 {
-    uint16_t adv_intrvl;                /**<the interval between the advertisings of a particular slot */
-    uint16_t slot_slot_interval;        /**<the interval between the advertising of two adjacent slots */
-    uint16_t etlm_etlm_interval;        /**<the interval between the advertising of two adjacent eTLM frames, each with its own EID pairing */
-} eddystone_adv_manager_intervals_t;
+    eddystone_adv_schedule_entry_t entries[ADV_SCHEDULE_MAX_ENTRIES];  /**<one entry per slot, or per EIK pairing for an eTLM slot */
+    uint8_t                        num_of_entries;                     /**<number of entries in use */
+    uint8_t                        next_entry;                         /**<index of the entry the schedule timer is armed for */
+    uint32_t                       last_adv;                           /**<RTC counter value of the last scheduled advertisement */
+    uint16_t                       base_interval_ms;                   /**<interval at which advertisements are due on average, over all entries */
+} eddystone_adv_schedule_t;
 
+static eddystone_adv_schedule_t          m_schedule;
 
-static eddystone_adv_manager_intervals_t m_intervals;
-static eddystone_etlm_adv_counter_t      m_etlm_adv_counter;
-static uint8_t m_currently_configured_slots[APP_MAX_ADV_SLOTS] = {0};
-static uint8_t m_temporary_slot_no;
+#if APP_ADV_USE_RADIO_NOTIFICATION
+/**@brief Advertising data prepared in main context, handed to the stack from the radio notification interrupt*/
+typedef struct
+{
+    uint8_t                 data[BLE_GAP_ADV_MAX_SIZE];
+    uint8_t                 length;
+    ble_ecs_radio_tx_pwr_t  radio_tx_pwr;
+    uint8_t                 slot_no;
+    uint32_t                deadline;               /**< RTC counter value at which the payload was due */
+} eddystone_adv_rn_payload_t;
+
+static eddystone_adv_rn_payload_t m_rn_payload;
+static volatile bool              m_rn_payload_ready = false;      /**< m_rn_payload belongs to the interrupt until it has been handed to the stack */
+static volatile bool              m_rn_active        = false;      /**< the advertiser is running and payloads are being swapped */
+static uint32_t                   m_rn_last_swap;                  /**< RTC counter value of the last payload swap */
+static uint32_t                   m_rn_min_swap_ticks;             /**< radio notifications closer than this to the last swap are not advertising events */
+#endif
 
 //Forward Declarations
 static void slots_advertising_start(void);
-static void advertising_init(uint8_t slot);
+static void slots_advertising_start_delayed(void);
+static ret_code_t advertising_init(uint8_t slot, uint8_t eik_pair_slot);
 static void all_advertising_halt(void);
-static void adv_interval_timer_start(void);
-static void intervals_calculate(void);
-static void adv_slot_timer_start(void);
-static void fetch_adv_data_from_slot( uint8_t slot, uint8_array_t * p_eddystone_data_array );
+static void tlm_data_refresh( uint8_t slot, uint8_t eik_pair_slot );
 
 /**@brief Function for starting advertising of the eddystone beacon.
  * @param[in]   conn  connectable or non-connectable
@@ -94,10 +136,11 @@ static void eddystone_ble_advertising_start(eddystone_ble_adv_connectable_t conn
 /**@brief Function for stopping all advertising and all running timers */
 void all_advertising_halt(void)
 {
+#if APP_ADV_USE_RADIO_NOTIFICATION
+    m_rn_active = false;
+#endif
     sd_ble_gap_adv_stop();
-    app_timer_stop(m_eddystone_adv_interval_timer);
-    app_timer_stop(m_eddystone_adv_slot_timer);
-    app_timer_stop(m_eddystone_etlm_cycle_timer);
+    app_timer_stop(m_eddystone_adv_schedule_timer);
 }
 
 /**@brief Function for starting connectable advertising of the eddystone beacon to register it
@@ -107,7 +150,9 @@ static void eddystone_ble_registr_adv_cb(void)
 {
     if (m_is_connectable_adv != true && m_is_connected == false)
     {
+#if !APP_CONNECTABLE_ADV_INTERLEAVED
         all_advertising_halt();
+#endif
 
         uint32_t      err_code;
         ble_advdata_t adv_data;
@@ -140,8 +185,21 @@ static void eddystone_ble_registr_adv_cb(void)
         scrsp_data.uuids_complete.uuid_cnt = sizeof(scrp_uuids) / sizeof(scrp_uuids[0]);
         scrsp_data.uuids_complete.p_uuids  = scrp_uuids;
 
+#if APP_CONNECTABLE_ADV_INTERLEAVED
+        //Encoded once, the slots overwrite the advertising data in between the connectable advertisements
+        uint16_t encoded_len = BLE_GAP_ADV_MAX_SIZE;
+        err_code = adv_data_encode(&adv_data, m_conn_adv_data, &encoded_len);
+        APP_ERROR_CHECK(err_code);
+        m_conn_adv_data_len = encoded_len;
+
+        encoded_len = BLE_GAP_ADV_MAX_SIZE;
+        err_code = adv_data_encode(&scrsp_data, m_conn_scrsp_data, &encoded_len);
+        APP_ERROR_CHECK(err_code);
+        m_conn_scrsp_data_len = encoded_len;
+#else
         err_code = ble_advdata_set(&adv_data, &scrsp_data);
         APP_ERROR_CHECK(err_code);
+#endif
 
         memset(&m_conn_adv_params, 0, sizeof(m_conn_adv_params));
 
@@ -152,7 +210,22 @@ static void eddystone_ble_registr_adv_cb(void)
         m_conn_adv_params.timeout        = APP_CFG_CONNECTABLE_ADV_TIMEOUT;
 
         m_is_connectable_adv = true;
+#if APP_CONNECTABLE_ADV_INTERLEAVED
+        uint32_t now;
+
+        //The schedule ends connectable advertising instead of the stack, see @ref adv_schedule_timeout
+        m_conn_adv_params.timeout = 0;
+        err_code = app_timer_cnt_get(&now);
+        APP_ERROR_CHECK(err_code);
+        m_conn_adv_end = now + APP_TIMER_TICKS(APP_CFG_CONNECTABLE_ADV_TIMEOUT * 1000, APP_TIMER_PRESCALER);
+
+        LEDS_ON(1 << LED_3);
+        bsp_indication_set(BSP_INDICATE_ADVERTISING);
+        DEBUG_PRINTF(0,"Connectable ADV interleaved... \r\n",0);
+        slots_advertising_start();
+#else
         eddystone_ble_advertising_start(EDDYSTONE_BLE_ADV_CONNECTABLE_TRUE);
+#endif
     }
 }
 
@@ -180,7 +253,7 @@ void eddystone_advertising_manager_on_ble_evt( ble_evt_t * p_ble_evt )
             m_is_connectable_adv = false;
             all_advertising_halt();
 
-            adv_interval_timer_start();
+            slots_advertising_start_delayed();
             //Essentially gives 1 advertising interval's time for flash to write
             break;
 
@@ -195,376 +268,661 @@ void eddystone_advertising_manager_on_ble_evt( ble_evt_t * p_ble_evt )
             }
             break;
 
-        case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
-            if (p_ble_evt->evt.gatts_evt.params.authorize_request.type == BLE_GATTS_AUTHORIZE_TYPE_WRITE)
-            {
-                DEBUG_PRINTF(0,"Stop Advertising For A bit!! \r\n",0);
-                all_advertising_halt();
-                adv_interval_timer_start();
-            }
+        //Configuration writes are staged by the slots and committed at the next schedule boundary,
+        //see @ref eddystone_adv_slot_commit, so advertising is not interrupted
         default:
             // No implementation needed.
             break;
     }
 }
 
-/**@brief Function for handling events coming from the S132 SoftDevice
- * @param[in]   slot                            Slot index
- * @param[out]   p_eddystone_data_array         buffer array to which the adv data is retrieved
+/**@brief Function for refreshing the TLM data of a TLM slot before it is advertised
+ * @details TLM data (ADV_CNT, SEC_CNT, temperature) changes between advertisements, so unlike the other
+ *          frame types the slot's cached advertising data must be rebuilt every time it goes on air.
+ * @param[in]   slot            Slot index
+ * @param[in]   eik_pair_slot   the EID slot whose EIK the eTLM is paired with, ADV_SCHEDULE_NO_EIK_PAIR for plain TLM
  */
-static void fetch_adv_data_from_slot( uint8_t slot, uint8_array_t * p_eddystone_data_array )
+static void tlm_data_refresh( uint8_t slot, uint8_t eik_pair_slot )
 {
-    eddystone_adv_slot_params_t eddystone_adv_slot_params;
-    eddystone_adv_slot_params_get(slot, &eddystone_adv_slot_params);
+    //If there are EIDs, broadcast eTLM, else just TLM
+    if (eik_pair_slot != ADV_SCHEDULE_NO_EIK_PAIR)
+    {
+        eddystone_etlm_frame_t const * p_etlm;
+        if (eddystone_tlm_manager_etlm_ready_get(eik_pair_slot, &p_etlm) == NRF_SUCCESS)
+        {
+            eddystone_adv_slot_tlm_refresh(slot, p_etlm);
+        }
+        else
+        {
+            //Not precomputed in time, encrypt it on the spot
+            eddystone_etlm_frame_t etlm;
+            eddystone_tlm_manager_etlm_get(eik_pair_slot, &etlm);
+            eddystone_adv_slot_tlm_refresh(slot, &etlm);
+        }
+    }
+    //Just plain TLM
+    else
+    {
+        eddystone_adv_slot_tlm_refresh(slot, NULL);
+    }
+}
 
-    sd_ble_gap_tx_power_set(eddystone_adv_slot_params.radio_tx_pwr);
+/**@brief Function for getting the advertising parameters and up to date advertising data of a slot
+ *
+ * @param[in]   slot            Slot index
+ * @param[in]   eik_pair_slot   for eTLM advertisements, the EID slot the eTLM is paired with, else ADV_SCHEDULE_NO_EIK_PAIR
+ * @param[out]  p_params        pointer to where the slot's parameters will be retrieved
+ *
+ * @retval NRF_SUCCESS              if the slot has advertising data
+ * @retval NRF_ERROR_INVALID_STATE  if the slot has nothing to advertise yet (e.g. EID not generated)
+ */
+static ret_code_t adv_payload_get( uint8_t slot, uint8_t eik_pair_slot, eddystone_adv_slot_params_t * p_params )
+{
+    eddystone_adv_slot_params_get(slot, p_params);
 
-    switch (eddystone_adv_slot_params.frame_type)
+    if (p_params->frame_type == EDDYSTONE_FRAME_TYPE_TLM)
     {
-        case EDDYSTONE_FRAME_TYPE_UID:
-            p_eddystone_data_array->p_data = (uint8_t *) &(eddystone_adv_slot_params.p_adv_frame->uid);
-            p_eddystone_data_array->size = sizeof(eddystone_uid_frame_t);
-            break;
-        case EDDYSTONE_FRAME_TYPE_URL:
-            p_eddystone_data_array->p_data = (uint8_t *) &(eddystone_adv_slot_params.p_adv_frame->url);
-            p_eddystone_data_array->size = eddystone_adv_slot_params.url_frame_length;
-            break;
-        case EDDYSTONE_FRAME_TYPE_TLM:
-            //If there are EIDs, broadcast eTLM, else just TLM
-            if (eddystone_adv_slot_num_of_current_eids(NULL, NULL) != 0)
-            {
-                //The current EIK slot that is paired with the current eTLM slot
-                uint8_t eik_pair_slot = m_etlm_adv_counter.eid_positions[m_etlm_adv_counter.eid_slot_counter];
-                eddystone_tlm_manager_etlm_get(eik_pair_slot, &(eddystone_adv_slot_params.p_adv_frame->etlm));
+        tlm_data_refresh(slot, eik_pair_slot);
+    }
 
-                p_eddystone_data_array->p_data = (uint8_t *) &(eddystone_adv_slot_params.p_adv_frame->etlm);
-                p_eddystone_data_array->size = sizeof(eddystone_etlm_frame_t);
-            }
-            //Just plain TLM
-            else
-            {
-                eddystone_tlm_manager_tlm_get(&(eddystone_adv_slot_params.p_adv_frame->tlm));
-                p_eddystone_data_array->p_data = (uint8_t *) &(eddystone_adv_slot_params.p_adv_frame->tlm);
-                p_eddystone_data_array->size = sizeof(eddystone_tlm_frame_t);
-            }
-            break;
-        case EDDYSTONE_FRAME_TYPE_EID:
-            p_eddystone_data_array->p_data = (uint8_t *) &(eddystone_adv_slot_params.p_adv_frame->eid);
-            p_eddystone_data_array->size = sizeof(eddystone_eid_frame_t);
-            break;
-        default:
-           APP_ERROR_CHECK(NRF_ERROR_INVALID_DATA);
-           //Should never happen!
-            break;
+    if (p_params->p_encoded_adv_data->length == 0)
+    {
+        return NRF_ERROR_INVALID_STATE;
     }
+    return NRF_SUCCESS;
 }
 
 /**@brief Function for initializing the advertising functionality.
  *
- * @details Encodes the required advertising data and passes it to the stack.
- *          Also builds a structure to be passed to the stack when starting advertising.
+ * @details Passes the slot's pre-encoded advertising data to the stack.
+ *          The advertising parameters are built by @ref non_conn_adv_params_set.
+ *
+ * @param[in]   slot            Slot index
+ * @param[in]   eik_pair_slot   for eTLM advertisements, the EID slot the eTLM is paired with, else ADV_SCHEDULE_NO_EIK_PAIR
+ *
+ * @retval NRF_SUCCESS              if the advertising data of the slot was set
+ * @retval NRF_ERROR_INVALID_STATE  if the slot has nothing to advertise yet (e.g. EID not generated)
  */
-static void advertising_init( uint8_t slot )
+static ret_code_t advertising_init( uint8_t slot, uint8_t eik_pair_slot )
 {
-    uint32_t      err_code;
-    ble_advdata_t adv_data;
-    ble_uuid_t    adv_uuids[] = {{EDDYSTONE_UUID, BLE_UUID_TYPE_BLE}};
-
-    uint8_array_t eddystone_data_array;                             // Array for Service Data structure.
-
-    fetch_adv_data_from_slot(slot,&eddystone_data_array);
-
-    ble_advdata_service_data_t service_data;                        // Structure to hold Service Data.
-    service_data.service_uuid = APP_EDDYSTONE_UUID;                 // Eddystone UUID to allow discoverability on iOS devices.
-    service_data.data = eddystone_data_array;                       // Array for service advertisement data.
+    uint32_t                    err_code;
+    eddystone_adv_slot_params_t eddystone_adv_slot_params;
 
-    // Build and set advertising data.
-    memset(&adv_data, 0, sizeof(adv_data));
+    err_code = adv_payload_get(slot, eik_pair_slot, &eddystone_adv_slot_params);
+    RETURN_IF_ERROR(err_code);
 
-    adv_data.name_type               = BLE_ADVDATA_NO_NAME;
-    adv_data.flags                   = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
-    adv_data.uuids_complete.uuid_cnt = sizeof(adv_uuids) / sizeof(adv_uuids[0]);
-    adv_data.uuids_complete.p_uuids  = adv_uuids;
-    adv_data.p_service_data_array    = &service_data;                // Pointer to Service Data structure.
-    adv_data.service_data_count      = 1;
+    sd_ble_gap_tx_power_set(eddystone_adv_slot_params.radio_tx_pwr);
 
-    //DEBUG_PRINTF(0, "Slot [%d] - Service Data Size: %d \r\n", slot, service_data.data.size);
+    //DEBUG_PRINTF(0, "Slot [%d] - Adv Data Size: %d \r\n", slot, eddystone_adv_slot_params.p_encoded_adv_data->length);
 
-    err_code = ble_advdata_set(&adv_data, NULL);
+    err_code = sd_ble_gap_adv_data_set(eddystone_adv_slot_params.p_encoded_adv_data->data,
+                                       eddystone_adv_slot_params.p_encoded_adv_data->length,
+                                       NULL,
+                                       0);
     APP_ERROR_CHECK(err_code);
 
-    // Initialize advertising parameters (used when starting advertising).
+    return NRF_SUCCESS;
+}
+
+/**@brief Function for building the non-connectable advertising parameters
+ * @param[in] adv_intrvl_ms    the advertising interval of the slot about to be advertised
+ */
+static void non_conn_adv_params_set(uint16_t adv_intrvl_ms)
+{
     memset(&m_non_conn_adv_params, 0, sizeof(m_non_conn_adv_params));
 
     /*Non-connectable*/
     m_non_conn_adv_params.type        = BLE_GAP_ADV_TYPE_ADV_NONCONN_IND;
     m_non_conn_adv_params.p_peer_addr = NULL;                                // Undirected advertisement.
     m_non_conn_adv_params.fp          = BLE_GAP_ADV_FP_ANY;
-    m_non_conn_adv_params.interval    = MSEC_TO_UNITS(m_intervals.adv_intrvl, UNIT_0_625_MS);
+    m_non_conn_adv_params.interval    = MSEC_TO_UNITS(adv_intrvl_ms, UNIT_0_625_MS);
     m_non_conn_adv_params.timeout     = APP_CFG_NON_CONN_ADV_TIMEOUT;
 }
 
-/**@brief Function for starting the advertising interval timer.*/
-static void adv_interval_timer_start(void)
+/**@brief Function for getting the signed number of RTC ticks from now until a deadline
+ * @param[in] deadline    RTC counter value of the deadline
+ * @param[in] now         current RTC counter value
+ * @retval    ticks until the deadline, negative if the deadline has already passed
+ */
+static int32_t ticks_until(uint32_t deadline, uint32_t now)
 {
-    ret_code_t err_code;
-    intervals_calculate();
-    err_code = app_timer_start(m_eddystone_adv_interval_timer,APP_TIMER_TICKS(m_intervals.adv_intrvl,APP_TIMER_PRESCALER), NULL);
-    APP_ERROR_CHECK(err_code);
+    uint32_t diff;
+    APP_ERROR_CHECK(app_timer_cnt_diff_compute(deadline, now, &diff));
+    if (diff >= RTC_COUNTER_HALF_RANGE)
+    {
+        return (int32_t)diff - RTC_COUNTER_RANGE;
+    }
+    return (int32_t)diff;
 }
 
-static void intervals_calculate(void)
+/**@brief Function for building the advertising schedule from the current slot configuration
+ *
+ * @details Every configured slot gets an entry with its own advertising interval. An eTLM slot gets one entry
+ *          per EID, each encrypted with that EID's EIK. The entries' first deadlines are spread over their interval
+ *          and from then on every deadline is the previous one plus the entry's interval, so there is no drift.
+ *
+ *          Each advertisement occupies the schedule for ADV_SCHEDULE_MIN_SPACING_MS, eTLMs included since they are
+ *          encrypted ahead of time. If the configured intervals ask for more than that, all the intervals are stretched by
+ *          the same factor until they fit. The achieved intervals are reported back to the slots,
+ *          see @ref eddystone_adv_slot_adv_intrvl_achieved_set.
+ *
+ * @param[in] start    RTC counter value from which the schedule starts
+ */
+static void adv_schedule_build(uint32_t start)
 {
+    uint8_t                     configured_slots[APP_MAX_ADV_SLOTS];
+    uint8_t                     eid_positions[APP_MAX_EID_SLOTS];
+    bool                        etlm_required = false;
+    uint32_t                    utilization = 0; // in permille
+    uint32_t                    adv_rate = 0;    // advertisements per 1000 s
+    eddystone_adv_slot_params_t adv_slot_params;
+
+    /**@note With the EAX key state kept per EIK, an eTLM costs three AES blocks, against a key expansion and seven
+    blocks with cifra's EAX (counted by tests/host/crypto_benchmark). Still, the next eTLM of every EIK pairing is
+    encrypted in the background by the TLM manager (see @ref eddystone_tlm_manager_etlm_precompute), so an eTLM is
+    scheduled like any other frame.*/
 
-    bool etlm_required = false;
-    uint8_t no_of_eid_slots = eddystone_adv_slot_num_of_current_eids(NULL, &etlm_required);
+    uint8_t no_of_configured_slots = eddystone_adv_slot_num_of_configured_slots(configured_slots);
+    uint8_t no_of_eid_slots = eddystone_adv_slot_num_of_current_eids(eid_positions, &etlm_required);
 
-    /*Buffers to hardcode a small shortening of the intervals just in case of any delays
-    between all the running timer interrupts (scheduled to main context) + variance in encyrption time
-    of eTLMs so that all slots have enough time to advertise before the next advertising interval comes around*/
+    eddystone_adv_timing_reset();
 
-    const uint8_t etlm_dist_buffer_ms = 25;
-    const uint8_t slot_dist_buffer_ms = 25;
+    DEBUG_PRINTF(0,"Number of Configured Slots: %d \r\n", no_of_configured_slots);
 
-    /**@note From internal testing we can see that eTLM encryption takes about ~170 ms on the NRF52.
-    Which means that the delay after the timer interrupt fires to advertise and the actual eTLM advertisement is ~170 ms,
-    this is a significant limiting factor for the minimum advertising interval.
+    m_schedule.num_of_entries = 0;
+    m_schedule.next_entry     = 0;
+    m_schedule.last_adv       = start;
 
-    Please read the comments above @ref timers_init to see what is the current scheme of
-    advertising timing before continuing.
+    for (uint8_t i = 0; i < APP_MAX_ADV_SLOTS; i++)
+    {
+        //Nothing achieved until the slot is scheduled
+        eddystone_adv_slot_adv_intrvl_achieved_set(i, 0);
+    }
 
-    Thus if there N EIDs configured (N > 0) in the beacon and at least 1 TLM configured, then the TLM frame auto switches
-    to eTLM and cycles through the set of EIKs of the EIDs frames and advertises N eTLM frames, all within one slot interval,
-    each encrypted with the EIK of one of the EID slots. Hence there must be enough time alotted in 1 slot interval for N*(~170 ms + buffer).
-     */
+    for (uint8_t i = 0; i < no_of_configured_slots; i++)
+    {
+        eddystone_adv_slot_params_get(configured_slots[i], &adv_slot_params);
 
-     /*Minimum interval between two eTLM advertisements (2+ EIDs) in one eTLM slot in ms*/
-     const uint16_t ETLM_INTERVAL_LIMIT = 225;  /*MUST be > ~170 ms + etlm_dist_buffer_ms */
+        //Can happen when flash R/W for storing/loading slot configs did not behave as expected
+        if (adv_slot_params.adv_intrvl == 0)
+        {
+            adv_slot_params.adv_intrvl = APP_CFG_NON_CONN_ADV_INTERVAL_MS;
+        }
 
-    /*Minimum interval between two slots in ms.
-     If eTLM is required then SLOT_INTERVAL_LIMIT becomes just the first half of the sum,
-     else the second half (MIN_NON_CONN_ADV_INTERVAL) since there is no significant real-time encrytion delays*/
-    const uint16_t SLOT_INTERVAL_LIMIT = (no_of_eid_slots*ETLM_INTERVAL_LIMIT)*(uint8_t)(etlm_required)
-                                          + MIN_NON_CONN_ADV_INTERVAL*((uint8_t)(!etlm_required));
+        bool    is_etlm_slot       = (adv_slot_params.frame_type == EDDYSTONE_FRAME_TYPE_TLM && etlm_required);
+        uint8_t no_of_slot_entries = is_etlm_slot ? no_of_eid_slots : 1;
 
-    DEBUG_PRINTF(0,"SLOT_INTERVAL_LIMIT: %d \r\n", SLOT_INTERVAL_LIMIT);
-    //See if any slot is configured at all
-    uint8_t no_of_currently_configed_slots = eddystone_adv_slot_num_of_configured_slots(m_currently_configured_slots);
-    DEBUG_PRINTF(0,"Number of Configured Slots: %d \r\n", no_of_currently_configed_slots);
+        for (uint8_t j = 0; j < no_of_slot_entries; j++)
+        {
+            eddystone_adv_schedule_entry_t * p_entry = &m_schedule.entries[m_schedule.num_of_entries];
 
-    //Gets slot 0's advertising interval since only global advertising interval is supported currently
-    eddystone_adv_slot_params_t adv_slot_0_params;
-    eddystone_adv_slot_params_get(0, &adv_slot_0_params);
-    m_intervals.adv_intrvl = adv_slot_0_params.adv_intrvl;
+            p_entry->slot_no       = configured_slots[i];
+            p_entry->period_ms     = adv_slot_params.adv_intrvl;
+            p_entry->eik_pair_slot = is_etlm_slot ? eid_positions[j] : ADV_SCHEDULE_NO_EIK_PAIR;
 
-    //Can happen when flash R/W for storing/loading slot configs did not behave as expected
-    //which can crash the app_timer_start
-    //TODO: might need a better error handling strategy for this...
-    if (m_intervals.adv_intrvl == 0)
-    {
-        m_intervals.adv_intrvl = 1000;
+            if (is_etlm_slot)
+            {
+                //The EIK may have changed with the configuration, start over
+                eddystone_tlm_manager_etlm_precompute(p_entry->eik_pair_slot);
+            }
+
+            utilization += ((uint32_t)ADV_SCHEDULE_MIN_SPACING_MS * 1000) / p_entry->period_ms;
+            m_schedule.num_of_entries++;
+        }
     }
 
-    if (no_of_currently_configed_slots == 0)
+#if APP_CONNECTABLE_ADV_INTERLEAVED
+    if (m_is_connectable_adv)
     {
-        m_intervals.slot_slot_interval = 0;
-        m_intervals.etlm_etlm_interval = 0;
+        eddystone_adv_schedule_entry_t * p_entry = &m_schedule.entries[m_schedule.num_of_entries];
+
+        p_entry->slot_no       = ADV_SCHEDULE_CONNECTABLE_SLOT;
+        p_entry->period_ms     = APP_CFG_CONNECTABLE_ADV_INTERVAL_MS;
+        p_entry->eik_pair_slot = ADV_SCHEDULE_NO_EIK_PAIR;
+
+        utilization += ((uint32_t)ADV_SCHEDULE_MIN_SPACING_MS * 1000) / p_entry->period_ms;
+        m_schedule.num_of_entries++;
     }
-    else
+#endif
+
+    DEBUG_PRINTF(0,"Schedule utilization: %d permille \r\n", utilization);
+
+    for (uint8_t k = 0; k < m_schedule.num_of_entries; k++)
     {
-        //Slot-Slot Interval
-        m_intervals.slot_slot_interval = (m_intervals.adv_intrvl/(no_of_currently_configed_slots)) - slot_dist_buffer_ms;
-        if (m_intervals.slot_slot_interval < SLOT_INTERVAL_LIMIT)
+        eddystone_adv_schedule_entry_t * p_entry = &m_schedule.entries[k];
+
+        //Stretch the intervals if the configured ones cannot all be met
+        if (utilization > 1000)
         {
-            ble_ecs_adv_intrvl_t adjusted_interval = (SLOT_INTERVAL_LIMIT + slot_dist_buffer_ms)*no_of_currently_configed_slots;
-            m_intervals.adv_intrvl = adjusted_interval;
-
-            DEBUG_PRINTF(0,"1 - ADV INTERVAL ADJUSTED BY ADV MGR: %d \r\n", adjusted_interval);
-            adjusted_interval = BYTES_SWAP_16BIT(adjusted_interval);
-            eddystone_adv_slot_adv_intrvl_set(0, &adjusted_interval, true);
-            m_intervals.slot_slot_interval = m_intervals.adv_intrvl/no_of_currently_configed_slots - slot_dist_buffer_ms;
-            DEBUG_PRINTF(0,"Slot-Slot Interval: %d \r\n", m_intervals.slot_slot_interval );
+            uint32_t stretched_ms = CEIL_DIV((uint32_t)p_entry->period_ms * utilization, 1000);
+            p_entry->period_ms = (stretched_ms > MAX_ADV_INTERVAL) ? MAX_ADV_INTERVAL : stretched_ms;
         }
 
-        //eTLM-eTLM interval
-        if (no_of_eid_slots != 0 && etlm_required == true)
+        p_entry->period_ticks  = APP_TIMER_TICKS(p_entry->period_ms, APP_TIMER_PRESCALER);
+        //Spread the first deadlines so entries with equal intervals do not all collide
+        p_entry->next_deadline = start + (p_entry->period_ticks * k) / m_schedule.num_of_entries;
+
+        if (p_entry->slot_no != ADV_SCHEDULE_CONNECTABLE_SLOT)
         {
-            m_intervals.etlm_etlm_interval = (m_intervals.slot_slot_interval/no_of_eid_slots) - etlm_dist_buffer_ms;
+            eddystone_adv_slot_adv_intrvl_achieved_set(p_entry->slot_no, p_entry->period_ms);
+        }
+        DEBUG_PRINTF(0,"Slot [%d] - interval: %d ms \r\n", p_entry->slot_no, p_entry->period_ms);
 
-            if (m_intervals.etlm_etlm_interval < ETLM_INTERVAL_LIMIT)
-            {
-                m_intervals.etlm_etlm_interval = ETLM_INTERVAL_LIMIT;
-                m_intervals.slot_slot_interval = (m_intervals.etlm_etlm_interval + etlm_dist_buffer_ms)*no_of_eid_slots - slot_dist_buffer_ms;
+        adv_rate += 1000000UL / p_entry->period_ms;
+    }
 
-                ble_ecs_adv_intrvl_t adjusted_interval = (m_intervals.slot_slot_interval + slot_dist_buffer_ms)*no_of_currently_configed_slots;
-                m_intervals.adv_intrvl = adjusted_interval;
+    //The harmonic combination of all the intervals: the average spacing of the deadlines
+    m_schedule.base_interval_ms = (adv_rate == 0) ? MAX_ADV_INTERVAL : (1000000UL / adv_rate);
+    if (m_schedule.base_interval_ms < ADV_SCHEDULE_MIN_SPACING_MS)
+    {
+        m_schedule.base_interval_ms = ADV_SCHEDULE_MIN_SPACING_MS;
+    }
+    else if (m_schedule.base_interval_ms > MAX_ADV_INTERVAL)
+    {
+        m_schedule.base_interval_ms = MAX_ADV_INTERVAL;
+    }
+}
 
-                DEBUG_PRINTF(0,"2 - ADV INTERVAL ADJUSTED BY ADV MGR: %d \r\n", adjusted_interval);
-                adjusted_interval = BYTES_SWAP_16BIT(adjusted_interval);
-                eddystone_adv_slot_adv_intrvl_set(0, &adjusted_interval, true);
+/**@brief Function for finding the schedule entry with the earliest deadline
+ * @param[in]   now                     current RTC counter value
+ * @param[out]  p_ticks_to_deadline     ticks from now until the entry's deadline, negative if it has passed
+ * @retval      the index of the entry
+ */
+static uint8_t adv_schedule_earliest_entry_get(uint32_t now, int32_t * p_ticks_to_deadline)
+{
+    uint8_t earliest = 0;
+    int32_t ticks_to_deadline;
 
-                DEBUG_PRINTF(0,"eTLM-eTLM Interval: %d \r\n", m_intervals.etlm_etlm_interval );
-                DEBUG_PRINTF(0,"Slot-Slot Interval: %d \r\n", m_intervals.slot_slot_interval );
-            }
-        }
-        else
+    *p_ticks_to_deadline = INT32_MAX;
+    for (uint8_t k = 0; k < m_schedule.num_of_entries; k++)
+    {
+        ticks_to_deadline = ticks_until(m_schedule.entries[k].next_deadline, now);
+        if (ticks_to_deadline < *p_ticks_to_deadline)
         {
-            m_intervals.etlm_etlm_interval = 0;
+            *p_ticks_to_deadline = ticks_to_deadline;
+            earliest             = k;
         }
     }
+    return earliest;
 }
 
-/**@brief Function for updating the etlm_cycle_timer
- * @param[in] slot_no    the slot index of the current eTLM slot
+/**@brief Function for moving an entry to its next deadline after it has been advertised
+ * @param[in] p_entry    pointer to the schedule entry that was advertised
+ * @param[in] now        current RTC counter value
  */
-static void etlm_cycle_timer_start(uint8_t slot_no)
+static void adv_schedule_entry_advance(eddystone_adv_schedule_entry_t * p_entry, uint32_t now)
 {
-    ret_code_t err_code;
-    m_temporary_slot_no = slot_no;
-    if (m_intervals.etlm_etlm_interval != 0)
+    p_entry->next_deadline += p_entry->period_ticks;
+
+    //If a whole interval has been missed (e.g. long flash or crypto operation), resynchronize the entry
+    //instead of trying to catch up on every missed advertisement
+    if (ticks_until(p_entry->next_deadline, now) < 0)
     {
-        err_code = app_timer_start(m_eddystone_etlm_cycle_timer, APP_TIMER_TICKS(m_intervals.etlm_etlm_interval, APP_TIMER_PRESCALER), NULL);
-        APP_ERROR_CHECK(err_code);
+        p_entry->next_deadline = now + p_entry->period_ticks;
     }
 }
 
-/**@brief Function for advertising an eTLM frame
- * @param[in] slot_no    the slot index of the current eTLM slot
+/**@brief Function for arming the schedule timer for the entry with the earliest deadline
+ * @details Two advertisements are never scheduled closer than ADV_SCHEDULE_MIN_SPACING_MS apart, a colliding
+ *          entry is delayed but keeps its nominal deadlines. If the deadline has already passed, the timer is armed
+ *          with the shortest possible timeout so the entry goes on air as soon as possible.
  */
-static void etlm_adv(uint8_t slot_no)
+static void adv_schedule_timer_start(void)
 {
-    DEBUG_PRINTF(0,"eTLM-EIK [%d] \r\n", m_etlm_adv_counter.eid_positions[m_etlm_adv_counter.eid_slot_counter]);
-    advertising_init(slot_no);
-    eddystone_ble_advertising_start(EDDYSTONE_BLE_ADV_CONNECTABLE_FALSE);
-    //Increment the eid-pair counter so the eTLM frame can be paired with the next EID frame.
-    m_etlm_adv_counter.eid_slot_counter++;
-}
+    ret_code_t err_code;
+    uint32_t   now;
+    int32_t    ticks_to_earliest;
+    int32_t    ticks_to_spacing;
 
-/**@brief Timeout handler for the etlm_cycle_timer*/
-static void etlm_cycle_timeout(void * p_context)
-{
-    sd_ble_gap_adv_stop();
+    if (m_schedule.num_of_entries == 0)
+    {
+        //Nothing to advertise, keep checking for a committed slot configuration
+        err_code = app_timer_start(m_eddystone_adv_schedule_timer,
+                                   APP_TIMER_TICKS(ADV_SCHEDULE_IDLE_POLL_MS, APP_TIMER_PRESCALER),
+                                   NULL);
+        APP_ERROR_CHECK(err_code);
+        return;
+    }
+
+    err_code = app_timer_cnt_get(&now);
+    APP_ERROR_CHECK(err_code);
+
+    m_schedule.next_entry = adv_schedule_earliest_entry_get(now, &ticks_to_earliest);
 
-    if (m_etlm_adv_counter.eid_slot_counter >= eddystone_adv_slot_num_of_current_eids(NULL, NULL))
+    ticks_to_spacing = ticks_until(m_schedule.last_adv + APP_TIMER_TICKS(ADV_SCHEDULE_MIN_SPACING_MS, APP_TIMER_PRESCALER), now);
+    if (ticks_to_spacing > ticks_to_earliest)
     {
-        m_etlm_adv_counter.eid_slot_counter = 0;
-        app_timer_stop(m_eddystone_etlm_cycle_timer);
+        ticks_to_earliest = ticks_to_spacing;
     }
-    else
+
+    if (ticks_to_earliest < APP_TIMER_MIN_TIMEOUT_TICKS)
     {
-        etlm_adv(m_temporary_slot_no);
-        //this will incremement eid_slot_counter
+        ticks_to_earliest = APP_TIMER_MIN_TIMEOUT_TICKS;
     }
+
+    err_code = app_timer_start(m_eddystone_adv_schedule_timer, (uint32_t)ticks_to_earliest, NULL);
+    APP_ERROR_CHECK(err_code);
 }
 
-/**@brief Timeout handler for the adv_slot_timer*/
-static void adv_slot_timeout(void * p_context)
+/**@brief Function for advertising one entry of the schedule
+ * @param[in] p_entry    pointer to the schedule entry to advertise
+ */
+static void adv_schedule_entry_advertise(eddystone_adv_schedule_entry_t const * p_entry)
 {
-    static uint8_t slot_counter = 0;
-    uint8_t slot_no = m_currently_configured_slots[slot_counter];
+    ret_code_t err_code;
 
-    m_etlm_adv_counter.eid_slot_counter = 0;
+    sd_ble_gap_adv_stop();
 
-    if(slot_no != 0xFF)
+    static uint8_t tick_tock = 0;
+    tick_tock++;
+    if (tick_tock % 2 == 0)
     {
-    sd_ble_gap_adv_stop();
+        LEDS_ON(1<<LED_1);
+    }
+    else
+    {
+        LEDS_OFF(1<<LED_1);
+    }
 
-        static uint8_t tick_tock = 0;
-        tick_tock++;
-        if (tick_tock % 2 == 0)
+#if APP_CONNECTABLE_ADV_INTERLEAVED
+    if (p_entry->slot_no == ADV_SCHEDULE_CONNECTABLE_SLOT)
+    {
+        DEBUG_PRINTF(0,"Connectable pseudo-slot \r\n",0);
+        err_code = sd_ble_gap_adv_data_set(m_conn_adv_data, m_conn_adv_data_len, m_conn_scrsp_data, m_conn_scrsp_data_len);
+        APP_ERROR_CHECK(err_code);
+        err_code = sd_ble_gap_adv_start(&m_conn_adv_params);
+        if (err_code != NRF_ERROR_BUSY && err_code != NRF_SUCCESS)
         {
-            LEDS_ON(1<<LED_1);
+            APP_ERROR_CHECK(err_code);
         }
-        else
+        return;
+    }
+#else
+    UNUSED_VARIABLE(err_code);
+#endif
+
+    //Unconfigured slots have no advertising data, see @ref advertising_init
+    if (APP_CONNECTABLE_ADV_INTERLEAVED || !m_is_connectable_adv)
+    {
+        DEBUG_PRINTF(0,"Slot [%d] - eTLM-EIK [%d] \r\n", p_entry->slot_no, p_entry->eik_pair_slot);
+
+        if (advertising_init(p_entry->slot_no, p_entry->eik_pair_slot) == NRF_SUCCESS)
         {
-            LEDS_OFF(1<<LED_1);
+            non_conn_adv_params_set(p_entry->period_ms);
+            eddystone_adv_timing_record(p_entry->slot_no, p_entry->next_deadline);
+            eddystone_ble_advertising_start(EDDYSTONE_BLE_ADV_CONNECTABLE_FALSE);
         }
+    }
+}
 
-        eddystone_adv_slot_params_t adv_slot_params;
-        eddystone_adv_slot_params_get(slot_no, &adv_slot_params);
+/**@brief Timeout handler for the adv_schedule_timer*/
+static void adv_schedule_timeout(void * p_context)
+{
+    ret_code_t                       err_code;
+    uint32_t                         now;
+    eddystone_adv_schedule_entry_t * p_entry = &m_schedule.entries[m_schedule.next_entry];
 
-        if (eddystone_adv_slot_is_configured(slot_no) && !m_is_connectable_adv)
-        {
-            DEBUG_PRINTF(0,"Slot [%d] - frame type: 0x%02x \r\n", slot_no, adv_slot_params.frame_type);
+    err_code = app_timer_cnt_get(&now);
+    APP_ERROR_CHECK(err_code);
 
-            if ((adv_slot_params.frame_type == EDDYSTONE_FRAME_TYPE_TLM)
-                && eddystone_adv_slot_num_of_current_eids(m_etlm_adv_counter.eid_positions, NULL) != 0)
-            {
-                etlm_cycle_timer_start(slot_no);
-                etlm_cycle_timeout(NULL);
-                //Trigger a timeout to advertisie right away
-            }
-            else
-            {
-                //Regular TLM slot
-                advertising_init(slot_no);
-                eddystone_ble_advertising_start(EDDYSTONE_BLE_ADV_CONNECTABLE_FALSE);
-            }
+#if APP_ADV_USE_RADIO_NOTIFICATION
+    //Only used to delay the start of advertising, see @ref slots_advertising_start_delayed
+    UNUSED_VARIABLE(p_entry);
+    UNUSED_VARIABLE(err_code);
+    UNUSED_VARIABLE(now);
+    slots_advertising_start();
+#else
+    //Schedule boundary: pick up the staged slot configuration
+    if (eddystone_adv_slot_commit())
+    {
+        //The slot layout or the intervals changed, reschedule from here on. Advertising carries on meanwhile.
+        adv_schedule_build(now);
+        m_schedule.next_entry = 0;
+        p_entry = &m_schedule.entries[0];
+    }
+
+    if (m_schedule.num_of_entries == 0)
+    {
+        sd_ble_gap_adv_stop();
+        adv_schedule_timer_start();
+        return;
+    }
+
+#if APP_CONNECTABLE_ADV_INTERLEAVED
+    if (p_entry->slot_no == ADV_SCHEDULE_CONNECTABLE_SLOT &&
+        APP_CFG_CONNECTABLE_ADV_TIMEOUT != 0 &&
+        ticks_until(m_conn_adv_end, now) <= 0)
+    {
+        //Same as when the stack times out connectable advertising, the schedule is rebuilt without the pseudo-slot
+        DEBUG_PRINTF(0,"Connectable ADV ended \r\n",0);
+        bsp_indication_set(BSP_INDICATE_IDLE);
+        LEDS_OFF(1<<LED_3);
+        m_is_connectable_adv = false;
+        slots_advertising_start();
+        return;
+    }
+#endif
+    adv_schedule_entry_advertise(p_entry);
+    m_schedule.last_adv = now;
+
+    adv_schedule_entry_advance(p_entry, now);
+    adv_schedule_timer_start();
+#endif
+}
+
+#if APP_ADV_USE_RADIO_NOTIFICATION
+/**@brief Function for preparing the advertising data of the entry with the earliest deadline
+ * @details Runs in main context. The data is published to the radio notification interrupt through m_rn_payload_ready.
+ */
+static void rn_payload_prepare(void)
+{
+    ret_code_t                  err_code;
+    uint32_t                    now;
+    int32_t                     ticks_to_deadline;
+    eddystone_adv_slot_params_t adv_slot_params;
 
+    if (!m_rn_active || m_rn_payload_ready || m_schedule.num_of_entries == 0)
+    {
+        return;
+    }
+
+    err_code = app_timer_cnt_get(&now);
+    APP_ERROR_CHECK(err_code);
+
+    //Skip entries that have nothing to advertise (e.g. EID not generated yet)
+    for (uint8_t i = 0; i < m_schedule.num_of_entries; i++)
+    {
+        eddystone_adv_schedule_entry_t * p_entry = &m_schedule.entries[adv_schedule_earliest_entry_get(now, &ticks_to_deadline)];
+        m_rn_payload.slot_no  = p_entry->slot_no;
+        m_rn_payload.deadline = p_entry->next_deadline;
+        adv_schedule_entry_advance(p_entry, now);
+
+        if (adv_payload_get(p_entry->slot_no, p_entry->eik_pair_slot, &adv_slot_params) == NRF_SUCCESS)
+        {
+            memcpy(m_rn_payload.data, adv_slot_params.p_encoded_adv_data->data, adv_slot_params.p_encoded_adv_data->length);
+            m_rn_payload.length       = adv_slot_params.p_encoded_adv_data->length;
+            m_rn_payload.radio_tx_pwr = adv_slot_params.radio_tx_pwr;
+            m_rn_payload_ready        = true;
+
+            eddystone_tlm_manager_adv_cnt_add(1);
+            DEBUG_PRINTF(0,"Slot [%d] - eTLM-EIK [%d] prepared \r\n", p_entry->slot_no, p_entry->eik_pair_slot);
+            return;
         }
     }
-    slot_counter++;
-    if (slot_counter >= eddystone_adv_slot_num_of_configured_slots(m_currently_configured_slots))
+}
+
+/**@brief scheduler event to prepare the next payload after the previous one has been handed to the stack*/
+static void rn_payload_prepare_scheduler_evt(void * p_event_data, uint16_t event_size)
+{
+    //Payload boundary: pick up the staged slot configuration
+    if (eddystone_adv_slot_commit())
     {
-        DEBUG_PRINTF(0,"End of Slots: \r\n");
-        slot_counter = 0;
+        //A single advertiser runs at the base interval of the schedule, so a new layout needs a restart
+        slots_advertising_start();
+        return;
     }
-    else
+    rn_payload_prepare();
+}
+
+/**@brief Radio notification interrupt handler, called when the radio goes inactive
+ * @details The advertiser is never stopped in this mode. Right after an advertising event completes, the
+ *          prepared payload is handed to the stack so it goes on air in the next advertising event.
+ *          Radio notifications also come after connection events, those that come sooner after the last swap than
+ *          an advertising event could are ignored.
+ */
+void SWI1_EGU1_IRQHandler(void)
+{
+    uint32_t now;
+    uint32_t ticks_since_last_swap;
+
+    if (!m_rn_active)
     {
-        adv_slot_timer_start();
+        return;
     }
+
+    UNUSED_VARIABLE(app_timer_cnt_get(&now));
+    UNUSED_VARIABLE(app_timer_cnt_diff_compute(now, m_rn_last_swap, &ticks_since_last_swap));
+    if (ticks_since_last_swap < m_rn_min_swap_ticks)
+    {
+        return;
+    }
+    m_rn_last_swap = now;
+
+    if (m_rn_payload_ready)
+    {
+        UNUSED_VARIABLE(sd_ble_gap_tx_power_set(m_rn_payload.radio_tx_pwr));
+        UNUSED_VARIABLE(sd_ble_gap_adv_data_set(m_rn_payload.data, m_rn_payload.length, NULL, 0));
+        //Recorded at the swap, the payload goes on air in the following advertising event
+        eddystone_adv_timing_record(m_rn_payload.slot_no, m_rn_payload.deadline);
+        m_rn_payload_ready = false;
+    }
+
+    UNUSED_VARIABLE(app_sched_event_put(NULL, 0, rn_payload_prepare_scheduler_evt));
 }
 
-/**@brief Function for starting the adv_slot_timer with the updated interval*/
-static void adv_slot_timer_start(void)
+/**@brief Function for starting the single, continuously running advertiser of the radio notification mode*/
+static void rn_advertising_start(void)
 {
     ret_code_t err_code;
-    if (m_intervals.slot_slot_interval != 0)
+
+    m_rn_active        = true;
+    m_rn_payload_ready = false;
+    rn_payload_prepare();
+
+    if (!m_rn_payload_ready)
     {
-        err_code = app_timer_start(m_eddystone_adv_slot_timer,APP_TIMER_TICKS(m_intervals.slot_slot_interval,APP_TIMER_PRESCALER), NULL);
+        //Nothing to advertise yet, check back for a committed configuration or a generated EID
+        m_rn_active = false;
+        err_code = app_timer_start(m_eddystone_adv_schedule_timer,
+                                   APP_TIMER_TICKS(ADV_SCHEDULE_IDLE_POLL_MS, APP_TIMER_PRESCALER),
+                                   NULL);
         APP_ERROR_CHECK(err_code);
+        return;
+    }
+
+    //The first payload goes to the stack directly, the following ones after each advertising event
+    m_rn_active = false;
+    err_code = sd_ble_gap_tx_power_set(m_rn_payload.radio_tx_pwr);
+    APP_ERROR_CHECK(err_code);
+    err_code = sd_ble_gap_adv_data_set(m_rn_payload.data, m_rn_payload.length, NULL, 0);
+    APP_ERROR_CHECK(err_code);
+    m_rn_payload_ready = false;
+
+    m_rn_min_swap_ticks = (APP_TIMER_TICKS(m_schedule.base_interval_ms, APP_TIMER_PRESCALER) * 3) / 4;
+    err_code = app_timer_cnt_get(&m_rn_last_swap);
+    APP_ERROR_CHECK(err_code);
+
+    non_conn_adv_params_set(m_schedule.base_interval_ms);
+    if (!m_is_connectable_adv)
+    {
+        sd_ble_gap_adv_stop();
+        eddystone_ble_advertising_start(EDDYSTONE_BLE_ADV_CONNECTABLE_FALSE);
+        m_rn_active = true;
+        rn_payload_prepare();
     }
 }
 
-/**@brief Timeout handler for the adv_interval_timer*/
-static void adv_interval_timeout(void * p_context)
+/**@brief Function for enabling the radio notification used to swap the advertising data*/
+static void radio_notification_init(void)
 {
-    m_etlm_adv_counter.eid_slot_counter = 0;
-    slots_advertising_start();
+    ret_code_t err_code;
+
+    err_code = sd_nvic_ClearPendingIRQ(SWI1_EGU1_IRQn);
+    APP_ERROR_CHECK(err_code);
+    err_code = sd_nvic_SetPriority(SWI1_EGU1_IRQn, APP_IRQ_PRIORITY_LOW);
+    APP_ERROR_CHECK(err_code);
+    err_code = sd_nvic_EnableIRQ(SWI1_EGU1_IRQn);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = sd_radio_notification_cfg_set(NRF_RADIO_NOTIFICATION_TYPE_INT_ON_INACTIVE,
+                                             NRF_RADIO_NOTIFICATION_DISTANCE_NONE);
+    APP_ERROR_CHECK(err_code);
 }
+#endif
 
 /**@brief Function for starting to advertise all slots with timer interval control */
 static void slots_advertising_start(void)
 {
-    adv_interval_timer_start(); //this must start first, since it calculates parameters that the adv_slot_timer depends on
-    adv_slot_timeout(NULL);     //Spoof a timeout right away so the actual advertising can begin immediately
+    ret_code_t err_code;
+    uint32_t   now;
+
+    app_timer_stop(m_eddystone_adv_schedule_timer);
+    err_code = app_timer_cnt_get(&now);
+    APP_ERROR_CHECK(err_code);
+    UNUSED_VARIABLE(eddystone_adv_slot_commit());
+    adv_schedule_build(now);
+
+#if APP_ADV_USE_RADIO_NOTIFICATION
+    rn_advertising_start();
+#else
+    m_schedule.next_entry = 0;
+    adv_schedule_timeout(NULL);  //Spoof a timeout right away so the actual advertising can begin immediately
+#endif
+}
+
+/**@brief Function for starting to advertise all slots one (shortest) advertising interval from now */
+static void slots_advertising_start_delayed(void)
+{
+    ret_code_t err_code;
+    uint32_t   now;
+    uint32_t   delay = 0;
+
+    app_timer_stop(m_eddystone_adv_schedule_timer);
+    err_code = app_timer_cnt_get(&now);
+    APP_ERROR_CHECK(err_code);
+    UNUSED_VARIABLE(eddystone_adv_slot_commit());
+    adv_schedule_build(now);
+
+    for (uint8_t k = 0; k < m_schedule.num_of_entries; k++)
+    {
+        if (delay == 0 || m_schedule.entries[k].period_ticks < delay)
+        {
+            delay = m_schedule.entries[k].period_ticks;
+        }
+    }
+    for (uint8_t k = 0; k < m_schedule.num_of_entries; k++)
+    {
+        m_schedule.entries[k].next_deadline += delay;
+    }
+
+    adv_schedule_timer_start();
 }
 
 /**@brief Function for initializing all required timers
- * @details The timer structure is illustrated below
- *          |-----------------------------|-----------------------------|  m_eddystone_adv_interval_timer (corresponds to the global advertising interval set in the slot)
- *          eTLM-----EID1-----EID2        eTLM-----EID1-----EID2           m_eddystone_adv_slot_timer (slot interval is the division of the advertising interval by the no. of slots configured)
- *          EIK1-EIK2                     EIK1-EIK2                        m_eddystone_etlm_cycle_timer (Cycles through each existing EID's EIK and pairs it with the eTLM)
+ * @details A single timer is re-armed to the earliest deadline of the advertising schedule.
+ *          Every slot advertises at its own interval, an eTLM slot cycles through the EIKs of the EIDs, e.g.:
+ *          UID  |-----------------------------------|-----------------------------------|     (10 s)
+ *          URL  |-----|-----|-----|-----|-----|-----|-----|-----|-----|-----|-----|-----|     (300 ms)
+ *          eTLM |-----------EIK1-------EIK2-----------EIK1-------EIK2-----------EIK1---|     (one entry per EIK)
  */
 static void timers_init(void)
 {
     ret_code_t err_code;
 
-    //SINGLE SHOT because the advertising interval might be changed by the user, so the timer
-    //needs to be restarted every time with the latest interval after a timeout
-    err_code = app_timer_create(&m_eddystone_adv_interval_timer,
+    //SINGLE SHOT because every deadline in the schedule is armed individually
+    err_code = app_timer_create(&m_eddystone_adv_schedule_timer,
                      APP_TIMER_MODE_SINGLE_SHOT,
-                     adv_interval_timeout);
-    APP_ERROR_CHECK(err_code);
-
-    err_code = app_timer_create(&m_eddystone_adv_slot_timer,
-                     APP_TIMER_MODE_SINGLE_SHOT,
-                     adv_slot_timeout);
-    APP_ERROR_CHECK(err_code);
-
-    err_code = app_timer_create(&m_eddystone_etlm_cycle_timer,
-                     APP_TIMER_MODE_REPEATED,
-                     etlm_cycle_timeout);
+                     adv_schedule_timeout);
     APP_ERROR_CHECK(err_code);
 }
 
@@ -576,8 +934,11 @@ void eddystone_advertising_manager_init( uint8_t ecs_uuid_type )
     APP_ERROR_CHECK(err_code);
     timers_init();
 
-    m_etlm_adv_counter.eid_slot_counter = 0;
-    memset(m_etlm_adv_counter.eid_positions, 0xFF, sizeof(m_etlm_adv_counter.eid_positions));
+    memset(&m_schedule, 0, sizeof(m_schedule));
+
+#if APP_ADV_USE_RADIO_NOTIFICATION
+    radio_notification_init();
+#endif
 
     err_code = eddystone_tlm_manager_init();
     APP_ERROR_CHECK(err_code);
@@ -14,6 +14,7 @@
 #include "eddystone_app_config.h"
 #include "eddystone_adv_slot.h"
 #include "eddystone_security.h"
+#include "eddystone_rng.h"
 #include "eddystone_registration_ui.h"
 #include "pstorage.h"
 #include "pstorage_platform.h"
@@ -21,6 +22,8 @@
 #include "debug_config.h"
 #include "ble_ecs.h"
 #include "eddystone_advertising_manager.h"
+#include "eddystone_adv_timing.h"
+#include "app_timer.h"
 
 #ifdef BLE_HANDLER_DEBUG
     #include "SEGGER_RTT.h"
@@ -31,7 +34,27 @@
 
 static ble_ecs_t            m_ble_ecs;                                    /**< Struct identifying the Eddystone Config Service. */
 static uint16_t             m_conn_handle = BLE_CONN_HANDLE_INVALID;      /**< The current connection handle. */
+
+#define BOOT_TIMEOUT            APP_TIMER_TICKS(5000, APP_TIMER_PRESCALER)              /**< Time the restore from flash may take before the boot is considered stalled */
+#define BOOT_TIME_TIMER         NRF_TIMER2                                              /**< Counts the time to the first advertisement, TIMER0 is the SoftDevice's */
+#define BOOT_TIME_PRESCALER     4                                                       /**< 16 MHz / 2^4, the boot time timer counts microseconds */
+
+/**@brief Boot states, from the start of the services init up to the first advertisement*/
+typedef enum
+{
+    BOOT_STATE_SECURITY,        /**< the lock code and ECDH key pair are read from flash */
+    BOOT_STATE_SLOTS,           /**< the slot configs are parsed in place from flash */
+    BOOT_STATE_ADVERTISING      /**< advertising has started */
+} boot_state_t;
+
+static boot_state_t         m_boot_state;
+static ble_ecs_init_t *     m_p_ecs_init;                                 /**< Initial characteristic values the slots are set up with. */
+static uint32_t             m_boot_time_us;                               /**< Microseconds from the start of the BLE init to the first advertisement. */
+
+APP_TIMER_DEF(m_boot_timer);
+
 //Forward Declartions:
+static void boot_state_enter(boot_state_t state);
 static ble_ecs_lock_state_read_t ble_eddystone_is_unlocked(void);
 static void ble_eddystone_lock_beacon(void);
 static void reset_active_slot(void);
@@ -56,27 +79,8 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
         case BLE_GAP_EVT_DISCONNECTED:
             m_conn_handle = BLE_CONN_HANDLE_INVALID;
             DEBUG_PRINTF(0,"Disconnected! \r\n",0);
-            //Writing all slot configs to NVM
-            eddystone_flash_flags_t flash_flag;
-            memset(&flash_flag, 0, sizeof(eddystone_flash_flags_t));
-
-            for (uint8_t i = 0; i < APP_MAX_ADV_SLOTS; i++)
-            {
-                eddystone_adv_slot_write_to_flash(i);
-
-                if (eddystone_adv_slot_is_configured(i))
-                {
-                    flash_flag.slot_is_empty[i] = false;
-                    DEBUG_PRINTF(0,"Slot [%d] Non-empty! \r\n",i);
-                }
-                else
-                {
-                    flash_flag.slot_is_empty[i] = true;
-                }
-            }
-            flash_flag.factory_state = false;
-            err_code = eddystone_flash_access_flags(&flash_flag, EDDYSTONE_FLASH_ACCESS_WRITE);
-            APP_ERROR_CHECK(err_code);
+            //Writing the slot configs changed in this connection to NVM
+            eddystone_adv_slots_persist();
 
             switch (ble_eddystone_is_unlocked())
             {
@@ -140,6 +144,8 @@ static void sys_evt_dispatch(uint32_t evt_id)
     {
         pstorage_sys_event_handler(evt_id);
     }
+
+    eddystone_rng_on_sys_evt(evt_id);
 }
 
 /**@brief Function for initializing the BLE stack.
@@ -366,7 +372,6 @@ static void ble_eddystone_security_cb(uint8_t slot_no,
     ble_gap_addr_t new_address;
     new_address.addr_type = BLE_GAP_ADDR_TYPE_PUBLIC;
 
-    uint8_t  bytes_available;
     const uint8_t ADDR_SIZE = 6;
 
     switch (msg_type)
@@ -386,16 +391,16 @@ static void ble_eddystone_security_cb(uint8_t slot_no,
             eddystone_adv_slot_eid_ready(slot_no);
             #ifdef RANDOMIZE_MAC
             //Randomize the MAC address on every EID generation
-            sd_rand_application_bytes_available_get(&bytes_available);
-            while (bytes_available < ADDR_SIZE)
+            if (eddystone_rng_bytes_get(new_address.addr, ADDR_SIZE) == NRF_SUCCESS)
             {
-               //wait for SD to acquire enough RNs
-               sd_rand_application_bytes_available_get(&bytes_available);
+                err_code = sd_ble_gap_address_set(BLE_GAP_ADDR_CYCLE_MODE_NONE, &new_address);
+                APP_ERROR_CHECK(err_code);
+            }
+            else
+            {
+                //Out of randomness, the address changes again on the next EID
+                DEBUG_PRINTF(0, "No random bytes for the MAC address! \r\n", 0);
             }
-            sd_rand_application_vector_get(new_address.addr, ADDR_SIZE);
-
-            err_code = sd_ble_gap_address_set(BLE_GAP_ADDR_CYCLE_MODE_NONE, &new_address);
-            APP_ERROR_CHECK(err_code);
             #endif
             break;
 
@@ -769,6 +774,18 @@ static void ecs_read_evt_handler(ble_ecs_t        * p_ecs,
             case BLE_ECS_EVT_REMAIN_CNNTBL:
                 break;
 
+#ifdef ADV_TIMING_DEBUG
+            case BLE_ECS_EVT_ADV_TIMING:
+                override_flag = true;
+                ble_ecs_adv_timing_t adv_timing;
+
+                eddystone_adv_timing_stats_get(slot_no, &adv_timing);
+                reply.params.read.len = sizeof(ble_ecs_adv_timing_t);
+                reply.params.read.p_data = (const uint8_t *)(&adv_timing);
+                reply.params.read.gatt_status = BLE_GATT_STATUS_SUCCESS;
+                break;
+#endif
+
             default:
                 break;
         }
@@ -806,15 +823,27 @@ static void ecs_read_evt_handler(ble_ecs_t        * p_ecs,
         uint8_t key_buff[ECS_AES_KEY_SIZE];
         uint32_t err_code;
 
-        eddystone_security_random_challenge_generate(key_buff);
-        err_code = eddystone_security_unlock_prepare(key_buff);
-        APP_ERROR_CHECK(err_code);
+        err_code = eddystone_security_random_challenge_generate(key_buff);
+        if (err_code == NRF_SUCCESS)
+        {
+            err_code = eddystone_security_unlock_prepare(key_buff);
+            APP_ERROR_CHECK(err_code);
 
-        reply.params.read.gatt_status = BLE_GATT_STATUS_SUCCESS;
-        reply.params.read.update      = 1;
-        reply.params.read.offset      = 0;
-        reply.params.read.len         = ECS_AES_KEY_SIZE;
-        reply.params.read.p_data      = key_buff;
+            reply.params.read.gatt_status = BLE_GATT_STATUS_SUCCESS;
+            reply.params.read.update      = 1;
+            reply.params.read.offset      = 0;
+            reply.params.read.len         = ECS_AES_KEY_SIZE;
+            reply.params.read.p_data      = key_buff;
+        }
+        else
+        {
+            //Out of randomness for the moment, the client can read the challenge again
+            reply.params.read.gatt_status = BLE_GATT_STATUS_ATTERR_INSUF_RESOURCES;
+            reply.params.read.update      = 1;
+            reply.params.read.offset      = 0;
+            reply.params.read.len         = 0;
+            reply.params.read.p_data      = NULL;
+        }
     }
 
     if ( m_conn_handle != BLE_CONN_HANDLE_INVALID )
@@ -824,45 +853,71 @@ static void ecs_read_evt_handler(ble_ecs_t        * p_ecs,
     }
 }
 
-/**@brief Function for handling pstorage events.*/
-static void eddystone_pstorage_cb_handler(  pstorage_handle_t * p_handle,
-                                            uint8_t             op_code,
-                                            uint32_t            result,
-                                            uint8_t *           p_data,
-                                            uint32_t            data_len )
+/**@brief Called once the security module has restored its keys from flash*/
+static void boot_security_done(void)
+{
+    boot_state_enter(BOOT_STATE_SLOTS);
+}
+
+/**@brief Timeout handler for the boot timer, the restore from flash has stalled*/
+static void boot_timeout(void * p_context)
+{
+    DEBUG_PRINTF(0, "Boot stalled in state %d \r\n", m_boot_state);
+    APP_ERROR_CHECK(NRF_ERROR_TIMEOUT);
+}
+
+/**@brief Moves the boot on to the next state
+ * @details The security state queues the flash reads of the keys, whose done callback enters the next state.
+ *          Nothing waits for flash, the reads complete from the scheduler once the main loop runs. The slots are
+ *          then restored at once from memory-mapped flash.
+ */
+static void boot_state_enter(boot_state_t state)
 {
-        if (result == NRF_SUCCESS)
+    ret_code_t err_code;
+
+    m_boot_state = state;
+
+    switch (state)
+    {
+        case BOOT_STATE_SECURITY:
         {
-            switch (op_code)
+            eddystone_security_init_t security_init =
             {
-                case PSTORAGE_STORE_OP_CODE:
-                    DEBUG_PRINTF(0," Flash Store Sucess \r\n", 0);
-                    break;
-                case PSTORAGE_LOAD_OP_CODE:
-                    DEBUG_PRINTF(0," Flash Load Sucess \r\n", 0);
-                    break;
-                case PSTORAGE_CLEAR_OP_CODE:
-                    DEBUG_PRINTF(0," Flash Clear Sucess \r\n", 0);
-                    break;
-                case PSTORAGE_UPDATE_OP_CODE:
-                    DEBUG_PRINTF(0," Flash Update Sucess \r\n", 0);
-                    break;
-                default:
-                    break;
-            }
-        }
-        else
-        {
-            DEBUG_PRINTF(0," Flash Fail \r\n", 0);
-            APP_ERROR_CHECK(result);
+                .msg_cb       = ble_eddystone_security_cb,
+                .init_done_cb = boot_security_done
+            };
+
+            err_code = eddystone_security_init(&security_init);
+            APP_ERROR_CHECK(err_code);
+            break;
         }
+        case BOOT_STATE_SLOTS:
+            //Initialize the slots with the initial values of the characteristics
+            eddystone_adv_slots_init(m_p_ecs_init);
+            boot_state_enter(BOOT_STATE_ADVERTISING);
+            break;
+        case BOOT_STATE_ADVERTISING:
+            eddystone_advertising_manager_init(m_ble_ecs.uuid_type);
+
+            UNUSED_VARIABLE(app_timer_stop(m_boot_timer));
+            BOOT_TIME_TIMER->TASKS_CAPTURE[0] = 1;
+            m_boot_time_us = BOOT_TIME_TIMER->CC[0];
+            BOOT_TIME_TIMER->TASKS_STOP = 1;
+            DEBUG_PRINTF(0, "Time to first advertisement: %d us \r\n", m_boot_time_us);
+            break;
+        default:
+            break;
+    }
 }
+
 /**@brief Initialize the ECS with initial values for the characteristics and other necessary modules */
 static void services_and_modules_init(void)
 {
     ret_code_t err_code;
-    ble_ecs_init_t ecs_init;
-    ble_ecs_init_params_t init_params;
+    //Static, the slots are set up from them after the flash reads of the boot, see boot_state_enter
+    static ble_ecs_init_t ecs_init;
+    static ble_ecs_init_params_t init_params;
+    static uint8_t eddystone_default_data[] = DEFAULT_FRAME_DATA;
     int8_t tx_powers[ECS_NUM_OF_SUPORTED_TX_POWER] = ECS_SUPPORTED_TX_POWER;
 
     /*Init the broadcast capabilities characteristic*/
@@ -895,7 +950,6 @@ static void services_and_modules_init(void)
     /*Init the lock state characteristic*/
     init_params.lock_state.read = BLE_ECS_LOCK_STATE_LOCKED;
 
-    uint8_t eddystone_default_data[] = DEFAULT_FRAME_DATA;
     init_params.rw_adv_slot.frame_type = (eddystone_frame_type_t)(DEFAULT_FRAME_TYPE);
     init_params.rw_adv_slot.p_data = (int8_t *)(eddystone_default_data);
     init_params.rw_adv_slot.char_length = sizeof(eddystone_default_data) + 1; // plus the frame_type
@@ -914,26 +968,40 @@ static void services_and_modules_init(void)
     err_code = ble_ecs_init(&m_ble_ecs, &ecs_init);
     APP_ERROR_CHECK(err_code);
 
-    //Initialize the security module
-    eddystone_security_init_t security_init =
-    {
-        .msg_cb = ble_eddystone_security_cb,
-    };
+    err_code = eddystone_flash_init();
+    APP_ERROR_CHECK(err_code);
 
-    err_code = eddystone_flash_init(eddystone_pstorage_cb_handler);
+    err_code = eddystone_rng_init();
     APP_ERROR_CHECK(err_code);
 
-    err_code = eddystone_security_init(&security_init);
+    //The rest of the init waits for flash, see boot_state_enter
+    m_p_ecs_init = &ecs_init;
+
+    err_code = app_timer_create(&m_boot_timer, APP_TIMER_MODE_SINGLE_SHOT, boot_timeout);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_start(m_boot_timer, BOOT_TIMEOUT, NULL);
     APP_ERROR_CHECK(err_code);
 
-    //Initialize the slots with the initial values of the characteristics
-    eddystone_adv_slots_init(&ecs_init);
+    boot_state_enter(BOOT_STATE_SECURITY);
+}
 
-    eddystone_advertising_manager_init(m_ble_ecs.uuid_type);
+/**@brief Starts counting the time to the first advertisement, see @ref boot_state_enter
+ * @details The RTC of the app timer does not count before the SoftDevice has started the LFCLK and a timer is
+ *          running, so it would leave out the SoftDevice enable and the LFCLK start. The TIMER counts from the HFCLK
+ *          at once, and keeps the HFCLK running while the CPU sleeps until it is stopped.
+ */
+static void boot_time_start(void)
+{
+    BOOT_TIME_TIMER->MODE        = TIMER_MODE_MODE_Timer;
+    BOOT_TIME_TIMER->BITMODE     = TIMER_BITMODE_BITMODE_32Bit;
+    BOOT_TIME_TIMER->PRESCALER   = BOOT_TIME_PRESCALER;
+    BOOT_TIME_TIMER->TASKS_CLEAR = 1;
+    BOOT_TIME_TIMER->TASKS_START = 1;
 }
 
 void eddystone_ble_init()
 {
+    boot_time_start();
     ble_stack_init();
     gap_params_init();
     conn_params_init();
@@ -0,0 +1,438 @@
+#include "eddystone_crypto.h"
+#include "macros_common.h"
+
+#define BLOCK_SIZE  EDDYSTONE_CRYPTO_AES_BLOCK_SIZE
+
+/**@brief Doubles a block in GF(2^128), to derive the OMAC subkeys*/
+static void eax_block_double(const uint8_t * p_in, uint8_t * p_out)
+{
+    uint8_t carry = p_in[0] >> 7;
+
+    for (uint8_t i = 0; i < BLOCK_SIZE - 1; i++)
+    {
+        p_out[i] = (uint8_t)((p_in[i] << 1) | (p_in[i + 1] >> 7));
+    }
+    p_out[BLOCK_SIZE - 1] = (uint8_t)((p_in[BLOCK_SIZE - 1] << 1) ^ (0x87 & (0 - carry)));
+}
+
+void eddystone_crypto_cached_eax_init(eddystone_crypto_eax_t * p_eax, const uint8_t * p_key)
+{
+    uint8_t block[BLOCK_SIZE] = {0};
+
+    cf_aes_init(&p_eax->aes, p_key, EDDYSTONE_CRYPTO_AES_KEY_SIZE);
+
+    //L = E(K, 0), K1 = 2L, K2 = 4L
+    cf_aes_encrypt(&p_eax->aes, block, block);
+    eax_block_double(block, p_eax->k1);
+    eax_block_double(p_eax->k1, p_eax->k2);
+
+    memset(block, 0, sizeof(block));
+    cf_aes_encrypt(&p_eax->aes, block, p_eax->nonce_prefix);
+
+    block[BLOCK_SIZE - 1] = 2;
+    cf_aes_encrypt(&p_eax->aes, block, p_eax->cipher_prefix);
+
+    //The empty header is a single complete block [1]
+    block[BLOCK_SIZE - 1] = 1;
+    for (uint8_t i = 0; i < BLOCK_SIZE; i++)
+    {
+        block[i] ^= p_eax->k1[i];
+    }
+    cf_aes_encrypt(&p_eax->aes, block, p_eax->header_mac);
+}
+
+/**@brief OMAC of a message of 1 to BLOCK_SIZE bytes, following the already encrypted tweak block*/
+static void cached_eax_omac(const eddystone_crypto_eax_t * p_eax, const uint8_t * p_prefix,
+                            const uint8_t * p_data, uint8_t length, uint8_t * p_mac)
+{
+    uint8_t         block[BLOCK_SIZE] = {0};
+    const uint8_t * p_subkey = (length == BLOCK_SIZE) ? p_eax->k1 : p_eax->k2;
+
+    memcpy(block, p_data, length);
+    if (length < BLOCK_SIZE)
+    {
+        block[length] = 0x80;
+    }
+
+    for (uint8_t i = 0; i < BLOCK_SIZE; i++)
+    {
+        block[i] ^= p_subkey[i] ^ p_prefix[i];
+    }
+    cf_aes_encrypt(&p_eax->aes, block, p_mac);
+}
+
+void eddystone_crypto_cached_eax_encrypt(const eddystone_crypto_eax_t * p_eax,
+                                         const uint8_t * p_nonce, uint8_t nonce_length,
+                                         const uint8_t * p_plain, uint8_t length,
+                                         uint8_t * p_cipher, uint8_t * p_tag, uint8_t tag_length)
+{
+    uint8_t nonce_mac[BLOCK_SIZE];
+    uint8_t keystream[BLOCK_SIZE];
+    uint8_t cipher_mac[BLOCK_SIZE];
+
+    cached_eax_omac(p_eax, p_eax->nonce_prefix, p_nonce, nonce_length, nonce_mac);
+
+    //CTR mode starting at the nonce OMAC, one block is enough
+    cf_aes_encrypt(&p_eax->aes, nonce_mac, keystream);
+    for (uint8_t i = 0; i < length; i++)
+    {
+        p_cipher[i] = p_plain[i] ^ keystream[i];
+    }
+
+    cached_eax_omac(p_eax, p_eax->cipher_prefix, p_cipher, length, cipher_mac);
+
+    for (uint8_t i = 0; i < tag_length; i++)
+    {
+        p_tag[i] = nonce_mac[i] ^ p_eax->header_mac[i] ^ cipher_mac[i];
+    }
+}
+
+void eddystone_crypto_cifra_eax_init(eddystone_crypto_eax_t * p_eax, const uint8_t * p_key)
+{
+    cf_aes_init(&p_eax->aes, p_key, EDDYSTONE_CRYPTO_AES_KEY_SIZE);
+}
+
+void eddystone_crypto_cifra_eax_encrypt(const eddystone_crypto_eax_t * p_eax,
+                                        const uint8_t * p_nonce, uint8_t nonce_length,
+                                        const uint8_t * p_plain, uint8_t length,
+                                        uint8_t * p_cipher, uint8_t * p_tag, uint8_t tag_length)
+{
+    cf_prp        prp;
+    const uint8_t header = 0;
+
+    prp.encrypt = (cf_prp_block)cf_aes_encrypt;
+    prp.decrypt = (cf_prp_block)cf_aes_decrypt;
+    prp.blocksz = BLOCK_SIZE;
+
+    cf_eax_encrypt(&prp, (void *)&p_eax->aes, p_plain, length, &header, 0, p_nonce, nonce_length, p_cipher, p_tag, tag_length);
+}
+
+void eddystone_crypto_eax_init(eddystone_crypto_eax_t * p_eax, const uint8_t * p_key)
+{
+#if APP_CRYPTO_EAX_BACKEND == EDDYSTONE_CRYPTO_BACKEND_CACHED
+    eddystone_crypto_cached_eax_init(p_eax, p_key);
+#else
+    eddystone_crypto_cifra_eax_init(p_eax, p_key);
+#endif
+
+    p_eax->is_valid = true;
+}
+
+void eddystone_crypto_eax_encrypt(const eddystone_crypto_eax_t * p_eax,
+                                  const uint8_t * p_nonce, uint8_t nonce_length,
+                                  const uint8_t * p_plain, uint8_t length,
+                                  uint8_t * p_cipher, uint8_t * p_tag, uint8_t tag_length)
+{
+#if APP_CRYPTO_EAX_BACKEND == EDDYSTONE_CRYPTO_BACKEND_CACHED
+    eddystone_crypto_cached_eax_encrypt(p_eax, p_nonce, nonce_length, p_plain, length, p_cipher, p_tag, tag_length);
+#else
+    eddystone_crypto_cifra_eax_encrypt(p_eax, p_nonce, nonce_length, p_plain, length, p_cipher, p_tag, tag_length);
+#endif
+}
+
+/* Bitsliced AES-128 decryption ----------------------------------------------------------------------------------*/
+
+/* The state is spread over 8 words, word k holding bit k of every byte of the block in bits 0 to 15. Byte j of the
+ * block, row j % 4 of column j / 4, is bit j. The S-box is then evaluated on all bytes at once with logic operations
+ * only, so no branch and no memory access depends on the key or the data. It inverts in GF((2^4)^2), with
+ * GF(2^4) built on x^4 + x + 1 and GF((2^4)^2) on y^2 + y + 13. The changes of basis are merged with the affine
+ * transforms of the S-box. */
+
+#define BS_ROTATE_1(x)      ((((x) >> 1) & 0x7777) | (((x) << 3) & 0x8888))    /**< Row r of each column gets row r + 1 */
+#define BS_ROTATE_2(x)      ((((x) >> 2) & 0x3333) | (((x) << 2) & 0xCCCC))    /**< Row r of each column gets row r + 2 */
+
+/**@brief Spreads a block over the 8 words of p_q*/
+static void bs_pack(uint32_t * p_q, const uint8_t * p_in)
+{
+    uint32_t w;
+
+    memset(p_q, 0, 8 * sizeof(uint32_t));
+    for (uint8_t c = 0; c < 4; c++)
+    {
+        w = p_in[4 * c] | (p_in[4 * c + 1] << 8) | (p_in[4 * c + 2] << 16) | ((uint32_t)p_in[4 * c + 3] << 24);
+        for (uint8_t k = 0; k < 8; k++)
+        {
+            //The multiplication gathers bit k of the 4 bytes in bits 28 to 31
+            p_q[k] |= ((((w >> k) & 0x01010101) * 0x10204080) >> 28) << (4 * c);
+        }
+    }
+}
+
+/**@brief Inverse of @ref bs_pack*/
+static void bs_unpack(uint8_t * p_out, const uint32_t * p_q)
+{
+    uint32_t w;
+
+    for (uint8_t c = 0; c < 4; c++)
+    {
+        w = 0;
+        for (uint8_t k = 0; k < 8; k++)
+        {
+            //The multiplication spreads the 4 bits of the column to bit 0 of each byte
+            w |= ((((p_q[k] >> (4 * c)) & 0xF) * 0x00204081) & 0x01010101) << k;
+        }
+        p_out[4 * c]     = (uint8_t)w;
+        p_out[4 * c + 1] = (uint8_t)(w >> 8);
+        p_out[4 * c + 2] = (uint8_t)(w >> 16);
+        p_out[4 * c + 3] = (uint8_t)(w >> 24);
+    }
+}
+
+static void bs_gf16_mul(uint32_t * p_r, const uint32_t * p_a, const uint32_t * p_b)
+{
+    uint32_t a0 = p_a[0], a1 = p_a[1], a2 = p_a[2], a3 = p_a[3];
+    uint32_t b0 = p_b[0], b1 = p_b[1], b2 = p_b[2], b3 = p_b[3];
+    uint32_t c4 = (a1 & b3) ^ (a2 & b2) ^ (a3 & b1);
+    uint32_t c5 = (a2 & b3) ^ (a3 & b2);
+    uint32_t c6 = a3 & b3;
+
+    //x^4 = x + 1
+    p_r[0] = (a0 & b0) ^ c4;
+    p_r[1] = (a0 & b1) ^ (a1 & b0) ^ c4 ^ c5;
+    p_r[2] = (a0 & b2) ^ (a1 & b1) ^ (a2 & b0) ^ c5 ^ c6;
+    p_r[3] = (a0 & b3) ^ (a1 & b2) ^ (a2 & b1) ^ (a3 & b0) ^ c6;
+}
+
+/**@brief Inverts in GF(2^4), 0 giving 0, from the algebraic normal form of the inverse*/
+static void bs_gf16_invert(uint32_t * p_r, const uint32_t * p_a)
+{
+    uint32_t a0 = p_a[0], a1 = p_a[1], a2 = p_a[2], a3 = p_a[3];
+    uint32_t a01  = a0 & a1;
+    uint32_t a02  = a0 & a2;
+    uint32_t a03  = a0 & a3;
+    uint32_t a12  = a1 & a2;
+    uint32_t a13  = a1 & a3;
+    uint32_t a123 = a12 & a3;
+
+    p_r[0] = a0 ^ a1 ^ a2 ^ a3 ^ a02 ^ a12 ^ (a01 & a2) ^ a123;
+    p_r[1] = a01 ^ a02 ^ a12 ^ a3 ^ a13 ^ (a01 & a3);
+    p_r[2] = a01 ^ a2 ^ a02 ^ a3 ^ a03 ^ (a02 & a3);
+    p_r[3] = a1 ^ a2 ^ a3 ^ a03 ^ a13 ^ (a2 & a3) ^ a123;
+}
+
+/**@brief Inverts in GF((2^4)^2), words 0 to 3 holding the low coefficient l and words 4 to 7 the high one h*/
+static void bs_gf256_invert(uint32_t * p_t)
+{
+    uint32_t * p_l = &p_t[0];
+    uint32_t * p_h = &p_t[4];
+    uint32_t   d[4];
+    uint32_t   e[4];
+
+    //d = 13 h^2 + h l + l^2, the norm of h y + l
+    bs_gf16_mul(e, p_h, p_l);
+    d[0] = p_h[0] ^ p_h[1] ^ p_h[3] ^ e[0] ^ p_l[0] ^ p_l[2];
+    d[1] = p_h[3] ^ e[1] ^ p_l[2];
+    d[2] = p_h[0] ^ p_h[2] ^ e[2] ^ p_l[1] ^ p_l[3];
+    d[3] = p_h[0] ^ e[3] ^ p_l[3];
+
+    bs_gf16_invert(d, d);
+
+    //(h y + l)^-1 = h d^-1 y + (h + l) d^-1
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        e[i] = p_h[i] ^ p_l[i];
+    }
+    bs_gf16_mul(p_h, p_h, d);
+    bs_gf16_mul(p_l, e, d);
+}
+
+static void bs_inv_sub_bytes(uint32_t * p_q)
+{
+    uint32_t t[8];
+
+    //Inverse affine transform, then to the tower field
+    t[0] = p_q[3];
+    t[1] = p_q[1] ^ p_q[3] ^ p_q[5];
+    t[2] = ~(p_q[2] ^ p_q[3] ^ p_q[6] ^ p_q[7]);
+    t[3] = ~(p_q[5] ^ p_q[7]);
+    t[4] = ~(p_q[1] ^ p_q[2] ^ p_q[7]);
+    t[5] = ~(p_q[0] ^ p_q[4] ^ p_q[5] ^ p_q[6]);
+    t[6] = p_q[1] ^ p_q[2] ^ p_q[3] ^ p_q[4] ^ p_q[5] ^ p_q[7];
+    t[7] = p_q[1] ^ p_q[2] ^ p_q[6] ^ p_q[7];
+
+    bs_gf256_invert(t);
+
+    //Back to the polynomial basis
+    p_q[0] = t[0] ^ t[1] ^ t[4];
+    p_q[1] = t[4] ^ t[5] ^ t[6];
+    p_q[2] = t[2] ^ t[3] ^ t[4] ^ t[6] ^ t[7];
+    p_q[3] = t[2] ^ t[3] ^ t[4] ^ t[5] ^ t[6];
+    p_q[4] = t[2] ^ t[4];
+    p_q[5] = t[1] ^ t[6];
+    p_q[6] = t[1] ^ t[2] ^ t[5] ^ t[6];
+    p_q[7] = t[1] ^ t[6] ^ t[7];
+}
+
+/**@brief Forward S-box, only needed by the key expansion*/
+static void bs_sub_bytes(uint32_t * p_q)
+{
+    uint32_t t[8];
+
+    //To the tower field
+    t[0] = p_q[0] ^ p_q[1] ^ p_q[2] ^ p_q[3] ^ p_q[7];
+    t[1] = p_q[1] ^ p_q[4] ^ p_q[6];
+    t[2] = p_q[2] ^ p_q[3] ^ p_q[6] ^ p_q[7];
+    t[3] = p_q[1] ^ p_q[2] ^ p_q[6] ^ p_q[7];
+    t[4] = p_q[2] ^ p_q[3] ^ p_q[4] ^ p_q[6] ^ p_q[7];
+    t[5] = p_q[2] ^ p_q[3] ^ p_q[5] ^ p_q[7];
+    t[6] = p_q[1] ^ p_q[4] ^ p_q[5] ^ p_q[6];
+    t[7] = p_q[5] ^ p_q[7];
+
+    bs_gf256_invert(t);
+
+    //Back to the polynomial basis, then the affine transform
+    p_q[0] = ~(t[0] ^ t[5] ^ t[6] ^ t[7]);
+    p_q[1] = ~(t[0] ^ t[2] ^ t[7]);
+    p_q[2] = t[0] ^ t[1] ^ t[3] ^ t[4];
+    p_q[3] = t[0];
+    p_q[4] = t[0] ^ t[1] ^ t[2] ^ t[4] ^ t[6] ^ t[7];
+    p_q[5] = ~(t[1] ^ t[2] ^ t[7]);
+    p_q[6] = ~(t[4] ^ t[7]);
+    p_q[7] = t[1] ^ t[2] ^ t[3] ^ t[7];
+}
+
+static void bs_inv_shift_rows(uint32_t * p_q)
+{
+    uint32_t x;
+
+    for (uint8_t k = 0; k < 8; k++)
+    {
+        //Row r moves r columns to the right, which is 4 r bits up modulo 16
+        x      = p_q[k] & 0xFFFF;
+        x     |= x << 16;
+        p_q[k] = (x & 0x1111) | ((x >> 12) & 0x2222) | ((x >> 8) & 0x4444) | ((x >> 4) & 0x8888);
+    }
+}
+
+/**@brief Multiplies every byte by x in GF(2^8)*/
+static void bs_xtime(uint32_t * p_q)
+{
+    uint32_t hi = p_q[7];
+
+    p_q[7] = p_q[6];
+    p_q[6] = p_q[5];
+    p_q[5] = p_q[4];
+    p_q[4] = p_q[3] ^ hi;
+    p_q[3] = p_q[2] ^ hi;
+    p_q[2] = p_q[1];
+    p_q[1] = p_q[0] ^ hi;
+    p_q[0] = hi;
+}
+
+static void bs_inv_mix_columns(uint32_t * p_q)
+{
+    uint32_t s[8];
+    uint32_t u[8];
+
+    //InvMixColumns is MixColumns after a[r] += 4 (a[r] + a[r + 2])
+    for (uint8_t k = 0; k < 8; k++)
+    {
+        s[k] = p_q[k] ^ BS_ROTATE_2(p_q[k]);
+    }
+    bs_xtime(s);
+    bs_xtime(s);
+    for (uint8_t k = 0; k < 8; k++)
+    {
+        p_q[k] ^= s[k];
+    }
+
+    //MixColumns, a[r] = 2 (a[r] + a[r + 1]) + a[r + 1] + a[r + 2] + a[r + 3]
+    for (uint8_t k = 0; k < 8; k++)
+    {
+        u[k] = BS_ROTATE_1(p_q[k]);
+        s[k] = p_q[k] ^ u[k];
+        u[k] ^= BS_ROTATE_2(s[k]);
+    }
+    bs_xtime(s);
+    for (uint8_t k = 0; k < 8; k++)
+    {
+        p_q[k] = s[k] ^ u[k];
+    }
+}
+
+void eddystone_crypto_bitsliced_aes_key_expand(uint16_t p_round_keys[][8], const uint8_t * p_key)
+{
+    uint32_t q[8];
+    uint32_t x;
+    uint32_t w;
+    uint8_t  rcon = 1;
+
+    bs_pack(q, p_key);
+    for (uint8_t k = 0; k < 8; k++)
+    {
+        p_round_keys[0][k] = (uint16_t)q[k];
+    }
+
+    for (uint8_t round = 1; round <= EDDYSTONE_CRYPTO_AES_NUM_OF_ROUNDS; round++)
+    {
+        //Only the S-box of the last column is used
+        for (uint8_t k = 0; k < 8; k++)
+        {
+            q[k] = p_round_keys[round - 1][k];
+        }
+        bs_sub_bytes(q);
+
+        for (uint8_t k = 0; k < 8; k++)
+        {
+            //SubWord(RotWord(last column)) + Rcon, in every column
+            x  = (q[k] >> 12) & 0xF;
+            x  = ((x >> 1) | (x << 3)) & 0xF;
+            x ^= (rcon >> k) & 1;
+
+            //Column c is the sum of the columns up to c of the previous round key
+            w  = p_round_keys[round - 1][k];
+            w ^= w << 4;
+            w ^= w << 8;
+
+            p_round_keys[round][k] = (uint16_t)(w ^ (x * 0x1111));
+        }
+
+        rcon = (uint8_t)((rcon << 1) ^ (0x1b & (0 - (rcon >> 7))));
+    }
+
+    memset(q, 0, sizeof(q));
+}
+
+static void bs_add_round_key(uint32_t * p_q, const uint16_t * p_round_key)
+{
+    for (uint8_t k = 0; k < 8; k++)
+    {
+        p_q[k] ^= p_round_key[k];
+    }
+}
+
+void eddystone_crypto_bitsliced_aes_decrypt(const uint16_t p_round_keys[][8], const uint8_t * p_in, uint8_t * p_out)
+{
+    uint32_t q[8];
+
+    bs_pack(q, p_in);
+    bs_add_round_key(q, p_round_keys[EDDYSTONE_CRYPTO_AES_NUM_OF_ROUNDS]);
+
+    for (uint8_t round = EDDYSTONE_CRYPTO_AES_NUM_OF_ROUNDS - 1; round > 0; round--)
+    {
+        bs_inv_shift_rows(q);
+        bs_inv_sub_bytes(q);
+        bs_add_round_key(q, p_round_keys[round]);
+        bs_inv_mix_columns(q);
+    }
+
+    bs_inv_shift_rows(q);
+    bs_inv_sub_bytes(q);
+    bs_add_round_key(q, p_round_keys[0]);
+
+    bs_unpack(p_out, q);
+
+    memset(q, 0, sizeof(q));
+}
+
+ret_code_t eddystone_crypto_bitsliced_aes_ecb_decrypt(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out)
+{
+    uint16_t round_keys[EDDYSTONE_CRYPTO_AES_NUM_OF_ROUNDS + 1][8];
+
+    eddystone_crypto_bitsliced_aes_key_expand(round_keys, p_key);
+    eddystone_crypto_bitsliced_aes_decrypt(round_keys, p_in, p_out);
+
+    memset(round_keys, 0, sizeof(round_keys));
+
+    return NRF_SUCCESS;
+}
@@ -0,0 +1,221 @@
+#include "eddystone_ecdh.h"
+#include <string.h>
+
+//Field arithmetic modulo 2^255 - 19 in 16 limbs of 16 bits, as in TweetNaCl (public domain)
+
+#define LADDER_STEPS    255
+#define INVERT_STEPS    254
+
+static const eddystone_ecdh_gf_t m_121665 = {0xDB41, 1};
+static const uint8_t m_base_point[EDDYSTONE_ECDH_KEY_SIZE] = {9};
+
+/**@brief Propagates the carries so that every limb fits in 16 bits again*/
+static void gf_carry(eddystone_ecdh_gf_t o)
+{
+    int64_t c;
+
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        o[i] += (1LL << 16);
+        c = o[i] >> 16;
+        o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+        o[i] -= c * 0x10000;
+    }
+}
+
+/**@brief Swaps p and q if b is 1, without branching on b*/
+static void gf_swap(eddystone_ecdh_gf_t p, eddystone_ecdh_gf_t q, int64_t b)
+{
+    int64_t t;
+    int64_t c = ~(b - 1);
+
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        t     = c & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+static void gf_add(eddystone_ecdh_gf_t o, const eddystone_ecdh_gf_t a, const eddystone_ecdh_gf_t b)
+{
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        o[i] = a[i] + b[i];
+    }
+}
+
+static void gf_sub(eddystone_ecdh_gf_t o, const eddystone_ecdh_gf_t a, const eddystone_ecdh_gf_t b)
+{
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        o[i] = a[i] - b[i];
+    }
+}
+
+static void gf_mul(eddystone_ecdh_gf_t o, const eddystone_ecdh_gf_t a, const eddystone_ecdh_gf_t b)
+{
+    int64_t t[31];
+
+    memset(t, 0, sizeof(t));
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        for (uint8_t j = 0; j < 16; j++)
+        {
+            t[i + j] += a[i] * b[j];
+        }
+    }
+    for (uint8_t i = 0; i < 15; i++)
+    {
+        t[i] += 38 * t[i + 16];
+    }
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        o[i] = t[i];
+    }
+    gf_carry(o);
+    gf_carry(o);
+}
+
+static void gf_square(eddystone_ecdh_gf_t o, const eddystone_ecdh_gf_t a)
+{
+    gf_mul(o, a, a);
+}
+
+static void gf_unpack(eddystone_ecdh_gf_t o, const uint8_t * p_in)
+{
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        o[i] = p_in[2 * i] + ((int64_t)p_in[2 * i + 1] << 8);
+    }
+    o[15] &= 0x7fff;
+}
+
+/**@brief Reduces n fully and encodes it in little endian*/
+static void gf_pack(uint8_t * p_out, const eddystone_ecdh_gf_t n)
+{
+    eddystone_ecdh_gf_t m;
+    eddystone_ecdh_gf_t t;
+    int64_t             b;
+
+    memcpy(t, n, sizeof(t));
+    gf_carry(t);
+    gf_carry(t);
+    gf_carry(t);
+
+    for (uint8_t j = 0; j < 2; j++)
+    {
+        m[0] = t[0] - 0xffed;
+        for (uint8_t i = 1; i < 15; i++)
+        {
+            m[i]      = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+        m[15]  = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        b      = (m[15] >> 16) & 1;
+        m[14] &= 0xffff;
+        gf_swap(t, m, 1 - b);
+    }
+
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        p_out[2 * i]     = (uint8_t)(t[i] & 0xff);
+        p_out[2 * i + 1] = (uint8_t)(t[i] >> 8);
+    }
+}
+
+/**@brief One bit of the Montgomery ladder, from the most significant bit down*/
+static void ladder_step(eddystone_ecdh_job_t * p_job, uint8_t bit_no)
+{
+    eddystone_ecdh_gf_t e;
+    eddystone_ecdh_gf_t f;
+    int64_t             r = (p_job->scalar[bit_no >> 3] >> (bit_no & 7)) & 1;
+
+    gf_swap(p_job->x2, p_job->x3, r);
+    gf_swap(p_job->z2, p_job->z3, r);
+    gf_add(e, p_job->x2, p_job->z2);
+    gf_sub(p_job->x2, p_job->x2, p_job->z2);
+    gf_add(p_job->z2, p_job->x3, p_job->z3);
+    gf_sub(p_job->x3, p_job->x3, p_job->z3);
+    gf_square(p_job->z3, e);
+    gf_square(f, p_job->x2);
+    gf_mul(p_job->x2, p_job->z2, p_job->x2);
+    gf_mul(p_job->z2, p_job->x3, e);
+    gf_add(e, p_job->x2, p_job->z2);
+    gf_sub(p_job->x2, p_job->x2, p_job->z2);
+    gf_square(p_job->x3, p_job->x2);
+    gf_sub(p_job->z2, p_job->z3, f);
+    gf_mul(p_job->x2, p_job->z2, m_121665);
+    gf_add(p_job->x2, p_job->x2, p_job->z3);
+    gf_mul(p_job->z2, p_job->z2, p_job->x2);
+    gf_mul(p_job->x2, p_job->z3, f);
+    gf_mul(p_job->z3, p_job->x3, p_job->x1);
+    gf_square(p_job->x3, e);
+    gf_swap(p_job->x2, p_job->x3, r);
+    gf_swap(p_job->z2, p_job->z3, r);
+
+    memset(e, 0, sizeof(e));
+    memset(f, 0, sizeof(f));
+}
+
+/**@brief One squaring of the inversion z2^(p-2), from the most significant exponent bit down*/
+static void invert_step(eddystone_ecdh_job_t * p_job, uint8_t bit_no)
+{
+    gf_square(p_job->inv, p_job->inv);
+    if (bit_no != 2 && bit_no != 4)
+    {
+        gf_mul(p_job->inv, p_job->inv, p_job->z2);
+    }
+}
+
+void eddystone_ecdh_job_start(eddystone_ecdh_job_t * p_job, const uint8_t * p_scalar, const uint8_t * p_point)
+{
+    memset(p_job, 0, sizeof(eddystone_ecdh_job_t));
+
+    memcpy(p_job->scalar, p_scalar, EDDYSTONE_ECDH_KEY_SIZE);
+    p_job->scalar[31] = (p_job->scalar[31] & 127) | 64;
+    p_job->scalar[0] &= 248;
+
+    gf_unpack(p_job->x1, (p_point != NULL) ? p_point : m_base_point);
+
+    //(x2:z2) = (1:0) is the point at infinity, (x3:z3) = (x1:1) the input point
+    memcpy(p_job->x3, p_job->x1, sizeof(eddystone_ecdh_gf_t));
+    p_job->x2[0] = 1;
+    p_job->z3[0] = 1;
+}
+
+bool eddystone_ecdh_job_run(eddystone_ecdh_job_t * p_job, uint16_t max_steps)
+{
+    for (uint16_t i = 0; i < max_steps && p_job->step < EDDYSTONE_ECDH_NUM_OF_STEPS; i++, p_job->step++)
+    {
+        if (p_job->step < LADDER_STEPS)
+        {
+            ladder_step(p_job, (uint8_t)(LADDER_STEPS - 1 - p_job->step));
+            if (p_job->step == LADDER_STEPS - 1)
+            {
+                memcpy(p_job->inv, p_job->z2, sizeof(eddystone_ecdh_gf_t));
+            }
+        }
+        else if (p_job->step < LADDER_STEPS + INVERT_STEPS)
+        {
+            invert_step(p_job, (uint8_t)(LADDER_STEPS + INVERT_STEPS - 1 - p_job->step));
+        }
+        else
+        {
+            gf_mul(p_job->x2, p_job->x2, p_job->inv);
+            gf_pack(p_job->result, p_job->x2);
+        }
+    }
+
+    return p_job->step >= EDDYSTONE_ECDH_NUM_OF_STEPS;
+}
+
+void eddystone_ecdh_job_result_get(const eddystone_ecdh_job_t * p_job, uint8_t * p_result)
+{
+    memcpy(p_result, p_job->result, EDDYSTONE_ECDH_KEY_SIZE);
+}
+
+void eddystone_ecdh_job_clear(eddystone_ecdh_job_t * p_job)
+{
+    memset(p_job, 0, sizeof(eddystone_ecdh_job_t));
+}
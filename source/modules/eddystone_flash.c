@@ -4,8 +4,11 @@
 #include "macros_common.h"
 #include "ecs_defs.h"
 #include <string.h>
+#include <stddef.h>
 #include "eddystone_app_config.h"
 #include "debug_config.h"
+#include "app_scheduler.h"
+#include "app_util_platform.h"
 
 static pstorage_handle_t m_pstorage_base_handle;
 
@@ -16,188 +19,1030 @@ static pstorage_handle_t m_pstorage_base_handle;
     #define DEBUG_PRINTF(...)
 #endif
 
-#define NUM_OF_BLOCKS       APP_MAX_ADV_SLOTS + 4   /*see @eddystone_flash_init */
+#define NUM_OF_BLOCKS       (APP_MAX_ADV_SLOTS + 4)   /*see @eddystone_flash_init */
 
-typedef PACKED(struct)
+#define BLOCK_INDEX_ECDH_PRIV   APP_MAX_ADV_SLOTS
+#define BLOCK_INDEX_ECDH_PUB    (APP_MAX_ADV_SLOTS + 1)
+#define BLOCK_INDEX_LOCK_KEY    (APP_MAX_ADV_SLOTS + 2)
+#define BLOCK_INDEX_FLAGS       (APP_MAX_ADV_SLOTS + 3)
+#define REQUEST_QUEUE_SIZE      (NUM_OF_BLOCKS + 4)     /**< A transaction of every block and its commit marker, with room to spare */
+
+#if APP_FLASH_LOG_NUM_OF_PAGES < 2 || APP_FLASH_LOG_NUM_OF_PAGES > PSTORAGE_NUM_OF_PAGES
+    #error "The record log needs 2 pages or more, and no more than pstorage has"
+#endif
+
+/**@brief Record log
+ * @details The blocks have no fixed place in flash. Every write or clear of a block appends a record to the head page
+ *          of a log over APP_FLASH_LOG_NUM_OF_PAGES pages, and the record of a block with the highest version wins.
+ *          Records are only ever stored to erased flash, so nothing is updated in place, and the pages wear evenly
+ *          as the head goes round them.
+ *          When the head moves on to the next page, the page after that is compacted in the background: its live
+ *          records are copied to the head and the page is erased, so there is always an erased page ahead of the head.
+ *          The records of a transaction only count once the commit marker after them is stored. The marker holds the
+ *          version of the first record of its transaction, so the records of a transaction a reset cut short never
+ *          count, not even when a later transaction commits.
+ *
+ * Page layout:
+ * [ Page header ] [ Record 0 ] [ Record 1 ] ... [ Record (m_records_per_page - 1) ]
+ */
+#define LOG_PAGE_MAGIC          0x474C4445      /**< "EDLG" */
+#define LOG_VERSION_FREE        0xFFFFFFFF      /**< Version of a record that is not written */
+#define LOG_LOCATION_NONE       0xFFFF
+#define LOG_PAGE_NONE           0xFF
+#define LOG_RECORD_FLAG_CLEARED 0x01            /**< The record clears the block, its data is not used */
+#define LOG_RECORD_FLAG_TRANSACTION 0x02        /**< The record is part of a transaction */
+#define LOG_BLOCK_COMMIT        NUM_OF_BLOCKS   /**< Block index of a commit marker, its data starts with the version of the first record committed */
+
+typedef struct
+{
+    uint32_t    magic;
+    uint32_t    erase_count;
+} log_page_header_t;
+
+/**@brief A record, flash is written a word at a time in this order
+ * @details The checksum is stored last, so a store a reset cut short leaves it erased. A Fletcher-16 sum never reads
+ *          0xFFFF, so a torn record can never pass for a whole one, whatever its data happens to be.
+ */
+typedef struct
+{
+    uint8_t     data[FLASH_BLOCK_SIZE];     /**< First, so a config is word aligned where it is read in place */
+    uint32_t    version;                    /**< LOG_VERSION_FREE if the record is not written */
+    uint8_t     block_index;
+    uint8_t     flags;
+    uint16_t    checksum;                   /**< Fletcher-16 of the rest of the record, a torn record is ignored */
+} log_record_t;
+
+typedef enum
 {
-    uint8_t buffer[FLASH_BLOCK_SIZE];
-} flash_buffers_t;
+    LOG_OP_NONE,
+    LOG_OP_REQUEST,     /**< m_in_flight, a queued request */
+    LOG_OP_COPY,        /**< copying a live record out of the page being compacted */
+    LOG_OP_ERASE,
+    LOG_OP_HEADER
+} log_op_t;
 
-static flash_buffers_t m_flash_buffers[NUM_OF_BLOCKS] = {0}; //pstorage write requires static buffer
+static pstorage_handle_t    m_page_handles[APP_FLASH_LOG_NUM_OF_PAGES];
+static uint16_t             m_records_per_page;
+static uint16_t             m_locations[NUM_OF_BLOCKS];                         /**< location of the latest record of each block, or LOG_LOCATION_NONE */
+static uint16_t             m_txn_locations[NUM_OF_BLOCKS];                     /**< location of the records of the transaction not yet committed */
+static bool                 m_is_txn_started;                                   /**< a record of a transaction is stored, its commit marker is not */
+static uint32_t             m_txn_start_version;                                /**< version of the first record of that transaction */
+static uint16_t             m_page_num_of_records[APP_FLASH_LOG_NUM_OF_PAGES];  /**< records stored to each page, torn ones included */
+static uint32_t             m_page_erase_counts[APP_FLASH_LOG_NUM_OF_PAGES];
+static uint32_t             m_page_erase_mask;                                  /**< bit n set if page n is to be erased */
+static uint32_t             m_page_header_mask;                                 /**< bit n set if page n is erased without a header */
+static uint8_t              m_head_page;
+static uint8_t              m_compact_page;
+static uint32_t             m_next_version;
+static uint32_t             m_num_of_compactions;
+static uint32_t             m_num_of_records;                                   /**< records stored for requests since init */
+static uint32_t             m_num_of_copies;                                    /**< records stored for compactions since init */
+static log_record_t         m_record;                                           /**< the record being stored, pstorage requires a static buffer */
+static log_page_header_t    m_page_header;
+static log_op_t             m_log_op = LOG_OP_NONE;
+static uint16_t             m_log_op_location;                                  /**< where m_record is being stored */
+static uint8_t              m_log_op_page;                                      /**< page being erased or given a header */
 
-ret_code_t eddystone_flash_access_lock_key(uint8_t * p_lock_key, eddystone_flash_access_t access_type)
+/**@brief A queued flash access*/
+typedef struct
 {
-    ret_code_t err_code;
-    pstorage_handle_t lock_key_handle;
-    const uint8_t blk_index = APP_MAX_ADV_SLOTS+2;
-    pstorage_block_identifier_get(&m_pstorage_base_handle, blk_index, &lock_key_handle);
+    eddystone_flash_access_t    access_type;
+    uint8_t                     block_index;        /**< block the access starts at*/
+    uint8_t                     first_block;        /**< first of the blocks the request is ordered against*/
+    uint8_t                     num_of_blocks;
+    uint16_t                    size;               /**< bytes from the start of block_index*/
+    uint8_t                     record_flags;       /**< LOG_RECORD_FLAG_TRANSACTION for a write or clear of a transaction*/
+    uint8_t *                   p_data;             /**< destination of a read*/
+    uint8_t                     data[FLASH_BLOCK_SIZE]; /**< data of a write*/
+    eddystone_flash_done_cb_t   done_cb;
+    void *                      p_context;
+} flash_request_t;
+
+typedef enum
+{
+    FLASH_STATE_IDLE,
+    FLASH_STATE_IN_FLIGHT,      /**< m_in_flight is with pstorage*/
+    FLASH_STATE_COMPLETE        /**< m_in_flight is done, its callback is not called yet*/
+} flash_state_t;
+
+static flash_request_t      m_requests[REQUEST_QUEUE_SIZE];
+static uint8_t              m_num_of_requests;
+static flash_request_t      m_in_flight;
+static ret_code_t           m_in_flight_result;
+static volatile flash_state_t m_state = FLASH_STATE_IDLE;
+static bool                 m_is_evt_pending;
+
+static void flash_scheduler_evt(void * p_event_data, uint16_t event_size);
+static ret_code_t flash_transaction_add(eddystone_flash_transaction_t * p_transaction,
+                                        uint8_t block_index,
+                                        uint16_t size,
+                                        uint8_t const * p_data,
+                                        eddystone_flash_access_t access_type);
+
+/**@brief Queues the scheduler event that completes and submits requests, unless it is queued or an operation is in flight
+ * @note Can be called from any context.
+ */
+static void flash_queue_kick(void)
+{
+    bool is_evt_needed;
 
-    switch (access_type)
+    CRITICAL_REGION_ENTER();
+    is_evt_needed    = !m_is_evt_pending && m_state != FLASH_STATE_IN_FLIGHT;
+    m_is_evt_pending = m_is_evt_pending || is_evt_needed;
+    CRITICAL_REGION_EXIT();
+
+    if (is_evt_needed)
     {
-        case EDDYSTONE_FLASH_ACCESS_READ:
-            err_code = pstorage_load(p_lock_key,
-                                     &lock_key_handle,
-                                     ECS_AES_KEY_SIZE,
-                                     0);
-            RETURN_IF_ERROR(err_code);
-            break;
-        case EDDYSTONE_FLASH_ACCESS_WRITE:
-            memcpy(m_flash_buffers[blk_index].buffer, p_lock_key, ECS_AES_KEY_SIZE);
-            err_code = pstorage_update(&lock_key_handle,
-                                       m_flash_buffers[blk_index].buffer,
-                                       ECS_AES_KEY_SIZE,
-                                       0);
-            RETURN_IF_ERROR(err_code);
-            break;
-        case EDDYSTONE_FLASH_ACCESS_CLEAR:
-            err_code = pstorage_clear(&lock_key_handle,
-                                      ECS_AES_KEY_SIZE);
-            RETURN_IF_ERROR(err_code);
-            break;
-        default:
+        APP_ERROR_CHECK(app_sched_event_put(NULL, 0, flash_scheduler_evt));
+    }
+}
 
-            break;
+/**@brief Adds a request to the end of the queue
+ * @note Called in a critical region, with the room in the queue checked.
+ */
+static void flash_request_append(const flash_request_t * p_request, uint8_t const * p_write_data)
+{
+    flash_request_t * p_queued = &m_requests[m_num_of_requests++];
+
+    *p_queued = *p_request;
+    if (p_request->access_type == EDDYSTONE_FLASH_ACCESS_WRITE && p_write_data != NULL)
+    {
+        memcpy(p_queued->data, p_write_data, p_request->size);
     }
-    return NRF_SUCCESS;
 }
 
-ret_code_t eddystone_flash_access_ecdh_key_pair(uint8_t * p_priv_key,
-                                                uint8_t * p_pub_key,
-                                                eddystone_flash_access_t access_type)
+/**@brief Queues requests, all or none of them
+ * @param[in] p_requests     the requests
+ * @param[in] p_write_data   data of each write request, in the order of p_requests
+ */
+static ret_code_t flash_requests_put(const flash_request_t * p_requests, uint8_t num_of_requests, uint8_t ** p_write_data)
+{
+    ret_code_t err_code = NRF_SUCCESS;
+
+    CRITICAL_REGION_ENTER();
+    if (m_num_of_requests + num_of_requests > REQUEST_QUEUE_SIZE)
+    {
+        err_code = NRF_ERROR_NO_MEM;
+    }
+    else
+    {
+        for (uint8_t i = 0; i < num_of_requests; i++)
+        {
+            flash_request_append(&p_requests[i], p_write_data[i]);
+        }
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (err_code == NRF_SUCCESS)
+    {
+        flash_queue_kick();
+    }
+
+    return err_code;
+}
+
+/**@brief Whether the block ranges of two requests overlap*/
+static bool flash_requests_overlap(const flash_request_t * p_a, const flash_request_t * p_b)
+{
+    return (p_a->first_block < p_b->first_block + p_b->num_of_blocks)
+        && (p_b->first_block < p_a->first_block + p_a->num_of_blocks);
+}
+
+/**@brief Takes the next request off the queue
+ * @details A read is a copy from flash, so it goes ahead of the writes queued before it as long as none of them
+ *          touches its blocks. Boot reads are thus not held up by the writes of a first boot.
+ */
+static bool flash_request_next_get(flash_request_t * p_request)
+{
+    bool    is_found = false;
+    uint8_t index    = 0;
+
+    CRITICAL_REGION_ENTER();
+    for (uint8_t i = 0; i < m_num_of_requests && !is_found; i++)
+    {
+        if (m_requests[i].access_type == EDDYSTONE_FLASH_ACCESS_READ)
+        {
+            bool is_blocked = false;
+
+            for (uint8_t j = 0; j < i; j++)
+            {
+                is_blocked = is_blocked || flash_requests_overlap(&m_requests[j], &m_requests[i]);
+            }
+
+            is_found = !is_blocked;
+            index    = i;
+        }
+    }
+
+    if (!is_found && m_num_of_requests > 0)
+    {
+        is_found = true;
+        index    = 0;
+    }
+
+    if (is_found)
+    {
+        *p_request = m_requests[index];
+        m_num_of_requests--;
+        memmove(&m_requests[index], &m_requests[index + 1], (m_num_of_requests - index) * sizeof(flash_request_t));
+        m_state = FLASH_STATE_IN_FLIGHT;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return is_found;
+}
+
+/**@brief Record at a location of the log, read in place from flash*/
+static log_record_t const * log_record_get(uint16_t location)
+{
+    uint8_t  page = location / m_records_per_page;
+    uint16_t slot = location % m_records_per_page;
+
+    return (log_record_t const *)(m_page_handles[page].block_id + sizeof(log_page_header_t) + slot * sizeof(log_record_t));
+}
+
+/**@brief Fletcher-16 of a record, without its checksum field*/
+static uint16_t log_record_checksum(log_record_t const * p_record)
+{
+    uint8_t const * p_bytes = (uint8_t const *)p_record;
+    uint16_t        sum1    = 0;
+    uint16_t        sum2    = 0;
+
+    for (uint8_t i = 0; i < sizeof(log_record_t); i++)
+    {
+        if (i < offsetof(log_record_t, checksum) || i >= offsetof(log_record_t, checksum) + sizeof(p_record->checksum))
+        {
+            sum1 = (sum1 + p_bytes[i]) % 255;
+            sum2 = (sum2 + sum1) % 255;
+        }
+    }
+
+    return (sum2 << 8) | sum1;
+}
+
+/**@brief Whether flash reads as erased, the record log is larger than the blocks eddystone_flash_read_is_empty checks*/
+static bool log_is_erased(void const * p_data, uint16_t size)
+{
+    uint8_t const * p_bytes = (uint8_t const *)p_data;
+
+    for (uint16_t i = 0; i < size; i++)
+    {
+        if (p_bytes[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool log_record_is_valid(log_record_t const * p_record)
+{
+    return p_record->version != LOG_VERSION_FREE
+        && p_record->block_index <= LOG_BLOCK_COMMIT
+        && p_record->checksum == log_record_checksum(p_record);
+}
+
+/**@brief Starts compacting the page after the head if it holds records, the head is about to reach it*/
+static void log_compaction_check(void)
+{
+    uint8_t next_page = (m_head_page + 1) % APP_FLASH_LOG_NUM_OF_PAGES;
+
+    if (m_compact_page == LOG_PAGE_NONE && m_page_num_of_records[next_page] > 0)
+    {
+        m_compact_page = next_page;
+        m_num_of_compactions++;
+    }
+}
+
+/**@brief Stores m_record at the end of the log, the head moves on to the next page if it is full*/
+static ret_code_t log_record_append(void)
 {
     ret_code_t err_code;
-    pstorage_handle_t priv_ecdh_handle;
-    pstorage_handle_t pub_ecdh_handle;
+    uint16_t   slot;
 
-    const uint8_t blk_index_priv = APP_MAX_ADV_SLOTS;
-    const uint8_t blk_index_pub = APP_MAX_ADV_SLOTS + 1;
-    //Private key block is immediately after the last slot config, and public key is immediately after the privtae key
+    if (m_page_num_of_records[m_head_page] >= m_records_per_page)
+    {
+        m_head_page = (m_head_page + 1) % APP_FLASH_LOG_NUM_OF_PAGES;
+        log_compaction_check();
+    }
 
-    pstorage_block_identifier_get(&m_pstorage_base_handle, blk_index_priv , &priv_ecdh_handle);
-    pstorage_block_identifier_get(&m_pstorage_base_handle, blk_index_pub , &pub_ecdh_handle);
+    slot               = m_page_num_of_records[m_head_page];
+    m_record.version   = m_next_version;
+    m_record.checksum  = log_record_checksum(&m_record);
+    m_log_op_location  = m_head_page * m_records_per_page + slot;
 
-    switch (access_type)
+    err_code = pstorage_store(&m_page_handles[m_head_page],
+                              (uint8_t *)&m_record,
+                              sizeof(log_record_t),
+                              sizeof(log_page_header_t) + slot * sizeof(log_record_t));
+    if (err_code == NRF_SUCCESS)
     {
-        case EDDYSTONE_FLASH_ACCESS_READ:
-            err_code = pstorage_load(p_priv_key,
-                                     &priv_ecdh_handle,
-                                     FLASH_BLOCK_SIZE,
-                                     0);
-            RETURN_IF_ERROR(err_code);
-            err_code = pstorage_load(p_pub_key,
-                                     &pub_ecdh_handle,
-                                     FLASH_BLOCK_SIZE,
-                                     0);
-            RETURN_IF_ERROR(err_code);
-            break;
-        case EDDYSTONE_FLASH_ACCESS_WRITE:
-            memcpy(m_flash_buffers[blk_index_priv].buffer, p_priv_key, FLASH_BLOCK_SIZE);
-            memcpy(m_flash_buffers[blk_index_pub].buffer, p_pub_key, FLASH_BLOCK_SIZE);
-
-            err_code = pstorage_update(&priv_ecdh_handle,
-                                       m_flash_buffers[blk_index_priv].buffer,
-                                       FLASH_BLOCK_SIZE,
-                                       0);
-            RETURN_IF_ERROR(err_code);
-            err_code = pstorage_update(&pub_ecdh_handle,
-                                       m_flash_buffers[blk_index_pub].buffer,
-                                       FLASH_BLOCK_SIZE,
-                                       0);
-            RETURN_IF_ERROR(err_code);
-            break;
-        case EDDYSTONE_FLASH_ACCESS_CLEAR:
-            err_code = pstorage_clear(&priv_ecdh_handle,
-                                      FLASH_BLOCK_SIZE);
-            RETURN_IF_ERROR(err_code);
-            err_code = pstorage_clear(&pub_ecdh_handle,
-                                      FLASH_BLOCK_SIZE);
-            RETURN_IF_ERROR(err_code);
-            break;
-        default:
+        //The slot is used from now on, even if the store fails part way
+        m_page_num_of_records[m_head_page]++;
+        m_next_version++;
+    }
 
-            break;
+    return err_code;
+}
+
+/**@brief Copies the data of the latest record of a block, a block without one reads as erased flash*/
+static void log_block_read(uint8_t block_index, uint8_t * p_data, uint16_t size)
+{
+    uint16_t location = m_locations[block_index];
+
+    if (location == LOG_LOCATION_NONE || (log_record_get(location)->flags & LOG_RECORD_FLAG_CLEARED))
+    {
+        memset(p_data, 0xFF, size);
+    }
+    else
+    {
+        memcpy(p_data, log_record_get(location)->data, size);
+    }
+}
+
+/**@brief Whether a write or clear of a block is queued or in progress, which a read in place would not see*/
+static bool flash_block_is_pending(uint8_t block_index)
+{
+    flash_request_t block = {.first_block = block_index, .num_of_blocks = 1};
+    bool            is_pending;
+
+    CRITICAL_REGION_ENTER();
+    is_pending = (m_log_op == LOG_OP_REQUEST)
+              && (m_in_flight.access_type != EDDYSTONE_FLASH_ACCESS_READ)
+              && flash_requests_overlap(&m_in_flight, &block);
+    for (uint8_t i = 0; i < m_num_of_requests; i++)
+    {
+        is_pending = is_pending
+                  || ((m_requests[i].access_type != EDDYSTONE_FLASH_ACCESS_READ)
+                      && flash_requests_overlap(&m_requests[i], &block));
+    }
+    CRITICAL_REGION_EXIT();
+
+    return is_pending;
+}
+
+/**@brief Points to the data of the latest record of a block where it is in flash
+ * @param[out] pp_data  the data, NULL if the block has no record or is cleared
+ */
+static ret_code_t flash_block_get(uint8_t block_index, uint8_t const ** pp_data)
+{
+    uint16_t             location = m_locations[block_index];
+    log_record_t const * p_record;
+
+    *pp_data = NULL;
+
+    if (flash_block_is_pending(block_index))
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    if (location == LOG_LOCATION_NONE)
+    {
+        return NRF_SUCCESS;
+    }
+
+    //The scan checked the record already, nothing is copied so it is checked again where it is read
+    p_record = log_record_get(location);
+    if (!log_record_is_valid(p_record) || p_record->block_index != block_index)
+    {
+        return NRF_ERROR_INVALID_DATA;
+    }
+
+    if (!(p_record->flags & LOG_RECORD_FLAG_CLEARED))
+    {
+        *pp_data = p_record->data;
     }
+
     return NRF_SUCCESS;
 }
 
-ret_code_t eddystone_flash_access_slot_configs(uint8_t slot_no,
-                                               eddystone_flash_slot_config_t * p_config,
-                                               eddystone_flash_access_t access_type)
+/**@brief Brings the locations up to date with a stored record
+ * @param[in]     p_record          the record
+ * @param[in]     location          where it is stored
+ * @param[in,out] p_txn_locations   records of transactions not yet committed
+ */
+static void log_record_apply(log_record_t const * p_record, uint16_t location, uint16_t * p_txn_locations)
+{
+    if (p_record->block_index == LOG_BLOCK_COMMIT)
+    {
+        uint32_t start_version;
+
+        memcpy(&start_version, p_record->data, sizeof(start_version));
+        for (uint8_t i = 0; i < NUM_OF_BLOCKS; i++)
+        {
+            //Records older than the transaction are left over from one that was cut short
+            if (p_txn_locations[i] != LOG_LOCATION_NONE && log_record_get(p_txn_locations[i])->version >= start_version)
+            {
+                m_locations[i] = p_txn_locations[i];
+            }
+            p_txn_locations[i] = LOG_LOCATION_NONE;
+        }
+    }
+    else if (p_record->flags & LOG_RECORD_FLAG_TRANSACTION)
+    {
+        p_txn_locations[p_record->block_index] = location;
+    }
+    else
+    {
+        m_locations[p_record->block_index] = location;
+    }
+}
+
+/**@brief Starts the next erase, page header or compaction copy, if there is one
+ * @details These go ahead of the queued requests, so the head always has room for the copies of a compaction.
+ * @retval true if an operation is in flight
+ */
+static bool log_maintenance_start(void)
 {
     ret_code_t err_code;
-    pstorage_handle_t slot_pstorage_handle;
-    pstorage_block_identifier_get(&m_pstorage_base_handle, slot_no, &slot_pstorage_handle);
 
-    switch (access_type)
+    while (m_compact_page != LOG_PAGE_NONE)
     {
-        case EDDYSTONE_FLASH_ACCESS_READ:
-            err_code = pstorage_load((uint8_t*)p_config,
-                                     &slot_pstorage_handle,
-                                     FLASH_BLOCK_SIZE,
-                                     0);
-            RETURN_IF_ERROR(err_code);
+        uint16_t * p_location = NULL;
+        bool       is_txn     = false;
+
+        //The records of a transaction not yet committed are live too, their copies stay part of it
+        for (uint8_t i = 0; i < NUM_OF_BLOCKS && p_location == NULL; i++)
+        {
+            if (m_locations[i] != LOG_LOCATION_NONE && (m_locations[i] / m_records_per_page) == m_compact_page)
+            {
+                p_location = &m_locations[i];
+            }
+            else if (m_txn_locations[i] != LOG_LOCATION_NONE && (m_txn_locations[i] / m_records_per_page) == m_compact_page)
+            {
+                p_location = &m_txn_locations[i];
+                is_txn     = true;
+            }
+        }
+
+        if (p_location == NULL)
+        {
+            //No live records are left in the page
+            m_page_erase_mask |= (1UL << m_compact_page);
+            m_compact_page     = LOG_PAGE_NONE;
+        }
+        else if (!is_txn && (log_record_get(*p_location)->flags & LOG_RECORD_FLAG_CLEARED))
+        {
+            //Every older record of the block is in this page too, so the clear goes with the erase
+            *p_location = LOG_LOCATION_NONE;
+        }
+        else
+        {
+            memcpy(&m_record, log_record_get(*p_location), sizeof(log_record_t));
+            if (!is_txn)
+            {
+                //A committed record does not need its commit marker anymore
+                m_record.flags &= ~LOG_RECORD_FLAG_TRANSACTION;
+            }
+            m_log_op = LOG_OP_COPY;
+            m_state  = FLASH_STATE_IN_FLIGHT;
+            APP_ERROR_CHECK(log_record_append());
+            m_num_of_copies++;
+            return true;
+        }
+    }
+
+    for (uint8_t page = 0; page < APP_FLASH_LOG_NUM_OF_PAGES; page++)
+    {
+        if (m_page_erase_mask & (1UL << page))
+        {
+            m_log_op      = LOG_OP_ERASE;
+            m_log_op_page = page;
+            m_state       = FLASH_STATE_IN_FLIGHT;
+            err_code      = pstorage_clear(&m_page_handles[page], PSTORAGE_FLASH_PAGE_SIZE);
+            APP_ERROR_CHECK(err_code);
+            return true;
+        }
+        if (m_page_header_mask & (1UL << page))
+        {
+            log_page_header_t const * p_header = (log_page_header_t const *)(uintptr_t)m_page_handles[page].block_id;
+            pstorage_size_t           offset   = (p_header->magic == LOG_PAGE_MAGIC) ? sizeof(p_header->magic) : 0;
+
+            //Only the count is stored if the magic made it before a reset
+            m_page_header.magic       = LOG_PAGE_MAGIC;
+            m_page_header.erase_count = m_page_erase_counts[page];
+            m_log_op      = LOG_OP_HEADER;
+            m_log_op_page = page;
+            m_state       = FLASH_STATE_IN_FLIGHT;
+            err_code      = pstorage_store(&m_page_handles[page],
+                                           (uint8_t *)&m_page_header + offset,
+                                           sizeof(log_page_header_t) - offset,
+                                           offset);
+            APP_ERROR_CHECK(err_code);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**@brief Brings the log up to date with an operation that has completed*/
+static void log_op_complete(log_op_t op, flash_request_t const * p_request, ret_code_t result)
+{
+    if (result != NRF_SUCCESS)
+    {
+        return;
+    }
+
+    switch (op)
+    {
+        case LOG_OP_REQUEST:
+            if (p_request->access_type == EDDYSTONE_FLASH_ACCESS_READ)
+            {
+                break;
+            }
+            //fall through
+        case LOG_OP_COPY:
+            log_record_apply(&m_record, m_log_op_location, m_txn_locations);
+            if (m_record.block_index == LOG_BLOCK_COMMIT)
+            {
+                m_is_txn_started = false;
+            }
             break;
-        case EDDYSTONE_FLASH_ACCESS_WRITE:
-            memcpy(m_flash_buffers[slot_no].buffer, p_config, FLASH_BLOCK_SIZE);
-            err_code = pstorage_update(&slot_pstorage_handle,
-                                       m_flash_buffers[slot_no].buffer,
-                                       FLASH_BLOCK_SIZE,
-                                       0);
-            RETURN_IF_ERROR(err_code);
+        case LOG_OP_ERASE:
+            m_page_erase_counts[m_log_op_page]++;
+            m_page_num_of_records[m_log_op_page] = 0;
+            m_page_erase_mask  &= ~(1UL << m_log_op_page);
+            m_page_header_mask |= (1UL << m_log_op_page);
+            DEBUG_PRINTF(0, "Log page %d erased, %d erases \r\n", m_log_op_page, m_page_erase_counts[m_log_op_page]);
             break;
-        case EDDYSTONE_FLASH_ACCESS_CLEAR:
-            err_code = pstorage_clear(&slot_pstorage_handle,
-                                      FLASH_BLOCK_SIZE);
-            RETURN_IF_ERROR(err_code);
+        case LOG_OP_HEADER:
+            m_page_header_mask &= ~(1UL << m_log_op_page);
             break;
         default:
             break;
     }
-    return NRF_SUCCESS;
 }
 
-ret_code_t eddystone_flash_access_flags(eddystone_flash_flags_t * p_flags, eddystone_flash_access_t access_type)
+/**@brief Finds the latest record of every block and the head of the log*/
+static void log_scan(void)
 {
-    ret_code_t err_code;
-    pstorage_handle_t flags_handle;
-    const uint8_t blk_index = APP_MAX_ADV_SLOTS+3;
-    pstorage_block_identifier_get(&m_pstorage_base_handle, blk_index, &flags_handle);
+    bool     is_any_record   = false;
+    uint32_t max_version     = 0;
+    uint32_t max_erase_count = 0;
+
+    memset(m_locations, 0xFF, sizeof(m_locations));
+    memset(m_txn_locations, 0xFF, sizeof(m_txn_locations));
+    m_head_page         = 0;
+    m_compact_page      = LOG_PAGE_NONE;
+    m_page_erase_mask   = 0;
+    m_page_header_mask  = 0;
+
+    for (uint8_t page = 0; page < APP_FLASH_LOG_NUM_OF_PAGES; page++)
+    {
+        log_page_header_t const * p_header = (log_page_header_t const *)(uintptr_t)m_page_handles[page].block_id;
+
+        m_page_erase_counts[page] = 0;
+        if (p_header->magic == LOG_PAGE_MAGIC && p_header->erase_count != LOG_VERSION_FREE)
+        {
+            m_page_erase_counts[page] = p_header->erase_count;
+        }
+        else
+        {
+            m_page_header_mask |= (1UL << page);
+
+            //An erase a reset cut short may leave anything in the header, the page is erased again before it gets one
+            if (p_header->erase_count != LOG_VERSION_FREE ||
+                (p_header->magic != LOG_PAGE_MAGIC && p_header->magic != LOG_VERSION_FREE))
+            {
+                m_page_erase_mask |= (1UL << page);
+            }
+        }
+
+        //A store that failed may leave a free record in between, so the whole page is scanned. A record is used if
+        //anything at all is stored in it, an erase cut short may leave its version erased and the rest not
+        m_page_num_of_records[page] = 0;
+        for (uint16_t slot = 0; slot < m_records_per_page; slot++)
+        {
+            uint16_t             location = page * m_records_per_page + slot;
+            log_record_t const * p_record = log_record_get(location);
+
+            if (log_is_erased(p_record, sizeof(log_record_t)))
+            {
+                continue;
+            }
+            m_page_num_of_records[page] = slot + 1;
+
+            //An erase cut short may leave any version in what is left of a record, only a valid one moves the head
+            if (log_record_is_valid(p_record) && (!is_any_record || p_record->version >= max_version))
+            {
+                is_any_record = true;
+                max_version   = p_record->version;
+                m_head_page   = page;
+            }
+        }
+    }
+
+    //Records are stored in the order of their versions, from the page after the head round to the head
+    for (uint8_t n = 1; n <= APP_FLASH_LOG_NUM_OF_PAGES; n++)
+    {
+        uint8_t page = (m_head_page + n) % APP_FLASH_LOG_NUM_OF_PAGES;
+
+        for (uint16_t slot = 0; slot < m_page_num_of_records[page]; slot++)
+        {
+            uint16_t             location = page * m_records_per_page + slot;
+            log_record_t const * p_record = log_record_get(location);
+
+            if (log_record_is_valid(p_record))
+            {
+                log_record_apply(p_record, location, m_txn_locations);
+            }
+        }
+    }
 
-    switch (access_type)
+    //A transaction without its commit marker never happened
+    memset(m_txn_locations, 0xFF, sizeof(m_txn_locations));
+    m_is_txn_started = false;
+
+    m_next_version = is_any_record ? max_version + 1 : 0;
+
+    //A reset between an erase and the header that follows loses the count of that page. The pages are erased in ring
+    //order, so the page before it has been erased as often. If that count is lost too, the highest count stands in
+    for (uint8_t page = 0; page < APP_FLASH_LOG_NUM_OF_PAGES; page++)
+    {
+        if (m_page_erase_counts[page] > max_erase_count)
+        {
+            max_erase_count = m_page_erase_counts[page];
+        }
+    }
+    for (uint8_t page = 0; page < APP_FLASH_LOG_NUM_OF_PAGES; page++)
+    {
+        uint8_t previous_page = (page + APP_FLASH_LOG_NUM_OF_PAGES - 1) % APP_FLASH_LOG_NUM_OF_PAGES;
+
+        if (m_page_header_mask & (1UL << page))
+        {
+            m_page_erase_counts[page] = (m_page_header_mask & (1UL << previous_page)) ? max_erase_count
+                                                                                      : m_page_erase_counts[previous_page];
+        }
+    }
+
+    //A page the head had just moved on to may hold nothing but a record a reset cut short. The head carries on from
+    //there, as the next append would have, instead of taking the page for one to compact
+    if (m_page_num_of_records[m_head_page] >= m_records_per_page)
+    {
+        uint8_t next_page    = (m_head_page + 1) % APP_FLASH_LOG_NUM_OF_PAGES;
+        bool    is_any_valid = false;
+
+        for (uint16_t slot = 0; slot < m_page_num_of_records[next_page]; slot++)
+        {
+            is_any_valid = is_any_valid || log_record_is_valid(log_record_get(next_page * m_records_per_page + slot));
+        }
+        if (m_page_num_of_records[next_page] > 0 && !is_any_valid && !(m_page_header_mask & (1UL << next_page)))
+        {
+            m_head_page = next_page;
+        }
+    }
+
+    //Picks up a compaction a reset cut short
+    log_compaction_check();
+}
+
+/**@brief Hands a request to the log
+ * @note A read is a copy from flash and completes at once.
+ */
+static void flash_request_submit(const flash_request_t * p_request)
+{
+    ret_code_t err_code = NRF_SUCCESS;
+
+    m_log_op = LOG_OP_REQUEST;
+
+    switch (p_request->access_type)
     {
         case EDDYSTONE_FLASH_ACCESS_READ:
-            err_code = pstorage_load((uint8_t*)p_flags,
-                                     &flags_handle,
-                                     FLASH_BLOCK_SIZE,
-                                     0);
-            RETURN_IF_ERROR(err_code);
-            break;
+            log_block_read(p_request->block_index, p_request->p_data, p_request->size);
+            m_in_flight_result = NRF_SUCCESS;
+            m_state            = FLASH_STATE_COMPLETE;
+            flash_queue_kick();
+            return;
         case EDDYSTONE_FLASH_ACCESS_WRITE:
-            memcpy(m_flash_buffers[blk_index].buffer, p_flags, FLASH_BLOCK_SIZE);
-            err_code = pstorage_update(&flags_handle,
-                                       m_flash_buffers[blk_index].buffer,
-                                       FLASH_BLOCK_SIZE,
-                                       0);
-            RETURN_IF_ERROR(err_code);
-            break;
         case EDDYSTONE_FLASH_ACCESS_CLEAR:
-            err_code = pstorage_clear(&flags_handle,
-                                      FLASH_BLOCK_SIZE);
-            RETURN_IF_ERROR(err_code);
+            memset(&m_record, 0xFF, sizeof(m_record));
+            m_record.block_index = p_request->block_index;
+            m_record.flags       = p_request->record_flags;
+            if (p_request->block_index == LOG_BLOCK_COMMIT)
+            {
+                if (!m_is_txn_started)
+                {
+                    //Nothing to commit
+                    m_in_flight_result = NRF_SUCCESS;
+                    m_state            = FLASH_STATE_COMPLETE;
+                    flash_queue_kick();
+                    return;
+                }
+                memcpy(m_record.data, &m_txn_start_version, sizeof(m_txn_start_version));
+            }
+            else if (p_request->access_type == EDDYSTONE_FLASH_ACCESS_WRITE)
+            {
+                memcpy(m_record.data, p_request->data, p_request->size);
+            }
+            else
+            {
+                m_record.flags |= LOG_RECORD_FLAG_CLEARED;
+            }
+
+            err_code = log_record_append();
+            if (err_code == NRF_SUCCESS)
+            {
+                m_num_of_records++;
+                if ((m_record.flags & LOG_RECORD_FLAG_TRANSACTION) && !m_is_txn_started)
+                {
+                    m_is_txn_started    = true;
+                    m_txn_start_version = m_record.version;
+                }
+            }
             break;
         default:
-
+            err_code = NRF_ERROR_INVALID_PARAM;
             break;
     }
+
+    if (err_code != NRF_SUCCESS)
+    {
+        m_in_flight_result = err_code;
+        m_state            = FLASH_STATE_COMPLETE;
+        flash_queue_kick();
+    }
+}
+
+/**@brief Calls back the owner of the completed request and submits the next one*/
+static void flash_scheduler_evt(void * p_event_data, uint16_t event_size)
+{
+    flash_request_t done;
+    ret_code_t      result = NRF_SUCCESS;
+    bool            is_done;
+
+    CRITICAL_REGION_ENTER();
+    m_is_evt_pending = false;
+    is_done          = (m_state == FLASH_STATE_COMPLETE);
+    if (is_done)
+    {
+        done    = m_in_flight;
+        result  = m_in_flight_result;
+        m_state = FLASH_STATE_IDLE;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (is_done)
+    {
+        log_op_t op = m_log_op;
+
+        m_log_op = LOG_OP_NONE;
+        log_op_complete(op, &done, result);
+
+        if (op == LOG_OP_REQUEST && done.done_cb != NULL)
+        {
+            done.done_cb(result, done.p_context);
+        }
+        else
+        {
+            APP_ERROR_CHECK(result);
+        }
+    }
+
+    //The callback may have queued more requests, a read among them goes first
+    if (m_state == FLASH_STATE_IDLE && !log_maintenance_start() && flash_request_next_get(&m_in_flight))
+    {
+        flash_request_submit(&m_in_flight);
+    }
+}
+
+/**@brief pstorage callback, from the SoftDevice event interrupt*/
+static void flash_pstorage_cb(pstorage_handle_t * p_handle,
+                              uint8_t             op_code,
+                              uint32_t            result,
+                              uint8_t *           p_data,
+                              uint32_t            data_len)
+{
+    if (result == NRF_SUCCESS)
+    {
+        DEBUG_PRINTF(0, " Flash op %d Success \r\n", op_code);
+    }
+    else
+    {
+        DEBUG_PRINTF(0, " Flash op %d Fail \r\n", op_code);
+    }
+
+    m_in_flight_result = result;
+    m_state            = FLASH_STATE_COMPLETE;
+    flash_queue_kick();
+}
+
+/**@brief Queues an access to one area of consecutive blocks*/
+static ret_code_t flash_access(uint8_t block_index,
+                               uint8_t num_of_blocks,
+                               uint16_t size,
+                               uint8_t * p_data,
+                               eddystone_flash_access_t access_type,
+                               eddystone_flash_done_cb_t done_cb,
+                               void * p_context)
+{
+    flash_request_t request =
+    {
+        .access_type   = access_type,
+        .block_index   = block_index,
+        .first_block   = block_index,
+        .num_of_blocks = num_of_blocks,
+        .size          = size,
+        .record_flags  = 0,
+        .p_data        = p_data,
+        .done_cb       = done_cb,
+        .p_context     = p_context
+    };
+
+    return flash_requests_put(&request, 1, &p_data);
+}
+
+
+ret_code_t eddystone_flash_access_lock_key(uint8_t * p_lock_key,
+                                           eddystone_flash_access_t access_type,
+                                           eddystone_flash_done_cb_t done_cb,
+                                           void * p_context)
+{
+    return flash_access(BLOCK_INDEX_LOCK_KEY, 1, ECS_AES_KEY_SIZE, p_lock_key, access_type, done_cb, p_context);
+}
+
+ret_code_t eddystone_flash_access_ecdh_key_pair(uint8_t * p_priv_key,
+                                                uint8_t * p_pub_key,
+                                                eddystone_flash_access_t access_type,
+                                                eddystone_flash_done_cb_t done_cb,
+                                                void * p_context)
+{
+    uint8_t *       p_data[2]     = {p_priv_key, p_pub_key};
+    flash_request_t requests[2];
+
+    //One key is of no use without the other, so they are written and cleared together
+    if (access_type != EDDYSTONE_FLASH_ACCESS_READ)
+    {
+        eddystone_flash_transaction_t transaction;
+
+        eddystone_flash_transaction_init(&transaction);
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            RETURN_IF_ERROR(flash_transaction_add(&transaction, BLOCK_INDEX_ECDH_PRIV + i, FLASH_BLOCK_SIZE, p_data[i], access_type));
+        }
+        return eddystone_flash_transaction_commit(&transaction, done_cb, p_context);
+    }
+
+    //Private key block is immediately after the last slot config, and public key is immediately after the private key
+    memset(requests, 0, sizeof(requests));
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        requests[i].access_type   = access_type;
+        requests[i].block_index   = BLOCK_INDEX_ECDH_PRIV + i;
+        requests[i].first_block   = BLOCK_INDEX_ECDH_PRIV;
+        requests[i].num_of_blocks = i + 1;
+        requests[i].size          = FLASH_BLOCK_SIZE;
+        requests[i].p_data        = p_data[i];
+    }
+
+    //Only the second access calls back, it is ordered against both blocks so that it never overtakes the first
+    requests[1].done_cb   = done_cb;
+    requests[1].p_context = p_context;
+
+    return flash_requests_put(requests, 2, p_data);
+}
+
+ret_code_t eddystone_flash_access_slot_configs(uint8_t slot_no,
+                                               eddystone_flash_slot_config_t * p_config,
+                                               eddystone_flash_access_t access_type,
+                                               eddystone_flash_done_cb_t done_cb,
+                                               void * p_context)
+{
+    return flash_access(slot_no, 1, FLASH_BLOCK_SIZE, (uint8_t *)p_config, access_type, done_cb, p_context);
+}
+
+ret_code_t eddystone_flash_access_flags(eddystone_flash_flags_t * p_flags,
+                                        eddystone_flash_access_t access_type,
+                                        eddystone_flash_done_cb_t done_cb,
+                                        void * p_context)
+{
+    return flash_access(BLOCK_INDEX_FLAGS, 1, FLASH_BLOCK_SIZE, (uint8_t *)p_flags, access_type, done_cb, p_context);
+}
+
+ret_code_t eddystone_flash_slot_config_get(uint8_t slot_no, eddystone_flash_slot_config_t const ** pp_config)
+{
+    return flash_block_get(slot_no, (uint8_t const **)pp_config);
+}
+
+ret_code_t eddystone_flash_flags_get(eddystone_flash_flags_t const ** pp_flags)
+{
+    return flash_block_get(BLOCK_INDEX_FLAGS, (uint8_t const **)pp_flags);
+}
+
+void eddystone_flash_transaction_init(eddystone_flash_transaction_t * p_transaction)
+{
+    p_transaction->num_of_records = 0;
+}
+
+/**@brief Adds a write or clear of a block to a transaction, replacing the one of the block already in it*/
+static ret_code_t flash_transaction_add(eddystone_flash_transaction_t * p_transaction,
+                                        uint8_t block_index,
+                                        uint16_t size,
+                                        uint8_t const * p_data,
+                                        eddystone_flash_access_t access_type)
+{
+    uint8_t index = 0;
+
+    if (access_type == EDDYSTONE_FLASH_ACCESS_READ)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    while (index < p_transaction->num_of_records && p_transaction->records[index].block_index != block_index)
+    {
+        index++;
+    }
+
+    if (index == EDDYSTONE_FLASH_TRANSACTION_MAX_RECORDS)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    p_transaction->records[index].block_index = block_index;
+    p_transaction->records[index].access_type = access_type;
+    p_transaction->records[index].size        = size;
+    p_transaction->records[index].p_data      = p_data;
+    if (index == p_transaction->num_of_records)
+    {
+        p_transaction->num_of_records++;
+    }
+
     return NRF_SUCCESS;
 }
 
+ret_code_t eddystone_flash_transaction_slot_config_add(eddystone_flash_transaction_t * p_transaction,
+                                                       uint8_t slot_no,
+                                                       eddystone_flash_slot_config_t const * p_config,
+                                                       eddystone_flash_access_t access_type)
+{
+    return flash_transaction_add(p_transaction, slot_no, FLASH_BLOCK_SIZE, (uint8_t const *)p_config, access_type);
+}
+
+ret_code_t eddystone_flash_transaction_flags_add(eddystone_flash_transaction_t * p_transaction,
+                                                 eddystone_flash_flags_t const * p_flags)
+{
+    return flash_transaction_add(p_transaction, BLOCK_INDEX_FLAGS, FLASH_BLOCK_SIZE, (uint8_t const *)p_flags,
+                                 EDDYSTONE_FLASH_ACCESS_WRITE);
+}
+
+ret_code_t eddystone_flash_transaction_commit(eddystone_flash_transaction_t const * p_transaction,
+                                              eddystone_flash_done_cb_t done_cb,
+                                              void * p_context)
+{
+    ret_code_t      err_code = NRF_SUCCESS;
+    flash_request_t request;
+
+    memset(&request, 0, sizeof(request));
+
+    CRITICAL_REGION_ENTER();
+    if (m_num_of_requests + p_transaction->num_of_records + 1 > REQUEST_QUEUE_SIZE)
+    {
+        err_code = NRF_ERROR_NO_MEM;
+    }
+    else
+    {
+        //Queued back to back with the commit marker, so no other write ends up in the transaction
+        for (uint8_t i = 0; i < p_transaction->num_of_records; i++)
+        {
+            request.access_type   = p_transaction->records[i].access_type;
+            request.block_index   = p_transaction->records[i].block_index;
+            request.first_block   = p_transaction->records[i].block_index;
+            request.num_of_blocks = 1;
+            request.size          = p_transaction->records[i].size;
+            request.record_flags  = LOG_RECORD_FLAG_TRANSACTION;
+            flash_request_append(&request, p_transaction->records[i].p_data);
+        }
+
+        //A read queued after the commit waits for it, the blocks only change once the marker is stored
+        request.access_type   = EDDYSTONE_FLASH_ACCESS_WRITE;
+        request.block_index   = LOG_BLOCK_COMMIT;
+        request.first_block   = 0;
+        request.num_of_blocks = NUM_OF_BLOCKS;
+        request.size          = 0;
+        request.record_flags  = 0;
+        request.done_cb       = done_cb;
+        request.p_context     = p_context;
+        flash_request_append(&request, NULL);
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (err_code == NRF_SUCCESS)
+    {
+        flash_queue_kick();
+    }
+
+    return err_code;
+}
+
 uint32_t eddystone_flash_num_pending_ops(void)
 {
-    ret_code_t err_code;
     uint32_t num_pending;
-    err_code = pstorage_access_status_get(&num_pending);
-    APP_ERROR_CHECK(err_code);
+
+    CRITICAL_REGION_ENTER();
+    num_pending = m_num_of_requests + ((m_state != FLASH_STATE_IDLE) ? 1 : 0);
+    CRITICAL_REGION_EXIT();
+
     return num_pending;
 }
 
@@ -215,35 +1060,61 @@ bool eddystone_flash_read_is_empty(uint8_t * p_input_array, uint8_t length)
     }
 }
 
-ret_code_t eddystone_flash_init(pstorage_ntf_cb_t ps_cb)
+void eddystone_flash_log_report_get(eddystone_flash_log_report_t * p_report)
+{
+    memcpy(p_report->erase_counts, m_page_erase_counts, sizeof(p_report->erase_counts));
+    p_report->head_page          = m_head_page;
+    p_report->free_records       = m_records_per_page - m_page_num_of_records[m_head_page];
+    p_report->num_of_compactions = m_num_of_compactions;
+    p_report->num_of_records     = m_num_of_records;
+    p_report->num_of_copies      = m_num_of_copies;
+}
+
+ret_code_t eddystone_flash_init(void)
 {
     ret_code_t                err_code;
     pstorage_module_param_t pstorage_params;
 
     pstorage_init();
 
-    pstorage_params.cb          = ps_cb;
-    pstorage_params.block_size  = FLASH_BLOCK_SIZE;
-    pstorage_params.block_count = NUM_OF_BLOCKS;
-    //One block for each slot's config, 2 for ECDH pair, 1 for lock key, 1 for Factory state flag
+    m_num_of_requests = 0;
+    m_state           = FLASH_STATE_IDLE;
+    m_is_evt_pending  = false;
+    m_log_op          = LOG_OP_NONE;
 
-    /* Flash Block Layout:
+    //One block of pstorage for each page of the record log, see @ref log_record_t
+    pstorage_params.cb          = flash_pstorage_cb;
+    pstorage_params.block_size  = PSTORAGE_FLASH_PAGE_SIZE;
+    pstorage_params.block_count = APP_FLASH_LOG_NUM_OF_PAGES;
+
+    /* Record keys, the block index of each record:
     [ Slot 0 config ].... [ Slot (APP_MAX_ADV_SLOTS - 1) config] [ Private ECDH ] [ Public ECDH ] [Lock Key] [Flags]
     */
     err_code = pstorage_register(&pstorage_params, &m_pstorage_base_handle);
     RETURN_IF_ERROR(err_code);
 
-    #ifdef ERASE_FLASH_ON_REBOOT
-    DEBUG_PRINTF(0, "Clearing all configurations stored in \r\n",0);
-    err_code = pstorage_clear(&m_pstorage_base_handle, pstorage_params.block_size*pstorage_params.block_count);
-    APP_ERROR_CHECK(err_code);
-
-    uint32_t ops_pending = eddystone_flash_num_pending_ops();
-    while (ops_pending != 0)
+    for (uint8_t page = 0; page < APP_FLASH_LOG_NUM_OF_PAGES; page++)
     {
-      ops_pending = eddystone_flash_num_pending_ops();
+        err_code = pstorage_block_identifier_get(&m_pstorage_base_handle, page, &m_page_handles[page]);
+        RETURN_IF_ERROR(err_code);
     }
+
+    m_records_per_page = (PSTORAGE_FLASH_PAGE_SIZE - sizeof(log_page_header_t)) / sizeof(log_record_t);
+    log_scan();
+
+    #ifdef ERASE_FLASH_ON_REBOOT
+    DEBUG_PRINTF(0, "Clearing all configurations stored in \r\n",0);
+    //The erase counts are kept from the scan
+    memset(m_locations, 0xFF, sizeof(m_locations));
+    m_head_page       = 0;
+    m_compact_page    = LOG_PAGE_NONE;
+    m_page_erase_mask = (1UL << APP_FLASH_LOG_NUM_OF_PAGES) - 1;
     #endif
 
+    DEBUG_PRINTF(0, "Log head on page %d, %d records in it \r\n", m_head_page, m_page_num_of_records[m_head_page]);
+
+    //Runs the erases and headers the log is left with
+    flash_queue_kick();
+
     return NRF_SUCCESS;
 }
@@ -0,0 +1,112 @@
+#include "eddystone_hkdf.h"
+#include <string.h>
+
+#define HMAC_IPAD   0x36
+#define HMAC_OPAD   0x5c
+
+void eddystone_hkdf_hmac_key_set(eddystone_hkdf_hmac_key_t * p_hmac_key, const uint8_t * p_key, uint16_t key_length)
+{
+    uint8_t block[CF_SHA256_BLOCKSZ];
+
+    memset(block, 0, sizeof(block));
+    if (key_length > CF_SHA256_BLOCKSZ)
+    {
+        cf_sha256_init(&p_hmac_key->inner);
+        cf_sha256_update(&p_hmac_key->inner, p_key, key_length);
+        cf_sha256_digest_final(&p_hmac_key->inner, block);
+    }
+    else if (key_length > 0)
+    {
+        memcpy(block, p_key, key_length);
+    }
+
+    for (uint8_t i = 0; i < CF_SHA256_BLOCKSZ; i++)
+    {
+        block[i] ^= HMAC_IPAD;
+    }
+    cf_sha256_init(&p_hmac_key->inner);
+    cf_sha256_update(&p_hmac_key->inner, block, CF_SHA256_BLOCKSZ);
+
+    for (uint8_t i = 0; i < CF_SHA256_BLOCKSZ; i++)
+    {
+        block[i] ^= HMAC_IPAD ^ HMAC_OPAD;
+    }
+    cf_sha256_init(&p_hmac_key->outer);
+    cf_sha256_update(&p_hmac_key->outer, block, CF_SHA256_BLOCKSZ);
+
+    memset(block, 0, sizeof(block));
+}
+
+/**@brief Finishes an HMAC whose message has been absorbed into the inner state, the key is consumed*/
+static void hmac_final(eddystone_hkdf_hmac_key_t * p_hmac_key, uint8_t * p_mac)
+{
+    cf_sha256_digest_final(&p_hmac_key->inner, p_mac);
+    cf_sha256_update(&p_hmac_key->outer, p_mac, CF_SHA256_HASHSZ);
+    cf_sha256_digest_final(&p_hmac_key->outer, p_mac);
+}
+
+void eddystone_hkdf_extract(const uint8_t * p_salt, uint16_t salt_length,
+                            const uint8_t * p_ikm, uint16_t ikm_length,
+                            uint8_t * p_prk)
+{
+    eddystone_hkdf_hmac_key_t hmac_key;
+
+    //An absent salt is HashLen zeros, which pad to the same key block as no key at all
+    eddystone_hkdf_hmac_key_set(&hmac_key, p_salt, salt_length);
+    cf_sha256_update(&hmac_key.inner, p_ikm, ikm_length);
+    hmac_final(&hmac_key, p_prk);
+
+    memset(&hmac_key, 0, sizeof(hmac_key));
+}
+
+void eddystone_hkdf_expand(const uint8_t * p_prk,
+                           const uint8_t * p_info, uint16_t info_length,
+                           uint8_t * p_okm, uint16_t okm_length)
+{
+    eddystone_hkdf_hmac_key_t prk_key;
+    eddystone_hkdf_hmac_key_t block_key;
+    uint8_t                   t[CF_SHA256_HASHSZ];
+    uint8_t                   counter = 1;
+
+    eddystone_hkdf_hmac_key_set(&prk_key, p_prk, EDDYSTONE_HKDF_PRK_SIZE);
+
+    while (okm_length > 0)
+    {
+        uint8_t length = (okm_length < CF_SHA256_HASHSZ) ? okm_length : CF_SHA256_HASHSZ;
+
+        //T(n) = HMAC(PRK, T(n - 1) | info | n), every block starts from the same midstates
+        memcpy(&block_key, &prk_key, sizeof(block_key));
+        if (counter > 1)
+        {
+            cf_sha256_update(&block_key.inner, t, CF_SHA256_HASHSZ);
+        }
+        if (info_length > 0)
+        {
+            cf_sha256_update(&block_key.inner, p_info, info_length);
+        }
+        cf_sha256_update(&block_key.inner, &counter, sizeof(counter));
+        hmac_final(&block_key, t);
+
+        memcpy(p_okm, t, length);
+        p_okm      += length;
+        okm_length -= length;
+        counter++;
+    }
+
+    memset(&prk_key, 0, sizeof(prk_key));
+    memset(&block_key, 0, sizeof(block_key));
+    memset(t, 0, sizeof(t));
+}
+
+void eddystone_hkdf(const uint8_t * p_salt, uint16_t salt_length,
+                    const uint8_t * p_ikm, uint16_t ikm_length,
+                    const uint8_t * p_info, uint16_t info_length,
+                    uint8_t * p_okm, uint16_t okm_length)
+{
+    uint8_t prk[EDDYSTONE_HKDF_PRK_SIZE];
+
+    eddystone_hkdf_extract(p_salt, salt_length, p_ikm, ikm_length, prk);
+    eddystone_hkdf_expand(prk, p_info, info_length, p_okm, okm_length);
+
+    memset(prk, 0, sizeof(prk));
+}
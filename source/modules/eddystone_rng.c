@@ -0,0 +1,151 @@
+#include "eddystone_rng.h"
+#include "eddystone_app_config.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "nrf_soc.h"
+#include "macros_common.h"
+#include <string.h>
+#include <stdbool.h>
+
+#if APP_RNG_RESERVOIR_SIZE > 255
+    #error "APP_RNG_RESERVOIR_SIZE must fit in a uint8_t"
+#endif
+
+#define RNG_REFILL_INTERVAL     APP_TIMER_TICKS(20, APP_TIMER_PRESCALER)    /**< Time for the SoftDevice RNG pool to gather some more bytes */
+
+static uint8_t                  m_reservoir[APP_RNG_RESERVOIR_SIZE];
+static uint8_t                  m_level;            //Bytes are served from the top of the reservoir
+static eddystone_rng_ready_cb_t m_ready_cb;         //Consumer waiting for m_wait_length bytes, or NULL
+static uint8_t                  m_wait_length;
+static bool                     m_is_timer_running;
+static eddystone_rng_stats_t    m_stats;
+
+APP_TIMER_DEF(m_rng_timer);
+
+/**@brief Moves what the SoftDevice RNG pool holds into the reservoir and calls back a waiting consumer if it can be served*/
+static void reservoir_refill(void)
+{
+    eddystone_rng_ready_cb_t ready_cb = NULL;
+    uint8_t                  bytes_available;
+    uint8_t                  num_of_bytes;
+    bool                     is_timer_needed;
+
+    CRITICAL_REGION_ENTER();
+    UNUSED_VARIABLE(sd_rand_application_bytes_available_get(&bytes_available));
+    num_of_bytes = MIN(bytes_available, APP_RNG_RESERVOIR_SIZE - m_level);
+
+    if (num_of_bytes > 0 && sd_rand_application_vector_get(&m_reservoir[m_level], num_of_bytes) == NRF_SUCCESS)
+    {
+        m_level += num_of_bytes;
+    }
+
+    if (m_ready_cb != NULL && m_level >= m_wait_length)
+    {
+        ready_cb   = m_ready_cb;
+        m_ready_cb = NULL;
+    }
+
+    is_timer_needed    = (m_level < APP_RNG_RESERVOIR_SIZE) && !m_is_timer_running;
+    m_is_timer_running = m_is_timer_running || is_timer_needed;
+    m_stats.level      = m_level;
+    CRITICAL_REGION_EXIT();
+
+    if (is_timer_needed)
+    {
+        APP_ERROR_CHECK(app_timer_start(m_rng_timer, RNG_REFILL_INTERVAL, NULL));
+    }
+
+    if (ready_cb != NULL)
+    {
+        ready_cb();
+    }
+}
+
+static void rng_timeout(void * p_context)
+{
+    m_is_timer_running = false;
+    reservoir_refill();
+}
+
+ret_code_t eddystone_rng_init(void)
+{
+    ret_code_t err_code;
+
+    m_level            = 0;
+    m_ready_cb         = NULL;
+    m_is_timer_running = false;
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_stats.level_min  = APP_RNG_RESERVOIR_SIZE;
+
+    err_code = app_timer_create(&m_rng_timer, APP_TIMER_MODE_SINGLE_SHOT, rng_timeout);
+    RETURN_IF_ERROR(err_code);
+
+    reservoir_refill();
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t eddystone_rng_bytes_get(uint8_t * p_buff, uint8_t length)
+{
+    ret_code_t err_code = NRF_SUCCESS;
+
+    CRITICAL_REGION_ENTER();
+    if (length > m_level)
+    {
+        m_stats.num_of_shortfalls++;
+        err_code = NRF_ERROR_SOC_RAND_NOT_ENOUGH_VALUES;
+    }
+    else
+    {
+        m_level -= length;
+        memcpy(p_buff, &m_reservoir[m_level], length);
+        //Bytes are only ever handed out once
+        memset(&m_reservoir[m_level], 0, length);
+
+        m_stats.num_of_requests++;
+        m_stats.level_min = MIN(m_stats.level_min, m_level);
+    }
+    CRITICAL_REGION_EXIT();
+
+    //Top up right away, whatever the SoftDevice pool already holds
+    reservoir_refill();
+
+    return err_code;
+}
+
+ret_code_t eddystone_rng_bytes_wait(uint8_t length, eddystone_rng_ready_cb_t ready_cb)
+{
+    ret_code_t err_code = NRF_SUCCESS;
+
+    CRITICAL_REGION_ENTER();
+    if (m_ready_cb != NULL)
+    {
+        err_code = NRF_ERROR_BUSY;
+    }
+    else
+    {
+        m_wait_length = MIN(length, APP_RNG_RESERVOIR_SIZE);
+        m_ready_cb    = ready_cb;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (err_code == NRF_SUCCESS)
+    {
+        reservoir_refill();
+    }
+
+    return err_code;
+}
+
+void eddystone_rng_on_sys_evt(uint32_t evt_id)
+{
+    UNUSED_PARAMETER(evt_id);
+    reservoir_refill();
+}
+
+void eddystone_rng_stats_get(eddystone_rng_stats_t * p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = m_stats;
+    CRITICAL_REGION_EXIT();
+}
@@ -6,26 +6,17 @@
 #include "nrf_soc.h"
 #include "pstorage.h"
 #include "eddystone_flash.h"
-#include "nrf_soc.h"
-#include "tiny-aes128-c\aes.h"
+#include "eddystone_rng.h"
 #include "app_timer.h"
+#include "app_scheduler.h"
+#include "app_util_platform.h"
 #include "eddystone_app_config.h"
 #include "macros_common.h"
 #include "SEGGER_RTT.h"
 #include "debug_config.h"
 
-//EAX Crypto
-#include "modes.h"
-#include "aes.h"
-
-//ECDH CRypto
-// Cifra
-#include "curve25519.h"
-#include "handy.h"
-
-
-// RFC6234
-#include "sha.h"
+#include "eddystone_crypto.h"
+#include "eddystone_hkdf.h"
 
 
  // #define ETLM_PRINT_TEST
@@ -47,9 +38,10 @@
     #define PRINT_ARRAY(...)
 #endif
 
-#define  SECURITY_TIMER_TIMEOUT  APP_TIMER_TICKS(1000, APP_TIMER_PRESCALER)
-#define  MS_PER_TICK             ((1+APP_TIMER_PRESCALER)*1000)/32768
-#define  RTC1_TICKS_MAX          16777216
+#define  TICKS_PER_SECOND          (APP_TIMER_CLOCK_FREQ / (APP_TIMER_PRESCALER + 1))
+#define  SECURITY_TIMER_MAX_TICKS  (240 * TICKS_PER_SECOND)                 /**< Longest sleep of the security timer, well below the 512 s overflow period of the 24 bit RTC */
+#define  SECURITY_TIMER_MIN_TICKS  5                                        /**< Shortest timeout accepted by app_timer */
+#define  PERSIST_INTERVAL_TICKS    ((uint64_t)60*60*24 * TICKS_PER_SECOND)  /**< Interval at which the EID clocks are written to flash */
 #define  TK_ROLLOVER             0x10000
 
 #define NONCE_SIZE    (6)
@@ -61,11 +53,13 @@
 static eddystone_security_init_t m_security_init;
 
 static nrf_ecb_hal_data_t m_aes_ecb_lk;    //AES encryption struct of global lock key
+static eddystone_crypto_aes_dec_key_t m_lock_dec_key;   //Lock key expanded for decryption, kept in sync with m_aes_ecb_lk.key
 
 /**@brief timing structure*/
 typedef struct
 {
-    uint32_t    seconds;
+    uint32_t    seconds;        /**< beacon time in seconds at ref_ticks */
+    uint64_t    ref_ticks;      /**< value of m_clock_ticks at which seconds was last updated */
     uint8_t     k_scaler;
 } eddystone_security_timing_t;
 
@@ -76,6 +70,12 @@ typedef struct
     uint8_t                     eid[EDDYSTONE_EID_ID_LENGTH];
     eddystone_security_timing_t timing;
     bool                        is_occupied;
+    uint8_t                     next_tk[ECS_AES_KEY_SIZE];          /**< temporary key in use at next_boundary */
+    uint8_t                     next_eid[EDDYSTONE_EID_ID_LENGTH];  /**< EID that goes on air at next_boundary */
+    uint32_t                    next_boundary;                      /**< beacon time in seconds of the next EID rotation */
+    bool                        is_next_ready;                      /**< next_tk and next_eid have been precomputed */
+    bool                        is_next_pending;                    /**< next_tk and next_eid are waiting for the precomputation job */
+    eddystone_crypto_eax_t      eax;                                /**< eTLM encryption values of the IK */
 } eddystone_security_slot_t;
 
 static eddystone_security_slot_t m_security_slot[APP_MAX_EID_SLOTS];
@@ -89,59 +89,97 @@ typedef struct
 typedef struct
 {
     ecdh_key_pair_t ecdh_key_pair;
+    bool            is_dirty;       //the key pair differs from the one in flash
 } eddystone_security_ecdh_t;
 
 static eddystone_security_ecdh_t m_ecdh;
 
-APP_TIMER_DEF(m_eddystone_security_timer);   //Security timer used to incrememnt the 32-bit second counter
+APP_TIMER_DEF(m_eddystone_security_timer);   //Security timer, single shot, armed for the next TK rollover or EID rotation
+
+static uint32_t m_rtc_last;         //RTC counter value at the last clock update
+static uint64_t m_clock_ticks;      //RTC ticks counted since init, extended past the 24 bit RTC counter
+static uint64_t m_persist_ticks;    //m_clock_ticks at the last time the EID clocks were written to flash
+
+static eddystone_security_ecb_stats_t m_ecb_stats;  //Accumulated statistics of the batched ECB service
+static bool m_is_precompute_queued;                 //The next EID precomputation job is in the scheduler queue
 
 //Forward Declaration:
 static uint32_t eddystone_security_temp_key_generate(uint8_t slot_no);
 static uint32_t eddystone_security_eid_generate(uint8_t slot_no);
-static void eddystone_security_lock_code_init(uint8_t * p_lock_buff);
+static void eddystone_security_eid_rotate(uint8_t slot_no, uint32_t previous);
+static void eddystone_security_lock_code_loaded(ret_code_t result, void * p_context);
+static void eddystone_security_ecdh_pair_loaded(ret_code_t result, void * p_context);
 static void eddystone_security_update_time(void * p_context);
+static void eddystone_security_timer_schedule(void);
+static void eddystone_security_ecdh_pair_pregenerate(void);
 
-ret_code_t eddystone_security_init(eddystone_security_init_t * p_init)
+/**@brief Extends the 24 bit RTC counter into @ref m_clock_ticks
+ * @note Has to run at least once per RTC overflow period, which the security timer guarantees
+ *       as long as any EID slot is occupied.
+ */
+static void clock_ticks_update(void)
 {
-    if (p_init->msg_cb != NULL)
-    {
-        uint32_t err_code;
+    uint32_t now;
+    uint32_t diff;
+
+    CRITICAL_REGION_ENTER();
+    UNUSED_VARIABLE(app_timer_cnt_get(&now));
+    UNUSED_VARIABLE(app_timer_cnt_diff_compute(now, m_rtc_last, &diff));
+    m_rtc_last     = now;
+    m_clock_ticks += diff;
+    CRITICAL_REGION_EXIT();
+}
 
-        //Generate the lock code from FICR + RNG or fetch it from flash if exists
-        eddystone_security_lock_code_init(m_aes_ecb_lk.key);
+/**@brief Returns the current beacon time of a slot in seconds, without changing the slot*/
+static uint32_t slot_seconds_get(uint8_t slot_no)
+{
+    uint32_t seconds;
 
-        DEBUG_PRINTF(0, "Lock Key in Security Module: ", 0);
-        PRINT_ARRAY(m_aes_ecb_lk.key, ECS_AES_KEY_SIZE);
+    clock_ticks_update();
 
-        m_security_init.msg_cb       = p_init->msg_cb;
+    CRITICAL_REGION_ENTER();
+    seconds = m_security_slot[slot_no].timing.seconds
+            + (uint32_t)((m_clock_ticks - m_security_slot[slot_no].timing.ref_ticks) / TICKS_PER_SECOND);
+    CRITICAL_REGION_EXIT();
 
-        memset(&m_ecdh,0,sizeof(eddystone_security_ecdh_t));
+    return seconds;
+}
 
-        //Read ECDH key pair from flash
-        uint8_t pub_key_buff[ECS_ECDH_KEY_SIZE];
-        uint8_t priv_key_buff[ECS_ECDH_KEY_SIZE];
+/**@brief Moves a slot's second counter up to now, keeping the fraction of a second in ref_ticks*/
+static void slot_time_update(uint8_t slot_no)
+{
+    eddystone_security_timing_t * p_timing = &m_security_slot[slot_no].timing;
+    uint32_t elapsed;
 
-        DEBUG_PRINTF(0, "ECDH Keys from Flash: ", 0);
-        err_code = eddystone_flash_access_ecdh_key_pair(priv_key_buff,
-                                                        pub_key_buff,
-                                                        EDDYSTONE_FLASH_ACCESS_READ);
+    clock_ticks_update();
 
-        FLASH_OP_WAIT();
+    CRITICAL_REGION_ENTER();
+    elapsed              = (uint32_t)((m_clock_ticks - p_timing->ref_ticks) / TICKS_PER_SECOND);
+    p_timing->seconds   += elapsed;
+    p_timing->ref_ticks += (uint64_t)elapsed * TICKS_PER_SECOND;
+    CRITICAL_REGION_EXIT();
+}
 
-        DEBUG_PRINTF(0, "Private Key from Flash: ", 0);
-        PRINT_ARRAY(priv_key_buff, ECS_ECDH_KEY_SIZE);
+/**@brief Sets a slot's second counter, counting from now*/
+static void slot_time_set(uint8_t slot_no, uint32_t seconds)
+{
+    clock_ticks_update();
 
-        DEBUG_PRINTF(0, "Public Key from Flash: ", 0);
-        PRINT_ARRAY(pub_key_buff, ECS_ECDH_KEY_SIZE);
+    CRITICAL_REGION_ENTER();
+    m_security_slot[slot_no].timing.seconds   = seconds;
+    m_security_slot[slot_no].timing.ref_ticks = m_clock_ticks;
+    CRITICAL_REGION_EXIT();
+}
 
-        if(!eddystone_flash_read_is_empty(priv_key_buff,ECS_ECDH_KEY_SIZE)
-            &&
-           !eddystone_flash_read_is_empty(pub_key_buff,ECS_ECDH_KEY_SIZE))
-        {
-            memcpy(m_ecdh.ecdh_key_pair.private,priv_key_buff,ECS_ECDH_KEY_SIZE);
-            memcpy(m_ecdh.ecdh_key_pair.public,pub_key_buff,ECS_ECDH_KEY_SIZE);
-            m_security_init.msg_cb(0, EDDYSTONE_SECURITY_MSG_ECDH);
-        }
+ret_code_t eddystone_security_init(eddystone_security_init_t * p_init)
+{
+    if (p_init->msg_cb != NULL)
+    {
+        uint32_t err_code;
+
+        m_security_init = *p_init;
+
+        memset(&m_ecdh,0,sizeof(eddystone_security_ecdh_t));
 
         for (uint8_t i = 0; i < APP_MAX_EID_SLOTS; i++)
         {
@@ -149,87 +187,140 @@ ret_code_t eddystone_security_init(eddystone_security_init_t * p_init)
             //Initial time as recommended by google to test TK rollover behaviour
         }
 
+        UNUSED_VARIABLE(app_timer_cnt_get(&m_rtc_last));
+        m_clock_ticks   = 0;
+        m_persist_ticks = 0;
+
+        //The timer is only armed once a slot is occupied, see eddystone_security_timer_schedule
         err_code = app_timer_create(&m_eddystone_security_timer,
-                                    APP_TIMER_MODE_REPEATED,
+                                    APP_TIMER_MODE_SINGLE_SHOT,
                                     eddystone_security_update_time);
+        RETURN_IF_ERROR(err_code);
+
+        //Fetch the lock code and the ECDH key pair from flash, the init continues as the reads complete
+        DEBUG_PRINTF(0, "Reading Lock Key From Flash \r\n",0);
+        err_code = eddystone_flash_access_lock_key(m_aes_ecb_lk.key,
+                                                   EDDYSTONE_FLASH_ACCESS_READ,
+                                                   eddystone_security_lock_code_loaded,
+                                                   NULL);
+        RETURN_IF_ERROR(err_code);
+
+        return eddystone_flash_access_ecdh_key_pair(m_ecdh.ecdh_key_pair.private,
+                                                    m_ecdh.ecdh_key_pair.public,
+                                                    EDDYSTONE_FLASH_ACCESS_READ,
+                                                    eddystone_security_ecdh_pair_loaded,
+                                                    NULL);
+    }
+    return NRF_ERROR_NULL;
+}
+
+/**@brief Completes the init once the ECDH key pair is read, the lock code is read before it*/
+static void eddystone_security_ecdh_pair_loaded(ret_code_t result, void * p_context)
+{
+    APP_ERROR_CHECK(result);
 
-        APP_ERROR_CHECK(err_code);
+    DEBUG_PRINTF(0, "Private Key from Flash: ", 0);
+    PRINT_ARRAY(m_ecdh.ecdh_key_pair.private, ECS_ECDH_KEY_SIZE);
 
-        err_code = app_timer_start(m_eddystone_security_timer, SECURITY_TIMER_TIMEOUT, NULL);
-        return err_code;
+    DEBUG_PRINTF(0, "Public Key from Flash: ", 0);
+    PRINT_ARRAY(m_ecdh.ecdh_key_pair.public, ECS_ECDH_KEY_SIZE);
+
+    if(!eddystone_flash_read_is_empty(m_ecdh.ecdh_key_pair.private,ECS_ECDH_KEY_SIZE)
+        &&
+       !eddystone_flash_read_is_empty(m_ecdh.ecdh_key_pair.public,ECS_ECDH_KEY_SIZE))
+    {
+        m_security_init.msg_cb(0, EDDYSTONE_SECURITY_MSG_ECDH);
+    }
+    else
+    {
+        //Generate the key pair in the background, so that a registration only has to compute the shared secret
+        memset(&m_ecdh.ecdh_key_pair, 0, sizeof(ecdh_key_pair_t));
+        eddystone_security_ecdh_pair_pregenerate();
+    }
+
+    if (m_security_init.init_done_cb != NULL)
+    {
+        m_security_init.init_done_cb();
     }
-    return NRF_ERROR_NULL;
 }
 
 void eddystone_security_eid_slots_restore(uint8_t slot_no, eddystone_eid_config_t * p_restore_data)
 {
     m_security_slot[slot_no].timing.k_scaler = p_restore_data->k_scaler;
-    m_security_slot[slot_no].timing.seconds = p_restore_data->seconds;
+    slot_time_set(slot_no, p_restore_data->seconds);
     memcpy(m_security_slot[slot_no].aes_ecb_ik.key, p_restore_data->ik, ECS_AES_KEY_SIZE);
+    m_security_slot[slot_no].eax.is_valid = false;
     m_security_slot[slot_no].is_occupied = true;
     m_security_init.msg_cb(slot_no, EDDYSTONE_SECURITY_MSG_IK);
     eddystone_security_temp_key_generate(slot_no);
     eddystone_security_eid_generate(slot_no);
+    eddystone_security_timer_schedule();
 }
 
-/**@brief Updates all active EID slots' timer*/
-static void eddystone_security_update_time(void * p_context)
+/**@brief Arms the security timer for the earliest TK rollover or EID rotation among the occupied slots
+ * @details The timeout is capped at SECURITY_TIMER_MAX_TICKS so that the RTC overflow is never missed
+ *          and the 24 hr flash write is never late by more than that. Nothing is armed if no slot is occupied.
+ */
+static void eddystone_security_timer_schedule(void)
 {
-    static uint32_t us_delay = 0;
-    const uint32_t US_PER_S = 1000000;
-    static uint32_t timer_persist = 0;
+    uint32_t timeout_ticks   = SECURITY_TIMER_MAX_TICKS;
+    bool     is_any_occupied = false;
+    uint64_t clock_ticks;
+
+    clock_ticks_update();
+
+    CRITICAL_REGION_ENTER();
+    clock_ticks = m_clock_ticks;
+    CRITICAL_REGION_EXIT();
+
+    for (uint8_t i = 0; i < APP_MAX_EID_SLOTS; i++)
+    {
+        if (m_security_slot[i].is_occupied)
+        {
+            eddystone_security_timing_t * p_timing = &m_security_slot[i].timing;
+            uint32_t rotation     = 1UL << p_timing->k_scaler;
+            uint32_t to_tk        = TK_ROLLOVER - (p_timing->seconds % TK_ROLLOVER);
+            uint32_t to_eid       = rotation - (p_timing->seconds & (rotation - 1));
+            uint64_t elapsed      = clock_ticks - p_timing->ref_ticks;
+            uint64_t to_boundary  = (uint64_t)MIN(to_tk, to_eid) * TICKS_PER_SECOND;
+
+            is_any_occupied = true;
+
+            to_boundary   = (to_boundary > elapsed) ? (to_boundary - elapsed) : 0;
+            timeout_ticks = (uint32_t)MIN(timeout_ticks, to_boundary);
+        }
+    }
 
-    //For every 1 second interrupt, there is 30 us delay with timer prescaler set at 0.
-    us_delay += 30;
+    UNUSED_VARIABLE(app_timer_stop(m_eddystone_security_timer));
 
-    if (APP_TIMER_PRESCALER != 0)
+    if (is_any_occupied)
     {
-        //If the prescaler is not 0, then a new us_delay increment needs to be calculated...
-        //Trigger a run time error here to prevent developers from blindly changing the prescaler
-        APP_ERROR_CHECK(NRF_ERROR_INVALID_PARAM);
+        timeout_ticks = MAX(timeout_ticks, SECURITY_TIMER_MIN_TICKS);
+        APP_ERROR_CHECK(app_timer_start(m_eddystone_security_timer, timeout_ticks, NULL));
     }
+}
 
-    //Cycle through the slots
+/**@brief Brings all active EID slots' clocks up to date and rolls their keys over if a boundary was crossed*/
+static void eddystone_security_update_time(void * p_context)
+{
     for (uint8_t i = 0; i < APP_MAX_EID_SLOTS; i++)
     {
         if (m_security_slot[i].is_occupied)
         {
-            m_security_slot[i].timing.seconds++;
+            uint32_t previous = m_security_slot[i].timing.seconds;
+            uint8_t  k_scaler = m_security_slot[i].timing.k_scaler;
 
-            if (m_security_slot[i].timing.seconds % TK_ROLLOVER == 0)
-            {
-                eddystone_security_temp_key_generate(i);
-            }
-
-            if ((m_security_slot[i].timing.seconds % (2 << (m_security_slot[i].timing.k_scaler - 1))) == 0)
-            {
-                eddystone_security_eid_generate(i);
-            }
+            slot_time_update(i);
 
-            //when us_delay accumulates to more than 1 second, add 1 more sec to the clock.
-            //Also do the TK roll over and K scaler timer checks again
-            if(us_delay >= US_PER_S)
+            if (m_security_slot[i].timing.seconds >> k_scaler != previous >> k_scaler)
             {
-                m_security_slot[i].timing.seconds++;
-                us_delay -= US_PER_S;
-
-                if (m_security_slot[i].timing.seconds % TK_ROLLOVER == 0)
-                {
-                    eddystone_security_temp_key_generate(i);
-                }
-
-                if ((m_security_slot[i].timing.seconds % (2 << (m_security_slot[i].timing.k_scaler - 1))) == 0)
-                {
-                    eddystone_security_eid_generate(i);
-                }
+                eddystone_security_eid_rotate(i, previous);
             }
         }
     }
 
     //Every 24 hr, write the new EID timer to flash
-    timer_persist++;
-    const uint32_t TWENTY_FOUR_HOURS = 60*60*24;
-    if (timer_persist >= TWENTY_FOUR_HOURS)
+    if (m_clock_ticks - m_persist_ticks >= PERSIST_INTERVAL_TICKS)
     {
         for(uint8_t i = 0; i <APP_MAX_EID_SLOTS; i++)
         {
@@ -238,23 +329,22 @@ static void eddystone_security_update_time(void * p_context)
                 m_security_init.msg_cb(i, EDDYSTONE_SECURITY_MSG_STORE_TIME);
             }
         }
-        timer_persist = 0;
+        m_persist_ticks = m_clock_ticks;
     }
+
+    eddystone_security_timer_schedule();
 }
 
 /**@brief Generates a device-unique beacon lock code from DEVICEID
- *        and RNG and copies it to the buffer, if no lock key exists
- *        in flash already.
+ *        and RNG once the lock code is read from flash, if no lock
+ *        key exists in flash already.
+ * @details The new lock code is used right away, its write to flash is not waited for.
  */
-static void eddystone_security_lock_code_init(uint8_t * p_lock_buff)
+static void eddystone_security_lock_code_loaded(ret_code_t result, void * p_context)
 {
-    ret_code_t err_code;
-
-    DEBUG_PRINTF(0, "Reading Lock Key From Flash \r\n",0);
-    err_code = eddystone_flash_access_lock_key(p_lock_buff, EDDYSTONE_FLASH_ACCESS_READ);
-    APP_ERROR_CHECK(err_code);
+    uint8_t * p_lock_buff = m_aes_ecb_lk.key;
 
-    FLASH_OP_WAIT();
+    APP_ERROR_CHECK(result);
 
     //If no lock keys exist, then generate one and copy it to buffer
     if(eddystone_flash_read_is_empty(p_lock_buff, ECS_AES_KEY_SIZE))
@@ -276,31 +366,63 @@ static void eddystone_security_lock_code_init(uint8_t * p_lock_buff)
 
         DEBUG_PRINTF(0, "Writing Lock Key to Flash \r\n",0);
 
-        err_code = eddystone_flash_access_lock_key(p_lock_buff, EDDYSTONE_FLASH_ACCESS_WRITE);
-        APP_ERROR_CHECK(err_code);
-
-        FLASH_OP_WAIT();
+        APP_ERROR_CHECK(eddystone_flash_access_lock_key(p_lock_buff, EDDYSTONE_FLASH_ACCESS_WRITE, NULL, NULL));
     }
+
+    eddystone_crypto_aes_dec_key_set(&m_lock_dec_key, m_aes_ecb_lk.key);
+
+    DEBUG_PRINTF(0, "Lock Key in Security Module: ", 0);
+    PRINT_ARRAY(m_aes_ecb_lk.key, ECS_AES_KEY_SIZE);
 }
 
 static ret_code_t eddystone_security_ecb_block_encrypt( nrf_ecb_hal_data_t * p_encrypt_blk )
 {
-    #if defined NRF52 && USE_ECB_ENCRYPT_HW == 1
-        return sd_ecb_block_encrypt(p_encrypt_blk);
+    return eddystone_crypto_aes_ecb_encrypt(p_encrypt_blk->key, p_encrypt_blk->cleartext, p_encrypt_blk->ciphertext);
+}
 
-    #elif defined NRF51 && USE_ECB_ENCRYPT_HW == 1
-        return sd_ecb_block_encrypt(p_encrypt_blk);
+/**@brief Encrypts an array of blocks back to back and accounts for them in @ref m_ecb_stats
+ * @details The SoftDevice restricts the ECB peripheral, so every block still goes through one
+ *          sd_ecb_block_encrypt call, but the blocks are issued in a single run with no work in between.
+ *
+ * @param[in,out] p_blocks       the blocks, each with its own key and cleartext
+ * @param[in]     num_of_blocks  number of blocks in p_blocks
+ */
+static ret_code_t eddystone_security_ecb_blocks_encrypt( nrf_ecb_hal_data_t * p_blocks, uint8_t num_of_blocks )
+{
+    ret_code_t err_code = NRF_SUCCESS;
+    uint32_t   start;
+    uint32_t   end;
+    uint32_t   ticks;
 
-    #elif !USE_ECB_ENCRYPT_HW
-        AES128_ECB_encrypt(p_encrypt_blk->cleartext, p_encrypt_blk->key, p_encrypt_blk->ciphertext);
+    if (num_of_blocks == 0)
+    {
         return NRF_SUCCESS;
-    #endif
+    }
+
+    UNUSED_VARIABLE(app_timer_cnt_get(&start));
+
+    for (uint8_t i = 0; i < num_of_blocks && err_code == NRF_SUCCESS; i++)
+    {
+        err_code = eddystone_security_ecb_block_encrypt(&p_blocks[i]);
+    }
+
+    UNUSED_VARIABLE(app_timer_cnt_get(&end));
+    UNUSED_VARIABLE(app_timer_cnt_diff_compute(end, start, &ticks));
+
+    m_ecb_stats.num_of_jobs++;
+    m_ecb_stats.num_of_blocks += num_of_blocks;
+    m_ecb_stats.ticks         += ticks;
+
+    DEBUG_PRINTF(0, "ECB - %d blocks in %d ticks, %d blocks/ms overall \r\n", num_of_blocks, ticks,
+                 (m_ecb_stats.ticks == 0) ? 0 : (m_ecb_stats.num_of_blocks * (TICKS_PER_SECOND / 1000)) / m_ecb_stats.ticks);
+
+    return err_code;
 }
 
 ret_code_t eddystone_security_lock_code_update( uint8_t * p_ecrypted_key )
 {
     uint8_t temp_buff[ECS_AES_KEY_SIZE] = {0};
-    AES128_ECB_decrypt(p_ecrypted_key, m_aes_ecb_lk.key, temp_buff);
+    UNUSED_VARIABLE(eddystone_crypto_aes_ecb_decrypt_with_key(&m_lock_dec_key, p_ecrypted_key, temp_buff));
 
     DEBUG_PRINTF(0,"New Lock Key:",0);
     for (uint8_t i = 0; i < 16; i++)
@@ -309,8 +431,15 @@ ret_code_t eddystone_security_lock_code_update( uint8_t * p_ecrypted_key )
     }
     DEBUG_PRINTF(0,"\r\n",0);
 
+    //Setting the same lock code again leaves the key in flash as it is
+    if (memcmp(m_aes_ecb_lk.key, temp_buff, ECS_AES_KEY_SIZE) == 0)
+    {
+        return NRF_SUCCESS;
+    }
+
     memcpy(m_aes_ecb_lk.key, temp_buff, ECS_AES_KEY_SIZE);
-    return eddystone_flash_access_lock_key(m_aes_ecb_lk.key, EDDYSTONE_FLASH_ACCESS_WRITE);
+    eddystone_crypto_aes_dec_key_set(&m_lock_dec_key, m_aes_ecb_lk.key);
+    return eddystone_flash_access_lock_key(m_aes_ecb_lk.key, EDDYSTONE_FLASH_ACCESS_WRITE, NULL, NULL);
 }
 
 
@@ -345,7 +474,8 @@ void eddystone_security_unlock_verify( uint8_t * p_unlock_token )
 ret_code_t eddystone_security_random_challenge_generate( uint8_t * p_rand_chlg_buff )
 {
     ret_code_t err_code;
-    err_code = sd_rand_application_vector_get(p_rand_chlg_buff,ECS_AES_KEY_SIZE);
+    err_code = eddystone_rng_bytes_get(p_rand_chlg_buff,ECS_AES_KEY_SIZE);
+    RETURN_IF_ERROR(err_code);
 
     DEBUG_PRINTF(0, "Challenge: ", 0);
     for (uint8_t i = 0; i < ECS_AES_KEY_SIZE; i++)
@@ -357,21 +487,173 @@ ret_code_t eddystone_security_random_challenge_generate( uint8_t * p_rand_chlg_b
     return err_code;
 }
 
-/**@brief Generates a EID with the Temporary Key*/
-static ret_code_t eddystone_security_eid_generate(uint8_t slot_no)
+/**@brief Fills in the ECB block that derives the temporary key for the TK period containing a beacon time*/
+static void temp_key_block_prepare(const uint8_t * p_ik, uint32_t seconds, nrf_ecb_hal_data_t * p_block)
+{
+    memcpy(p_block->key, p_ik, ECS_AES_KEY_SIZE);
+    memset(p_block->cleartext, 0, ECS_AES_KEY_SIZE);
+    p_block->cleartext[11] = 0xFF;
+    p_block->cleartext[14] = (uint8_t)((seconds >> 24) & 0xff);
+    p_block->cleartext[15] = (uint8_t)((seconds >> 16) & 0xff);
+}
+
+/**@brief Fills in the ECB block that derives the EID for the rotation period containing a beacon time*/
+static void eid_block_prepare(const uint8_t * p_tk, uint8_t k_scaler, uint32_t seconds, nrf_ecb_hal_data_t * p_block)
+{
+    uint32_t k_bits_cleared_time = (seconds >> k_scaler) << k_scaler;
+
+    memcpy(p_block->key, p_tk, ECS_AES_KEY_SIZE);
+    memset(p_block->cleartext, 0, ECS_AES_KEY_SIZE);
+    p_block->cleartext[11] = k_scaler;
+    p_block->cleartext[12] = (uint8_t)((k_bits_cleared_time >> 24) & 0xff);
+    p_block->cleartext[13] = (uint8_t)((k_bits_cleared_time >> 16) & 0xff);
+    p_block->cleartext[14] = (uint8_t)((k_bits_cleared_time >> 8) & 0xff);
+    p_block->cleartext[15] = (uint8_t)((k_bits_cleared_time) & 0xff);
+}
+
+/**@brief Computes the temporary key of an identity key for the TK period containing a beacon time
+ * @param[in]  p_ik     the identity key
+ * @param[in]  seconds  the beacon time in seconds
+ * @param[out] p_tk     buffer of ECS_AES_KEY_SIZE bytes for the temporary key
+ */
+static void temp_key_compute(const uint8_t * p_ik, uint32_t seconds, uint8_t * p_tk)
+{
+    nrf_ecb_hal_data_t ecb;
+
+    temp_key_block_prepare(p_ik, seconds, &ecb);
+    eddystone_security_ecb_block_encrypt(&ecb);
+    memcpy(p_tk, ecb.ciphertext, ECS_AES_KEY_SIZE);
+}
+
+/**@brief Computes the EID of a temporary key for the rotation period containing a beacon time
+ * @param[in]  p_tk      the temporary key
+ * @param[in]  k_scaler  the rotation exponent
+ * @param[in]  seconds   the beacon time in seconds
+ * @param[out] p_eid     buffer of EDDYSTONE_EID_ID_LENGTH bytes for the EID
+ */
+static void eid_compute(const uint8_t * p_tk, uint8_t k_scaler, uint32_t seconds, uint8_t * p_eid)
+{
+    nrf_ecb_hal_data_t ecb;
+
+    eid_block_prepare(p_tk, k_scaler, seconds, &ecb);
+    eddystone_security_ecb_block_encrypt(&ecb);
+    memcpy(p_eid, ecb.ciphertext, EDDYSTONE_EID_ID_LENGTH);
+}
+
+/**@brief Precomputes the TK and EID of the next rotation period of all pending slots, run from the scheduler
+ * @details The TK blocks of the slots whose next period starts a new TK period are encrypted in one batch,
+ *          then the EID blocks of all pending slots in a second batch.
+ */
+static void eddystone_security_next_eid_scheduler_evt(void * p_event_data, uint16_t event_size)
+{
+    nrf_ecb_hal_data_t  blocks[APP_MAX_EID_SLOTS];
+    uint8_t             slots[APP_MAX_EID_SLOTS];
+    uint8_t             tk_blocks[APP_MAX_EID_SLOTS];   //index into blocks of the slot's TK block, or 0xFF
+    uint8_t             ik[APP_MAX_EID_SLOTS][ECS_AES_KEY_SIZE];
+    uint8_t             tk[APP_MAX_EID_SLOTS][ECS_AES_KEY_SIZE];
+    uint32_t            next_boundary[APP_MAX_EID_SLOTS];
+    uint8_t             k_scaler[APP_MAX_EID_SLOTS];
+    uint8_t             num_of_slots  = 0;
+    uint8_t             num_of_blocks = 0;
+
+    m_is_precompute_queued = false;
+
+    for (uint8_t slot_no = 0; slot_no < APP_MAX_EID_SLOTS; slot_no++)
+    {
+        eddystone_security_slot_t * p_slot = &m_security_slot[slot_no];
+        uint8_t n = num_of_slots;
+
+        if (!p_slot->is_next_pending || !p_slot->is_occupied)
+        {
+            continue;
+        }
+        p_slot->is_next_pending = false;
+
+        slots[n]         = slot_no;
+        k_scaler[n]      = p_slot->timing.k_scaler;
+        next_boundary[n] = ((p_slot->timing.seconds >> k_scaler[n]) + 1) << k_scaler[n];
+        memcpy(ik[n], p_slot->aes_ecb_ik.key, ECS_AES_KEY_SIZE);
+
+        if (next_boundary[n] / TK_ROLLOVER == p_slot->timing.seconds / TK_ROLLOVER)
+        {
+            memcpy(tk[n], p_slot->aes_ecb_tk.key, ECS_AES_KEY_SIZE);
+            tk_blocks[n] = 0xFF;
+        }
+        else
+        {
+            temp_key_block_prepare(ik[n], next_boundary[n], &blocks[num_of_blocks]);
+            tk_blocks[n] = num_of_blocks++;
+        }
+        num_of_slots++;
+    }
+
+    UNUSED_VARIABLE(eddystone_security_ecb_blocks_encrypt(blocks, num_of_blocks));
+
+    for (uint8_t n = 0; n < num_of_slots; n++)
+    {
+        if (tk_blocks[n] != 0xFF)
+        {
+            memcpy(tk[n], blocks[tk_blocks[n]].ciphertext, ECS_AES_KEY_SIZE);
+        }
+    }
+    for (uint8_t n = 0; n < num_of_slots; n++)
+    {
+        eid_block_prepare(tk[n], k_scaler[n], next_boundary[n], &blocks[n]);
+    }
+
+    UNUSED_VARIABLE(eddystone_security_ecb_blocks_encrypt(blocks, num_of_slots));
+
+    for (uint8_t n = 0; n < num_of_slots; n++)
+    {
+        eddystone_security_slot_t * p_slot = &m_security_slot[slots[n]];
+
+        //The slot may have been set up again while computing, only keep the result if it still applies
+        CRITICAL_REGION_ENTER();
+        if (p_slot->is_occupied
+            && !p_slot->is_next_pending
+            && p_slot->timing.k_scaler == k_scaler[n]
+            && memcmp(p_slot->aes_ecb_ik.key, ik[n], ECS_AES_KEY_SIZE) == 0)
+        {
+            memcpy(p_slot->next_tk, tk[n], ECS_AES_KEY_SIZE);
+            memcpy(p_slot->next_eid, blocks[n].ciphertext, EDDYSTONE_EID_ID_LENGTH);
+            p_slot->next_boundary = next_boundary[n];
+            p_slot->is_next_ready = true;
+        }
+        CRITICAL_REGION_EXIT();
+
+        DEBUG_PRINTF(0, "Slot [%d] - Next EID precomputed for %d s \r\n", slots[n], next_boundary[n]);
+    }
+}
+
+/**@brief Marks a slot's next EID for precomputation and queues the job if it is not queued already*/
+static void eddystone_security_next_eid_precompute(uint8_t slot_no)
 {
-    memset(m_security_slot[slot_no].aes_ecb_tk.cleartext, 0, ECS_AES_KEY_SIZE);
-    m_security_slot[slot_no].aes_ecb_tk.cleartext[11] = m_security_slot[slot_no].timing.k_scaler;
+    bool is_queued;
 
-    uint32_t k_bits_cleared_time = (m_security_slot[slot_no].timing.seconds >> m_security_slot[slot_no].timing.k_scaler) << m_security_slot[slot_no].timing.k_scaler;
+    CRITICAL_REGION_ENTER();
+    m_security_slot[slot_no].is_next_ready   = false;
+    m_security_slot[slot_no].is_next_pending = true;
+    is_queued              = m_is_precompute_queued;
+    m_is_precompute_queued = true;
+    CRITICAL_REGION_EXIT();
 
-    m_security_slot[slot_no].aes_ecb_tk.cleartext[12] = (uint8_t)((k_bits_cleared_time >> 24) & 0xff);
-    m_security_slot[slot_no].aes_ecb_tk.cleartext[13] = (uint8_t)((k_bits_cleared_time >> 16) & 0xff);
-    m_security_slot[slot_no].aes_ecb_tk.cleartext[14] = (uint8_t)((k_bits_cleared_time >> 8) & 0xff);
-    m_security_slot[slot_no].aes_ecb_tk.cleartext[15] = (uint8_t)((k_bits_cleared_time) & 0xff);
+    if (!is_queued)
+    {
+        if (app_sched_event_put(NULL, 0, eddystone_security_next_eid_scheduler_evt) != NRF_SUCCESS)
+        {
+            //Nothing is lost, the EID is generated inline at the boundary instead
+            m_is_precompute_queued = false;
+        }
+    }
+}
 
-    eddystone_security_ecb_block_encrypt(&m_security_slot[slot_no].aes_ecb_tk);
-    memcpy(m_security_slot[slot_no].eid, m_security_slot[slot_no].aes_ecb_tk.ciphertext, EDDYSTONE_EID_ID_LENGTH);
+/**@brief Generates a EID with the Temporary Key*/
+static ret_code_t eddystone_security_eid_generate(uint8_t slot_no)
+{
+    eid_compute(m_security_slot[slot_no].aes_ecb_tk.key,
+                m_security_slot[slot_no].timing.k_scaler,
+                m_security_slot[slot_no].timing.seconds,
+                m_security_slot[slot_no].eid);
 
     DEBUG_PRINTF(0, "Slot [%d] - EID: ", slot_no);
     for (uint8_t i = 0; i < EDDYSTONE_EID_ID_LENGTH; i++)
@@ -380,6 +662,7 @@ static ret_code_t eddystone_security_eid_generate(uint8_t slot_no)
     }
     DEBUG_PRINTF(0, "\r\n", 0);
 
+    eddystone_security_next_eid_precompute(slot_no);
     m_security_init.msg_cb(slot_no, EDDYSTONE_SECURITY_MSG_EID);
 
     return NRF_SUCCESS;
@@ -388,12 +671,9 @@ static ret_code_t eddystone_security_eid_generate(uint8_t slot_no)
 /**@brief Generates a temporary key with the Identity key*/
 static ret_code_t eddystone_security_temp_key_generate(uint8_t slot_no)
 {
-    memset(m_security_slot[slot_no].aes_ecb_ik.cleartext, 0, ECS_AES_KEY_SIZE);
-    m_security_slot[slot_no].aes_ecb_ik.cleartext[11] = 0xFF;
-    m_security_slot[slot_no].aes_ecb_ik.cleartext[14] = (uint8_t)((m_security_slot[slot_no].timing.seconds >> 24) & 0xff);
-    m_security_slot[slot_no].aes_ecb_ik.cleartext[15] = (uint8_t)((m_security_slot[slot_no].timing.seconds >> 16) & 0xff);
-    eddystone_security_ecb_block_encrypt(&m_security_slot[slot_no].aes_ecb_ik);
-    memcpy(m_security_slot[slot_no].aes_ecb_tk.key, m_security_slot[slot_no].aes_ecb_ik.ciphertext, ECS_AES_KEY_SIZE);
+    temp_key_compute(m_security_slot[slot_no].aes_ecb_ik.key,
+                     m_security_slot[slot_no].timing.seconds,
+                     m_security_slot[slot_no].aes_ecb_tk.key);
 
     DEBUG_PRINTF(0,"Slot [%d] - Temp Key:",slot_no);
     for (uint8_t i = 0; i < 16; i++)
@@ -405,14 +685,47 @@ static ret_code_t eddystone_security_temp_key_generate(uint8_t slot_no)
     return NRF_SUCCESS;
 }
 
+/**@brief Moves a slot to the EID of its current rotation period
+ * @details Swaps in the precomputed TK and EID if they are for the period the slot's clock is in,
+ *          otherwise (e.g. when the precomputation has not run yet) generates them on the spot.
+ *
+ * @param[in] slot_no   the index of the slot
+ * @param[in] previous  the slot's beacon time before its clock was updated
+ */
+static void eddystone_security_eid_rotate(uint8_t slot_no, uint32_t previous)
+{
+    eddystone_security_slot_t * p_slot = &m_security_slot[slot_no];
+    uint8_t k_scaler = p_slot->timing.k_scaler;
+
+    if (p_slot->is_next_ready && (p_slot->next_boundary >> k_scaler) == (p_slot->timing.seconds >> k_scaler))
+    {
+        memcpy(p_slot->aes_ecb_tk.key, p_slot->next_tk, ECS_AES_KEY_SIZE);
+        memcpy(p_slot->eid, p_slot->next_eid, EDDYSTONE_EID_ID_LENGTH);
+
+        DEBUG_PRINTF(0, "Slot [%d] - Precomputed EID swapped in \r\n", slot_no);
+
+        eddystone_security_next_eid_precompute(slot_no);
+        m_security_init.msg_cb(slot_no, EDDYSTONE_SECURITY_MSG_EID);
+    }
+    else
+    {
+        if (p_slot->timing.seconds / TK_ROLLOVER != previous / TK_ROLLOVER)
+        {
+            eddystone_security_temp_key_generate(slot_no);
+        }
+        eddystone_security_eid_generate(slot_no);
+    }
+}
+
 ret_code_t eddystone_security_shared_ik_receive( uint8_t slot_no, uint8_t * p_encrypted_ik, uint8_t scaler_k )
 {
 
     m_security_slot[slot_no].is_occupied = true;
     m_security_slot[slot_no].timing.k_scaler = scaler_k;
-    m_security_slot[slot_no].timing.seconds = 65280;
+    slot_time_set(slot_no, 65280);
 
-    AES128_ECB_decrypt(p_encrypted_ik, m_aes_ecb_lk.key, m_security_slot[slot_no].aes_ecb_ik.key);
+    UNUSED_VARIABLE(eddystone_crypto_aes_ecb_decrypt_with_key(&m_lock_dec_key, p_encrypted_ik, m_security_slot[slot_no].aes_ecb_ik.key));
+    m_security_slot[slot_no].eax.is_valid = false;
 
     DEBUG_PRINTF(0,"Identity Key:",0);
     for (uint8_t i = 0; i < ECS_AES_KEY_SIZE; i++)
@@ -426,179 +739,267 @@ ret_code_t eddystone_security_shared_ik_receive( uint8_t slot_no, uint8_t * p_en
 
     m_security_init.msg_cb(slot_no, EDDYSTONE_SECURITY_MSG_IK);
 
+    eddystone_security_timer_schedule();
+
     return NRF_SUCCESS;
 }
 
-/**@brief Generates a the private/public ECDH key pair
- *
- * @param[out]  p_priv_buffer   buffer of size 32 bytes to hold the private key
- * @param[out]  p_pub_buffer    buffer of size 32 bytes to hold the public key
- */
-static void eddystone_beacon_ecdh_pair_generate(uint8_t * p_priv_buffer, uint8_t * p_pub_buffer)
+/**@brief Phases of the ECDH key agreement of an EID registration*/
+typedef enum
 {
-    //Generate random beacon private key
-    uint8_t  pool_size;
-    uint8_t  bytes_available;
+    ECDH_PHASE_IDLE,        /**< No key agreement in progress */
+    ECDH_PHASE_RANDOM,      /**< Waiting for the random bytes of a new beacon private key */
+    ECDH_PHASE_PUBLIC,      /**< Computing the beacon public key from a new private key */
+    ECDH_PHASE_SHARED       /**< Computing the shared secret from the beacon private key and the phone public key */
+} eddystone_security_ecdh_phase_t;
 
-    sd_rand_application_pool_capacity_get(&pool_size);
-    sd_rand_application_bytes_available_get(&bytes_available);
-    DEBUG_PRINTF(0,"RNG Pool Size: %d \r\n", pool_size);
-    DEBUG_PRINTF(0,"RNG Bytes Avail: %d \r\n", bytes_available);
+/**@brief State of the key pair generation and key agreement, run a few ladder steps per scheduler event*/
+typedef struct
+{
+    eddystone_crypto_x25519_job_t   job;
+    eddystone_security_ecdh_phase_t phase;
+    bool                            is_registration_pending;/**< a registration waits for the shared secret, otherwise the key pair is only generated */
+    uint8_t                         slot_no;
+    uint8_t                         k_scaler;
+    uint8_t                         phone_public[ECS_ECDH_KEY_SIZE];
+    uint8_t                         attempt_counter;
+} eddystone_security_ecdh_job_t;
 
-    while (bytes_available < pool_size)
-    {
-       //wait for SD to acquire enough RNs
-       sd_rand_application_bytes_available_get(&bytes_available);
-    }
+static eddystone_security_ecdh_job_t m_ecdh_job;
 
-    sd_rand_application_vector_get(p_priv_buffer, pool_size);
+static void eddystone_security_ecdh_scheduler_evt(void * p_event_data, uint16_t event_size);
 
-    if (pool_size < ECS_ECDH_KEY_SIZE)
+/**@brief Called by the entropy reservoir once it holds enough bytes for the beacon private ECDH key*/
+static void eddystone_security_ecdh_random_ready(void)
+{
+    APP_ERROR_CHECK(app_sched_event_put(NULL, 0, eddystone_security_ecdh_scheduler_evt));
+}
+
+/**@brief Starts a phase of the key agreement and queues its first slice*/
+static void eddystone_security_ecdh_phase_start(eddystone_security_ecdh_phase_t phase)
+{
+    m_ecdh_job.phase = phase;
+
+    if (phase == ECDH_PHASE_RANDOM)
     {
-        sd_rand_application_bytes_available_get(&bytes_available);
-        //    sd_rand_application_bytes_available_get(&bytes_available);
-        while (bytes_available < (ECS_ECDH_KEY_SIZE-pool_size))
-        {
-           //wait for SD to acquire enough RNs
-           sd_rand_application_bytes_available_get(&bytes_available);
-        }
-        sd_rand_application_vector_get(p_priv_buffer + pool_size, ECS_ECDH_KEY_SIZE-pool_size);
+        //A new key pair replaces the old one
+        memset(&m_ecdh.ecdh_key_pair, 0, sizeof(ecdh_key_pair_t));
+        APP_ERROR_CHECK(eddystone_rng_bytes_wait(ECS_ECDH_KEY_SIZE, eddystone_security_ecdh_random_ready));
+        return;
+    }
+    else if (phase == ECDH_PHASE_PUBLIC)
+    {
+        //Create beacon public 32-byte ECDH key from private 32-byte ECDH key
+        eddystone_crypto_x25519_start(&m_ecdh_job.job, m_ecdh.ecdh_key_pair.private, NULL);
+    }
+    else
+    {
+        //Generate shared 32-byte ECDH secret from beacon private service ECDH key and phone public ECDH key
+        eddystone_crypto_x25519_start(&m_ecdh_job.job, m_ecdh.ecdh_key_pair.private, m_ecdh_job.phone_public);
     }
 
-    //Create beacon public 32-byte ECDH key from private 32-byte ECDH key
-    cf_curve25519_mul_base(p_pub_buffer, p_priv_buffer);
+    APP_ERROR_CHECK(app_sched_event_put(NULL, 0, eddystone_security_ecdh_scheduler_evt));
+}
 
-    #ifdef ECDH_PRINT_TEST
+/**@brief Derives the Identity Key from the shared ECDH secret and sets up the EID slot with it*/
+static ret_code_t eddystone_security_ecdh_identity_key_derive(uint8_t slot_no, uint8_t scaler_k, uint8_t * p_shared)
+{
+    uint8_t prk[EDDYSTONE_HKDF_PRK_SIZE];
+    uint8_t public_keys[2 * ECS_ECDH_KEY_SIZE];
 
-    SEGGER_RTT_printf(0, "\r\n********* 4. Generate Beacon public 32-byte ECDH\r\n");
-    SEGGER_RTT_printf(0, "\r\nBEACON PRIVATE ECDH:\r\n ");
-    PRINT_ARRAY(p_priv_buffer, 32);
-    SEGGER_RTT_printf(0, "\r\nBEACON PUBLIC ECDH:\r\n ");
-    PRINT_ARRAY(p_pub_buffer, 32);
+    //HKDF-SHA256 with the public keys of phone and beacon as salt and the shared ECDH secret as input keying material
+    memcpy(public_keys, m_ecdh_job.phone_public, ECS_ECDH_KEY_SIZE);
+    memcpy(public_keys + ECS_ECDH_KEY_SIZE, m_ecdh.ecdh_key_pair.public, ECS_ECDH_KEY_SIZE);
+
+    eddystone_hkdf_extract(public_keys, sizeof(public_keys), p_shared, ECS_ECDH_KEY_SIZE, prk);
 
+    #ifdef ECDH_PRINT_TEST
+
+    SEGGER_RTT_printf(0, "\r\n\r\n********* 6. Extract the pseudorandom key from the shared ECDH secret with HKDF-SHA256\r\n");
+    SEGGER_RTT_printf(0, "\r\nHKDF SALT (PUBLIC KEYS):\r\n ");
+    PRINT_ARRAY((uint8_t*)public_keys, 64);
+    SEGGER_RTT_printf(0, "\r\nHKDF IKM (SHARED SECRET):\r\n ");
+    PRINT_ARRAY((uint8_t*)p_shared, 32);
+    SEGGER_RTT_printf(0, "\r\nHKDF PRK:\r\n ");
+    PRINT_ARRAY((uint8_t*)prk, 32);
     #endif /*ECDH_PRINT_TEST*/
-}
 
-ret_code_t eddystone_security_client_pub_ecdh_receive( uint8_t slot_no, uint8_t * p_pub_ecdh, uint8_t scaler_k )
-{
-    static uint8_t attempt_counter = 0;
+    //The 16-byte Identity Key is the expanded key material without info, written straight into the slot
+    eddystone_hkdf_expand(prk, NULL, 0, m_security_slot[slot_no].aes_ecb_ik.key, ECS_AES_KEY_SIZE);
+    memset(prk, 0, sizeof(prk));
+
+    #ifdef ECDH_PRINT_TEST
+    SEGGER_RTT_printf(0, "\r\n\r\n********* 7. Expand the pseudorandom key into the 16-byte Identity Key with HKDF-SHA256\r\n");
+    SEGGER_RTT_printf(0, "\r\nHKDF OKM (IDENTITY KEY):\r\n ");
+    PRINT_ARRAY(m_security_slot[slot_no].aes_ecb_ik.key, 16);
+    #endif /*ECDH_PRINT_TEST*/
 
     m_security_slot[slot_no].is_occupied = true;
     m_security_slot[slot_no].timing.k_scaler = scaler_k;
-    m_security_slot[slot_no].timing.seconds = 65280;
+    slot_time_set(slot_no, 65280);
 
-    uint8_t zeros[ECS_ECDH_KEY_SIZE] = {0};                // Array of zeros for checking if there are already keys
+    m_security_slot[slot_no].eax.is_valid = false;
 
-    uint8_t beacon_private[ECS_ECDH_KEY_SIZE];             // Beacon private ECDH key
-    uint8_t beacon_public[ECS_ECDH_KEY_SIZE];              // Beacon public ECDH key
-    uint8_t phone_public[ECS_ECDH_KEY_SIZE];               // Phone public ECDH key
+    DEBUG_PRINTF(0,"Identity Key:",0);
+    for (uint8_t i = 0; i < ECS_AES_KEY_SIZE; i++)
+    {
+        DEBUG_PRINTF(0,"0x%02x, ", m_security_slot[slot_no].aes_ecb_ik.key[i]);
+    }
+    DEBUG_PRINTF(0,"\r\n",0);
+
+    eddystone_security_temp_key_generate(slot_no);
+    eddystone_security_eid_generate(slot_no);
+
+    m_security_init.msg_cb(slot_no, EDDYSTONE_SECURITY_MSG_ECDH);
+    m_security_init.msg_cb(slot_no, EDDYSTONE_SECURITY_MSG_IK);
+
+    eddystone_security_timer_schedule();
+
+    return eddystone_security_ecdh_pair_preserve();
+}
+
+/**@brief Runs one slice of the key agreement, and queues the next one until it is done*/
+static void eddystone_security_ecdh_scheduler_evt(void * p_event_data, uint16_t event_size)
+{
     uint8_t shared[ECS_ECDH_KEY_SIZE];                     // Shared secret ECDH key
-    const uint8_t salt[1] = {0x01};                        // Salt
-    uint8_t identity_key[ECS_AES_KEY_SIZE];                // Identity Key
+    uint8_t zeros[ECS_ECDH_KEY_SIZE] = {0};
 
-    //Get public 32-byte service ECDH key from phone
-    memcpy(phone_public, p_pub_ecdh, ECS_ECDH_KEY_SIZE);
+    if (m_ecdh_job.phase == ECDH_PHASE_IDLE)
+    {
+        //The slot was destroyed while the key agreement was in progress
+        return;
+    }
+
+    if (m_ecdh_job.phase == ECDH_PHASE_RANDOM)
+    {
+        if (eddystone_rng_bytes_get(m_ecdh.ecdh_key_pair.private, ECS_ECDH_KEY_SIZE) == NRF_SUCCESS)
+        {
+            eddystone_security_ecdh_phase_start(ECDH_PHASE_PUBLIC);
+        }
+        else
+        {
+            //Another consumer took the bytes in the meantime
+            APP_ERROR_CHECK(eddystone_rng_bytes_wait(ECS_ECDH_KEY_SIZE, eddystone_security_ecdh_random_ready));
+        }
+        return;
+    }
 
-    if (memcmp(m_ecdh.ecdh_key_pair.public,zeros,ECS_ECDH_KEY_SIZE) == 0)
+    if (!eddystone_crypto_x25519_run(&m_ecdh_job.job, APP_ECDH_STEPS_PER_SLICE))
     {
-        eddystone_beacon_ecdh_pair_generate(beacon_private, beacon_public);
-        memcpy(m_ecdh.ecdh_key_pair.private, beacon_private,ECS_ECDH_KEY_SIZE);
-        memcpy(m_ecdh.ecdh_key_pair.public,  beacon_public,ECS_ECDH_KEY_SIZE);
+        APP_ERROR_CHECK(app_sched_event_put(NULL, 0, eddystone_security_ecdh_scheduler_evt));
+        return;
     }
-    else
+
+    if (m_ecdh_job.phase == ECDH_PHASE_PUBLIC)
     {
-        memcpy(beacon_private, m_ecdh.ecdh_key_pair.private, ECS_ECDH_KEY_SIZE);
-        memcpy(beacon_public, m_ecdh.ecdh_key_pair.public, ECS_ECDH_KEY_SIZE);
+        eddystone_crypto_x25519_result_get(&m_ecdh_job.job, m_ecdh.ecdh_key_pair.public);
+        m_ecdh.is_dirty = true;
+
+        #ifdef ECDH_PRINT_TEST
+
+        SEGGER_RTT_printf(0, "\r\n********* 4. Generate Beacon public 32-byte ECDH\r\n");
+        SEGGER_RTT_printf(0, "\r\nBEACON PRIVATE ECDH:\r\n ");
+        PRINT_ARRAY(m_ecdh.ecdh_key_pair.private, 32);
+        SEGGER_RTT_printf(0, "\r\nBEACON PUBLIC ECDH:\r\n ");
+        PRINT_ARRAY(m_ecdh.ecdh_key_pair.public, 32);
+
+        #endif /*ECDH_PRINT_TEST*/
+
+        if (m_ecdh_job.is_registration_pending)
+        {
+            eddystone_security_ecdh_phase_start(ECDH_PHASE_SHARED);
+        }
+        else
+        {
+            eddystone_crypto_x25519_clear(&m_ecdh_job.job);
+            m_ecdh_job.phase = ECDH_PHASE_IDLE;
+
+            DEBUG_PRINTF(0, "ECDH key pair pregenerated \r\n", 0);
+            m_security_init.msg_cb(0, EDDYSTONE_SECURITY_MSG_ECDH);
+            APP_ERROR_CHECK(eddystone_security_ecdh_pair_preserve());
+        }
+        return;
     }
 
-    //Generate shared 32-byte ECDH secret from beacon private service ECDH key and phone public ECDH key
-    cf_curve25519_mul(shared,  beacon_private, phone_public);
+    eddystone_crypto_x25519_result_get(&m_ecdh_job.job, shared);
+    eddystone_crypto_x25519_clear(&m_ecdh_job.job);
 
     #ifdef ECDH_PRINT_TEST
 
     SEGGER_RTT_printf(0, "\r\n\r\n********* 5. Generate Shared 32-byte ECDH\r\n");
     SEGGER_RTT_printf(0, "\r\nPHONE PUBLIC ECDH:\r\n ");
-    PRINT_ARRAY(phone_public, 32);
+    PRINT_ARRAY(m_ecdh_job.phone_public, 32);
     SEGGER_RTT_printf(0, "\r\nBEACON PRIVATE ECDH:\r\n ");
-    PRINT_ARRAY(beacon_private, 32);
+    PRINT_ARRAY(m_ecdh.ecdh_key_pair.private, 32);
     SEGGER_RTT_printf(0, "\r\nSHARED ECDH KEY:\r\n ");
     PRINT_ARRAY(shared, 32);
 
-
     #endif /*ECDH_PRINT_TEST*/
 
-
-    //Generate key material using shared ECDH secret as salt and public_keys as key material. RFC 2104 HMAC-SHA256.
-    uint8_t digest[64];
-    uint8_t public_keys[64];
-    memcpy(public_keys, phone_public, 32);
-    memcpy(public_keys+32, beacon_public, 32);
-
-    hmac(SHA256, shared, 32, public_keys, 64, digest);
-
     /* Zero check of the shared secret becoming zero, try generating a new key pair if so. Max attempt limit twice */
-    uint8_t empty_check[32] = {0};
-
-    if(memcmp(empty_check, shared, 32) == 0)
+    if (memcmp(zeros, shared, ECS_ECDH_KEY_SIZE) == 0 && m_ecdh_job.attempt_counter < 2)
     {
-        if (attempt_counter < 2)
-        {
-            attempt_counter++;
-            DEBUG_PRINTF(0, "Key Regen Attempt: %d \r\n", attempt_counter);
-            eddystone_beacon_ecdh_pair_generate(beacon_private, beacon_public);
-        }
-    }
-    else
-    {
-        attempt_counter = 0;
+        m_ecdh_job.attempt_counter++;
+        DEBUG_PRINTF(0, "Key Regen Attempt: %d \r\n", m_ecdh_job.attempt_counter);
+        eddystone_security_ecdh_phase_start(ECDH_PHASE_RANDOM);
+        return;
     }
 
-    #ifdef ECDH_PRINT_TEST
-
-    SEGGER_RTT_printf(0, "\r\n\r\n********* 6. Generate key material from shared ECDH secret using RFC 2104 HMAC-SHA256 without salt\r\n");
-    SEGGER_RTT_printf(0, "\r\nHMAC PUBLIC KEYS:\r\n ");
-    PRINT_ARRAY((uint8_t*)public_keys, 64);
-    SEGGER_RTT_printf(0, "\r\nHMAC SHARED KEY INPUT:\r\n ");
-    PRINT_ARRAY((uint8_t*)shared, 32);
-    SEGGER_RTT_printf(0, "\r\nHMAC DIGEST OUTPUT:\r\n ");
-    PRINT_ARRAY((uint8_t*)digest, 32);
-    #endif /*ECDH_PRINT_TEST*/
-
+    m_ecdh_job.attempt_counter         = 0;
+    m_ecdh_job.is_registration_pending = false;
+    m_ecdh_job.phase                   = ECDH_PHASE_IDLE;
 
-    //Generate 16-byte Identity Key from shared ECDH secret using RFC 2104 HMAC-SHA256 and salt
-    uint8_t digest_salted[64];
-    hmac(SHA256, salt, 1, digest, 32, digest_salted);
-    DEBUG_PRINTF(0,"  hmac(SHA256, salt, 1, digest, 32, digest_salted);  \r\n" ,0);
-
-    #ifdef ECDH_PRINT_TEST
-    SEGGER_RTT_printf(0, "\r\n\r\n********* 7. Generate 16-byte key material from shared ECDH secret using RFC 2104 HMAC-SHA256 and salt\r\n");
-    SEGGER_RTT_printf(0, "\r\nHMAC DIGEST INPUT:\r\n ");
-    PRINT_ARRAY((uint8_t*)digest, 32);
-    SEGGER_RTT_printf(0, "\r\nHMAC DIGEST SALTED OUTPUT:\r\n ");
-    PRINT_ARRAY((uint8_t*)digest_salted, 16);
-    #endif /*ECDH_PRINT_TEST*/
+    APP_ERROR_CHECK(eddystone_security_ecdh_identity_key_derive(m_ecdh_job.slot_no, m_ecdh_job.k_scaler, shared));
+    memset(shared, 0, sizeof(shared));
+}
 
-    for(uint8_t i = 0; i<16; i++)
+/**@brief Starts generating the beacon key pair in the background, if it is not being generated already*/
+static void eddystone_security_ecdh_pair_pregenerate(void)
+{
+    if (m_ecdh_job.phase == ECDH_PHASE_IDLE)
     {
-        identity_key[i] = digest_salted[i];
+        eddystone_security_ecdh_phase_start(ECDH_PHASE_RANDOM);
     }
+}
 
-    memcpy(m_security_slot[slot_no].aes_ecb_ik.key, identity_key, ECS_AES_KEY_SIZE);
+ret_code_t eddystone_security_client_pub_ecdh_receive( uint8_t slot_no, uint8_t * p_pub_ecdh, uint8_t scaler_k )
+{
+    uint8_t zeros[ECS_ECDH_KEY_SIZE] = {0};                // Array of zeros for checking if there are already keys
 
-    DEBUG_PRINTF(0,"Identity Key:",0);
-    for (uint8_t i = 0; i < ECS_AES_KEY_SIZE; i++)
+    if (m_ecdh_job.is_registration_pending && m_ecdh_job.slot_no != slot_no)
     {
-        DEBUG_PRINTF(0,"0x%02x, ", m_security_slot[slot_no].aes_ecb_ik.key[i]);
+        return NRF_ERROR_BUSY;
     }
-    DEBUG_PRINTF(0,"\r\n",0);
 
-    eddystone_security_temp_key_generate(slot_no);
-    eddystone_security_eid_generate(slot_no);
+    m_ecdh_job.slot_no                 = slot_no;
+    m_ecdh_job.k_scaler                = scaler_k;
+    m_ecdh_job.attempt_counter         = 0;
+    m_ecdh_job.is_registration_pending = true;
 
-    m_security_init.msg_cb(slot_no, EDDYSTONE_SECURITY_MSG_ECDH);
-    m_security_init.msg_cb(slot_no, EDDYSTONE_SECURITY_MSG_IK);
+    //Get public 32-byte service ECDH key from phone
+    memcpy(m_ecdh_job.phone_public, p_pub_ecdh, ECS_ECDH_KEY_SIZE);
 
-    return eddystone_security_ecdh_pair_preserve();
+    //The slot is set up when the key agreement is done, see eddystone_security_ecdh_identity_key_derive
+    if (m_ecdh_job.phase == ECDH_PHASE_SHARED)
+    {
+        //A new registration of the same slot replaces the one in progress, the slices already queued run the new one
+        eddystone_crypto_x25519_clear(&m_ecdh_job.job);
+        eddystone_crypto_x25519_start(&m_ecdh_job.job, m_ecdh.ecdh_key_pair.private, m_ecdh_job.phone_public);
+    }
+    else if (m_ecdh_job.phase != ECDH_PHASE_IDLE)
+    {
+        //The key pair is still being generated in the background, the shared secret follows it
+    }
+    else if (memcmp(m_ecdh.ecdh_key_pair.public,zeros,ECS_ECDH_KEY_SIZE) == 0)
+    {
+        eddystone_security_ecdh_phase_start(ECDH_PHASE_RANDOM);
+    }
+    else
+    {
+        eddystone_security_ecdh_phase_start(ECDH_PHASE_SHARED);
+    }
+
+    return NRF_SUCCESS;
 }
 
 void eddystone_security_pub_ecdh_get(uint8_t slot_no, uint8_t * p_edch_buffer)
@@ -606,29 +1007,62 @@ void eddystone_security_pub_ecdh_get(uint8_t slot_no, uint8_t * p_edch_buffer)
     memcpy(p_edch_buffer, m_ecdh.ecdh_key_pair.public, ECS_ECDH_KEY_SIZE);
 }
 
+void eddystone_security_ecb_stats_get(eddystone_security_ecb_stats_t * p_stats)
+{
+    *p_stats = m_ecb_stats;
+}
+
 uint32_t eddystone_security_clock_get(uint8_t slot_no)
 {
-    return m_security_slot[slot_no].timing.seconds;
+    return slot_seconds_get(slot_no);
 }
 
 void eddystone_security_eid_slot_destroy(uint8_t slot_no)
 {
     DEBUG_PRINTF(0,"Slot [%d] - Destroying EID state if slot was EID \r\n", slot_no);
     memset(&m_security_slot[slot_no],0,sizeof(eddystone_security_slot_t));
+
+    if (m_ecdh_job.is_registration_pending && m_ecdh_job.slot_no == slot_no)
+    {
+        m_ecdh_job.is_registration_pending = false;
+        if (m_ecdh_job.phase == ECDH_PHASE_SHARED)
+        {
+            eddystone_crypto_x25519_clear(&m_ecdh_job.job);
+            m_ecdh_job.phase = ECDH_PHASE_IDLE;
+        }
+        //A key pair being generated is still kept for the next registration
+    }
+
+    eddystone_security_timer_schedule();
 }
 
 ret_code_t eddystone_security_ecdh_pair_preserve( void )
 {
-    return eddystone_flash_access_ecdh_key_pair(m_ecdh.ecdh_key_pair.private,
-                                                m_ecdh.ecdh_key_pair.public,
-                                                EDDYSTONE_FLASH_ACCESS_WRITE);
+    ret_code_t err_code;
+
+    //A pregenerated key pair is already in flash when a registration uses it
+    if (!m_ecdh.is_dirty)
+    {
+        return NRF_SUCCESS;
+    }
+
+    err_code = eddystone_flash_access_ecdh_key_pair(m_ecdh.ecdh_key_pair.private,
+                                                    m_ecdh.ecdh_key_pair.public,
+                                                    EDDYSTONE_FLASH_ACCESS_WRITE,
+                                                    NULL,
+                                                    NULL);
+    if (err_code == NRF_SUCCESS)
+    {
+        m_ecdh.is_dirty = false;
+    }
+    return err_code;
 }
 
 void eddystone_security_eid_config_get( uint8_t slot_no, eddystone_eid_config_t * p_config )
 {
     p_config->frame_type = EDDYSTONE_FRAME_TYPE_EID;
     p_config->k_scaler = m_security_slot[slot_no].timing.k_scaler;
-    p_config->seconds = m_security_slot[slot_no].timing.seconds;
+    p_config->seconds = slot_seconds_get(slot_no);
     memcpy(p_config->ik, m_security_slot[slot_no].aes_ecb_ik.key, ECS_AES_KEY_SIZE);
 }
 
@@ -642,6 +1076,21 @@ void eddystone_security_eid_get(uint8_t slot_no, uint8_t * p_eid_buffer)
     memcpy(p_eid_buffer, m_security_slot[slot_no].eid, EDDYSTONE_EID_ID_LENGTH);
 }
 
+ret_code_t eddystone_security_eid_at_time_get(uint8_t slot_no, uint32_t seconds, uint8_t * p_eid_buffer)
+{
+    uint8_t tk[ECS_AES_KEY_SIZE];
+
+    if (slot_no >= APP_MAX_EID_SLOTS || !m_security_slot[slot_no].is_occupied)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    temp_key_compute(m_security_slot[slot_no].aes_ecb_ik.key, seconds, tk);
+    eid_compute(tk, m_security_slot[slot_no].timing.k_scaler, seconds, p_eid_buffer);
+
+    return NRF_SUCCESS;
+}
+
 void eddystone_security_encrypted_eid_id_key_get(uint8_t slot_no, uint8_t * p_key_buffer)
 {
     memcpy(m_aes_ecb_lk.cleartext, m_security_slot[slot_no].aes_ecb_ik.key,ECS_AES_KEY_SIZE);
@@ -656,27 +1105,24 @@ void eddystone_security_plain_eid_id_key_get(uint8_t slot_no, uint8_t * p_key_bu
 
 void eddystone_security_tlm_to_etlm( uint8_t ik_slot_no, eddystone_tlm_frame_t * p_tlm, eddystone_etlm_frame_t * p_etlm)
 {
-    cf_prp prp;                                                     // Describe the block cipher to use.
-
     uint8_t plain[TLM_DATA_SIZE]  = {0};                            // plaintext tlm, without the frame byte and version
-    size_t nplain                 = TLM_DATA_SIZE;                  // Length of message plaintext.
 
     memcpy(plain, (uint8_t *)&p_tlm->vbatt, sizeof(plain));
 
-    const uint8_t header          = 0;                              // Additionally authenticated data (AAD).
-    size_t nheader                = 0;                              // Length of header (AAD). May be zero.
+    //Key schedule and EAX values of the EIK, computed once per IK
+    eddystone_crypto_eax_t * p_eax = &m_security_slot[ik_slot_no].eax;
 
-    uint8_t key[EIK_SIZE]         = {0};                            // Encryption/decryption key: EIK
-    size_t  nkey                         = EIK_SIZE;                // Length of encryption/decryption key.
-
-    memcpy(key, &m_security_slot[ik_slot_no].aes_ecb_ik.key, EIK_SIZE);
+    if (!p_eax->is_valid)
+    {
+        eddystone_crypto_eax_init(p_eax, m_security_slot[ik_slot_no].aes_ecb_ik.key);
+    }
 
     uint8_t nonce[NONCE_SIZE]     = {0};                            // Nonce. This must not repeat for a given key.
-    size_t nnonce                       = NONCE_SIZE;               // Length of nonce.First 4 bytes are beacon time base with k-bits cleared
+                                                                    // First 4 bytes are beacon time base with k-bits cleared
                                                                     // Last two bits are randomly generated
 
     //Take the current timestamp and clear the lowest K bits, use it as nonce
-    uint32_t k_bits_cleared_time = (m_security_slot[ik_slot_no].timing.seconds
+    uint32_t k_bits_cleared_time = (slot_seconds_get(ik_slot_no)
                                     >> m_security_slot[ik_slot_no].timing.k_scaler)
                                     << m_security_slot[ik_slot_no].timing.k_scaler;
 
@@ -687,14 +1133,25 @@ void eddystone_security_tlm_to_etlm( uint8_t ik_slot_no, eddystone_tlm_frame_t *
     nonce[3] = (uint8_t)((k_bits_cleared_time) & 0xff);
 
     //Generate random salt
+    static uint16_t salt_counter = 0;
     uint8_t salt[SALT_SIZE] = {0};
-    sd_rand_application_vector_get(salt, SALT_SIZE);
+    if (eddystone_rng_bytes_get(salt, SALT_SIZE) == NRF_SUCCESS)
+    {
+        memcpy(&salt_counter, salt, SALT_SIZE);
+    }
+    else
+    {
+        //Out of randomness, the salt counts on from the last random one. The counter is not kept over a reset and
+        //counts from 0 until a random salt is drawn, so a salt, and with it a nonce, used before in the same period
+        //can come up again. Only a random salt makes that unlikely.
+        salt_counter++;
+        memcpy(salt, &salt_counter, SALT_SIZE);
+    }
     memcpy(&nonce[4], salt, SALT_SIZE);
 
     uint8_t cipher[EDDYSTONE_ETLM_ECRYPTED_LENGTH];                 // Ciphertext output. nplain bytes are written.
     uint8_t tag[TAG_SIZE] = {0};                                    // Authentication tag. ntag bytes are written.
-    size_t  ntag                         = TAG_SIZE;                // Length of authentication tag.
-    #ifdef ETLM_DEBUG_SESH
+    #ifdef ETLM_PRINT_TEST
     uint8_t decrypted_tlm[TLM_DATA_SIZE];                           // Decryption result.
     #endif
 
@@ -703,21 +1160,16 @@ void eddystone_security_tlm_to_etlm( uint8_t ik_slot_no, eddystone_tlm_frame_t *
     uint8_t hardcode_tlm[12] = {0, 0, 28, 64, 0, 0, 0, 72, 0, 0, 0, 115};
     uint8_t hardcode_nonce[6] = {0,1,0,0,0xF6,0x83};
     uint8_t hardcode_eik[16] = {0x58, 0x94, 0x17, 0xB0, 0x32, 0x4B, 0x1B, 0x71, 0xD7, 0xA6,0x75, 0x18, 0x52, 0x86, 0x7A, 0xE8};
+    static eddystone_crypto_eax_t hardcode_eax;
 
     memcpy(plain, hardcode_tlm, 12);
     memcpy(nonce, hardcode_nonce, 6);
-    memcpy(key, hardcode_eik, 16);
+    eddystone_crypto_eax_init(&hardcode_eax, hardcode_eik);
+    p_eax = &hardcode_eax;
     #endif
 
     //Encryption
     //--------------------------------------------------------------------------
-    cf_aes_context ctx;
-    cf_aes_init(&ctx, key, nkey);
-
-    prp.encrypt = (cf_prp_block)cf_aes_encrypt;   // Encryption context
-    prp.decrypt = (cf_prp_block)cf_aes_decrypt;   // Decryption context
-    prp.blocksz = ECS_AES_KEY_SIZE;
-
     #ifdef ETLM_PRINT_TEST
     SEGGER_RTT_printf(0, "\r\n\r\nAES-128-EAX Encryption/Decryption Example using CIFRA Library\r\n");
 
@@ -726,21 +1178,16 @@ void eddystone_security_tlm_to_etlm( uint8_t ik_slot_no, eddystone_tlm_frame_t *
     PRINT_ARRAY((uint8_t *)plain, TLM_DATA_SIZE);
     SEGGER_RTT_printf(0, "NONCE/SALT: ");
     PRINT_ARRAY((uint8_t *)nonce, NONCE_SIZE);
-    SEGGER_RTT_printf(0, "KEY/EIK: ");
-    PRINT_ARRAY((uint8_t *)key, EIK_SIZE);
     #endif
-    cf_eax_encrypt( &prp,
-                    &ctx,
-                    plain,      // Plaintext input, aka TLM
-                    nplain,     // Length of TLM
-                    &header,    // Empty
-                    nheader,    // Empty
-                    nonce,      // Nonce input
-                    nnonce,     // Length of nonce
-                    cipher,     // Encrypted output
-                    tag,        // Authentication tag output
-                    ntag        // Length of authentication tag
-                  );
+    eddystone_crypto_eax_encrypt(p_eax,
+                                 nonce,              // Nonce input
+                                 NONCE_SIZE,         // Length of nonce
+                                 plain,              // Plaintext input, aka TLM
+                                 TLM_DATA_SIZE,      // Length of TLM
+                                 cipher,             // Encrypted output
+                                 tag,                // Authentication tag output
+                                 TAG_SIZE            // Length of authentication tag
+                                );
 
       #ifdef ETLM_PRINT_TEST
       SEGGER_RTT_printf(0, "\r\nEncryption result\r\n");
@@ -749,20 +1196,27 @@ void eddystone_security_tlm_to_etlm( uint8_t ik_slot_no, eddystone_tlm_frame_t *
       SEGGER_RTT_printf(0, "TAG: ");
       PRINT_ARRAY(tag, sizeof(tag));
 
-      cf_eax_decrypt( &prp,
-                      &ctx,
-                      cipher,         // Encrypted input
-                      nplain,         // Length of encrypted input
-                      &header,        // Empty
-                      nheader,        // Empty
-                      nonce,          // Nonce input
-                      nnonce,         // Length of nonce
-                      tag,            // Authentication tag input
-                      ntag,           // Length of authentication tag
-                      decrypted_tlm   // Decryption result
-                    );
-
-      SEGGER_RTT_printf(0, "\r\nDecryption result\r\n");
+      //Check the selected EAX backend against the CIFRA implementation
+      cf_prp prp;
+      const uint8_t header = 0;
+      prp.encrypt = (cf_prp_block)cf_aes_encrypt;   // Encryption context
+      prp.decrypt = (cf_prp_block)cf_aes_decrypt;   // Decryption context
+      prp.blocksz = ECS_AES_KEY_SIZE;
+
+      int result = cf_eax_decrypt( &prp,
+                                   (void *)&p_eax->aes,
+                                   cipher,         // Encrypted input
+                                   TLM_DATA_SIZE,  // Length of encrypted input
+                                   &header,        // Empty
+                                   0,              // Empty
+                                   nonce,          // Nonce input
+                                   NONCE_SIZE,     // Length of nonce
+                                   tag,            // Authentication tag input
+                                   TAG_SIZE,       // Length of authentication tag
+                                   decrypted_tlm   // Decryption result
+                                 );
+
+      SEGGER_RTT_printf(0, "\r\nDecryption result %d\r\n", result);
       SEGGER_RTT_printf(0, "PLAINTEXT/TLM: ");
       PRINT_ARRAY(decrypted_tlm, TLM_DATA_SIZE);
       SEGGER_RTT_printf(0, "TAG: ");
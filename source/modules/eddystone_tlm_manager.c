@@ -3,6 +3,7 @@
 #include "eddystone_security.h"
 #include "app_error.h"
 #include "app_timer.h"
+#include "app_scheduler.h"
 #include "endian_convert.h"
 #include <string.h>
 #include "debug_config.h"
@@ -16,6 +17,25 @@
 
 #define TLM_TEMP_INTERVAL (30)
 
+/**@brief Double buffer of precomputed eTLMs for one EIK pairing*/
+typedef struct
+{
+    eddystone_etlm_frame_t  frames[2];          /**< front frame is handed out, the other one is encrypted into */
+    uint8_t                 front;              /**< index of the frame handed out by @ref eddystone_tlm_manager_etlm_ready_get */
+    uint8_t                 generation;         /**< incremented on every request, so jobs queued for an old EIK are discarded */
+    bool                    is_ready;           /**< frames[front] holds an eTLM that has not been handed out yet */
+    bool                    is_pending;         /**< a precompute job is queued */
+} eddystone_etlm_pipeline_t;
+
+/**@brief Scheduler event data of an eTLM precompute job*/
+typedef struct
+{
+    uint8_t eik_pair_slot;
+    uint8_t generation;
+} eddystone_etlm_job_t;
+
+static eddystone_etlm_pipeline_t m_etlm_pipeline[APP_MAX_EID_SLOTS];
+
 #ifdef TLM_DEBUG
 uint8_t ascii_table[] = {
 '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F'
@@ -166,6 +186,95 @@ void eddystone_tlm_manager_etlm_get( uint8_t eik_pair_slot, eddystone_etlm_frame
     #endif
 }
 
+/**@brief scheduler event to encrypt the next eTLM of an EIK pairing in main context, outside of the advertising path*/
+static void etlm_precompute_scheduler_evt(void * p_event_data, uint16_t event_size)
+{
+    eddystone_etlm_job_t        job         = *(eddystone_etlm_job_t *)p_event_data;
+    eddystone_etlm_pipeline_t * p_pipeline  = &m_etlm_pipeline[job.eik_pair_slot];
+    uint8_t                     back        = p_pipeline->front ^ 1;
+
+    if (job.generation != p_pipeline->generation)
+    {
+        //Requested for an old EIK, a newer job has been queued
+        return;
+    }
+
+    eddystone_tlm_manager_etlm_get(job.eik_pair_slot, &p_pipeline->frames[back]);
+
+    p_pipeline->front      = back;
+    p_pipeline->is_ready   = true;
+    p_pipeline->is_pending = false;
+}
+
+/**@brief Function for queuing the precompute job of an EIK pairing, unless one is already queued*/
+static void etlm_precompute_job_put(uint8_t eik_pair_slot)
+{
+    ret_code_t           err_code;
+    eddystone_etlm_job_t job;
+
+    if (m_etlm_pipeline[eik_pair_slot].is_pending)
+    {
+        return;
+    }
+
+    job.eik_pair_slot = eik_pair_slot;
+    job.generation    = m_etlm_pipeline[eik_pair_slot].generation;
+
+    err_code = app_sched_event_put(&job, sizeof(job), etlm_precompute_scheduler_evt);
+    if (err_code == NRF_SUCCESS)
+    {
+        m_etlm_pipeline[eik_pair_slot].is_pending = true;
+    }
+    //If the queue is full the eTLM is simply encrypted on demand by eddystone_tlm_manager_etlm_get
+}
+
+void eddystone_tlm_manager_etlm_precompute( uint8_t eik_pair_slot )
+{
+    if (eik_pair_slot >= APP_MAX_EID_SLOTS)
+    {
+        return;
+    }
+    m_etlm_pipeline[eik_pair_slot].generation++;
+    m_etlm_pipeline[eik_pair_slot].is_ready   = false;
+    m_etlm_pipeline[eik_pair_slot].is_pending = false;
+    etlm_precompute_job_put(eik_pair_slot);
+}
+
+void eddystone_tlm_manager_etlm_invalidate( uint8_t eik_pair_slot )
+{
+    if (eik_pair_slot >= APP_MAX_EID_SLOTS)
+    {
+        return;
+    }
+
+    //Only a pairing the schedule takes eTLMs from has a frame ready or a job queued
+    if (m_etlm_pipeline[eik_pair_slot].is_ready || m_etlm_pipeline[eik_pair_slot].is_pending)
+    {
+        eddystone_tlm_manager_etlm_precompute(eik_pair_slot);
+    }
+}
+
+ret_code_t eddystone_tlm_manager_etlm_ready_get( uint8_t eik_pair_slot, eddystone_etlm_frame_t const ** pp_etlm_frame )
+{
+    ret_code_t err_code = NRF_ERROR_INVALID_STATE;
+
+    if (eik_pair_slot >= APP_MAX_EID_SLOTS || pp_etlm_frame == NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    if (m_etlm_pipeline[eik_pair_slot].is_ready)
+    {
+        *pp_etlm_frame = &m_etlm_pipeline[eik_pair_slot].frames[m_etlm_pipeline[eik_pair_slot].front];
+        m_etlm_pipeline[eik_pair_slot].is_ready = false;
+        err_code = NRF_SUCCESS;
+    }
+
+    //Encrypt the next one while the radio is busy with this one
+    etlm_precompute_job_put(eik_pair_slot);
+    return err_code;
+}
+
 void eddystone_tlm_manager_adv_cnt_add(uint8_t n)
 {
     static uint32_t le_adv_cnt = 0; //little endian
@@ -0,0 +1,246 @@
+/**@brief Host test of the AES-128 ECB backends, see eddystone_crypto.h
+ * @details Checks every encryption and decryption backend against FIPS-197 and SP 800-38A test vectors, then
+ *          cross-checks the bitsliced decryption against OpenSSL on random keys and blocks, both with a key expanded
+ *          per block and with a key expanded once. The decryption backends are timed on the same random blocks on
+ *          the way, which tells how they compare but not what they cost on the nRF52.
+ *          The SoftDevice ECB encryption is done with OpenSSL on the host.
+ *
+ *          Usage: aes_test [number of random blocks] [seed]
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/evp.h>
+#include "eddystone_crypto.h"
+
+#define BLOCK_SIZE              EDDYSTONE_CRYPTO_AES_BLOCK_SIZE
+#define KEY_SIZE                EDDYSTONE_CRYPTO_AES_KEY_SIZE
+#define TIMED_BLOCKS_MAX        20000       /**< random blocks each decryption backend is timed on, at most */
+
+#define TEST_ASSERT(COND, ...)                                                                    \
+    do                                                                                            \
+    {                                                                                             \
+        if (!(COND))                                                                              \
+        {                                                                                         \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                           \
+            printf(__VA_ARGS__);                                                                  \
+            printf("\n");                                                                         \
+            exit(1);                                                                              \
+        }                                                                                         \
+    } while (0)
+
+typedef ret_code_t (*ecb_fn_t)(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out);
+
+/**@brief AES-128 known answer test vector*/
+typedef struct
+{
+    uint8_t key[KEY_SIZE];
+    uint8_t plain[BLOCK_SIZE];
+    uint8_t cipher[BLOCK_SIZE];
+} aes_kat_t;
+
+//FIPS-197 appendix C.1 and B, SP 800-38A F.1.1
+static const aes_kat_t m_aes_kats[] =
+{
+    {{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f},
+     {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+     {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a}},
+    {{0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c},
+     {0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d, 0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34},
+     {0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb, 0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32}},
+    {{0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c},
+     {0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a},
+     {0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97}},
+    {{0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c},
+     {0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51},
+     {0xf5, 0xd3, 0xd5, 0x85, 0x03, 0xb9, 0x69, 0x9d, 0xe7, 0x85, 0x89, 0x5a, 0x96, 0xfd, 0xba, 0xaf}},
+    {{0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c},
+     {0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef},
+     {0x43, 0xb1, 0xcd, 0x7f, 0x59, 0x8e, 0xce, 0x23, 0x88, 0x1b, 0x00, 0xe3, 0xed, 0x03, 0x06, 0x88}},
+    {{0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c},
+     {0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10},
+     {0x7b, 0x0c, 0x78, 0x5e, 0x27, 0xe8, 0xad, 0x3f, 0x82, 0x23, 0x20, 0x71, 0x04, 0x72, 0x5d, 0xd4}},
+};
+
+#define NUM_OF_KATS (sizeof(m_aes_kats) / sizeof(m_aes_kats[0]))
+
+static EVP_CIPHER_CTX * mp_evp_ctx;
+
+/**@brief Encrypts or decrypts one block with OpenSSL, the reference every backend is checked against*/
+static void openssl_aes_ecb(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out, bool is_decrypt)
+{
+    int length;
+
+    TEST_ASSERT(EVP_CipherInit_ex(mp_evp_ctx, EVP_aes_128_ecb(), NULL, p_key, NULL, is_decrypt ? 0 : 1) == 1,
+                "OpenSSL cipher init failed");
+    EVP_CIPHER_CTX_set_padding(mp_evp_ctx, 0);
+    TEST_ASSERT(EVP_CipherUpdate(mp_evp_ctx, p_out, &length, p_in, BLOCK_SIZE) == 1 && length == BLOCK_SIZE,
+                "OpenSSL cipher update failed");
+}
+
+uint32_t sd_ecb_block_encrypt(nrf_ecb_hal_data_t * p_ecb_data)
+{
+    openssl_aes_ecb(p_ecb_data->key, p_ecb_data->cleartext, p_ecb_data->ciphertext, false);
+    return NRF_SUCCESS;
+}
+
+/**@brief Decrypts with a key expanded by @ref eddystone_crypto_aes_dec_key_set just before*/
+static ret_code_t expanded_key_aes_ecb_decrypt(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out)
+{
+    eddystone_crypto_aes_dec_key_t dec_key;
+
+    eddystone_crypto_aes_dec_key_set(&dec_key, p_key);
+    return eddystone_crypto_aes_ecb_decrypt_with_key(&dec_key, p_in, p_out);
+}
+
+/**@brief Checks a backend against all known answer test vectors, in place as well*/
+static void kat_check(const char * p_name, ecb_fn_t ecb_fn, bool is_decrypt)
+{
+    uint8_t out[BLOCK_SIZE];
+
+    for (uint8_t i = 0; i < NUM_OF_KATS; i++)
+    {
+        const aes_kat_t * p_kat      = &m_aes_kats[i];
+        const uint8_t *   p_in       = is_decrypt ? p_kat->cipher : p_kat->plain;
+        const uint8_t *   p_expected = is_decrypt ? p_kat->plain : p_kat->cipher;
+
+        memset(out, 0, sizeof(out));
+        TEST_ASSERT(ecb_fn(p_kat->key, p_in, out) == NRF_SUCCESS, "%s returned an error", p_name);
+        TEST_ASSERT(memcmp(out, p_expected, BLOCK_SIZE) == 0, "%s, test vector %d", p_name, i);
+
+        memcpy(out, p_in, BLOCK_SIZE);
+        TEST_ASSERT(ecb_fn(p_kat->key, out, out) == NRF_SUCCESS, "%s returned an error", p_name);
+        TEST_ASSERT(memcmp(out, p_expected, BLOCK_SIZE) == 0, "%s in place, test vector %d", p_name, i);
+    }
+    printf("%-32s %d test vectors passed\n", p_name, (int)NUM_OF_KATS);
+}
+
+static void random_fill(uint8_t * p_buf, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++)
+    {
+        p_buf[i] = (uint8_t)rand();
+    }
+}
+
+/**@brief Checks the bitsliced decryption against OpenSSL on random keys and blocks*/
+static void bitsliced_cross_check(uint32_t num_of_blocks)
+{
+    uint8_t  key[KEY_SIZE];
+    uint8_t  in[BLOCK_SIZE];
+    uint8_t  out[BLOCK_SIZE];
+    uint8_t  expected[BLOCK_SIZE];
+    uint16_t round_keys[EDDYSTONE_CRYPTO_AES_NUM_OF_ROUNDS + 1][8];
+
+    for (uint32_t n = 0; n < num_of_blocks; n++)
+    {
+        //A new key every other block, so that every key decrypts with a fresh and with a reused schedule
+        if ((n % 2) == 0)
+        {
+            random_fill(key, sizeof(key));
+            eddystone_crypto_bitsliced_aes_key_expand(round_keys, key);
+        }
+        random_fill(in, sizeof(in));
+        openssl_aes_ecb(key, in, expected, true);
+
+        UNUSED_VARIABLE(eddystone_crypto_bitsliced_aes_ecb_decrypt(key, in, out));
+        TEST_ASSERT(memcmp(out, expected, BLOCK_SIZE) == 0, "bitsliced one-shot differs from OpenSSL, block %u", n);
+
+        eddystone_crypto_bitsliced_aes_decrypt((const uint16_t (*)[8])round_keys, in, out);
+        TEST_ASSERT(memcmp(out, expected, BLOCK_SIZE) == 0, "bitsliced expanded key differs from OpenSSL, block %u", n);
+    }
+    printf("%-32s %u random blocks agree with OpenSSL\n", "AES dec bitsliced", num_of_blocks);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**@brief Times a decryption backend on the same random keys and blocks as the others*/
+static void decrypt_time(const char * p_name, ecb_fn_t ecb_fn, const uint8_t * p_keys, const uint8_t * p_blocks,
+                         uint32_t num_of_blocks)
+{
+    uint8_t  out[BLOCK_SIZE];
+    uint8_t  check = 0;
+    double   start = now_ns();
+
+    for (uint32_t n = 0; n < num_of_blocks; n++)
+    {
+        UNUSED_VARIABLE(ecb_fn(&p_keys[n * KEY_SIZE], &p_blocks[n * BLOCK_SIZE], out));
+        check ^= out[n % BLOCK_SIZE];
+    }
+    printf("%-32s %8.0f ns per block (%02x)\n", p_name, (now_ns() - start) / num_of_blocks, check);
+}
+
+static void bitsliced_expanded_time(const uint8_t * p_keys, const uint8_t * p_blocks, uint32_t num_of_blocks)
+{
+    uint8_t  out[BLOCK_SIZE];
+    uint8_t  check = 0;
+    uint16_t round_keys[EDDYSTONE_CRYPTO_AES_NUM_OF_ROUNDS + 1][8];
+    double   start;
+
+    //One key for all blocks, as for the lock code
+    eddystone_crypto_bitsliced_aes_key_expand(round_keys, p_keys);
+    start = now_ns();
+    for (uint32_t n = 0; n < num_of_blocks; n++)
+    {
+        eddystone_crypto_bitsliced_aes_decrypt((const uint16_t (*)[8])round_keys, &p_blocks[n * BLOCK_SIZE], out);
+        check ^= out[n % BLOCK_SIZE];
+    }
+    printf("%-32s %8.0f ns per block (%02x)\n", "AES dec bitsliced, expanded key", (now_ns() - start) / num_of_blocks, check);
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t  num_of_blocks = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 200000;
+    uint32_t  seed          = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 1;
+    uint32_t  num_of_timed  = (num_of_blocks < TIMED_BLOCKS_MAX) ? num_of_blocks : TIMED_BLOCKS_MAX;
+    uint8_t * p_keys;
+    uint8_t * p_blocks;
+
+    srand(seed);
+    mp_evp_ctx = EVP_CIPHER_CTX_new();
+    TEST_ASSERT(mp_evp_ctx != NULL, "no OpenSSL cipher context");
+
+    kat_check("AES enc SD",                     eddystone_crypto_sd_aes_ecb_encrypt,         false);
+    kat_check("AES enc tiny-AES",               eddystone_crypto_tiny_aes_ecb_encrypt,       false);
+    kat_check("AES enc cifra",                  eddystone_crypto_cifra_aes_ecb_encrypt,      false);
+    kat_check("AES enc selected backend",       eddystone_crypto_aes_ecb_encrypt,            false);
+    kat_check("AES dec tiny-AES",               eddystone_crypto_tiny_aes_ecb_decrypt,       true);
+    kat_check("AES dec cifra",                  eddystone_crypto_cifra_aes_ecb_decrypt,      true);
+    kat_check("AES dec bitsliced",              eddystone_crypto_bitsliced_aes_ecb_decrypt,  true);
+    kat_check("AES dec selected backend",       eddystone_crypto_aes_ecb_decrypt,            true);
+    kat_check("AES dec selected, expanded key", expanded_key_aes_ecb_decrypt,                true);
+
+    bitsliced_cross_check(num_of_blocks);
+
+    if (num_of_timed > 0)
+    {
+        p_keys   = malloc(num_of_timed * KEY_SIZE);
+        p_blocks = malloc(num_of_timed * BLOCK_SIZE);
+        TEST_ASSERT(p_keys != NULL && p_blocks != NULL, "out of memory");
+        random_fill(p_keys, num_of_timed * KEY_SIZE);
+        random_fill(p_blocks, num_of_timed * BLOCK_SIZE);
+
+        printf("Host timing over %u random blocks, key expansion included unless stated\n", num_of_timed);
+        decrypt_time("AES dec bitsliced",   eddystone_crypto_bitsliced_aes_ecb_decrypt,  p_keys, p_blocks, num_of_timed);
+        decrypt_time("AES dec tiny-AES",    eddystone_crypto_tiny_aes_ecb_decrypt,       p_keys, p_blocks, num_of_timed);
+        decrypt_time("AES dec cifra",       eddystone_crypto_cifra_aes_ecb_decrypt,      p_keys, p_blocks, num_of_timed);
+        bitsliced_expanded_time(p_keys, p_blocks, num_of_timed);
+
+        free(p_keys);
+        free(p_blocks);
+    }
+
+    EVP_CIPHER_CTX_free(mp_evp_ctx);
+    printf("PASS\n");
+    return 0;
+}
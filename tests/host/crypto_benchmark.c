@@ -0,0 +1,387 @@
+/**@brief Host benchmark of the crypto backends, see eddystone_crypto.h
+ * @details Times every backend of every primitive on the same inputs and checks that the backends of a primitive
+ *          agree. The times are those of the host, they tell how the backends compare and not what they cost on the
+ *          nRF52. The SoftDevice ECB encryption is done with OpenSSL on the host, so it is only checked, not timed.
+ *
+ *          The eTLM encryption is timed as it was before the EAX key state was kept per EIK, with the key expanded
+ *          for every eTLM and cifra's EAX, next to the CIFRA and CACHED backends on a key state set up once.
+ *          cifra's cf_aes_init and cf_aes_encrypt are wrapped at link time, so the key expansions and the AES blocks
+ *          of every eTLM are counted too. Unlike the times, the counts hold on the nRF52.
+ *
+ *          Usage: crypto_benchmark [rounds] [seed]
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/evp.h>
+#include "eddystone_crypto.h"
+#include "eddystone_hkdf.h"
+
+#define BLOCK_SIZE              EDDYSTONE_CRYPTO_AES_BLOCK_SIZE
+#define KEY_SIZE                EDDYSTONE_CRYPTO_AES_KEY_SIZE
+#define X25519_KEY_SIZE         EDDYSTONE_CRYPTO_X25519_KEY_SIZE
+#define NUM_OF_INPUTS           64      /**< different random inputs the rounds cycle through */
+#define X25519_ROUNDS_DIVIDER   100     /**< an X25519 is timed over this many times fewer rounds */
+#define ETLM_NONCE_SIZE         6
+#define ETLM_DATA_SIZE          12
+#define ETLM_TAG_SIZE           2
+
+#define TEST_ASSERT(COND, ...)                                                                    \
+    do                                                                                            \
+    {                                                                                             \
+        if (!(COND))                                                                              \
+        {                                                                                         \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                           \
+            printf(__VA_ARGS__);                                                                  \
+            printf("\n");                                                                         \
+            exit(1);                                                                              \
+        }                                                                                         \
+    } while (0)
+
+typedef ret_code_t (*ecb_fn_t)(const uint8_t * p_key, const uint8_t * p_in, uint8_t * p_out);
+typedef void (*eax_init_fn_t)(eddystone_crypto_eax_t * p_eax, const uint8_t * p_key);
+typedef void (*eax_fn_t)(const eddystone_crypto_eax_t * p_eax,
+                         const uint8_t * p_nonce, uint8_t nonce_length,
+                         const uint8_t * p_plain, uint8_t length,
+                         uint8_t * p_cipher, uint8_t * p_tag, uint8_t tag_length);
+typedef void (*hmac_fn_t)(const uint8_t * p_key, uint8_t key_length,
+                          const uint8_t * p_msg, uint8_t msg_length, uint8_t * p_mac);
+
+/**@brief Random inputs, the same for every backend*/
+typedef struct
+{
+    uint8_t key[KEY_SIZE];
+    uint8_t block[BLOCK_SIZE];
+    uint8_t nonce[ETLM_NONCE_SIZE];
+    uint8_t tlm[ETLM_DATA_SIZE];
+    uint8_t msg[64];
+    uint8_t scalar[X25519_KEY_SIZE];
+} bench_input_t;
+
+static bench_input_t    m_inputs[NUM_OF_INPUTS];
+static uint32_t         m_rounds;
+static double           m_start;
+static EVP_CIPHER_CTX * mp_evp_ctx;
+static uint32_t         m_aes_inits;    /**< cifra key expansions, counted by @ref __wrap_cf_aes_init */
+static uint32_t         m_aes_blocks;   /**< cifra AES blocks, counted by @ref __wrap_cf_aes_encrypt */
+
+void __real_cf_aes_init(cf_aes_context * ctx, const uint8_t * key, size_t nkey);
+void __real_cf_aes_encrypt(const cf_aes_context * ctx, const uint8_t * in, uint8_t * out);
+
+/**@brief Counts the key expansion, linked in place of cf_aes_init with -Wl,--wrap=cf_aes_init*/
+void __wrap_cf_aes_init(cf_aes_context * ctx, const uint8_t * key, size_t nkey)
+{
+    m_aes_inits++;
+    __real_cf_aes_init(ctx, key, nkey);
+}
+
+/**@brief Counts the AES block, linked in place of cf_aes_encrypt with -Wl,--wrap=cf_aes_encrypt.
+ * @details The calls through the cf_prp of cifra's EAX are counted too, the address of cf_aes_encrypt taken in
+ *          eddystone_crypto.c being that of the wrapper.
+ */
+void __wrap_cf_aes_encrypt(const cf_aes_context * ctx, const uint8_t * in, uint8_t * out)
+{
+    m_aes_blocks++;
+    __real_cf_aes_encrypt(ctx, in, out);
+}
+
+uint32_t sd_ecb_block_encrypt(nrf_ecb_hal_data_t * p_ecb_data)
+{
+    int length;
+
+    TEST_ASSERT(EVP_EncryptInit_ex(mp_evp_ctx, EVP_aes_128_ecb(), NULL, p_ecb_data->key, NULL) == 1
+             && EVP_CIPHER_CTX_set_padding(mp_evp_ctx, 0) == 1
+             && EVP_EncryptUpdate(mp_evp_ctx, p_ecb_data->ciphertext, &length, p_ecb_data->cleartext, BLOCK_SIZE) == 1,
+                "OpenSSL encryption failed");
+    return NRF_SUCCESS;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void benchmark_start(void)
+{
+    m_start = now_ns();
+}
+
+/**@brief Prints the time per operation since @ref benchmark_start*/
+static void benchmark_end(const char * p_name, uint32_t rounds)
+{
+    printf("%-40s %10.0f ns\n", p_name, (now_ns() - m_start) / rounds);
+}
+
+/**@brief Times an ECB backend, p_out gets the result of every input*/
+static void ecb_benchmark(const char * p_name, ecb_fn_t ecb_fn, uint8_t p_out[][BLOCK_SIZE])
+{
+    benchmark_start();
+    for (uint32_t i = 0; i < m_rounds; i++)
+    {
+        const bench_input_t * p_input = &m_inputs[i % NUM_OF_INPUTS];
+
+        UNUSED_VARIABLE(ecb_fn(p_input->key, p_input->block, p_out[i % NUM_OF_INPUTS]));
+    }
+    benchmark_end(p_name, m_rounds);
+}
+
+/**@brief Decrypts with a key expanded once per input, for timing the decryption without the key schedule*/
+static void expanded_key_benchmark(uint8_t p_out[][BLOCK_SIZE])
+{
+    static eddystone_crypto_aes_dec_key_t dec_keys[NUM_OF_INPUTS];
+
+    for (uint32_t i = 0; i < NUM_OF_INPUTS; i++)
+    {
+        eddystone_crypto_aes_dec_key_set(&dec_keys[i], m_inputs[i].key);
+    }
+
+    benchmark_start();
+    for (uint32_t i = 0; i < m_rounds; i++)
+    {
+        UNUSED_VARIABLE(eddystone_crypto_aes_ecb_decrypt_with_key(&dec_keys[i % NUM_OF_INPUTS],
+                                                                  m_inputs[i % NUM_OF_INPUTS].block,
+                                                                  p_out[i % NUM_OF_INPUTS]));
+    }
+    benchmark_end("AES dec selected backend, expanded key", m_rounds);
+}
+
+static void outputs_check(const char * p_name, const void * p_a, const void * p_b, size_t size)
+{
+    TEST_ASSERT(memcmp(p_a, p_b, size) == 0, "%s backends disagree", p_name);
+    printf("%-40s agree\n", p_name);
+}
+
+static void aes_benchmark(void)
+{
+    static uint8_t reference[NUM_OF_INPUTS][BLOCK_SIZE];
+    static uint8_t out[NUM_OF_INPUTS][BLOCK_SIZE];
+
+    //The SoftDevice encryption is OpenSSL here, as the reference
+    for (uint32_t i = 0; i < NUM_OF_INPUTS; i++)
+    {
+        UNUSED_VARIABLE(eddystone_crypto_sd_aes_ecb_encrypt(m_inputs[i].key, m_inputs[i].block, reference[i]));
+    }
+
+    ecb_benchmark("AES enc tiny-AES", eddystone_crypto_tiny_aes_ecb_encrypt, out);
+    outputs_check("AES enc tiny-AES and SD", reference, out, sizeof(out));
+    ecb_benchmark("AES enc cifra", eddystone_crypto_cifra_aes_ecb_encrypt, out);
+    outputs_check("AES enc cifra and SD", reference, out, sizeof(out));
+
+    ecb_benchmark("AES dec tiny-AES", eddystone_crypto_tiny_aes_ecb_decrypt, reference);
+    ecb_benchmark("AES dec cifra", eddystone_crypto_cifra_aes_ecb_decrypt, out);
+    outputs_check("AES dec cifra and tiny-AES", reference, out, sizeof(out));
+    ecb_benchmark("AES dec bitsliced", eddystone_crypto_bitsliced_aes_ecb_decrypt, out);
+    outputs_check("AES dec bitsliced and tiny-AES", reference, out, sizeof(out));
+    expanded_key_benchmark(out);
+    outputs_check("AES dec expanded key and tiny-AES", reference, out, sizeof(out));
+}
+
+/**@brief Prints the key expansions and the AES blocks per operation, counted since m_aes_inits and m_aes_blocks were
+ *        cleared. Checks that they are whole numbers per operation.
+ */
+static void aes_count_end(const char * p_name, uint32_t rounds, uint32_t * p_inits, uint32_t * p_blocks)
+{
+    TEST_ASSERT(m_aes_inits % rounds == 0 && m_aes_blocks % rounds == 0,
+                "%s: %u key expansions and %u AES blocks over %u rounds", p_name, m_aes_inits, m_aes_blocks, rounds);
+    *p_inits  = m_aes_inits / rounds;
+    *p_blocks = m_aes_blocks / rounds;
+    printf("%-40s key expansions: %u, AES blocks: %u\n", "", *p_inits, *p_blocks);
+}
+
+/**@brief Times the key setup, and eTLM sized encryptions either with a key set up once or with the key set up for
+ *        every eTLM. p_out gets the ciphertext and the tag of every input, p_inits and p_blocks the key expansions
+ *        and the AES blocks per eTLM.
+ */
+static void eax_benchmark(const char * p_name, eax_init_fn_t init_fn, eax_fn_t eax_fn, bool is_init_per_etlm,
+                          uint8_t p_out[][ETLM_DATA_SIZE + ETLM_TAG_SIZE], uint32_t * p_inits, uint32_t * p_blocks)
+{
+    uint32_t                      setup_inits;
+    uint32_t                      setup_blocks;
+    static eddystone_crypto_eax_t eax[NUM_OF_INPUTS];
+    char                          name[64];
+
+    if (!is_init_per_etlm)
+    {
+        m_aes_inits  = 0;
+        m_aes_blocks = 0;
+        benchmark_start();
+        for (uint32_t i = 0; i < m_rounds; i++)
+        {
+            init_fn(&eax[i % NUM_OF_INPUTS], m_inputs[i % NUM_OF_INPUTS].key);
+        }
+        snprintf(name, sizeof(name), "%s key setup", p_name);
+        benchmark_end(name, m_rounds);
+        aes_count_end(name, m_rounds, &setup_inits, &setup_blocks);
+    }
+
+    m_aes_inits  = 0;
+    m_aes_blocks = 0;
+    benchmark_start();
+    for (uint32_t i = 0; i < m_rounds; i++)
+    {
+        const bench_input_t * p_input = &m_inputs[i % NUM_OF_INPUTS];
+        uint8_t *             p_etlm  = p_out[i % NUM_OF_INPUTS];
+
+        if (is_init_per_etlm)
+        {
+            init_fn(&eax[i % NUM_OF_INPUTS], p_input->key);
+        }
+        eax_fn(&eax[i % NUM_OF_INPUTS], p_input->nonce, ETLM_NONCE_SIZE, p_input->tlm, ETLM_DATA_SIZE,
+               p_etlm, &p_etlm[ETLM_DATA_SIZE], ETLM_TAG_SIZE);
+    }
+    snprintf(name, sizeof(name), "%s eTLM", p_name);
+    benchmark_end(name, m_rounds);
+    aes_count_end(name, m_rounds, p_inits, p_blocks);
+}
+
+static void etlm_benchmark(void)
+{
+    static uint8_t reference[NUM_OF_INPUTS][ETLM_DATA_SIZE + ETLM_TAG_SIZE];
+    static uint8_t out[NUM_OF_INPUTS][ETLM_DATA_SIZE + ETLM_TAG_SIZE];
+    uint32_t       inits;
+    uint32_t       blocks;
+
+    eax_benchmark("EAX cifra, key expanded for every", eddystone_crypto_cifra_eax_init, eddystone_crypto_cifra_eax_encrypt,
+                  true, reference, &inits, &blocks);
+    TEST_ASSERT(inits == 1, "the key is expanded %u times per eTLM", inits);
+    eax_benchmark("EAX cifra", eddystone_crypto_cifra_eax_init, eddystone_crypto_cifra_eax_encrypt, false, out,
+                  &inits, &blocks);
+    outputs_check("EAX cifra, key once and per eTLM", reference, out, sizeof(out));
+    eax_benchmark("EAX cached", eddystone_crypto_cached_eax_init, eddystone_crypto_cached_eax_encrypt, false, out,
+                  &inits, &blocks);
+    TEST_ASSERT(inits == 0 && blocks == 3, "the cached eTLM costs %u key expansions and %u AES blocks, not 0 and 3",
+                inits, blocks);
+    outputs_check("EAX cached and cifra", reference, out, sizeof(out));
+}
+
+static void hmac_benchmark(const char * p_name, hmac_fn_t hmac_fn, uint8_t p_out[][USHAMaxHashSize])
+{
+    benchmark_start();
+    for (uint32_t i = 0; i < m_rounds; i++)
+    {
+        const bench_input_t * p_input = &m_inputs[i % NUM_OF_INPUTS];
+
+        hmac_fn(p_input->key, KEY_SIZE, p_input->msg, sizeof(p_input->msg), p_out[i % NUM_OF_INPUTS]);
+    }
+    benchmark_end(p_name, m_rounds);
+}
+
+/**@brief Times the Identity Key derivation of an EID registration, with HKDF and with the two HMACs of before*/
+static void ik_benchmark(void)
+{
+    static uint8_t reference[NUM_OF_INPUTS][USHAMaxHashSize];
+    static uint8_t out[NUM_OF_INPUTS][USHAMaxHashSize];
+    uint8_t        digest[USHAMaxHashSize];
+    const uint8_t  info[1] = {0x01};
+
+    //The salt is the two public keys, the key material the shared secret
+    benchmark_start();
+    for (uint32_t i = 0; i < m_rounds; i++)
+    {
+        const bench_input_t * p_input = &m_inputs[i % NUM_OF_INPUTS];
+
+        eddystone_hkdf(p_input->msg, sizeof(p_input->msg), p_input->scalar, X25519_KEY_SIZE, NULL, 0,
+                       reference[i % NUM_OF_INPUTS], KEY_SIZE);
+    }
+    benchmark_end("IK derivation HKDF", m_rounds);
+
+    benchmark_start();
+    for (uint32_t i = 0; i < m_rounds; i++)
+    {
+        const bench_input_t * p_input = &m_inputs[i % NUM_OF_INPUTS];
+
+        eddystone_crypto_hmac_sha256(p_input->msg, sizeof(p_input->msg), p_input->scalar, X25519_KEY_SIZE, digest);
+        eddystone_crypto_hmac_sha256(digest, EDDYSTONE_CRYPTO_HMAC_SHA256_SIZE, info, sizeof(info),
+                                     out[i % NUM_OF_INPUTS]);
+    }
+    benchmark_end("IK derivation two HMACs", m_rounds);
+
+    for (uint32_t i = 0; i < NUM_OF_INPUTS; i++)
+    {
+        TEST_ASSERT(memcmp(reference[i], out[i], KEY_SIZE) == 0, "IK derivations disagree");
+    }
+    printf("%-40s agree\n", "IK derivation HKDF and two HMACs");
+}
+
+static void x25519_benchmark(void)
+{
+    static uint8_t       reference[NUM_OF_INPUTS][X25519_KEY_SIZE];
+    static uint8_t       out[NUM_OF_INPUTS][X25519_KEY_SIZE];
+    uint32_t             rounds = (m_rounds > X25519_ROUNDS_DIVIDER) ? m_rounds / X25519_ROUNDS_DIVIDER : 1;
+    eddystone_ecdh_job_t job;
+
+    //The first rounds compute the public keys, the rounds after the shared secrets with the next input's key
+    benchmark_start();
+    for (uint32_t i = 0; i < rounds; i++)
+    {
+        const uint8_t * p_point = (i < NUM_OF_INPUTS) ? NULL : reference[(i + 1) % NUM_OF_INPUTS];
+
+        eddystone_ecdh_job_start(&job, m_inputs[i % NUM_OF_INPUTS].scalar, p_point);
+        UNUSED_VARIABLE(eddystone_ecdh_job_run(&job, EDDYSTONE_ECDH_NUM_OF_STEPS));
+        eddystone_ecdh_job_result_get(&job, reference[i % NUM_OF_INPUTS]);
+        eddystone_ecdh_job_clear(&job);
+    }
+    benchmark_end("X25519 sliced", rounds);
+
+    benchmark_start();
+    for (uint32_t i = 0; i < rounds; i++)
+    {
+        if (i < NUM_OF_INPUTS)
+        {
+            cf_curve25519_mul_base(out[i % NUM_OF_INPUTS], m_inputs[i % NUM_OF_INPUTS].scalar);
+        }
+        else
+        {
+            cf_curve25519_mul(out[i % NUM_OF_INPUTS], m_inputs[i % NUM_OF_INPUTS].scalar, out[(i + 1) % NUM_OF_INPUTS]);
+        }
+    }
+    benchmark_end("X25519 cifra", rounds);
+
+    outputs_check("X25519 sliced and cifra", reference, out, X25519_KEY_SIZE * ((rounds < NUM_OF_INPUTS) ? rounds : NUM_OF_INPUTS));
+}
+
+int main(int argc, char * argv[])
+{
+    static uint8_t hmac_a[NUM_OF_INPUTS][USHAMaxHashSize];
+    static uint8_t hmac_b[NUM_OF_INPUTS][USHAMaxHashSize];
+    uint32_t       seed = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 1;
+    uint8_t *      p_bytes = (uint8_t *)m_inputs;
+
+    m_rounds = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 10000;
+    TEST_ASSERT(m_rounds >= NUM_OF_INPUTS, "at least %d rounds, one per input", NUM_OF_INPUTS);
+
+    srand(seed);
+    for (uint32_t i = 0; i < sizeof(m_inputs); i++)
+    {
+        p_bytes[i] = (uint8_t)rand();
+    }
+    mp_evp_ctx = EVP_CIPHER_CTX_new();
+    TEST_ASSERT(mp_evp_ctx != NULL, "no OpenSSL cipher context");
+
+    printf("Host time per operation over %u rounds, %d different inputs\n", m_rounds, NUM_OF_INPUTS);
+
+    aes_benchmark();
+    etlm_benchmark();
+
+    hmac_benchmark("HMAC-SHA256 RFC6234", eddystone_crypto_rfc6234_hmac_sha256, hmac_a);
+    hmac_benchmark("HMAC-SHA256 cifra", eddystone_crypto_cifra_hmac_sha256, hmac_b);
+    for (uint32_t i = 0; i < NUM_OF_INPUTS; i++)
+    {
+        TEST_ASSERT(memcmp(hmac_a[i], hmac_b[i], EDDYSTONE_CRYPTO_HMAC_SHA256_SIZE) == 0, "HMAC-SHA256 backends disagree");
+    }
+    printf("%-40s agree\n", "HMAC-SHA256 RFC6234 and cifra");
+
+    ik_benchmark();
+    x25519_benchmark();
+
+    EVP_CIPHER_CTX_free(mp_evp_ctx);
+    printf("PASS\n");
+    return 0;
+}
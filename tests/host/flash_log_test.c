@@ -0,0 +1,530 @@
+/**@brief Host test of the configuration record log, see eddystone_flash.c
+ * @details Replays random slot config updates against flash simulated in host memory and checks every block against
+ *          a model of what flash should hold. Power is cut at random, in the middle of stores and erases, after which
+ *          the log is scanned again as on a reset: a write that was cut short reads back as either the old or the new
+ *          config, never anything else, and completed writes are never lost. The erase counts the log keeps in its
+ *          page headers are checked against the erases the simulated flash has done.
+ *          A third of the updates are transactions of several slots, which must read back all old or all new. A
+ *          transaction whose commit marker is cut short must never count, not even once a later one commits.
+ *          The flash bytes stored per byte of config and the records stored per erase are measured on the way.
+ *
+ *          Usage: flash_log_test [number of updates] [seed]
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "eddystone_flash.h"
+#include "pstorage.h"
+#include "app_scheduler.h"
+
+#define NUM_OF_PAGES            APP_FLASH_LOG_NUM_OF_PAGES
+#define NUM_OF_SLOTS            APP_MAX_ADV_SLOTS
+#define TEST_SCHED_QUEUE_SIZE   64
+#define CUT_ONE_IN              3000        /**< updates a power cut is injected into, on average */
+#define RESTART_ONE_IN          50000       /**< updates a clean reset follows, on average */
+#define CLEAR_ONE_IN            20          /**< updates that clear the slot instead of writing it, on average */
+#define TRANSACTION_ONE_IN      3           /**< updates that are transactions, on average */
+#define MAX_BYTES_PER_BYTE      2.0         /**< flash bytes stored per config byte updated the log has to stay below */
+
+//Mirror log_record_t in eddystone_flash.c, to find the commit markers among the stores
+#define LOG_RECORD_SIZE                 40
+#define LOG_RECORD_BLOCK_INDEX_OFFSET   36
+#define LOG_BLOCK_COMMIT                (APP_MAX_ADV_SLOTS + 4)
+
+#define TEST_ASSERT(COND, ...)                                                                    \
+    do                                                                                            \
+    {                                                                                             \
+        if (!(COND))                                                                              \
+        {                                                                                         \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                           \
+            printf(__VA_ARGS__);                                                                  \
+            printf("\n");                                                                         \
+            exit(1);                                                                              \
+        }                                                                                         \
+    } while (0)
+
+typedef enum
+{
+    NVM_OP_NONE,
+    NVM_OP_STORE,
+    NVM_OP_ERASE
+} nvm_op_type_t;
+
+/**@brief The flash operation pstorage has in progress, the log runs one at a time*/
+typedef struct
+{
+    nvm_op_type_t   type;
+    uint8_t *       p_dest;
+    uint8_t const * p_src;
+    uint16_t        size;
+} nvm_op_t;
+
+static uint8_t *                    m_nvm;                                  /**< the pages of the log, erased flash is 0xFF */
+static uint32_t                     m_nvm_erases[NUM_OF_PAGES];             /**< erases each page went through */
+static uint32_t                     m_nvm_torn_erases;                      /**< erases the power was cut in */
+static uint32_t                     m_nvm_stores;
+static uint64_t                     m_nvm_bytes_stored;
+static bool                         m_is_marker_cut;                        /**< the power is cut in the next commit marker store */
+static nvm_op_t                     m_nvm_op;
+static int32_t                      m_cut_countdown = -1;                   /**< operations to complete before the power is cut, -1 for none */
+static pstorage_ntf_cb_t            m_pstorage_cb;
+
+static app_sched_event_handler_t    m_sched_queue[TEST_SCHED_QUEUE_SIZE];
+static uint8_t                      m_sched_queue_length;
+
+static uint8_t                      m_model[NUM_OF_SLOTS][FLASH_BLOCK_SIZE]; /**< config flash holds for each slot, 0xFF if cleared */
+static uint64_t                     m_config_bytes;                         /**< config bytes updated, what the log stores is measured against */
+static uint32_t                     m_num_of_transactions;
+static uint32_t                     m_num_of_cuts;
+static uint32_t                     m_num_of_restarts;
+
+/**@brief pstorage, on top of the simulated flash*/
+uint32_t pstorage_init(void)
+{
+    return NRF_SUCCESS;
+}
+
+uint32_t pstorage_register(pstorage_module_param_t * p_module_param, pstorage_handle_t * p_block_id)
+{
+    TEST_ASSERT(p_module_param->block_size == PSTORAGE_FLASH_PAGE_SIZE, "the log registers whole pages");
+    TEST_ASSERT(p_module_param->block_count == NUM_OF_PAGES, "the log registers %d pages", NUM_OF_PAGES);
+
+    m_pstorage_cb         = p_module_param->cb;
+    p_block_id->module_id = 0;
+    p_block_id->block_id  = (pstorage_block_t)(uintptr_t)m_nvm;
+    return NRF_SUCCESS;
+}
+
+uint32_t pstorage_block_identifier_get(pstorage_handle_t * p_base_id, pstorage_size_t block_num, pstorage_handle_t * p_block_id)
+{
+    p_block_id->module_id = p_base_id->module_id;
+    p_block_id->block_id  = p_base_id->block_id + block_num * PSTORAGE_FLASH_PAGE_SIZE;
+    return NRF_SUCCESS;
+}
+
+uint32_t pstorage_store(pstorage_handle_t * p_dest, uint8_t * p_src, pstorage_size_t size, pstorage_size_t offset)
+{
+    TEST_ASSERT(m_nvm_op.type == NVM_OP_NONE, "a store while another operation is in progress");
+    TEST_ASSERT(size % 4 == 0 && offset % 4 == 0 && (uintptr_t)p_src % 4 == 0, "a store that is not word aligned");
+    TEST_ASSERT(offset + size <= PSTORAGE_FLASH_PAGE_SIZE, "a store past the end of a page");
+
+    m_nvm_op.type   = NVM_OP_STORE;
+    m_nvm_op.p_dest = (uint8_t *)(uintptr_t)(p_dest->block_id + offset);
+    m_nvm_op.p_src  = p_src;
+    m_nvm_op.size   = size;
+    return NRF_SUCCESS;
+}
+
+uint32_t pstorage_clear(pstorage_handle_t * p_base_id, pstorage_size_t size)
+{
+    TEST_ASSERT(m_nvm_op.type == NVM_OP_NONE, "an erase while another operation is in progress");
+    TEST_ASSERT(size == PSTORAGE_FLASH_PAGE_SIZE, "the log erases whole pages");
+
+    m_nvm_op.type   = NVM_OP_ERASE;
+    m_nvm_op.p_dest = (uint8_t *)(uintptr_t)p_base_id->block_id;
+    m_nvm_op.size   = size;
+    return NRF_SUCCESS;
+}
+
+uint32_t app_sched_event_put(void * p_event_data, uint16_t event_size, app_sched_event_handler_t handler)
+{
+    //The flash module queues events without data
+    TEST_ASSERT(event_size == 0, "a scheduler event with data");
+    TEST_ASSERT(m_sched_queue_length < TEST_SCHED_QUEUE_SIZE, "the scheduler queue is full");
+
+    m_sched_queue[m_sched_queue_length++] = handler;
+    return NRF_SUCCESS;
+}
+
+/**@brief Whether the flash operation in progress is the store of a commit marker*/
+static bool nvm_op_is_marker(void)
+{
+    return m_nvm_op.type == NVM_OP_STORE
+        && m_nvm_op.size == LOG_RECORD_SIZE
+        && m_nvm_op.p_src[LOG_RECORD_BLOCK_INDEX_OFFSET] == LOG_BLOCK_COMMIT;
+}
+
+/**@brief Runs the next scheduler event, or else completes the flash operation in progress
+ * @retval false if the power was cut, the operation is left part done
+ */
+static bool nvm_step(void)
+{
+    if (m_sched_queue_length > 0)
+    {
+        app_sched_event_handler_t handler = m_sched_queue[0];
+
+        m_sched_queue_length--;
+        memmove(&m_sched_queue[0], &m_sched_queue[1], m_sched_queue_length * sizeof(handler));
+        handler(NULL, 0);
+        return true;
+    }
+
+    if (m_cut_countdown == 0 || (m_is_marker_cut && nvm_op_is_marker()))
+    {
+        //A store is cut after some of its words, an erase after some of its bytes
+        m_is_marker_cut = false;
+        if (m_nvm_op.type == NVM_OP_STORE)
+        {
+            uint16_t size = (rand() % (m_nvm_op.size / 4)) * 4;
+
+            for (uint16_t i = 0; i < size; i++)
+            {
+                m_nvm_op.p_dest[i] &= m_nvm_op.p_src[i];
+            }
+        }
+        else
+        {
+            //Wears the page as much as an erase that completes
+            memset(m_nvm_op.p_dest, 0xFF, rand() % m_nvm_op.size);
+            m_nvm_erases[(m_nvm_op.p_dest - m_nvm) / PSTORAGE_FLASH_PAGE_SIZE]++;
+            m_nvm_torn_erases++;
+        }
+        m_nvm_op.type = NVM_OP_NONE;
+        return false;
+    }
+    if (m_cut_countdown > 0)
+    {
+        m_cut_countdown--;
+    }
+
+    if (m_nvm_op.type == NVM_OP_STORE)
+    {
+        //Flash bits only go from 1 to 0, the log never stores over what it has stored
+        for (uint16_t i = 0; i < m_nvm_op.size; i++)
+        {
+            TEST_ASSERT(m_nvm_op.p_dest[i] == 0xFF, "a store to flash that is not erased, offset 0x%x",
+                        (unsigned)(m_nvm_op.p_dest - m_nvm) + i);
+            m_nvm_op.p_dest[i] = m_nvm_op.p_src[i];
+        }
+        m_nvm_stores++;
+        m_nvm_bytes_stored += m_nvm_op.size;
+    }
+    else
+    {
+        memset(m_nvm_op.p_dest, 0xFF, m_nvm_op.size);
+        m_nvm_erases[(m_nvm_op.p_dest - m_nvm) / PSTORAGE_FLASH_PAGE_SIZE]++;
+    }
+
+    m_nvm_op.type = NVM_OP_NONE;
+    m_pstorage_cb(NULL, 0, NRF_SUCCESS, NULL, 0);
+    return true;
+}
+
+/**@brief Runs until the flash module is idle
+ * @retval false if the power was cut
+ */
+static bool nvm_run(void)
+{
+    while (m_sched_queue_length > 0 || m_nvm_op.type != NVM_OP_NONE)
+    {
+        if (!nvm_step())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**@brief Resets the device, the log is scanned from flash again*/
+static void power_cycle(void)
+{
+    m_cut_countdown      = -1;
+    m_is_marker_cut      = false;
+    m_sched_queue_length = 0;
+    m_nvm_op.type        = NVM_OP_NONE;
+
+    TEST_ASSERT(eddystone_flash_init() == NRF_SUCCESS, "init");
+    TEST_ASSERT(nvm_run(), "the erases after init");
+}
+
+static void read_done(ret_code_t result, void * p_context)
+{
+    TEST_ASSERT(result == NRF_SUCCESS, "read result 0x%x", (unsigned)result);
+    *(bool *)p_context = true;
+}
+
+/**@brief Reads the config of a slot through the request queue*/
+static void slot_read(uint8_t slot_no, uint8_t * p_config)
+{
+    bool is_done = false;
+
+    TEST_ASSERT(eddystone_flash_access_slot_configs(slot_no,
+                                                    (eddystone_flash_slot_config_t *)p_config,
+                                                    EDDYSTONE_FLASH_ACCESS_READ,
+                                                    read_done,
+                                                    &is_done) == NRF_SUCCESS, "read of slot %d", slot_no);
+    TEST_ASSERT(nvm_run() && is_done, "read of slot %d not done", slot_no);
+}
+
+/**@brief Checks that every slot reads back what the model holds*/
+static void slots_check(void)
+{
+    for (uint8_t slot_no = 0; slot_no < NUM_OF_SLOTS; slot_no++)
+    {
+        uint8_t config[FLASH_BLOCK_SIZE];
+
+        slot_read(slot_no, config);
+        TEST_ASSERT(memcmp(config, m_model[slot_no], FLASH_BLOCK_SIZE) == 0, "slot %d reads back wrong", slot_no);
+    }
+}
+
+/**@brief Checks the erase counts of the log against the erases flash has done
+ * @details A reset between an erase and the page header after it loses the count of that page, which then takes
+ *          the count of the page before it in the ring, off by one at most. An erase cut short is either not counted
+ *          or done again, and a count taken from the page before is off by as much, so the count may be off by one
+ *          more for each erase the power was cut in.
+ */
+static void erase_counts_check(void)
+{
+    eddystone_flash_log_report_t report;
+
+    eddystone_flash_log_report_get(&report);
+    for (uint8_t page = 0; page < NUM_OF_PAGES; page++)
+    {
+        int64_t diff      = (int64_t)report.erase_counts[page] - m_nvm_erases[page];
+        int64_t tolerance = 1 + m_nvm_torn_erases;
+
+        TEST_ASSERT(diff >= -tolerance && diff <= tolerance, "page %d erased %u times, the log counts %u",
+                    page, m_nvm_erases[page], report.erase_counts[page]);
+    }
+}
+
+/**@brief Fills in a random config for a slot, or an erased one for a clear*/
+static bool slot_config_generate(uint8_t * p_config)
+{
+    bool is_clear = (rand() % CLEAR_ONE_IN) == 0;
+
+    for (uint8_t i = 0; i < FLASH_BLOCK_SIZE; i++)
+    {
+        p_config[i] = is_clear ? 0xFF : rand();
+    }
+    m_config_bytes += FLASH_BLOCK_SIZE;
+
+    return is_clear;
+}
+
+/**@brief Queues the updates of some slots, as single requests or as one transaction*/
+static void slots_update_put(uint8_t const * p_slots,
+                             uint8_t num_of_slots,
+                             uint8_t configs[][FLASH_BLOCK_SIZE],
+                             bool const * p_is_clear,
+                             bool is_transaction)
+{
+    eddystone_flash_transaction_t transaction;
+
+    eddystone_flash_transaction_init(&transaction);
+    for (uint8_t i = 0; i < num_of_slots; i++)
+    {
+        eddystone_flash_slot_config_t * p_config = p_is_clear[i] ? NULL : (eddystone_flash_slot_config_t *)configs[i];
+        eddystone_flash_access_t        access   = p_is_clear[i] ? EDDYSTONE_FLASH_ACCESS_CLEAR : EDDYSTONE_FLASH_ACCESS_WRITE;
+        ret_code_t                      err_code;
+
+        if (is_transaction)
+        {
+            err_code = eddystone_flash_transaction_slot_config_add(&transaction, p_slots[i], p_config, access);
+        }
+        else
+        {
+            err_code = eddystone_flash_access_slot_configs(p_slots[i], p_config, access, NULL, NULL);
+        }
+        TEST_ASSERT(err_code == NRF_SUCCESS, "update of slot %d", p_slots[i]);
+    }
+
+    if (is_transaction)
+    {
+        TEST_ASSERT(eddystone_flash_transaction_commit(&transaction, NULL, NULL) == NRF_SUCCESS, "commit");
+        m_num_of_transactions++;
+    }
+}
+
+/**@brief Writes or clears one slot, or a transaction of several, with a power cut now and then*/
+static void slots_update(void)
+{
+    bool    is_transaction = (rand() % TRANSACTION_ONE_IN) == 0;
+    uint8_t slots[NUM_OF_SLOTS];
+    uint8_t configs[NUM_OF_SLOTS][FLASH_BLOCK_SIZE];
+    bool    is_clear[NUM_OF_SLOTS];
+    uint8_t num_of_slots   = 0;
+    uint8_t num_of_new     = 0;
+    uint8_t num_of_changes = 0;
+    bool    is_completed;
+
+    if (is_transaction)
+    {
+        for (uint8_t slot_no = 0; slot_no < NUM_OF_SLOTS; slot_no++)
+        {
+            if (rand() % 2)
+            {
+                slots[num_of_slots++] = slot_no;
+            }
+        }
+    }
+    if (num_of_slots == 0)
+    {
+        slots[num_of_slots++] = rand() % NUM_OF_SLOTS;
+    }
+    for (uint8_t i = 0; i < num_of_slots; i++)
+    {
+        is_clear[i] = slot_config_generate(configs[i]);
+    }
+
+    slots_update_put(slots, num_of_slots, configs, is_clear, is_transaction);
+
+    //The cut may hit a record, the commit marker, or a compaction copy or erase before them
+    if (rand() % CUT_ONE_IN == 0)
+    {
+        m_cut_countdown = rand() % (num_of_slots + 3);
+    }
+
+    is_completed = nvm_run();
+    if (!is_completed)
+    {
+        m_num_of_cuts++;
+        power_cycle();
+        erase_counts_check();
+    }
+
+    for (uint8_t i = 0; i < num_of_slots; i++)
+    {
+        uint8_t read_back[FLASH_BLOCK_SIZE];
+        bool    is_new;
+
+        slot_read(slots[i], read_back);
+        is_new = (memcmp(read_back, configs[i], FLASH_BLOCK_SIZE) == 0);
+
+        if (!is_new)
+        {
+            TEST_ASSERT(!is_completed, "slot %d lost a completed update", slots[i]);
+            TEST_ASSERT(memcmp(read_back, m_model[slots[i]], FLASH_BLOCK_SIZE) == 0,
+                        "slot %d reads back neither the old nor the new config after a power cut", slots[i]);
+        }
+
+        //Clearing a cleared slot reads back the same either way
+        if (memcmp(configs[i], m_model[slots[i]], FLASH_BLOCK_SIZE) != 0)
+        {
+            num_of_changes++;
+            num_of_new += is_new ? 1 : 0;
+        }
+    }
+
+    if (is_transaction)
+    {
+        TEST_ASSERT(num_of_new == 0 || num_of_new == num_of_changes,
+                    "a transaction cut short left %d of %d slots updated", num_of_new, num_of_changes);
+    }
+
+    //A single request at a time, so also outside of transactions each update either made it or did not
+    for (uint8_t i = 0; i < num_of_slots; i++)
+    {
+        uint8_t read_back[FLASH_BLOCK_SIZE];
+
+        slot_read(slots[i], read_back);
+        memcpy(m_model[slots[i]], read_back, FLASH_BLOCK_SIZE);
+    }
+
+    if (!is_completed)
+    {
+        slots_check();
+    }
+}
+
+/**@brief Cuts the power in the store of a commit marker
+ * @details The records of the transaction are all stored by then, but must not count. A later transaction that commits
+ *          must not make them count either, its marker only covers the records from its own first one on.
+ */
+static void torn_marker_test(void)
+{
+    uint8_t slots[2]        = {0, NUM_OF_SLOTS - 1};
+    uint8_t configs[2][FLASH_BLOCK_SIZE];
+    bool    is_clear[2]     = {false, false};
+    uint8_t later_slot[1]   = {NUM_OF_SLOTS / 2};
+    uint8_t later_config[1][FLASH_BLOCK_SIZE];
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        memset(configs[i], 0xA0 + i, FLASH_BLOCK_SIZE);
+    }
+    memset(later_config[0], 0xC0, FLASH_BLOCK_SIZE);
+
+    slots_update_put(slots, 2, configs, is_clear, true);
+    m_is_marker_cut = true;
+    TEST_ASSERT(!nvm_run(), "the commit marker was not stored");
+    m_num_of_cuts++;
+    power_cycle();
+    slots_check();
+
+    slots_update_put(later_slot, 1, later_config, is_clear, true);
+    TEST_ASSERT(nvm_run(), "later transaction");
+    memcpy(m_model[later_slot[0]], later_config[0], FLASH_BLOCK_SIZE);
+    slots_check();
+
+    power_cycle();
+    slots_check();
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t                     num_of_updates = (argc > 1) ? strtoul(argv[1], NULL, 0) : 1000000;
+    unsigned                     seed           = (argc > 2) ? strtoul(argv[2], NULL, 0) : 1;
+    eddystone_flash_log_report_t report;
+    uint32_t                     min_erases     = UINT32_MAX;
+    uint32_t                     max_erases     = 0;
+    double                       bytes_per_byte;
+
+    //pstorage block ids are 32 bits
+    m_nvm = mmap(NULL, NUM_OF_PAGES * PSTORAGE_FLASH_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    TEST_ASSERT(m_nvm != MAP_FAILED, "no memory below 4 GB for the simulated flash");
+    memset(m_nvm, 0xFF, NUM_OF_PAGES * PSTORAGE_FLASH_PAGE_SIZE);
+    memset(m_model, 0xFF, sizeof(m_model));
+    srand(seed);
+
+    power_cycle();
+    slots_check();
+    torn_marker_test();
+
+    for (uint32_t i = 0; i < num_of_updates; i++)
+    {
+        slots_update();
+
+        if (rand() % RESTART_ONE_IN == 0)
+        {
+            m_num_of_restarts++;
+            power_cycle();
+            slots_check();
+            erase_counts_check();
+        }
+    }
+
+    torn_marker_test();
+    power_cycle();
+    slots_check();
+    erase_counts_check();
+
+    //The head goes round the pages, so they wear evenly but for the erases the power was cut in, which are repeated
+    for (uint8_t page = 0; page < NUM_OF_PAGES; page++)
+    {
+        min_erases = (m_nvm_erases[page] < min_erases) ? m_nvm_erases[page] : min_erases;
+        max_erases = (m_nvm_erases[page] > max_erases) ? m_nvm_erases[page] : max_erases;
+    }
+    TEST_ASSERT(max_erases - min_erases <= 2 + m_nvm_torn_erases, "uneven wear, %u to %u erases",
+                min_erases, max_erases);
+
+    //Records and their commit markers, page headers and compaction copies against the configs updated
+    bytes_per_byte = (double)m_nvm_bytes_stored / m_config_bytes;
+    TEST_ASSERT(bytes_per_byte < MAX_BYTES_PER_BYTE, "%.2f flash bytes stored per config byte", bytes_per_byte);
+
+    eddystone_flash_log_report_get(&report);
+    printf("%d pages, %u updates (%u transactions), %u power cuts, %u resets: %u stores, %u to %u erases per page\n",
+           NUM_OF_PAGES, num_of_updates, m_num_of_transactions, m_num_of_cuts, m_num_of_restarts, m_nvm_stores,
+           min_erases, max_erases);
+    printf("%.2f flash bytes stored per config byte, %.1f stores per erase\n",
+           bytes_per_byte, (double)m_nvm_stores / (min_erases * NUM_OF_PAGES));
+    printf("PASS\n");
+
+    return 0;
+}
@@ -0,0 +1,283 @@
+/**@brief Host test of the HKDF-SHA256 module, see eddystone_hkdf.h
+ * @details Checks the extract and expand steps and the whole derivation against RFC 5869 A.1, A.2 and A.3, and an
+ *          EID registration with the RFC 7748 6.1 key pairs: the beacon's public key and the shared secret from the
+ *          sliced X25519, run a slice at a time as during a registration, then the Identity Key derived from them as
+ *          eddystone_security.c does. The Identity Key must also come out of the two HMACs it was derived with
+ *          before, with every HMAC backend. Last, random salts, keys, infos and lengths are cross-checked against
+ *          OpenSSL.
+ *
+ *          Usage: hkdf_test [number of random derivations] [seed]
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include "eddystone_hkdf.h"
+#include "eddystone_crypto.h"
+
+#define KEY_SIZE                EDDYSTONE_CRYPTO_X25519_KEY_SIZE
+#define IK_SIZE                 EDDYSTONE_CRYPTO_AES_KEY_SIZE
+#define RANDOM_INPUT_MAX        100     /**< longest random salt, key and info, longer than a SHA-256 block */
+#define RANDOM_OKM_MAX          300     /**< longest random output, ten blocks */
+
+#define TEST_ASSERT(COND, ...)                                                                    \
+    do                                                                                            \
+    {                                                                                             \
+        if (!(COND))                                                                              \
+        {                                                                                         \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                           \
+            printf(__VA_ARGS__);                                                                  \
+            printf("\n");                                                                         \
+            exit(1);                                                                              \
+        }                                                                                         \
+    } while (0)
+
+/**@brief RFC 5869 test case, the inputs are runs of bytes*/
+typedef struct
+{
+    const char *    p_name;
+    uint8_t         ikm_first;
+    uint8_t         ikm_length;
+    bool            is_ikm_run;         /**< IKM counts up from ikm_first, or repeats it */
+    uint8_t         salt_first;
+    uint8_t         salt_length;
+    uint8_t         info_first;
+    uint8_t         info_length;
+    uint8_t         prk[EDDYSTONE_HKDF_PRK_SIZE];
+    uint8_t         okm_length;
+    const uint8_t * p_okm;
+} hkdf_case_t;
+
+static const uint8_t m_okm_a1[42] =
+{
+    0x3c, 0xb2, 0x5f, 0x25, 0xfa, 0xac, 0xd5, 0x7a, 0x90, 0x43, 0x4f, 0x64, 0xd0, 0x36, 0x2f, 0x2a,
+    0x2d, 0x2d, 0x0a, 0x90, 0xcf, 0x1a, 0x5a, 0x4c, 0x5d, 0xb0, 0x2d, 0x56, 0xec, 0xc4, 0xc5, 0xbf,
+    0x34, 0x00, 0x72, 0x08, 0xd5, 0xb8, 0x87, 0x18, 0x58, 0x65
+};
+
+static const uint8_t m_okm_a2[82] =
+{
+    0xb1, 0x1e, 0x39, 0x8d, 0xc8, 0x03, 0x27, 0xa1, 0xc8, 0xe7, 0xf7, 0x8c, 0x59, 0x6a, 0x49, 0x34,
+    0x4f, 0x01, 0x2e, 0xda, 0x2d, 0x4e, 0xfa, 0xd8, 0xa0, 0x50, 0xcc, 0x4c, 0x19, 0xaf, 0xa9, 0x7c,
+    0x59, 0x04, 0x5a, 0x99, 0xca, 0xc7, 0x82, 0x72, 0x71, 0xcb, 0x41, 0xc6, 0x5e, 0x59, 0x0e, 0x09,
+    0xda, 0x32, 0x75, 0x60, 0x0c, 0x2f, 0x09, 0xb8, 0x36, 0x77, 0x93, 0xa9, 0xac, 0xa3, 0xdb, 0x71,
+    0xcc, 0x30, 0xc5, 0x81, 0x79, 0xec, 0x3e, 0x87, 0xc1, 0x4c, 0x01, 0xd5, 0xc1, 0xf3, 0x43, 0x4f,
+    0x1d, 0x87
+};
+
+static const uint8_t m_okm_a3[42] =
+{
+    0x8d, 0xa4, 0xe7, 0x75, 0xa5, 0x63, 0xc1, 0x8f, 0x71, 0x5f, 0x80, 0x2a, 0x06, 0x3c, 0x5a, 0x31,
+    0xb8, 0xa1, 0x1f, 0x5c, 0x5e, 0xe1, 0x87, 0x9e, 0xc3, 0x45, 0x4e, 0x5f, 0x3c, 0x73, 0x8d, 0x2d,
+    0x9d, 0x20, 0x13, 0x95, 0xfa, 0xa4, 0xb6, 0x1a, 0x96, 0xc8
+};
+
+//RFC 5869 appendix A.1 to A.3, A.3 has no salt and no info
+static const hkdf_case_t m_hkdf_cases[] =
+{
+    {"RFC 5869 A.1", 0x0b, 22, false, 0x00, 13, 0xf0, 10,
+     {0x07, 0x77, 0x09, 0x36, 0x2c, 0x2e, 0x32, 0xdf, 0x0d, 0xdc, 0x3f, 0x0d, 0xc4, 0x7b, 0xba, 0x63,
+      0x90, 0xb6, 0xc7, 0x3b, 0xb5, 0x0f, 0x9c, 0x31, 0x22, 0xec, 0x84, 0x4a, 0xd7, 0xc2, 0xb3, 0xe5},
+     sizeof(m_okm_a1), m_okm_a1},
+    {"RFC 5869 A.2", 0x00, 80, true, 0x60, 80, 0xb0, 80,
+     {0x06, 0xa6, 0xb8, 0x8c, 0x58, 0x53, 0x36, 0x1a, 0x06, 0x10, 0x4c, 0x9c, 0xeb, 0x35, 0xb4, 0x5c,
+      0xef, 0x76, 0x00, 0x14, 0x90, 0x46, 0x71, 0x01, 0x4a, 0x19, 0x3f, 0x40, 0xc1, 0x5f, 0xc2, 0x44},
+     sizeof(m_okm_a2), m_okm_a2},
+    {"RFC 5869 A.3", 0x0b, 22, false, 0x00, 0, 0x00, 0,
+     {0x19, 0xef, 0x24, 0xa3, 0x2c, 0x71, 0x7b, 0x16, 0x7f, 0x33, 0xa9, 0x1d, 0x6f, 0x64, 0x8b, 0xdf,
+      0x96, 0x59, 0x67, 0x76, 0xaf, 0xdb, 0x63, 0x77, 0xac, 0x43, 0x4c, 0x1c, 0x29, 0x3c, 0xcb, 0x04},
+     sizeof(m_okm_a3), m_okm_a3},
+};
+
+//EID registration with the RFC 7748 6.1 key pairs, Alice as the phone and Bob as the beacon
+static const uint8_t m_eid_phone_public[KEY_SIZE] =
+{
+    0x85, 0x20, 0xf0, 0x09, 0x89, 0x30, 0xa7, 0x54, 0x74, 0x8b, 0x7d, 0xdc, 0xb4, 0x3e, 0xf7, 0x5a,
+    0x0d, 0xbf, 0x3a, 0x0d, 0x26, 0x38, 0x1a, 0xf4, 0xeb, 0xa4, 0xa9, 0x8e, 0xaa, 0x9b, 0x4e, 0x6a
+};
+static const uint8_t m_eid_beacon_private[KEY_SIZE] =
+{
+    0x5d, 0xab, 0x08, 0x7e, 0x62, 0x4a, 0x8a, 0x4b, 0x79, 0xe1, 0x7f, 0x8b, 0x83, 0x80, 0x0e, 0xe6,
+    0x6f, 0x3b, 0xb1, 0x29, 0x26, 0x18, 0xb6, 0xfd, 0x1c, 0x2f, 0x8b, 0x27, 0xff, 0x88, 0xe0, 0xeb
+};
+static const uint8_t m_eid_beacon_public[KEY_SIZE] =
+{
+    0xde, 0x9e, 0xdb, 0x7d, 0x7b, 0x7d, 0xc1, 0xb4, 0xd3, 0x5b, 0x61, 0xc2, 0xec, 0xe4, 0x35, 0x37,
+    0x3f, 0x83, 0x43, 0xc8, 0x5b, 0x78, 0x67, 0x4d, 0xad, 0xfc, 0x7e, 0x14, 0x6f, 0x88, 0x2b, 0x4f
+};
+static const uint8_t m_eid_shared[KEY_SIZE] =
+{
+    0x4a, 0x5d, 0x9d, 0x5b, 0xa4, 0xce, 0x2d, 0xe1, 0x72, 0x8e, 0x3b, 0xf4, 0x80, 0x35, 0x0f, 0x25,
+    0xe0, 0x7e, 0x21, 0xc9, 0x47, 0xd1, 0x9e, 0x33, 0x76, 0xf0, 0x9b, 0x3c, 0x1e, 0x16, 0x17, 0x42
+};
+static const uint8_t m_eid_identity_key[IK_SIZE] =
+{
+    0x73, 0xe3, 0xda, 0x79, 0xc6, 0x95, 0xd1, 0x62, 0x9d, 0x9b, 0x62, 0xc2, 0xa8, 0x01, 0xa7, 0xff
+};
+
+static void run_fill(uint8_t * p_buf, uint8_t first, uint8_t length, bool is_run)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+        p_buf[i] = is_run ? (uint8_t)(first + i) : first;
+    }
+}
+
+static void rfc5869_check(const hkdf_case_t * p_case)
+{
+    uint8_t ikm[80];
+    uint8_t salt[80];
+    uint8_t info[80];
+    uint8_t prk[EDDYSTONE_HKDF_PRK_SIZE];
+    uint8_t okm[82];
+
+    run_fill(ikm, p_case->ikm_first, p_case->ikm_length, p_case->is_ikm_run);
+    run_fill(salt, p_case->salt_first, p_case->salt_length, true);
+    run_fill(info, p_case->info_first, p_case->info_length, true);
+
+    eddystone_hkdf_extract(salt, p_case->salt_length, ikm, p_case->ikm_length, prk);
+    TEST_ASSERT(memcmp(prk, p_case->prk, sizeof(prk)) == 0, "%s PRK", p_case->p_name);
+
+    memset(okm, 0, sizeof(okm));
+    eddystone_hkdf_expand(prk, info, p_case->info_length, okm, p_case->okm_length);
+    TEST_ASSERT(memcmp(okm, p_case->p_okm, p_case->okm_length) == 0, "%s OKM of the expand step", p_case->p_name);
+
+    memset(okm, 0, sizeof(okm));
+    eddystone_hkdf(salt, p_case->salt_length, ikm, p_case->ikm_length, info, p_case->info_length,
+                   okm, p_case->okm_length);
+    TEST_ASSERT(memcmp(okm, p_case->p_okm, p_case->okm_length) == 0, "%s OKM", p_case->p_name);
+
+    printf("%-28s PRK and %d byte OKM match\n", p_case->p_name, p_case->okm_length);
+}
+
+/**@brief Runs a sliced X25519 multiplication to the end, APP_ECDH_STEPS_PER_SLICE steps at a time*/
+static void x25519_sliced(const uint8_t * p_scalar, const uint8_t * p_point, uint8_t * p_result)
+{
+    eddystone_ecdh_job_t job;
+    uint16_t             num_of_slices = 1;
+
+    eddystone_ecdh_job_start(&job, p_scalar, p_point);
+    while (!eddystone_ecdh_job_run(&job, APP_ECDH_STEPS_PER_SLICE))
+    {
+        num_of_slices++;
+    }
+    TEST_ASSERT(num_of_slices == (EDDYSTONE_ECDH_NUM_OF_STEPS + APP_ECDH_STEPS_PER_SLICE - 1) / APP_ECDH_STEPS_PER_SLICE,
+                "X25519 took %d slices", num_of_slices);
+    eddystone_ecdh_job_result_get(&job, p_result);
+    eddystone_ecdh_job_clear(&job);
+}
+
+static void registration_check(void)
+{
+    uint8_t       beacon_public[KEY_SIZE];
+    uint8_t       shared[KEY_SIZE];
+    uint8_t       public_keys[2 * KEY_SIZE];
+    uint8_t       prk[EDDYSTONE_HKDF_PRK_SIZE];
+    uint8_t       ik[IK_SIZE];
+    uint8_t       digest[USHAMaxHashSize];              //as large as the RFC6234 hmac() declares its digest
+    const uint8_t info[1] = {0x01};
+
+    x25519_sliced(m_eid_beacon_private, NULL, beacon_public);
+    TEST_ASSERT(memcmp(beacon_public, m_eid_beacon_public, KEY_SIZE) == 0, "beacon public key");
+
+    x25519_sliced(m_eid_beacon_private, m_eid_phone_public, shared);
+    TEST_ASSERT(memcmp(shared, m_eid_shared, KEY_SIZE) == 0, "shared secret");
+
+    //As eddystone_security.c derives the Identity Key
+    memcpy(public_keys, m_eid_phone_public, KEY_SIZE);
+    memcpy(&public_keys[KEY_SIZE], beacon_public, KEY_SIZE);
+    eddystone_hkdf_extract(public_keys, sizeof(public_keys), shared, sizeof(shared), prk);
+    eddystone_hkdf_expand(prk, NULL, 0, ik, sizeof(ik));
+    TEST_ASSERT(memcmp(ik, m_eid_identity_key, IK_SIZE) == 0, "Identity Key");
+
+    //The two HMACs the Identity Key was derived with before, T(1) of an empty info
+    eddystone_crypto_rfc6234_hmac_sha256(public_keys, sizeof(public_keys), shared, sizeof(shared), digest);
+    eddystone_crypto_rfc6234_hmac_sha256(digest, EDDYSTONE_CRYPTO_HMAC_SHA256_SIZE, info, sizeof(info), digest);
+    TEST_ASSERT(memcmp(digest, m_eid_identity_key, IK_SIZE) == 0, "Identity Key from the RFC6234 HMACs");
+
+    eddystone_crypto_cifra_hmac_sha256(public_keys, sizeof(public_keys), shared, sizeof(shared), digest);
+    eddystone_crypto_cifra_hmac_sha256(digest, EDDYSTONE_CRYPTO_HMAC_SHA256_SIZE, info, sizeof(info), digest);
+    TEST_ASSERT(memcmp(digest, m_eid_identity_key, IK_SIZE) == 0, "Identity Key from the cifra HMACs");
+
+    printf("%-28s beacon key, shared secret and Identity Key match\n", "EID registration");
+}
+
+static void random_fill(uint8_t * p_buf, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        p_buf[i] = (uint8_t)rand();
+    }
+}
+
+static void openssl_hkdf(const uint8_t * p_salt, uint16_t salt_length, const uint8_t * p_ikm, uint16_t ikm_length,
+                         const uint8_t * p_info, uint16_t info_length, uint8_t * p_okm, uint16_t okm_length)
+{
+    EVP_PKEY_CTX * p_ctx  = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
+    size_t         length = okm_length;
+
+    TEST_ASSERT(p_ctx != NULL, "no OpenSSL HKDF context");
+    TEST_ASSERT(EVP_PKEY_derive_init(p_ctx) == 1
+             && EVP_PKEY_CTX_set_hkdf_md(p_ctx, EVP_sha256()) == 1
+             && EVP_PKEY_CTX_set1_hkdf_salt(p_ctx, p_salt, salt_length) == 1
+             && EVP_PKEY_CTX_set1_hkdf_key(p_ctx, p_ikm, ikm_length) == 1
+             && EVP_PKEY_CTX_add1_hkdf_info(p_ctx, p_info, info_length) == 1
+             && EVP_PKEY_derive(p_ctx, p_okm, &length) == 1
+             && length == okm_length,
+                "OpenSSL HKDF failed");
+    EVP_PKEY_CTX_free(p_ctx);
+}
+
+/**@brief Cross-checks random derivations against OpenSSL, the lengths cover the key hashing and partial blocks*/
+static void random_check(uint32_t num_of_derivations)
+{
+    uint8_t  salt[RANDOM_INPUT_MAX];
+    uint8_t  ikm[RANDOM_INPUT_MAX];
+    uint8_t  info[RANDOM_INPUT_MAX];
+    uint8_t  okm[RANDOM_OKM_MAX];
+    uint8_t  expected[RANDOM_OKM_MAX];
+    uint16_t salt_length;
+    uint16_t ikm_length;
+    uint16_t info_length;
+    uint16_t okm_length;
+
+    for (uint32_t n = 0; n < num_of_derivations; n++)
+    {
+        salt_length = rand() % (RANDOM_INPUT_MAX + 1);
+        ikm_length  = 1 + rand() % RANDOM_INPUT_MAX;
+        info_length = rand() % (RANDOM_INPUT_MAX + 1);
+        okm_length  = 1 + rand() % RANDOM_OKM_MAX;
+        random_fill(salt, salt_length);
+        random_fill(ikm, ikm_length);
+        random_fill(info, info_length);
+
+        openssl_hkdf(salt, salt_length, ikm, ikm_length, info, info_length, expected, okm_length);
+        eddystone_hkdf(salt, salt_length, ikm, ikm_length, info, info_length, okm, okm_length);
+        TEST_ASSERT(memcmp(okm, expected, okm_length) == 0,
+                    "derivation %u differs from OpenSSL: salt %d, IKM %d, info %d, OKM %d bytes",
+                    n, salt_length, ikm_length, info_length, okm_length);
+    }
+    printf("%-28s %u random derivations agree with OpenSSL\n", "HKDF-SHA256", num_of_derivations);
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t num_of_derivations = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 10000;
+    uint32_t seed               = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 1;
+
+    srand(seed);
+
+    for (uint8_t i = 0; i < sizeof(m_hkdf_cases) / sizeof(m_hkdf_cases[0]); i++)
+    {
+        rfc5869_check(&m_hkdf_cases[i]);
+    }
+    registration_check();
+    random_check(num_of_derivations);
+
+    printf("PASS\n");
+    return 0;
+}
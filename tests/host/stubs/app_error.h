@@ -0,0 +1,20 @@
+#ifndef APP_ERROR_H__
+#define APP_ERROR_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sdk_common.h"
+
+/* On the host an error is a failed test */
+#define APP_ERROR_CHECK(ERR_CODE)                                                                 \
+    do                                                                                            \
+    {                                                                                             \
+        const uint32_t LOCAL_ERR_CODE = (ERR_CODE);                                               \
+        if (LOCAL_ERR_CODE != NRF_SUCCESS)                                                        \
+        {                                                                                         \
+            printf("Error 0x%x at %s:%d\n", (unsigned)LOCAL_ERR_CODE, __FILE__, __LINE__);        \
+            abort();                                                                              \
+        }                                                                                         \
+    } while (0)
+
+#endif /*APP_ERROR_H__*/
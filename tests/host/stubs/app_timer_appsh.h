@@ -0,0 +1,6 @@
+#ifndef APP_TIMER_APPSH_H__
+#define APP_TIMER_APPSH_H__
+
+/* Not needed by the modules under test */
+
+#endif /*APP_TIMER_APPSH_H__*/
@@ -0,0 +1,14 @@
+#ifndef APP_UTIL_PLATFORM_H__
+#define APP_UTIL_PLATFORM_H__
+
+#include "sdk_common.h"
+
+/* The host test is single threaded, pstorage completions are delivered from the test loop */
+#define PACKED(TYPE)                TYPE __attribute__((packed))
+#define __INLINE                    inline
+#define UNUSED_VARIABLE(X)          ((void)(X))
+#define UNUSED_PARAMETER(X)         ((void)(X))
+#define CRITICAL_REGION_ENTER()     {
+#define CRITICAL_REGION_EXIT()      }
+
+#endif /*APP_UTIL_PLATFORM_H__*/
@@ -0,0 +1,12 @@
+#ifndef BLE_H__
+#define BLE_H__
+
+#include <stdint.h>
+
+/* Only the types ble_ecs.h declares its interface with */
+typedef struct
+{
+    uint16_t    evt_id;
+} ble_evt_t;
+
+#endif /*BLE_H__*/
@@ -0,0 +1,15 @@
+#ifndef BLE_SRV_COMMON_H__
+#define BLE_SRV_COMMON_H__
+
+#include <stdint.h>
+
+/* Only the types ble_ecs.h declares its interface with */
+typedef struct
+{
+    uint16_t    value_handle;
+    uint16_t    user_desc_handle;
+    uint16_t    cccd_handle;
+    uint16_t    sccd_handle;
+} ble_gatts_char_handles_t;
+
+#endif /*BLE_SRV_COMMON_H__*/
@@ -0,0 +1,6 @@
+#ifndef BOARDS_H__
+#define BOARDS_H__
+
+/* Not needed by the modules under test */
+
+#endif /*BOARDS_H__*/
@@ -0,0 +1,7 @@
+/* The application config, with the pages of the record log set by the build of the test */
+#include_next "eddystone_app_config.h"
+
+#ifdef TEST_FLASH_LOG_NUM_OF_PAGES
+    #undef  APP_FLASH_LOG_NUM_OF_PAGES
+    #define APP_FLASH_LOG_NUM_OF_PAGES  TEST_FLASH_LOG_NUM_OF_PAGES
+#endif
@@ -0,0 +1,6 @@
+#ifndef NRF_H__
+#define NRF_H__
+
+/* Not needed by the modules under test */
+
+#endif /*NRF_H__*/
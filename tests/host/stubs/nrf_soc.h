@@ -0,0 +1,25 @@
+#ifndef NRF_SOC_H__
+#define NRF_SOC_H__
+
+#include <stdint.h>
+#include "app_util_platform.h"
+
+/* The SoftDevice ECB encryption, implemented by the crypto tests */
+#define SOC_ECB_KEY_LENGTH          (16)
+#define SOC_ECB_CLEARTEXT_LENGTH    (16)
+#define SOC_ECB_CIPHERTEXT_LENGTH   (SOC_ECB_CLEARTEXT_LENGTH)
+
+typedef uint8_t soc_ecb_key_t[SOC_ECB_KEY_LENGTH];
+typedef uint8_t soc_ecb_cleartext_t[SOC_ECB_CLEARTEXT_LENGTH];
+typedef uint8_t soc_ecb_ciphertext_t[SOC_ECB_CIPHERTEXT_LENGTH];
+
+typedef struct
+{
+    soc_ecb_key_t        key;
+    soc_ecb_cleartext_t  cleartext;
+    soc_ecb_ciphertext_t ciphertext;
+} nrf_ecb_hal_data_t;
+
+uint32_t sd_ecb_block_encrypt(nrf_ecb_hal_data_t * p_ecb_data);
+
+#endif /*NRF_SOC_H__*/
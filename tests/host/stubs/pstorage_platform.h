@@ -0,0 +1,21 @@
+#ifndef PSTORAGE_PL_H__
+#define PSTORAGE_PL_H__
+
+#include <stdint.h>
+
+/* Flash is simulated in host memory by flash_log_test.c, mapped below 4 GB so that block ids stay 32 bits */
+#define PSTORAGE_FLASH_PAGE_SIZE    4096
+#ifndef PSTORAGE_NUM_OF_PAGES
+#define PSTORAGE_NUM_OF_PAGES       2
+#endif
+
+typedef uint32_t pstorage_block_t;
+typedef uint16_t pstorage_size_t;
+
+typedef struct
+{
+    uint32_t            module_id;
+    pstorage_block_t    block_id;
+} pstorage_handle_t;
+
+#endif /*PSTORAGE_PL_H__*/
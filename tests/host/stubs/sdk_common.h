@@ -0,0 +1,11 @@
+#ifndef SDK_COMMON_H__
+#define SDK_COMMON_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf_error.h"
+
+typedef uint32_t ret_code_t;
+
+#endif /*SDK_COMMON_H__*/